@@ -6,20 +6,25 @@
 #define RENDER_SPHEAR_H
 
 #include <cmath>
+#include <algorithm>
 #include <vector>
 #include <glad/glad.h>
 #include <glm/glm.hpp>
 
+#include "engine/mesh.h"
+
 class Sphere {
 public:
 
-    Sphere() {
-        sphere_gen(64, 32);
+    /* 球面的三角形在单位球的内部，分段越少越小；从外面看顶点顺序是顺时针 */
+    explicit Sphere(int x_slice = 64, int y_slice = 32) {
+        sphere_gen(x_slice, y_slice);
     }
 
-    void draw() const {
+    /* amount 大于 1 时实例化绘制；计入 Mesh 的绘制统计 */
+    void draw(GLsizei amount = 1) const {
         glBindVertexArray(VAO);
-        glDrawElements(GL_TRIANGLE_STRIP, index_cnt, GL_UNSIGNED_INT, nullptr);
+        Mesh::draw_elements(GL_TRIANGLE_STRIP, (GLsizei) index_cnt, GL_UNSIGNED_INT, std::max<GLsizei>(amount, 1));
     }
 
     /**
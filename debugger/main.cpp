@@ -195,8 +195,8 @@ private:
 };
 
 
-int main() {
-    Render::init();
+int main(int argc, char **argv) {
+    Render::init(RenderOptions::parse(argc, argv));
     DB::init_db(DB_PATH);
     Render::render<SceneD>();
     DB::close_db();
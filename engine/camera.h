@@ -31,6 +31,27 @@ public:
 
     [[nodiscard]] inline glm::mat4 projection_matrix() const { return this->_projection; }
 
+    /* 垂直方向的视角，角度制 */
+    [[nodiscard]] inline float fov() const { return this->_fov; }
+
+    /* 视锥体的长宽比，近平面和远平面的距离 */
+    [[nodiscard]] inline float aspect() const { return this->_aspect; }
+
+    [[nodiscard]] inline float z_near() const { return this->_z_near; }
+
+    [[nodiscard]] inline float z_far() const { return this->_z_far; }
+
+    /* 欧拉角，角度制 */
+    [[nodiscard]] inline float yaw() const { return this->_direction.yaw; }
+
+    [[nodiscard]] inline float pitch() const { return this->_direction.pitch; }
+
+    /* 修改长宽比（比如窗口大小改变之后），重新计算投影矩阵 */
+    void aspect_set(float aspect);
+
+    /* 直接设置摄像机的位置和朝向，比如回放摄像机的路径；俯仰角会被限制在 [-89, 89] */
+    void pose_set(const glm::vec3 &position, float yaw, float pitch);
+
     /* 摄像机移动 */
     void translate(TransDirection direction, float distance);
 
@@ -42,7 +63,7 @@ private:
     const float _fov = 45.0f;       // field of view 视角
     const float _z_near = 0.1f;     // 近平面
     const float _z_far = 100.f;     // 远平面
-    const float _aspect;            // 长宽比
+    float _aspect;                  // 长宽比
 
     glm::vec3 _position;            // 摄像机的位置
 
@@ -52,7 +73,7 @@ private:
         float pitch = 0.f;                                      // 欧拉角：俯仰
     } _direction;
 
-    const glm::mat4 _projection;                                 // 摄像机的投影矩阵
+    glm::mat4 _projection;                                       // 摄像机的投影矩阵
 
     const glm::vec3 GLOBAL_Y{0.f, 1.f, 0.f};      // 摄像机的上方向
     const float CAMERA_MOVE_SPEED = 0.05f;                  // 摄像机移动速度
@@ -0,0 +1,66 @@
+/**
+ * 摄像机的路径：一系列按时间排序的关键帧（位置，偏航，俯仰），关键帧之间线性插值
+ * 文本格式，每行一个关键帧，# 开头的行是注释：
+ *  # time x y z yaw pitch
+ *  0.0   0 0 3   0 0
+ *  2.5   1 0 3  30 -10
+ * 交互运行时可以记录（record），之后在 benchmark 中回放
+ */
+#ifndef RENDER_ENGINE_CAMERA_PATH_H
+#define RENDER_ENGINE_CAMERA_PATH_H
+
+#include <string>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "camera.h"
+
+
+struct CameraKey {
+    double time{0.0};                   // 秒，从路径开始计算
+    glm::vec3 position{0.f};
+    float yaw{0.f};                     // 角度制，和 Camera 一致
+    float pitch{0.f};
+};
+
+
+class CameraPath {
+public:
+    /* 记录时相邻关键帧的最小间隔（秒） */
+    static constexpr double RECORD_INTERVAL = 0.1;
+
+    CameraPath() = default;
+
+    /* 从文件中读取，文件不存在或者格式有误时抛出异常 */
+    static CameraPath load(const std::string &path);
+
+    /* 内置的路径：停在摄像机当前的位置，原地转一圈 */
+    static CameraPath spin(const Camera &camera, double seconds);
+
+    void save(const std::string &path) const;
+
+    /* 在路径末尾记录摄像机当前的姿态，和上一个关键帧的间隔小于 RECORD_INTERVAL 时忽略 */
+    void record(double time, const Camera &camera);
+
+    /* 某一时刻的姿态，超出范围时取两端的关键帧 */
+    [[nodiscard]] CameraKey sample(double time) const;
+
+    /* 将某一时刻的姿态设置到摄像机 */
+    inline void apply(double time, Camera &camera) const {
+        CameraKey key = sample(time);
+        camera.pose_set(key.position, key.yaw, key.pitch);
+    }
+
+    [[nodiscard]] inline double duration() const { return _keys.empty() ? 0.0 : _keys.back().time; }
+
+    [[nodiscard]] inline bool empty() const { return _keys.empty(); }
+
+    [[nodiscard]] inline const std::vector<CameraKey> &keys() const { return _keys; }
+
+private:
+    std::vector<CameraKey> _keys;
+};
+
+
+#endif //RENDER_ENGINE_CAMERA_PATH_H
@@ -0,0 +1,139 @@
+/**
+ * 多线程录制绘制命令，在 OpenGL 的线程中统一提交：
+ *  - 剔除，排序键，uniform 的打包等 CPU 工作通过 CommandQueue::record() 分给多个线程，
+ *    每个线程只向自己的 CommandList 追加紧凑的 DrawPacket，不调用 OpenGL
+ *  - 每个 CommandList 在录制它的线程中按照排序键排好序；CommandQueue::submit() 在 OpenGL 的线程中多路归并，
+ *    依次执行，program 和材质发生变化时才重新绑定
+ *  - 工作线程来自 WorkerPool（见 utils/parallel.h），和 parallel_for() 共用，每一帧复用
+ * DrawPacket 只保存指针，Mesh 和 Material 需要存活到 submit() 结束
+ * @example
+ *  CommandQueue::record(rocks.size(), [&](CommandList &list, size_t begin, size_t end) {
+ *      for (size_t i = begin; i < end; ++i)
+ *          if (visible(rocks[i]))
+ *              list.draw(CommandList::key(program, material->id(), depth), mesh, program, material, loc, model);
+ *  });
+ *  CommandQueue::submit();
+ */
+#ifndef RENDER_ENGINE_COMMAND_LIST_H
+#define RENDER_ENGINE_COMMAND_LIST_H
+
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#include <algorithm>
+#include <functional>
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include "mesh.h"
+#include "material.h"
+
+
+/* 一次绘制，执行时需要的所有数据 */
+struct DrawPacket {
+    uint64_t key;                       // 排序键，见 CommandList::key()
+    const Mesh *mesh;
+    const Material *material;           // 可以为空，此时不绑定材质
+    GLuint program;
+    GLint model_location;               // model 矩阵的 uniform，-1 表示没有
+    uint32_t model_index;               // model 矩阵在 CommandList::models() 中的下标
+    GLsizei amount;                     // 实例的数量
+};
+
+
+/* 一个线程录制的绘制命令 */
+class CommandList {
+public:
+    /**
+     * 排序键：program（高 12 位），材质（20 位），深度（低 32 位，由近到远）
+     * 相同 program 和材质的绘制排在一起，减少状态切换；同一个材质内由近到远，减少 overdraw
+     * @param depth 到摄像机的距离，非负
+     */
+    static inline uint64_t key(GLuint program, uint64_t material_id, float depth) {
+        uint32_t depth_bits;
+        depth = std::max(depth, 0.f);
+        std::memcpy(&depth_bits, &depth, sizeof(depth_bits));      // 非负浮点数的位模式和大小的顺序一致
+        return ((uint64_t) (program & 0xfffu) << 52) | ((material_id & 0xfffffu) << 32) | depth_bits;
+    }
+
+    inline void draw(uint64_t key, const Mesh &mesh, GLuint program, const Material *material,
+                     GLint model_location, const glm::mat4 &model, GLsizei amount = 1) {
+        _packets.push_back({key, &mesh, material, program, model_location, (uint32_t) _models.size(), amount});
+        _models.push_back(model);
+    }
+
+    [[nodiscard]] inline const std::vector<DrawPacket> &packets() const { return _packets; }
+
+    [[nodiscard]] inline const std::vector<glm::mat4> &models() const { return _models; }
+
+    [[nodiscard]] inline size_t size() const { return _packets.size(); }
+
+    /* [0, sorted) 已经有序，将之后新录制的部分排序并合并进来 */
+    void sort(size_t sorted);
+
+    /* 清空命令，保留内存 */
+    inline void clear() {
+        _packets.clear();
+        _models.clear();
+    }
+
+private:
+    std::vector<DrawPacket> _packets;
+    std::vector<glm::mat4> _models;
+};
+
+
+class CommandQueue {
+public:
+    /* 每次领取的下标数量 */
+    static const size_t CHUNK = 256;
+
+    /* 上一次 submit() 的统计 */
+    struct Stats {
+        size_t packets;
+        size_t program_changes;
+        size_t material_changes;
+        double record_ms;               // 这一帧所有 record() 的耗时（调用线程等待的时间）
+        double submit_ms;               // 归并和执行的耗时
+        unsigned threads;               // 录制使用的线程数
+    };
+
+    /**
+     * 创建 WorkerPool 的工作线程，每个线程准备一个 CommandList
+     * @param threads 录制的线程数（包括调用 record() 的线程），0 表示硬件线程数；WorkerPool 已经创建时使用它的线程数
+     */
+    static void init(unsigned threads = 0);
+
+    /* 停止 WorkerPool 的工作线程 */
+    static void terminate();
+
+    /* 录制可以使用的线程数，没有 init() 时是 1 */
+    [[nodiscard]] static inline unsigned threads() { return (unsigned) _lists.size(); }
+
+    /**
+     * 将 [0, count) 按 CHUNK 分块，由 WorkerPool 的多个线程并行录制，调用线程也会参与；所有的线程结束后返回
+     * 任意一块抛出异常后，其余的块不再执行，返回前重新抛出第一个异常
+     * @param func void(CommandList &list, size_t begin, size_t end)，需要是线程安全的，不能调用 OpenGL
+     * @param threads 最多使用多少个线程，0 表示全部
+     */
+    static void record(size_t count, const std::function<void(CommandList &, size_t, size_t)> &func,
+                       unsigned threads = 0);
+
+    /* 在 OpenGL 的线程中归并并执行所有录制的命令，然后清空 */
+    static void submit();
+
+    [[nodiscard]] static inline const Stats &stats() { return _stats; }
+
+private:
+    /* 每个线程一个 CommandList，下标是 WorkerPool::run() 的 slot，第 0 个属于调用 record() 的线程 */
+    inline static std::vector<CommandList> _lists{std::vector<CommandList>(1)};
+
+    inline static Stats _stats{0, 0, 0, 0.0, 0.0, 1};
+    inline static double _record_ms{0.0};
+    inline static unsigned _record_threads{1};
+};
+
+
+#endif //RENDER_ENGINE_COMMAND_LIST_H
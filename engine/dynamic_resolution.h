@@ -0,0 +1,115 @@
+/**
+ * 动态分辨率：根据场景在 GPU 上的耗时调整渲染的分辨率
+ *  - 场景绘制到一个和窗口一样大的离屏渲染目标，但是只使用左下角 scale 倍大小的区域（glViewport），
+ *    分辨率变化时不需要重新分配；绘制期间 FrameBuffer::screen() 指向它，场景离开自己的帧缓冲时回到这里
+ *  - 场景绘制结束后，用全屏的三角形将这个区域放大到屏幕：双线性，或者对比度自适应的锐化；之后 ImGui 按照屏幕的分辨率绘制
+ *  - 场景的 GPU 耗时通过 GL_TIMESTAMP 查询测量，几帧之后结果可用时才读取，不等待 GPU；
+ *    耗时大约和像素数（scale²）成正比，由此估计满足预算的 scale，下降得快，上升得慢，变化很小时不调整
+ *  - 离屏渲染目标从 RenderTargetPool 借出，尺寸跟随窗口：窗口大小改变时由渲染目标池就地重新分配
+ */
+#ifndef RENDER_ENGINE_DYNAMIC_RESOLUTION_H
+#define RENDER_ENGINE_DYNAMIC_RESOLUTION_H
+
+#include <array>
+#include <memory>
+
+#include <glad/glad.h>
+
+#include "shader.h"
+#include "frame_buffer.h"
+#include "render_target.h"
+
+
+/* 动态分辨率的选项，见 RenderOptions */
+struct DynamicResolutionOptions {
+    bool enabled{false};
+    double target_ms{12.0};             // 场景在 GPU 上的预算
+    float min_scale{0.5f};              // 渲染分辨率和窗口分辨率之比的范围
+    float max_scale{1.f};
+    bool sharpen{true};                 // 放大时锐化，否则只是双线性插值
+};
+
+
+class DynamicResolution {
+public:
+    struct Stats {
+        bool enabled;
+        float scale;
+        int width, height;              // 渲染的分辨率
+        double gpu_ms;                  // 最近一次测量的场景耗时
+        double full_ms;                 // 估计的全分辨率下的耗时
+        double target_ms;
+    };
+
+    /* 记录选项，开启时才借出离屏渲染目标 */
+    static void init(const DynamicResolutionOptions &options);
+
+    /* 归还离屏渲染目标，释放查询，需要在上下文销毁之前调用 */
+    static void terminate();
+
+    [[nodiscard]] static inline bool enabled() { return _options.enabled; }
+
+    static void enabled_set(bool enabled);
+
+    /* 渲染的分辨率，关闭时是窗口的分辨率 */
+    [[nodiscard]] static int width();
+
+    [[nodiscard]] static int height();
+
+    /* 场景绘制之前调用：绑定并清空缩放的离屏缓冲，开始计时 */
+    static void begin();
+
+    /* 场景绘制之后，ImGui 之前调用：结束计时，放大到屏幕，根据之前的测量结果调整分辨率 */
+    static void resolve();
+
+    [[nodiscard]] static Stats stats();
+
+    /* 动态分辨率的 ImGui 窗口 */
+    static void gui();
+
+private:
+    /* 借出离屏渲染目标，创建着色器和查询 */
+    static void _create();
+
+    /* 读取已经可用的查询，调整 _scale */
+    static void _feedback();
+
+    /* 将缩放的区域放大到当前的帧缓冲 */
+    static void _upscale();
+
+private:
+    /* 查询轮流使用的帧数 */
+    static constexpr int QUERY_FRAMES = 4;
+
+    /* 渲染的尺寸对齐到 8 像素，避免分辨率每帧都有很小的变化 */
+    static constexpr int ALIGN = 8;
+
+    inline static DynamicResolutionOptions _options{};
+    inline static bool _created{false};
+    inline static bool _active{false};                  // 这一帧 begin() 之后，resolve() 之前
+
+    inline static RenderTarget *_target{nullptr};
+    inline static GLuint _screen{0};                    // begin() 之前的屏幕帧缓冲
+
+    inline static std::shared_ptr<Shader> _shader{nullptr};
+    inline static GLuint _vao{0};
+
+    inline static float _scale{1.f};
+    inline static int _width{0}, _height{0};            // 这一帧渲染的尺寸
+
+    /* 每一帧一对 GL_TIMESTAMP 查询，以及发起查询时的 scale */
+    struct Timing {
+        GLuint begin, end;
+        float scale;
+        bool pending;
+    };
+    inline static std::array<Timing, QUERY_FRAMES> _timings{};
+    inline static int _timing_index{0};
+    inline static bool _timing{false};                  // 这一帧是否发起了查询
+
+    inline static double _gpu_ms{0.0};
+    inline static double _full_ms{0.0};                 // 平滑之后的全分辨率耗时
+};
+
+
+#endif //RENDER_ENGINE_DYNAMIC_RESOLUTION_H
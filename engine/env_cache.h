@@ -0,0 +1,95 @@
+/**
+ * 环境贴图的磁盘缓存：HDR 转换得到的立方体贴图，卷积得到的辐照度图等，计算一次之后保存到磁盘，之后直接载入
+ *  - 文件格式是 .envmap：文件头 + 所有面所有级别的 RGB half float 数据，见 env_cache.cpp
+ *  - 除了立方体贴图，也可以缓存 2D 纹理（比如 BRDF 的查找表），也就是只有 1 个面
+ *  - 缓存的 key 是所有输入文件（源文件，生成时使用的 shader）的内容哈希，以及生成参数的哈希
+ *  - key 不匹配时（源文件或 shader 修改了，参数变了）重新生成并覆盖缓存文件
+ */
+#ifndef RENDER_ENGINE_ENV_CACHE_H
+#define RENDER_ENGINE_ENV_CACHE_H
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <algorithm>
+#include <optional>
+#include <functional>
+
+#include <glad/glad.h>
+
+
+/* 立方体贴图的数据：6 个面，每个面若干级 mip，元素是 RGB half float；只有 1 个面时是正方形的 2D 纹理 */
+struct EnvCubeData {
+    GLsizei size{0};                // 第 0 级的边长
+    GLsizei levels{1};
+    GLsizei faces{6};
+
+    /* 每个面每一级的数据，下标是 face * levels + level，顺序是 +x, -x, +y, -y, +z, -z */
+    std::vector<std::vector<uint16_t>> data;
+
+    [[nodiscard]] inline GLsizei level_size(GLsizei level) const { return std::max(1, size >> level); }
+
+    [[nodiscard]] inline const std::vector<uint16_t> &level(GLsizei face, GLsizei level) const {
+        return data[(size_t) face * levels + level];
+    }
+};
+
+
+class EnvCache {
+public:
+    /**
+     * 缓存的 key：所有输入文件内容的哈希（FNV-1a 64），再混合参数
+     * @param inputs 源文件，以及生成时使用的 shader 等，任何一个修改都会使缓存失效
+     * @param params 生成参数，比如尺寸，采样数
+     */
+    static uint64_t key(const std::vector<std::string> &inputs, const std::string &params);
+
+    /* 缓存文件的路径：和源文件在同一个目录，比如 a.hdr 的 irradiance-512 是 a.irradiance-512.envmap */
+    static std::string cache_path(const std::string &source, const std::string &tag);
+
+    /* 读取缓存文件：文件不存在，格式错误，或者 key 不匹配时返回空 */
+    static std::optional<EnvCubeData> load(const std::string &path, uint64_t key);
+
+    /* 保存缓存文件，先写入临时文件再重命名，不会留下不完整的文件 */
+    static void save(const std::string &path, uint64_t key, const EnvCubeData &data);
+
+    /* 从显存读回立方体贴图的所有级别 */
+    static EnvCubeData cube_map_read(GLuint cube_map, GLsizei size, GLsizei levels = 1);
+
+    /* 创建立方体贴图（GL_RGB16F）并上传所有级别 */
+    static GLuint cube_map_create(const EnvCubeData &data);
+
+    /* 从显存读回正方形 2D 纹理的第 0 级 */
+    static EnvCubeData texture_2d_read(GLuint texture, GLsizei size);
+
+    /* 创建 2D 纹理（GL_RGB16F，GL_CLAMP_TO_EDGE）并上传第 0 级 */
+    static GLuint texture_2d_create(const EnvCubeData &data);
+
+    /**
+     * 带缓存地生成立方体贴图：缓存有效时直接载入，否则创建空的立方体贴图，调用 generate 渲染，读回并保存
+     * @param source 源文件，缓存文件放在它旁边
+     * @param tag 缓存文件名中的标签，同一个源文件的不同结果需要使用不同的标签
+     * @param inputs 除了源文件之外，影响结果的文件（比如 shader）
+     * @param params 影响结果的参数
+     * @param generate void(GLuint cube_map)，渲染到 cube_map 的每个面，每一级
+     */
+    static GLuint cube_map_cached(const std::string &source, const std::string &tag,
+                                  const std::vector<std::string> &inputs, const std::string &params,
+                                  GLsizei size, GLsizei levels, const std::function<void(GLuint)> &generate);
+
+    /* 带缓存地生成正方形的 2D 纹理，参数同 cube_map_cached() */
+    static GLuint texture_2d_cached(const std::string &source, const std::string &tag,
+                                    const std::vector<std::string> &inputs, const std::string &params,
+                                    GLsizei size, const std::function<void(GLuint)> &generate);
+
+private:
+    /* 缓存的公共流程：create 创建纹理（data 为空时只分配存储），read 读回 */
+    static GLuint _cached(const std::string &source, const std::string &tag, const std::vector<std::string> &inputs,
+                          const std::string &params, const EnvCubeData &shape,
+                          const std::function<GLuint(const EnvCubeData &)> &create,
+                          const std::function<EnvCubeData(GLuint)> &read,
+                          const std::function<void(GLuint)> &generate);
+};
+
+
+#endif //RENDER_ENGINE_ENV_CACHE_H
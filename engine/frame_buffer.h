@@ -12,17 +12,47 @@
 class FrameBuffer : public With{
 public:
 
-    /* 创建帧缓冲对象及附件 */
-    FrameBuffer(unsigned int width, unsigned int height);
+    /**
+     * 创建帧缓冲对象及附件
+     * @param hdr 颜色缓冲使用 RGBA16F，否则是 RGB8
+     */
+    FrameBuffer(unsigned int width, unsigned int height, bool hdr = false);
+
+    FrameBuffer(const FrameBuffer &) = delete;
+
+    FrameBuffer &operator=(const FrameBuffer &) = delete;
+
+    /* 删除帧缓冲对象及附件，需要在上下文销毁之前析构 */
+    ~FrameBuffer() override;
+
+    /* 重新分配附件的存储，对象的 id 不变 */
+    void resize(unsigned int width, unsigned int height);
+
+    [[nodiscard]] inline unsigned int width_get() const { return width; }
+
+    [[nodiscard]] inline unsigned int height_get() const { return height; }
 
     /* 获取颜色缓冲的纹理 */
     [[nodiscard]] GLuint color_tex_get() const;
 
+    [[nodiscard]] inline GLuint id() const { return frame_buffer; }
+
     void in() override;
 
+    /* 回到屏幕的帧缓冲，见 screen() */
     void out() override;
 
+    /**
+     * 代表屏幕的帧缓冲：通常是 0（窗口的默认帧缓冲）
+     * 离屏模式下没有默认帧缓冲，Render 会设置为离屏的 FrameBuffer，离开其他帧缓冲时回到这里
+     */
+    inline static GLuint screen() { return _screen; }
+
+    inline static void screen_set(GLuint frame_buffer) { _screen = frame_buffer; }
+
 private:
+    inline static GLuint _screen{0};
+
     // 帧缓冲的 id
     GLuint frame_buffer{};
     // 颜色缓冲的 id，这里颜色缓冲用的是 texture2D
@@ -31,17 +61,46 @@ private:
     GLuint depth_stencil_buffer{};
 
     unsigned int width, height;
+    bool hdr;
 };
 
 
-/* 用于阴影绘制的深度缓冲 */
-class DepthBuffer {
+/**
+ * 用于阴影绘制的深度缓冲：深度纹理（GL_DEPTH_COMPONENT32F）是帧缓冲唯一的附件
+ *  - layers > 1 时是纹理数组，一次绘制其中的一层（layer_set()），比如级联阴影的每个级联
+ *  - 纹理开启了深度比较，在 shader 中用 sampler2DShadow / sampler2DArrayShadow 采样，线性过滤得到 2x2 的 PCF；
+ *    纹理范围之外的深度是 1，不在阴影中
+ */
+class DepthBuffer : public With {
 public:
-    DepthBuffer(GLuint width, GLuint height);
+    DepthBuffer(GLuint width, GLuint height, GLuint layers = 1);
+
+    DepthBuffer(const DepthBuffer &) = delete;
+
+    DepthBuffer &operator=(const DepthBuffer &) = delete;
+
+    ~DepthBuffer() override;
+
+    /* 将纹理数组的第 layer 层作为深度附件，需要先绑定帧缓冲（in()） */
+    void layer_set(GLuint layer);
+
+    [[nodiscard]] inline GLuint texture() const { return depth_buffer; }
+
+    [[nodiscard]] inline GLuint width_get() const { return width; }
+
+    [[nodiscard]] inline GLuint height_get() const { return height; }
+
+    [[nodiscard]] inline GLuint layers_get() const { return layers; }
+
+    void in() override;
+
+    void out() override;
 
 private:
     GLuint frame_buffer{};
     GLuint depth_buffer{};
+
+    GLuint width, height, layers;
 };
 
 
@@ -50,6 +109,12 @@ class DepthFrameBuffer : public With {
 public:
     DepthFrameBuffer(GLuint width, GLuint height);
 
+    DepthFrameBuffer(const DepthFrameBuffer &) = delete;
+
+    DepthFrameBuffer &operator=(const DepthFrameBuffer &) = delete;
+
+    ~DepthFrameBuffer() override;
+
     void in() override;
 
     void out() override;
@@ -0,0 +1,204 @@
+/**
+ * 模拟线程和渲染线程之间的帧流水线：
+ *  - 模拟线程：读取主线程采样的输入，移动摄像机，执行 Scene::_simulate()，再按照这一帧的摄像机剔除物体（cull()），
+ *    产生不可变的一帧（FrameSnapshot），不调用 OpenGL，也不调用 glfw 和 ImGui
+ *  - 渲染线程（主线程，OpenGL 上下文所在的线程）：轮询窗口的事件，取出最新的一帧绘制，交换缓冲
+ *  - 两个线程通过无锁的三缓冲交换帧：模拟线程总是写入自己的槽位，发布时和中间的槽位交换；渲染线程取走中间的槽位，
+ *    两边都不会等待对方读写完成
+ *  - 流水线深度 depth：模拟线程最多领先渲染线程 depth 帧；depth = 1 时模拟第 n + 1 帧和绘制第 n 帧同时进行，
+ *    每一帧都会被绘制；depth > 1 时模拟线程可以多领先几帧，用来吸收模拟耗时的波动，渲染线程只取最新的一帧，
+ *    落后的帧被丢弃；稳定状态下模拟比渲染快，多出的帧只会被丢弃，并不能降低输入的延迟；
+ *    depth = 0 时不创建模拟线程，在渲染线程中依次模拟和绘制
+ *  - 延迟：每一帧记录所用输入的采样时刻，交换缓冲之后计算输入到显示的时间
+ */
+#ifndef RENDER_ENGINE_FRAME_PIPELINE_H
+#define RENDER_ENGINE_FRAME_PIPELINE_H
+
+#include <array>
+#include <mutex>
+#include <atomic>
+#include <thread>
+#include <vector>
+#include <cstdint>
+#include <functional>
+#include <condition_variable>
+
+#include <glm/glm.hpp>
+
+#include "window.h"
+
+
+/* 主线程采样的输入，模拟线程取走时鼠标的移动清零 */
+struct FrameInput {
+    std::vector<KeyboardEvent> keys;            // 按住的键
+    bool rotating{false};                       // 按住鼠标右键
+    double delta_x{0.0}, delta_y{0.0};          // 累计的鼠标移动
+    int64_t sample_ns{-1};                      // 最早一次没有被取走的采样的时刻，-1 表示没有新的输入
+};
+
+
+/* 摄像机在某一帧的状态 */
+struct CameraState {
+    glm::vec3 position{0.f};
+    float yaw{0.f}, pitch{0.f};
+    glm::mat4 view{1.f};
+    glm::mat4 projection{1.f};                  // 按照这一帧的长宽比计算，窗口大小改变后跟随
+};
+
+
+/**
+ * 模拟线程产生的一帧，发布之后渲染线程只读
+ * transforms，bounds，lights 由场景的 _simulate() 填写，含义由场景决定；visible 由 FramePipeline::cull() 填写；
+ * 槽位会复用，vector 的内存不会每帧重新分配
+ */
+struct FrameSnapshot {
+    int frame{0};
+    double time{0.0};                           // 场景的时间，见 Render::time()
+    double delta_time{0.0};
+    int ticks{0};                               // 这一帧执行的固定步数，见 FixedStep
+    double alpha{0.0};                          // 固定步长插值的系数，camera 已经插值
+    CameraState camera;
+    std::vector<glm::mat4> transforms;          // 物体的 model 矩阵
+    glm::vec4 bounds{0.f, 0.f, 0.f, -1.f};      // transforms 共用的模型空间的包围球（中心，半径），半径小于 0 时不剔除
+    std::vector<uint32_t> visible;              // 和视锥体相交的物体在 transforms 中的下标，从小到大
+    std::vector<glm::vec4> lights;              // 光源的数据，布局由场景决定
+    int64_t input_ns{0};                        // 这一帧所用输入的采样时刻（Profiler::now_ns()）
+    int64_t simulated_ns{0};                    // 模拟完成的时刻
+};
+
+
+/**
+ * 无锁的三缓冲：一个生产者，一个消费者
+ * 生产者写入 back()，publish() 和中间的槽位交换；消费者 acquire() 用 front 和中间的槽位交换，只有中间是新的一帧时才交换
+ */
+template<class T>
+class TripleBuffer {
+public:
+    /* 生产者写入的槽位 */
+    inline T &back() { return _slots[_back]; }
+
+    /* 生产者发布 back()，返回是否覆盖了一个还没有被取走的帧 */
+    inline bool publish() {
+        uint8_t prev = _middle.exchange((uint8_t) (_back | FRESH), std::memory_order_acq_rel);
+        _back = prev & INDEX;
+        return (prev & FRESH) != 0;
+    }
+
+    /* 消费者：有新的帧时换到 front()，返回 true */
+    inline bool acquire() {
+        if ((_middle.load(std::memory_order_acquire) & FRESH) == 0)
+            return false;
+        _front = _middle.exchange(_front, std::memory_order_acq_rel) & INDEX;
+        return true;
+    }
+
+    [[nodiscard]] inline bool fresh() const { return (_middle.load(std::memory_order_acquire) & FRESH) != 0; }
+
+    /* 消费者读取的槽位 */
+    inline const T &front() const { return _slots[_front]; }
+
+    /* 在没有生产者和消费者时调用：丢弃中间的帧 */
+    inline void reset() { _middle.fetch_and(INDEX, std::memory_order_acq_rel); }
+
+private:
+    static constexpr uint8_t INDEX = 0x3;
+    static constexpr uint8_t FRESH = 0x4;       // 中间的槽位是新发布的
+
+    std::array<T, 3> _slots{};
+    uint8_t _back{0};                           // 只有生产者修改
+    uint8_t _front{1};                          // 只有消费者修改
+    std::atomic<uint8_t> _middle{2};
+};
+
+
+class FramePipeline {
+public:
+    /* 流水线深度的上限 */
+    static constexpr int MAX_DEPTH = 3;
+
+    /* 统计延迟的帧数 */
+    static constexpr int LATENCY_FRAMES = 120;
+
+    struct Stats {
+        int depth;
+        uint64_t simulated;                     // 模拟的帧数
+        uint64_t rendered;                      // 绘制的帧数
+        uint64_t dropped;                       // 没有被绘制就被覆盖的帧数
+        double simulate_ms;                     // 最近一帧模拟的耗时
+        double latency_ms;                      // 最近 LATENCY_FRAMES 帧输入到显示的平均延迟
+        double latency_max_ms;
+    };
+
+    /* 模拟一帧：根据输入填写 snapshot，snapshot.frame 已经设置好 */
+    using Simulate = std::function<void(FrameSnapshot &snapshot, const FrameInput &input)>;
+
+    /**
+     * 开始流水线
+     * @param depth 0 表示不创建模拟线程，在 acquire() 中直接模拟
+     */
+    static void start(int depth, Simulate simulate);
+
+    /* 停止模拟线程 */
+    static void stop();
+
+    /* 模拟线程：按照 snapshot.camera 的视锥体剔除 transforms，结果写入 snapshot.visible；bounds 的半径小于 0 时全部可见 */
+    static void cull(FrameSnapshot &snapshot);
+
+    [[nodiscard]] static inline bool threaded() { return _thread.joinable(); }
+
+    [[nodiscard]] static inline int depth() { return _depth.load(std::memory_order_relaxed); }
+
+    /* 运行时修改深度，只能在 1 到 MAX_DEPTH 之间，depth = 0 时不能修改 */
+    static void depth_set(int depth);
+
+    /* 主线程：提交这一帧采样的输入 */
+    static void input_push(const std::vector<KeyboardEvent> &keys, bool rotating, double delta_x, double delta_y);
+
+    /* 渲染线程：取得下一帧，没有新的帧时等待 */
+    static const FrameSnapshot &acquire();
+
+    /* 渲染线程：这一帧已经交换到屏幕，记录延迟 */
+    static void presented(const FrameSnapshot &snapshot);
+
+    [[nodiscard]] static Stats stats();
+
+    /* 流水线的 ImGui 窗口：深度，延迟，丢弃的帧 */
+    static void gui();
+
+private:
+    static void _worker();
+
+    /* 取走输入，鼠标的移动清零 */
+    static FrameInput _input_take();
+
+    /* 模拟一帧并发布 */
+    static void _simulate_one(int frame);
+
+private:
+    inline static Simulate _simulate;
+    inline static std::thread _thread;
+    inline static std::atomic<int> _depth{1};
+    inline static std::atomic<bool> _stop{false};
+
+    inline static TripleBuffer<FrameSnapshot> _buffer;
+
+    /* 模拟线程等待渲染线程取走帧，渲染线程等待新的帧；只用于唤醒，帧本身通过三缓冲交换 */
+    inline static std::mutex _wait_mutex;
+    inline static std::condition_variable _cv_simulate;
+    inline static std::condition_variable _cv_render;
+
+    inline static std::mutex _input_mutex;
+    inline static FrameInput _input;
+
+    inline static std::atomic<uint64_t> _simulated{0};
+    inline static std::atomic<uint64_t> _rendered{0};
+    inline static std::atomic<uint64_t> _dropped{0};
+    inline static std::atomic<int64_t> _simulate_ns{0};
+
+    /* 最近的延迟，只有渲染线程访问 */
+    inline static std::array<double, LATENCY_FRAMES> _latency{};
+    inline static int _latency_count{0};
+};
+
+
+#endif //RENDER_ENGINE_FRAME_PIPELINE_H
@@ -0,0 +1,105 @@
+/**
+ * 帧的节奏：
+ *  - 时钟：Profiler::now_ns()（steady_clock，单调递增），所有的计时都使用它
+ *  - 固定步长：FixedStep 将每一帧真实经过的时间累加起来，按 TICK 的整数倍推进模拟（比如摄像机的移动），
+ *    剩余不足一步的时间作为插值的系数，显示的状态在上一步和这一步之间插值，速度和帧速率无关
+ *  - 垂直同步：glfwSwapInterval()，0 关闭，1 每次刷新交换一次，-1 自适应（错过刷新时立即交换，需要扩展）
+ *  - 限帧：每一帧结束时先睡眠到目标时刻之前 margin，再自旋到目标时刻；睡眠的误差因系统而异（Windows 的计时器
+ *    精度通常是 1 ~ 15 ms），margin 跟随最近睡眠超时的最大值调整，在 CPU 占用和帧间隔的抖动之间取得平衡
+ *  - 统计最近 PACING_FRAMES 帧的帧间隔：平均值，标准差，最大值，用于检查帧的节奏是否均匀
+ */
+#ifndef RENDER_ENGINE_FRAME_TIMER_H
+#define RENDER_ENGINE_FRAME_TIMER_H
+
+#include <array>
+#include <cstdint>
+
+
+/* 固定步长的累加器，只在一个线程中使用 */
+class FixedStep {
+public:
+    /* @param step_ns 每一步的时间 */
+    explicit FixedStep(int64_t step_ns) : _step_ns(step_ns) {}
+
+    /**
+     * 经过了 delta 秒，返回这一帧需要执行的步数；最多 max_steps 步，多余的时间丢弃，卡顿（比如断点）之后不追赶
+     */
+    int advance(double delta, int max_steps);
+
+    /* 剩余的时间占一步的比例，[0, 1)：显示的状态 = mix(上一步，这一步，alpha) */
+    [[nodiscard]] inline double alpha() const { return (double) _accumulator_ns / (double) _step_ns; }
+
+    [[nodiscard]] inline double step() const { return (double) _step_ns / 1e9; }
+
+private:
+    int64_t _step_ns;
+    int64_t _accumulator_ns{0};
+};
+
+
+class FrameTimer {
+public:
+    /* 模拟的固定步长：1/120 秒 */
+    static constexpr int64_t TICK_NS = 1'000'000'000 / 120;
+
+    /* 每一帧最多执行的步数 */
+    static constexpr int MAX_TICKS = 8;
+
+    /* 统计帧间隔的帧数 */
+    static constexpr int PACING_FRAMES = 240;
+
+    struct Stats {
+        int swap_interval;
+        double fps_limit;                       // 0 表示不限帧
+        double mean_ms;                         // 帧间隔的平均值
+        double stddev_ms;                       // 帧间隔的标准差
+        double max_ms;
+        double margin_ms;                       // 限帧时睡眠预留的时间，之后自旋
+        double wait_ms;                         // 最近一帧限帧等待的时间
+    };
+
+    /**
+     * 在 OpenGL 的线程中调用，需要当前的上下文
+     * @param swap_interval 见 glfwSwapInterval()，-1 不支持时使用 1
+     * @param fps_limit 限制的帧速率，0 表示不限制
+     */
+    static void init(int swap_interval, double fps_limit);
+
+    /* 修改垂直同步，需要在 OpenGL 的线程中调用 */
+    static void swap_interval_set(int swap_interval);
+
+    static void fps_limit_set(double fps_limit);
+
+    /* 交换缓冲之后调用：限帧，并记录帧间隔 */
+    static void frame_end();
+
+    [[nodiscard]] static Stats stats();
+
+    /* 帧节奏的 ImGui 窗口：垂直同步，限帧，帧间隔的曲线 */
+    static void gui();
+
+private:
+    /* 睡眠加自旋，等待到 deadline */
+    static void _wait_until(int64_t deadline_ns);
+
+private:
+    /* 睡眠预留的时间的范围，以及每帧的衰减 */
+    static constexpr int64_t MARGIN_MIN_NS = 250'000;
+    static constexpr int64_t MARGIN_MAX_NS = 20'000'000;
+    static constexpr int64_t MARGIN_DECAY_NS = 20'000;
+
+    inline static int _swap_interval{1};
+    inline static bool _swap_tear{false};       // 是否支持自适应的垂直同步
+    inline static double _fps_limit{0.0};
+
+    inline static int64_t _deadline_ns{0};      // 上一帧的目标时刻
+    inline static int64_t _margin_ns{2'000'000};
+    inline static int64_t _wait_ns{0};
+
+    inline static int64_t _last_ns{0};          // 上一帧结束的时刻
+    inline static std::array<float, PACING_FRAMES> _intervals{};
+    inline static int _count{0};
+};
+
+
+#endif //RENDER_ENGINE_FRAME_TIMER_H
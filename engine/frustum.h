@@ -0,0 +1,34 @@
+#ifndef RENDER_ENGINE_FRUSTUM_H
+#define RENDER_ENGINE_FRUSTUM_H
+
+#include <array>
+
+#include <glm/glm.hpp>
+
+
+/* 视锥体的 6 个平面（Gribb-Hartmann），法线朝向视锥体的内部，已经归一化 */
+struct Frustum {
+    std::array<glm::vec4, 6> planes;
+
+    explicit Frustum(const glm::mat4 &view_projection) {
+        auto row = [&](int i) {
+            return glm::vec4(view_projection[0][i], view_projection[1][i], view_projection[2][i],
+                             view_projection[3][i]);
+        };
+        planes = {row(3) + row(0), row(3) - row(0), row(3) + row(1),
+                  row(3) - row(1), row(3) + row(2), row(3) - row(2)};
+        for (auto &plane: planes)
+            plane /= glm::length(glm::vec3(plane));
+    }
+
+    /* 包围球是否和视锥体相交（保守的：靠近角点的球也算作可见） */
+    [[nodiscard]] bool sphere_visible(const glm::vec3 &center, float radius) const {
+        for (const auto &plane: planes)
+            if (glm::dot(glm::vec3(plane), center) + plane.w < -radius)
+                return false;
+        return true;
+    }
+};
+
+
+#endif //RENDER_ENGINE_FRUSTUM_H
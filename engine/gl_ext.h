@@ -0,0 +1,108 @@
+/**
+ * glad 只生成了 OpenGL 3.3 的核心接口，这里手动载入渲染器用到的扩展
+ * 扩展不一定存在（比如 MacOS 最高只支持 OpenGL 4.1），使用前需要检查对应的标志
+ */
+#ifndef RENDER_ENGINE_GL_EXT_H
+#define RENDER_ENGINE_GL_EXT_H
+
+#include <set>
+#include <string>
+
+#include <glad/glad.h>
+
+
+// =====================================================
+// ARB_buffer_storage
+// =====================================================
+#ifndef GL_MAP_PERSISTENT_BIT
+#define GL_MAP_PERSISTENT_BIT 0x0040
+#endif
+#ifndef GL_MAP_COHERENT_BIT
+#define GL_MAP_COHERENT_BIT 0x0080
+#endif
+#ifndef GL_DYNAMIC_STORAGE_BIT
+#define GL_DYNAMIC_STORAGE_BIT 0x0100
+#endif
+
+typedef void (APIENTRYP PFNGLBUFFERSTORAGEPROC_EXT)(GLenum target, GLsizeiptr size, const void *data,
+                                                    GLbitfield flags);
+
+
+// =====================================================
+// ARB_texture_storage（OpenGL 4.2 核心）：不可变的纹理存储
+// =====================================================
+typedef void (APIENTRYP PFNGLTEXSTORAGE2DPROC_EXT)(GLenum target, GLsizei levels, GLenum internalformat,
+                                                   GLsizei width, GLsizei height);
+
+
+// =====================================================
+// EXT_texture_compression_s3tc，EXT_texture_sRGB：BC1，BC3
+// =====================================================
+#ifndef GL_COMPRESSED_RGB_S3TC_DXT1_EXT
+#define GL_COMPRESSED_RGB_S3TC_DXT1_EXT 0x83F0
+#endif
+#ifndef GL_COMPRESSED_RGBA_S3TC_DXT1_EXT
+#define GL_COMPRESSED_RGBA_S3TC_DXT1_EXT 0x83F1
+#endif
+#ifndef GL_COMPRESSED_RGBA_S3TC_DXT5_EXT
+#define GL_COMPRESSED_RGBA_S3TC_DXT5_EXT 0x83F3
+#endif
+#ifndef GL_COMPRESSED_SRGB_S3TC_DXT1_EXT
+#define GL_COMPRESSED_SRGB_S3TC_DXT1_EXT 0x8C4C
+#endif
+#ifndef GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT1_EXT
+#define GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT1_EXT 0x8C4D
+#endif
+#ifndef GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT5_EXT
+#define GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT5_EXT 0x8C4F
+#endif
+
+// =====================================================
+// ARB_texture_compression_bptc（OpenGL 4.2 核心）：BC6H，BC7
+// =====================================================
+#ifndef GL_COMPRESSED_RGBA_BPTC_UNORM
+#define GL_COMPRESSED_RGBA_BPTC_UNORM 0x8E8C
+#endif
+#ifndef GL_COMPRESSED_SRGB_ALPHA_BPTC_UNORM
+#define GL_COMPRESSED_SRGB_ALPHA_BPTC_UNORM 0x8E8D
+#endif
+#ifndef GL_COMPRESSED_RGB_BPTC_SIGNED_FLOAT
+#define GL_COMPRESSED_RGB_BPTC_SIGNED_FLOAT 0x8E8E
+#endif
+#ifndef GL_COMPRESSED_RGB_BPTC_UNSIGNED_FLOAT
+#define GL_COMPRESSED_RGB_BPTC_UNSIGNED_FLOAT 0x8E8F
+#endif
+
+
+class GLExt {
+public:
+    /**
+     * 查询扩展，载入扩展的函数；需要在 glad 初始化之后调用
+     * @param load 获取函数地址的方法，比如 glfwGetProcAddress
+     */
+    static void init(GLADloadproc load);
+
+    /* 当前上下文是否支持某个扩展，比如 "GL_ARB_buffer_storage" */
+    static bool supported(const std::string &name) { return _extensions.count(name) != 0; }
+
+    // =====================================================
+    // 扩展是否可用，以及扩展的函数
+    // =====================================================
+
+    inline static bool ARB_buffer_storage{false};
+    inline static PFNGLBUFFERSTORAGEPROC_EXT BufferStorage{nullptr};
+
+    inline static bool ARB_texture_storage{false};
+    inline static PFNGLTEXSTORAGE2DPROC_EXT TexStorage2D{nullptr};
+
+    /* 只有格式常量，没有新的函数；RGTC（BC4，BC5）是 OpenGL 3.0 的核心功能 */
+    inline static bool EXT_texture_compression_s3tc{false};
+    inline static bool ARB_texture_compression_bptc{false};
+
+private:
+    /* 当前上下文支持的所有扩展 */
+    inline static std::set<std::string> _extensions;
+};
+
+
+#endif //RENDER_ENGINE_GL_EXT_H
@@ -13,4 +13,10 @@ struct VertAttribLocation {
     inline static const GLuint texcoord = 2;
 };
 
+/* uniform block 的绑定点 */
+struct UniformBlockBinding {
+    inline static const GLuint matrices = 0;        // 摄像机的 view，projection 矩阵
+    inline static const GLuint material = 1;        // 材质的参数块
+};
+
 #endif //RENDER_GLOBAL_H
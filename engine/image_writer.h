@@ -0,0 +1,25 @@
+/**
+ * 将像素写入图像文件，用于保存渲染的结果（比如离屏模式的截图）
+ *  - PNG：8 位，1~4 通道；找到 libpng 时使用它依赖的 zlib 压缩，否则写入不压缩的 deflate 块
+ *  - EXR：32 位 float，1~4 通道，scanline，不压缩
+ * 输出只取决于像素，同样的像素总是得到同样的文件，可以直接比较
+ */
+#ifndef RENDER_ENGINE_IMAGE_WRITER_H
+#define RENDER_ENGINE_IMAGE_WRITER_H
+
+#include <string>
+
+
+/**
+ * 保存为 PNG，像素紧密排列；失败时抛出异常
+ * @param flip 垂直翻转：第 0 行是图像的底部（比如 glReadPixels 读取的数据）
+ */
+void image_png_save(const std::string &path, int width, int height, int channels, const unsigned char *pixels,
+                    bool flip = false);
+
+/* 保存为 EXR，参数和 image_png_save 相同 */
+void image_exr_save(const std::string &path, int width, int height, int channels, const float *pixels,
+                    bool flip = false);
+
+
+#endif //RENDER_ENGINE_IMAGE_WRITER_H
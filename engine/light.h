@@ -4,6 +4,10 @@
 #ifndef RENDER_ENGINE_LIGHT_H
 #define RENDER_ENGINE_LIGHT_H
 
+#include <cmath>
+#include <limits>
+#include <algorithm>
+
 #include <glm/glm.hpp>
 
 #include "shader.h"
@@ -34,6 +38,21 @@ struct PointLight {
     LightColor color{};
     glm::vec3 position{};      // 光源的位置
     AttenuationCoeffDistance attenuation{};
+
+    /**
+     * 影响范围：漫反射和高光衰减到 threshold 以下的距离，用于延迟渲染的光源包围球
+     * 求解 quadratic * d² + linear * d + constant = intensity / threshold
+     */
+    [[nodiscard]] inline float range(float threshold = 1.f / 256.f) const {
+        const glm::vec3 brightest = glm::max(color.diffuse, color.specular);
+        const float intensity = std::max(brightest.x, std::max(brightest.y, brightest.z));
+        const float a = attenuation.quadratic, b = attenuation.linear, c = attenuation.constant - intensity / threshold;
+        if (a > 0.f)
+            return (-b + std::sqrt(b * b - 4.f * a * c)) / (2.f * a);
+        if (b > 0.f)
+            return -c / b;
+        return std::numeric_limits<float>::max();
+    }
 };
 
 
@@ -0,0 +1,217 @@
+/**
+ * 材质：参数块 + 纹理集合
+ * 参数块以 std140 的布局存放在一个共享的 uniform buffer 中，每个材质占用其中的一段；
+ * 纹理在创建材质时就确定了纹理单元，绘制时不需要再查找
+ */
+#ifndef RENDER_ENGINE_MATERIAL_H
+#define RENDER_ENGINE_MATERIAL_H
+
+#include <map>
+#include <string>
+#include <memory>
+#include <vector>
+#include <cstring>
+#include <cassert>
+#include <cstdint>
+#include <type_traits>
+
+#include <glad/glad.h>
+
+#include "global.h"
+#include "texture.h"
+
+
+/* 材质中的一个纹理绑定 */
+struct MaterialTexture {
+    GLuint unit;        // 纹理单元，0，1，2，...
+    GLenum target;      // GL_TEXTURE_2D，GL_TEXTURE_CUBE_MAP 等
+    GLuint id;          // 纹理对象
+};
+
+
+/**
+ * 以纹理数组导入模型时，材质的参数块：每种纹理在纹理数组中的层，-1 表示没有这种纹理
+ * 和 shader 中 std140 的 uniform block 布局一致：
+ *  layout (std140) uniform MaterialBlock { ivec4 layers; };
+ */
+struct TextureLayers {
+    GLint diffuse{-1};
+    GLint specular{-1};
+    GLint normal{-1};
+    GLint _padding{0};
+};
+
+
+class Material {
+public:
+    friend class MaterialManager;
+
+    ~Material();
+
+    Material(const Material &) = delete;
+
+    Material &operator=(const Material &) = delete;
+
+    /* 导入模型时，每种类型的纹理对应的纹理单元，shader 中的采样器需要和这里保持一致 */
+    static inline GLuint texture_unit(TextureType texture_type) {
+        switch (texture_type) {
+            case TextureType::diffuse:
+                return 0;
+            case TextureType::specular:
+                return 1;
+            case TextureType::normal:
+                return 2;
+        }
+        return 0;
+    }
+
+    // =====================================================
+    // 属性
+    // =====================================================
+
+    /**
+     * 材质的 id：纹理集合和参数块的内容完全相同的材质 id 相同，否则一定不同（按内容比较，不是哈希）
+     * id 相同的材质绑定的纹理和参数完全相同，可以用于绘制排序和合批；参数改变时 id 也会改变。id 从 1 开始
+     */
+    [[nodiscard]] inline uint64_t id() const { return _id; }
+
+    [[nodiscard]] inline const std::vector<MaterialTexture> &texture_bindings() const { return _texture_bindings; }
+
+    /* 材质引用的 Texture2D，按类型存放，用于兼容 Mesh::textures() */
+    [[nodiscard]] inline const std::map<TextureType, std::vector<std::shared_ptr<Texture2D>>> &textures() const {
+        return _textures;
+    }
+
+    /* 参数块在 uniform buffer 中的偏移和大小 */
+    [[nodiscard]] inline GLintptr param_offset() const { return _param_offset; }
+
+    [[nodiscard]] inline GLsizeiptr param_size() const { return (GLsizeiptr) _params.size(); }
+
+    // =====================================================
+    // 参数
+    // =====================================================
+
+    /**
+     * 更新参数块，只有参数真正改变时才会标记为需要上传
+     * @tparam T 需要和 shader 中的 std140 uniform block 的布局一致
+     */
+    template<class T>
+    void params_set(const T &params) {
+        static_assert(std::is_trivially_copyable_v<T>, "material params must be trivially copyable");
+        assert(sizeof(T) <= _params.size());
+        if (std::memcmp(_params.data(), &params, sizeof(T)) == 0)
+            return;
+        std::memcpy(_params.data(), &params, sizeof(T));
+        _mark_dirty();
+        _id_update();
+    }
+
+    template<class T>
+    [[nodiscard]] const T &params() const {
+        static_assert(std::is_trivially_copyable_v<T>, "material params must be trivially copyable");
+        assert(sizeof(T) <= _params.size());
+        return *reinterpret_cast<const T *>(_params.data());
+    }
+
+    // =====================================================
+    // 绑定
+    // =====================================================
+
+    /* 绑定材质的所有纹理 */
+    void bind_textures() const;
+
+    /* 将参数块绑定到 uniform block 的绑定点 */
+    void bind_params(GLuint block_binding = UniformBlockBinding::material) const;
+
+    /* 绑定纹理，并将参数块绑定到 uniform block 的绑定点 */
+    inline void bind(GLuint block_binding = UniformBlockBinding::material) const {
+        bind_textures();
+        bind_params(block_binding);
+    }
+
+private:
+    Material(std::vector<MaterialTexture> texture_bindings, GLsizeiptr param_size);
+
+    void _mark_dirty();
+
+    /* 根据纹理集合和参数块的内容重新确定 id */
+    void _id_update();
+
+private:
+    uint64_t _id{0};
+    std::string _key;                   // 确定 id 的内容：纹理绑定和参数块的字节
+    std::vector<MaterialTexture> _texture_bindings;
+    std::map<TextureType, std::vector<std::shared_ptr<Texture2D>>> _textures;
+
+    /* 参数块在 CPU 端的副本 */
+    std::vector<unsigned char> _params;
+    GLintptr _param_offset{0};
+    bool _dirty{false};
+};
+
+
+/**
+ * 创建材质，管理所有材质参数块所在的 uniform buffer
+ * 每一帧开始时调用 upload()，只有修改过的材质会被上传
+ */
+class MaterialManager {
+public:
+    friend class Material;
+
+    /**
+     * 创建材质
+     * @param texture_bindings 材质的纹理，以及每个纹理对应的纹理单元
+     * @param param_size 参数块的大小（std140 布局），可以为 0
+     */
+    static std::shared_ptr<Material>
+    material_create(std::vector<MaterialTexture> texture_bindings, GLsizeiptr param_size = 0);
+
+    /* 根据 Assimp 导入的纹理创建材质：每种类型的第 0 个纹理绑定到 Material::texture_unit() 对应的单元 */
+    static std::shared_ptr<Material>
+    material_create(const std::map<TextureType, std::vector<std::shared_ptr<Texture2D>>> &textures,
+                    GLsizeiptr param_size = 0);
+
+    /* 将修改过的材质参数上传到 uniform buffer */
+    static void upload();
+
+    [[nodiscard]] static inline GLuint buffer() { return _buffer; }
+
+private:
+    /* 为参数块分配一段 buffer，偏移满足 GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT */
+    static GLintptr _alloc(GLsizeiptr size);
+
+    /* 回收一段 buffer，留给之后相同大小的参数块 */
+    static void _free(GLintptr offset, GLsizeiptr size);
+
+    /* 扩大 uniform buffer，保留已有的内容 */
+    static void _grow(GLsizeiptr min_capacity);
+
+    /* 内容对应的 id，没有时分配新的；引用计数加一 */
+    static uint64_t _id_acquire(const std::string &key);
+
+    /* 引用计数减一，为 0 时删除这个内容 */
+    static void _id_release(const std::string &key);
+
+private:
+    inline static GLuint _buffer{0};
+    inline static GLsizeiptr _capacity{0};
+    inline static GLsizeiptr _used{0};
+    inline static GLint _alignment{256};
+
+    /* 空闲的区段：大小 - 偏移 */
+    inline static std::multimap<GLsizeiptr, GLintptr> _free_list;
+
+    /* 需要上传的材质 */
+    inline static std::vector<Material *> _dirty;
+
+    /* 材质的内容到 id 和引用计数的映射 */
+    struct IdEntry {
+        uint64_t id;
+        size_t refs;
+    };
+    inline static std::map<std::string, IdEntry> _ids;
+    inline static uint64_t _next_id{1};
+};
+
+
+#endif //RENDER_ENGINE_MATERIAL_H
@@ -2,6 +2,7 @@
 #define RENDER_MESH_H
 
 #include <map>
+#include <atomic>
 #include <string>
 #include <vector>
 #include <memory>
@@ -14,6 +15,7 @@
 #include <assimp/postprocess.h>
 
 #include "texture.h"
+#include "material.h"
 #include "utils/with.h"
 
 
@@ -100,8 +102,11 @@ public:
     explicit Mesh(const std::vector<Line> &lines);
 
 
-    // 通过 Assimp 来创建 Mesh 对象
-    static Mesh mesh_load(const aiMesh &mesh, const aiScene &scene, const std::string &dir);
+    /**
+     * 通过 Assimp 来创建 Mesh 对象
+     * @param material 导入模型时为每个 aiMaterial 创建的材质，多个 mesh 可以共用；为空表示没有材质
+     */
+    static Mesh mesh_load(const aiMesh &mesh, const std::shared_ptr<Material> &material);
 
 
     // =====================================================
@@ -134,6 +139,33 @@ public:
                : iter->second;
     }
 
+    /* 查找 Mesh 的指定类型、指定序号的 Texture，不存在时返回 nullptr；不会复制 texture 数组，适合在绘制循环中使用 */
+    [[nodiscard]] inline const Texture2D *texture(TextureType texture_type, unsigned idx = 0) const {
+        auto iter = _textures.find(texture_type);
+        return (iter == _textures.end() || idx >= iter->second.size())
+               ? nullptr
+               : iter->second[idx].get();
+    }
+
+
+    /* Mesh 的所有纹理，按类型存放 */
+    [[nodiscard]] inline const std::map<TextureType, std::vector<std::shared_ptr<Texture2D>>> &texture_map() const {
+        return _textures;
+    }
+
+    /* 模型空间中的包围球，用于估计 mesh 在屏幕上的大小 */
+    [[nodiscard]] inline const glm::vec3 &bounds_center() const { return _bounds_center; }
+
+    [[nodiscard]] inline float bounds_radius() const { return _bounds_radius; }
+
+    /* 模型空间中单位长度对应多少纹理坐标（按面积平均）；为 0 表示未知 */
+    [[nodiscard]] inline float uv_density() const { return _uv_density; }
+
+
+    /* Mesh 的材质，纹理绑定和参数块在创建材质时就已经确定；可能为空 */
+    [[nodiscard]] inline const std::shared_ptr<Material> &material() const { return _material; }
+
+    inline void set_material(const std::shared_ptr<Material> &material) { _material = material; }
 
     inline void in() override { glBindVertexArray(_vao); }
 
@@ -142,13 +174,48 @@ public:
     /* 绘制 Mesh，并不绑定 shader */
     void draw(GLsizei amount = 1) const;
 
+    /**
+     * 不经过 Mesh 的绘制（Sphere，全屏三角形等）也通过这两个函数，同样计入绘制的统计；调用之前需要绑定 VAO
+     * @param amount 不等于 1 时实例化绘制
+     */
+    static void draw_arrays(GLenum mode, GLint first, GLsizei count, GLsizei amount = 1);
+
+    static void draw_elements(GLenum mode, GLsizei count, GLenum type, GLsizei amount = 1);
+
+    /* 绘制的统计，Render 在每一帧的开始清零 */
+    struct DrawStats {
+        size_t draws;
+        size_t triangles;           // 实例化的绘制包括所有的实例；线段和点不计入
+    };
+
+    [[nodiscard]] static inline DrawStats draw_stats() {
+        return {_draws.load(std::memory_order_relaxed), _triangles.load(std::memory_order_relaxed)};
+    }
+
+    static inline void draw_stats_reset() {
+        _draws.store(0, std::memory_order_relaxed);
+        _triangles.store(0, std::memory_order_relaxed);
+    }
+
 private:
+    /* 记录一次绘制：图元是三角形时按照顶点数换算 */
+    static void _draw_count(GLenum mode, GLsizei count, GLsizei amount);
+
+    /* 原子的计数器：CommandQueue 的工作线程等其他线程也可以记录或读取，不会产生数据竞争 */
+    inline static std::atomic<size_t> _draws{0};
+    inline static std::atomic<size_t> _triangles{0};
+
     GLuint _vao{0};
     MeshType _type;
     GLsizei _primitive_cnt{0};
     std::map<TextureType, std::vector<std::shared_ptr<Texture2D>>> _textures;
+    std::shared_ptr<Material> _material{nullptr};
     glm::mat4 _model_matrix = glm::one<glm::mat4>();
 
+    glm::vec3 _bounds_center{0.f};
+    float _bounds_radius{0.f};
+    float _uv_density{0.f};
+
 };
 
 
@@ -24,7 +24,12 @@ public:
             : _position(pos),
               _model(glm::translate(glm::one<glm::mat4>(), pos)) {}
 
-    static std::shared_ptr<Model> load_model(const std::string &path);
+    /**
+     * 使用 Assimp 导入模型
+     * @param texture_array 将尺寸和格式相同的纹理合并为纹理数组，整个 Model 只使用少数几个纹理数组；
+     *                      每个材质的参数块是 TextureLayers，记录了纹理在数组中的层
+     */
+    static std::shared_ptr<Model> load_model(const std::string &path, bool texture_array = false);
 
     // =====================================================
     // 属性
@@ -46,13 +51,18 @@ public:
     void rotate(const glm::vec3 &axis, float angle);
 
 protected:
-    /* 使用 Assimp 读取模型：递归地读取节点及子节点的模型，将结果放入 meshes 中 */
+    /**
+     * 使用 Assimp 读取模型：递归地读取节点及子节点的模型，将结果放入 meshes 中
+     * @param materials 每个 aiMaterial 对应的材质，下标和 aiScene::mMaterials 一致
+     */
     static void
-    process_node(std::vector<Mesh> &meshes, const aiNode &node, const aiScene &scene, const std::string &dir_path);
+    process_node(std::vector<Mesh> &meshes, const aiNode &node, const aiScene &scene,
+                 const std::vector<std::shared_ptr<Material>> &materials);
 
 protected:
 
     std::vector<Mesh> _meshes{};
+    std::vector<std::shared_ptr<Texture2DArray>> _texture_arrays{};     // 以纹理数组导入时，持有纹理数组
     glm::vec3 _position;                // Model 的位置
     glm::mat4 _model;                   // model 矩阵
 };
@@ -0,0 +1,276 @@
+/**
+ * 分层的 CPU/GPU 帧分析器：
+ *  - CPU 区段：PROFILE_ZONE("name") 在作用域内计时，可以在任意线程中使用，可以嵌套
+ *    每个线程的事件写入自己的环形缓冲（单生产者单消费者，无锁），主线程在 frame_end() 中收集
+ *  - GPU 区段：PROFILE_GPU_ZONE("name") 在作用域的开始和结束插入 GL_TIMESTAMP 查询，只能在主线程中使用，可以嵌套
+ *    查询对象有 GPU_FRAMES 组，轮流使用，几帧之后结果可用时才读取，不会等待 GPU
+ *  - 保留最近 HISTORY 帧的记录：gui() 显示帧时间的曲线，某一帧的时间线和每个区段的耗时；
+ *    trace_save() 导出为 Chrome trace 的 JSON（chrome://tracing 或者 Perfetto 打开）
+ * 区段的名字必须是静态的字符串（比如字面量），记录中只保存指针
+ */
+#ifndef RENDER_ENGINE_PROFILER_H
+#define RENDER_ENGINE_PROFILER_H
+
+#include <deque>
+#include <mutex>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+#include <glad/glad.h>
+
+
+/* 一个区段的一次执行，时间是相对于 Profiler::init() 的纳秒数 */
+struct ProfileEvent {
+    const char *name{nullptr};
+    int64_t begin_ns{0};
+    int64_t end_ns{0};
+    uint16_t depth{0};              // 嵌套的层数，0 是最外层
+    uint16_t thread{0};             // 线程的编号，见 Profiler::thread_name()
+};
+
+
+/* 一帧的记录 */
+struct ProfileFrame {
+    uint64_t index{0};
+    int64_t begin_ns{0};
+    int64_t end_ns{0};
+    std::vector<ProfileEvent> cpu;          // 按开始时间排序
+    std::vector<ProfileEvent> gpu;          // GPU 的时间已经换算到 CPU 的时间轴上
+    bool gpu_resolved{false};               // GPU 查询的结果已经读取（或者已经放弃）
+
+    [[nodiscard]] inline double cpu_ms() const { return (double) (end_ns - begin_ns) / 1e6; }
+
+    /* 最外层 GPU 区段的耗时之和 */
+    [[nodiscard]] double gpu_ms() const;
+};
+
+
+/* 一个线程的事件缓冲：只有这个线程写入，只有主线程读取；满了之后丢弃新的事件 */
+class ProfileRing {
+public:
+    static constexpr size_t CAPACITY = 4096;
+
+    /* 生产者调用 */
+    bool push(const ProfileEvent &event);
+
+    /* 消费者调用，取出所有的事件 */
+    void drain(std::vector<ProfileEvent> &out);
+
+    [[nodiscard]] inline size_t dropped() const { return _dropped.load(std::memory_order_relaxed); }
+
+private:
+    std::array<ProfileEvent, CAPACITY> _events{};
+    std::atomic<size_t> _head{0};           // 下一个写入的位置，只有生产者修改
+    std::atomic<size_t> _tail{0};           // 下一个读取的位置，只有消费者修改
+    std::atomic<size_t> _dropped{0};
+};
+
+
+class Profiler {
+public:
+    /* 保留的帧数 */
+    static const int HISTORY = 300;
+
+    /* GPU 查询的组数：查询的结果在 GPU_FRAMES - 1 帧之后读取 */
+    static const int GPU_FRAMES = 3;
+
+    /* 开始记录，需要在 OpenGL 上下文创建之后调用 */
+    static void init();
+
+    /* 删除查询对象，需要在上下文销毁之前调用 */
+    static void terminate();
+
+    [[nodiscard]] static inline bool enabled() { return _enabled.load(std::memory_order_relaxed); }
+
+    /* 暂停时仍然收集事件，但是不再记录新的帧，方便查看某一帧 */
+    static inline void pause(bool paused) { _paused = paused; }
+
+    [[nodiscard]] static inline bool paused() { return _paused; }
+
+    /* 每一帧的开始和结束，在主线程中调用 */
+    static void frame_begin();
+
+    static void frame_end();
+
+    /* 给当前线程命名，显示在时间线和 trace 中 */
+    static void thread_name_set(const std::string &name);
+
+    [[nodiscard]] static std::string thread_name(uint16_t thread);
+
+    /* 当前帧的编号，和记录中的 ProfileFrame::index 对应 */
+    [[nodiscard]] static inline uint64_t frame_index() { return _current.index; }
+
+    /* 最近的帧，最新的在最后；暂停期间的帧不会记录，编号可能不连续 */
+    [[nodiscard]] static inline const std::deque<ProfileFrame> &frames() { return _frames; }
+
+    /* 按照编号查找记录的帧，没有记录（已经丢弃，或者在暂停期间）时返回 nullptr */
+    [[nodiscard]] static const ProfileFrame *frame_find(uint64_t index);
+
+    /* 因为缓冲满了，或者 GPU 的结果没有及时可用而丢弃的事件数 */
+    [[nodiscard]] static size_t dropped();
+
+    /**
+     * 将记录的所有帧导出为 Chrome trace 的 JSON
+     * CPU 的事件在 pid 0，每个线程一个 tid；GPU 的事件在 pid 1
+     */
+    static void trace_save(const std::string &path);
+
+    /* 分析器的 ImGui 窗口，需要在 ImGui::NewFrame() 和 ImGui::Render() 之间调用 */
+    static void gui();
+
+    /* 当前时间，相对于 init() 的纳秒数 */
+    [[nodiscard]] static int64_t now_ns();
+
+    // =====================================================
+    // 由 ProfileZone 和 GpuProfileZone 调用
+    // =====================================================
+
+    /* 开始一个 CPU 区段，返回嵌套的层数 */
+    static uint16_t _cpu_begin();
+
+    static void _cpu_end(const char *name, int64_t begin_ns, uint16_t depth);
+
+    static void _gpu_begin(const char *name);
+
+    static void _gpu_end();
+
+private:
+    /* 注册的线程：线程结束之后，缓冲中的事件被取出后删除 */
+    struct Thread {
+        ProfileRing ring;
+        uint16_t index{0};
+        uint16_t depth{0};                  // 只有这个线程自己修改
+        std::atomic<bool> exited{false};
+    };
+
+    /* 一个 GPU 区段：开始和结束的查询在查询池中的下标 */
+    struct GpuZone {
+        const char *name;
+        size_t begin_query;
+        size_t end_query;
+        uint16_t depth;
+    };
+
+    /* 一组 GPU 查询，对应一帧；使用 GpuFrame{} 初始化 */
+    struct GpuFrame {
+        std::vector<GLuint> queries;
+        size_t used;
+        std::vector<GpuZone> zones;
+        uint64_t frame;
+        bool pending;                       // 查询已经发出，结果还没有读取
+        int64_t offset_ns;                  // GPU 时间戳换算到 CPU 时间轴的偏移
+    };
+
+    /* 当前线程的状态，第一次使用时注册 */
+    static Thread &_thread();
+
+    /* 收集所有线程缓冲中的事件，删除已经结束的线程 */
+    static void _collect(std::vector<ProfileEvent> &out);
+
+    /* 读取 GPU 查询的结果，结果还不可用时返回 false */
+    static bool _gpu_resolve(GpuFrame &gpu_frame);
+
+    /* 同时读取 GPU 和 CPU 的时间，得到 GPU 时间戳换算到 CPU 时间轴的偏移 */
+    static int64_t _gpu_offset();
+
+    /* 每隔多少帧重新校准一次 GPU 的时间 */
+    static const int GPU_CALIBRATE_FRAMES = 60;
+
+    static ProfileFrame *_frame_find(uint64_t index);
+
+    static GLuint _gpu_query(GpuFrame &gpu_frame, size_t &index);
+
+private:
+    inline static std::atomic<bool> _enabled{false};
+    inline static bool _paused{false};
+
+    inline static std::mutex _threads_mutex;
+    inline static std::vector<std::shared_ptr<Thread>> _threads;
+
+    /* 每个线程的名字，下标是线程的编号；线程退出之后 trace 中仍然需要 */
+    inline static std::vector<std::string> _thread_names;
+    inline static size_t _dropped_exited{0};
+
+    inline static std::chrono::steady_clock::time_point _epoch{std::chrono::steady_clock::now()};
+
+    inline static std::deque<ProfileFrame> _frames;
+    inline static ProfileFrame _current;
+    inline static uint64_t _frame_index{0};
+    inline static size_t _dropped_gpu{0};
+
+    inline static std::array<GpuFrame, GPU_FRAMES> _gpu_frames{};
+    inline static GpuFrame *_gpu_current{nullptr};
+    inline static std::vector<size_t> _gpu_stack;           // 正在进行的 GPU 区段在 zones 中的下标
+    inline static int64_t _gpu_offset_ns{0};
+
+    /* gui 中选中的帧，相对于最新一帧的偏移 */
+    inline static int _gui_frame_offset{0};
+    inline static float _gui_zoom{1.f};
+};
+
+
+/* CPU 区段：构造时开始计时，析构时结束 */
+class ProfileZone {
+public:
+    explicit ProfileZone(const char *name) : _name(name) {
+        if (Profiler::enabled()) {
+            _depth = Profiler::_cpu_begin();
+            _begin_ns = Profiler::now_ns();
+        }
+    }
+
+    ~ProfileZone() {
+        if (_begin_ns >= 0)
+            Profiler::_cpu_end(_name, _begin_ns, _depth);
+    }
+
+    ProfileZone(const ProfileZone &) = delete;
+
+    ProfileZone &operator=(const ProfileZone &) = delete;
+
+private:
+    const char *_name;
+    int64_t _begin_ns{-1};
+    uint16_t _depth{0};
+};
+
+
+/* GPU 区段：构造和析构时插入时间戳查询，只能在 OpenGL 上下文所在的线程中使用 */
+class GpuProfileZone {
+public:
+    explicit GpuProfileZone(const char *name) : _active(Profiler::enabled()) {
+        if (_active)
+            Profiler::_gpu_begin(name);
+    }
+
+    ~GpuProfileZone() {
+        if (_active)
+            Profiler::_gpu_end();
+    }
+
+    GpuProfileZone(const GpuProfileZone &) = delete;
+
+    GpuProfileZone &operator=(const GpuProfileZone &) = delete;
+
+private:
+    bool _active;
+};
+
+
+#define PROFILE_CONCAT_(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_(a, b)
+
+/* 在当前作用域中记录一个 CPU 区段，name 需要是字面量 */
+#define PROFILE_ZONE(name) ProfileZone PROFILE_CONCAT(__profile_zone_, __LINE__)(name)
+
+/* 在当前作用域中记录一个 GPU 区段，name 需要是字面量 */
+#define PROFILE_GPU_ZONE(name) GpuProfileZone PROFILE_CONCAT(__profile_gpu_zone_, __LINE__)(name)
+
+
+#endif //RENDER_ENGINE_PROFILER_H
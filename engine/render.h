@@ -7,29 +7,91 @@
 #define GLFW_INCLUDE_NONE
 #endif
 
+#include <atomic>
 #include <memory>
 #include <chrono>
+#include <string>
+#include <vector>
+#include <algorithm>
 
 #include <glad/glad.h>
 #include <GLFW/glfw3.h>
 
 #include "window.h"
 #include "camera.h"
+#include "material.h"
+#include "frame_buffer.h"
+#include "texture_stream.h"
+#include "texture_upload.h"
+#include "profiler.h"
+#include "camera_path.h"
+#include "render_bench.h"
+#include "command_list.h"
+#include "frame_pipeline.h"
+#include "frame_timer.h"
+#include "dynamic_resolution.h"
+#include "render_target.h"
 
 
 // =====================================================
 // 使用方法：
-//  Render.init();
+//  Render.init(RenderOptions::parse(argc, argv));
 //  Render.render<Scene>();
 //  Render.terminate();
 // =====================================================
 
 
+/**
+ * 渲染器的选项，通常来自命令行（parse）：
+ *  --headless                  离屏模式：不需要显示器，绘制到固定分辨率的离屏 FrameBuffer；没有 ImGui，不流送纹理
+ *  --size WxH                  离屏模式的分辨率，默认 1280x720
+ *  --frames n                  绘制 n 帧之后退出，0 表示直到窗口关闭；离屏模式默认 60
+ *  --timestep s                固定的时间步长（秒），Render::time() 每帧增加 s；离屏模式默认 1/60，否则使用真实的时间
+ *  --capture 0,30,59 | all     保存这些帧（从 0 开始）的画面
+ *  --capture-dir dir           截图的目录，默认 capture
+ *  --capture-format png | exr  exr 时离屏的 FrameBuffer 是 RGBA16F
+ *  --bench path | spin         benchmark：回放摄像机的路径文件（spin 是原地转一圈），输出每一帧的耗时，见 RenderBench
+ *                              此时 --frames 是测量的帧数（默认覆盖整个路径），时间步长默认 1/60
+ *  --warmup n                  benchmark 预热的帧数，默认 60
+ *  --bench-out prefix          benchmark 报告的路径前缀，默认 <可执行文件>-bench，输出 .json 和 .csv
+ *  --record-path file          记录交互运行时摄像机的路径，退出时保存，之后可以用于 --bench
+ *  --pipeline n                模拟线程最多领先渲染线程 n 帧（0 到 3），0 表示不使用模拟线程，默认 1；
+ *                              离屏模式和 benchmark 中最多为 1，每一帧都会被绘制，保证结果可以复现
+ *  --swap-interval n           垂直同步，0 关闭，1 开启（默认），-1 自适应；benchmark 中总是 0
+ *  --fps-limit n               限制帧速率，默认 0 不限制；离屏模式和 benchmark 中不限制
+ *  --dynamic-res ms            开启动态分辨率，场景在 GPU 上的预算；离屏模式中不可用
+ *  --res-scale min,max         动态分辨率的缩放范围，默认 0.5,1
+ *  --upscale sharpen|bilinear  动态分辨率放大的方式，默认 sharpen
+ * 离屏模式下，同样的选项每次运行得到的截图相同，可以用于回归测试
+ */
+struct RenderOptions {
+    bool headless{false};
+    int width{1280}, height{720};
+    int frames{0};
+    double timestep{0.0};
+    std::vector<int> captures;
+    bool capture_all{false};
+    std::string capture_dir{"capture"};
+    std::string capture_format{"png"};
+    std::string name{"render"};             // 截图的文件名前缀：可执行文件的名字
+    BenchOptions bench;
+    int pipeline{1};                        // 流水线深度，见 FramePipeline
+    int swap_interval{1};
+    double fps_limit{0.0};
+    DynamicResolutionOptions dynamic_res;
+    bool debug_gui{false};                  // 一开始就显示引擎的调试窗口，见 Scene::_debug_gui
+
+    /* 解析命令行，参数有误时输出用法并退出 */
+    static RenderOptions parse(int argc, char **argv);
+};
+
+
 class Render {
 public:
 
     /* 渲染器初始化 */
-    static void init() {
+    static void init(const RenderOptions &options = {}) {
+        _options = options;
 
         // =====================================================
         // 环境初始化
@@ -37,10 +99,50 @@ public:
         // glfw -> window -> glad -> imgui
         // =====================================================
         _spdlog_init();
-        _glfw_init();
-        Window::init("AccRender", 720, 16, 9);
+        _glfw_init(_options.headless);
+        if (_options.headless)
+            Window::init_headless(_options.width, _options.height);
+        else
+            Window::init("AccRender", 720, 16, 9);
         _glad_init();
-        _imgui_init();
+        if (_options.headless)
+            _headless_init();
+        else
+            _imgui_init();
+
+        /* 离屏的渲染目标按照规格复用，相对尺寸的跟随窗口重新分配 */
+        RenderTargetPool::init();
+
+        /* CPU/GPU 分析器，需要 OpenGL 的上下文 */
+        Profiler::init();
+
+        /* 模型的纹理按照屏幕上的大小流送 mip；流送的级别何时到达取决于后台线程，离屏模式下不流送，保证结果可以复现 */
+        if (!_options.headless)
+            TextureStreamer::init();
+
+        /* 纹理数据通过 PBO 上传，每帧有上传的预算 */
+        TextureUploader::init();
+
+        /* 录制绘制命令的工作线程 */
+        CommandQueue::init();
+
+        /* benchmark 的帧数由摄像机的路径决定 */
+        if (!_options.bench.path.empty()) {
+            try {
+                RenderBench::init(_options.bench, _options.timestep, _options.name);
+            } catch (const std::exception &e) {
+                SPDLOG_ERROR("fail to init bench: {}", e.what());
+                exit(-1);
+            }
+            _options.frames = RenderBench::frames();
+        }
+
+        /* 垂直同步和限帧；benchmark 关闭了垂直同步，否则测量的是显示器的刷新率 */
+        if (!_options.headless)
+            FrameTimer::init(_options.swap_interval, _options.fps_limit);
+
+        /* 动态分辨率，关闭时在 GUI 中开启才创建离屏缓冲 */
+        DynamicResolution::init(_options.dynamic_res);
     }
 
     /* 渲染某个场景 */
@@ -48,67 +150,221 @@ public:
     static void render() {
 
         /* 创建一个摄像机 */
-        camera = std::make_shared<Camera>(16.f / 9.f);
+        camera = std::make_shared<Camera>((float) Window::width() / (float) Window::height());
 
         /* 场景初始化 */
         SCENE scene;
         scene.init();
+        if (_options.debug_gui)
+            scene.debug_gui_set(true);
+        RenderBench::start(*camera);
+        CameraPath recorded;
 
         /* 帧速率统计相关的变量 */
-        auto last_time = std::chrono::system_clock::now();
+        auto last_time = std::chrono::steady_clock::now();
         const int frames_per_update = 60;       // 每 60 帧更新一次帧速率
         int frame_idx = 0;      // 每 60 帧统计一次，当前是第几帧
 
+        /**
+         * 模拟：移动摄像机，执行场景的 _simulate()；在模拟线程中执行（流水线深度为 0 时在 acquire() 中执行）
+         * 模拟线程有自己的摄像机，渲染线程的摄像机在每一帧开始时设置为这一帧的姿态；
+         * 长宽比由渲染线程在窗口大小改变时写入 _aspect，模拟线程每一帧同步，投影矩阵随这一帧写入 snapshot
+         * 键盘按照固定步长移动摄像机，速度和帧速率无关；显示的位置在上一步和这一步之间插值
+         */
+        const auto start_time = std::chrono::steady_clock::now();
+        _aspect = camera->aspect();
+        Camera sim_camera = *camera;
+        glm::vec3 last_position = sim_camera.position();
+        FixedStep fixed_step(FrameTimer::TICK_NS);
+        double last_sim_time = 0.0;
+        FramePipeline::start(_options.pipeline, [&](FrameSnapshot &snapshot, const FrameInput &input) {
+            /* 固定步长时，时间只取决于帧的序号 */
+            snapshot.time = _options.timestep > 0.0
+                            ? _options.timestep * (double) snapshot.frame
+                            : std::chrono::duration<double>(std::chrono::steady_clock::now() - start_time).count();
+            snapshot.delta_time = snapshot.frame == 0 ? 0.0 : snapshot.time - last_sim_time;
+            last_sim_time = snapshot.time;
+            snapshot.ticks = fixed_step.advance(snapshot.delta_time, FrameTimer::MAX_TICKS);
+            snapshot.alpha = fixed_step.alpha();
+
+            if (const float aspect = _aspect.load(std::memory_order_relaxed); aspect != sim_camera.aspect())
+                sim_camera.aspect_set(aspect);
+
+            /* benchmark 由摄像机的路径决定摄像机的姿态，否则根据键盘和鼠标移动和旋转摄像机 */
+            glm::vec3 shown_position;
+            if (RenderBench::enabled()) {
+                RenderBench::pose(snapshot.frame, sim_camera);
+                shown_position = sim_camera.position();
+            } else {
+                /* 每一步移动的距离和原来每秒 60 帧，每帧移动一次时相同 */
+                const auto distance = (float) (fixed_step.step() * 60.0);
+                for (int tick = 0; tick < snapshot.ticks; ++tick) {
+                    last_position = sim_camera.position();
+                    for (auto key_event: input.keys)
+                        if (auto iter = CAMERA_KEY_MAP.find(key_event); iter != CAMERA_KEY_MAP.end())
+                            sim_camera.translate(iter->second, distance);
+                }
+
+                /* 鼠标的移动量和帧速率无关，直接作用在这一帧上 */
+                if (input.rotating)
+                    sim_camera.rotate(std::abs(input.delta_x) < 0.01 ? 0 : (float) input.delta_x,
+                                      std::abs(input.delta_y) < 0.01 ? 0 : float(-input.delta_y));
+                shown_position = glm::mix(last_position, sim_camera.position(), (float) snapshot.alpha);
+            }
+            Camera shown = sim_camera;
+            shown.pose_set(shown_position, sim_camera.yaw(), sim_camera.pitch());
+            snapshot.camera = {shown.position(), shown.yaw(), shown.pitch(),
+                               shown.view_matrix_get(), shown.projection_matrix()};
+
+            scene.simulate(snapshot);
+            FramePipeline::cull(snapshot);
+        });
+
         /* 开始渲染 */
+        _time = 0.0;
+        _frame = 0;
         glEnable(GL_DEPTH_TEST);
-        while (!Window::should_close()) {
+        while (!Window::should_close() && (_options.frames <= 0 || _frame < _options.frames)) {
+            Profiler::frame_begin();
+            if (RenderBench::enabled())
+                RenderBench::frame_begin(_frame);
+
             /* 清空 buffer */
             glClearColor(0, 0, 0, 0);
             glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-            /* 窗口检测事件 */
-            Window::update();
+            /* 窗口检测事件，将键盘和鼠标的输入交给模拟线程；benchmark 时忽略输入 */
+            {
+                PROFILE_ZONE("input");
+                Window::update();
+
+                /* 窗口大小改变之后，渲染线程的摄像机立即使用新的长宽比，模拟线程从下一次模拟开始；最小化时尺寸是 0，不修改 */
+                if (Window::width() > 0 && Window::height() > 0) {
+                    const float aspect = (float) Window::width() / (float) Window::height();
+                    if (aspect != camera->aspect()) {
+                        camera->aspect_set(aspect);
+                        _aspect.store(aspect, std::memory_order_relaxed);
+                    }
+                }
+
+                if (!RenderBench::enabled()) {
+                    auto iter = Window::mouse_button_events().find(MouseButton::Right);
+                    bool rotating = iter != Window::mouse_button_events().end() && iter->second == ButtonEvent::Press;
+                    auto[delta_x, delta_y] = Window::delta_mouse_pos();
+                    FramePipeline::input_push(Window::key_events(), rotating, delta_x, delta_y);
+                }
+            }
+
+            /* 取得模拟好的一帧，渲染线程的时间和摄像机都来自这一帧 */
+            const FrameSnapshot &snapshot = FramePipeline::acquire();
+            _snapshot = &snapshot;
+            _time = snapshot.time;
+            _delta_time = snapshot.delta_time;
+            camera->pose_set(snapshot.camera.position, snapshot.camera.yaw, snapshot.camera.pitch);
+
+            /* 上传修改过的材质参数 */
+            {
+                PROFILE_ZONE("material upload");
+                MaterialManager::upload();
+            }
 
-            /* 检查键盘，移动摄像机 */
-            for (auto key_event: Window::key_events())
-                if (CAMERA_KEY_MAP.find(key_event) != CAMERA_KEY_MAP.end())
-                    camera->translate(CAMERA_KEY_MAP[key_event], 1.f);
+            /* 纹理流送根据摄像机估计纹理需要的级别 */
+            TextureStreamer::frame_begin(camera->position(), glm::radians(camera->fov()), DynamicResolution::height());
 
-            /* 检查鼠标位置，旋转摄像机 */
-            if (auto iter = Window::mouse_button_events().find(MouseButton::Right);
-                    iter != Window::mouse_button_events().end() && iter->second == ButtonEvent::Press) {
-                auto[delta_x, delta_y] = Window::delta_mouse_pos();
-                camera->rotate(std::abs(delta_x) < 0.01 ? 0 : (float) delta_x,
-                               std::abs(delta_y) < 0.01 ? 0 : float(-delta_y));
+            /* 场景更新内容，渲染；离屏模式没有 GUI */
+            scene.update(!_options.headless);
+
+            /* 上传后台载入完成的 mip，发起新的载入，释放不再需要的 mip */
+            {
+                PROFILE_ZONE("texture stream");
+                TextureStreamer::update();
+            }
+
+            /* 回收 GPU 已经读取完的 PBO，在这一帧的预算内上传排队的纹理数据 */
+            {
+                PROFILE_ZONE("texture upload");
+                PROFILE_GPU_ZONE("texture upload");
+                TextureUploader::update();
             }
 
-            /* 场景更新内容，渲染 */
-            scene.update();
+            /* 纹理缓存超出预算时，回收已经不再使用的纹理 */
+            TextureManager::trim();
+            RenderTargetPool::frame_end();
+
+            /* 保存这一帧的画面 */
+            if (_options.capture_all ||
+                std::find(_options.captures.begin(), _options.captures.end(), _frame) != _options.captures.end())
+                _capture();
 
-            /* 交换双缓冲 */
-            glfwSwapBuffers(Window::window());
+            /* 交换双缓冲；离屏模式没有需要显示的缓冲 */
+            if (!_options.headless) {
+                PROFILE_ZONE("swap");
+                glfwSwapBuffers(Window::window());
+            }
+            FramePipeline::presented(snapshot);
+            RenderBench::frame_end();
+            FrameTimer::frame_end();
+            if (!_options.bench.record.empty())
+                recorded.record(_time, *camera);
 
             /* 检测是否发生了错误 */
             _check_gl_error();
+            Profiler::frame_end();
+            ++_frame;
 
             /* 计算 frame rate */
             if (frame_idx++ > frames_per_update) {
                 frame_idx = 0;
-                auto cur_time = std::chrono::system_clock::now();
+                auto cur_time = std::chrono::steady_clock::now();
                 auto delta_ms = std::chrono::duration_cast<std::chrono::milliseconds>(cur_time - last_time).count();
-                _frame_rate = frames_per_update * 1000.f / (float) delta_ms;
+                _frame_rate = frames_per_update * 1000.f / (float) std::max<long long>(1, delta_ms);
                 last_time = cur_time;
             }
         }
+
+        /* 模拟线程引用了场景，需要在场景析构之前停止 */
+        FramePipeline::stop();
+        _snapshot = nullptr;
+
+        if (_options.headless) {
+            auto total = std::chrono::steady_clock::now() - start_time;
+            double total_ms = std::chrono::duration<double, std::milli>(total).count();
+            SPDLOG_INFO("headless: {} frames in {:.1f} ms, {:.3f} ms/frame", _frame, total_ms,
+                        total_ms / std::max(1, _frame));
+        }
+
+        RenderBench::report();
+        if (!_options.bench.record.empty()) {
+            try {
+                recorded.save(_options.bench.record);
+                SPDLOG_INFO("camera path: {} keys, {:.2f} s -> {}", recorded.keys().size(), recorded.duration(),
+                            _options.bench.record);
+            } catch (const std::exception &e) {
+                SPDLOG_ERROR("fail to save camera path: {}", e.what());
+            }
+        }
     }
 
     /* 渲染器终止，回收资源 */
     static void terminate() {
+        /* 纹理需要在上下文销毁之前释放，先停止流送的后台线程 */
+        TextureStreamer::terminate();
+        TextureUploader::terminate();
+        TextureManager::clear();
+        Profiler::terminate();
+        RenderBench::terminate();
+        DynamicResolution::terminate();
+        CommandQueue::terminate();
+        RenderTargetPool::terminate();
+        _target.reset();
+        FrameBuffer::screen_set(0);
+
         /* 销毁窗口 */
         Window::destroy();
 
         /* 回收 imgui 的资源 */
-        _imgui_terminate();
+        if (!_options.headless)
+            _imgui_terminate();
 
         /* glfw 关闭 */
         glfwTerminate();
@@ -117,6 +373,20 @@ public:
 
     inline static float frame_rate() { return _frame_rate; }
 
+    /* 从第 0 帧开始经过的时间（秒），使用固定步长时只取决于帧的序号，场景的动画应该使用这个时间 */
+    inline static double time() { return _time; }
+
+    /* 和上一帧的时间差（秒），第 0 帧是 0 */
+    inline static double delta_time() { return _delta_time; }
+
+    /* 当前是第几帧，从 0 开始 */
+    inline static int frame() { return _frame; }
+
+    inline static const RenderOptions &options() { return _options; }
+
+    /* 渲染线程正在绘制的一帧，只能在 Scene::_update() 等渲染线程的代码中使用 */
+    inline static const FrameSnapshot &snapshot() { return *_snapshot; }
+
 public:
     static inline std::shared_ptr<Camera> camera{nullptr};
 
@@ -126,11 +396,31 @@ private:
     /* 帧率 frame per second */
     static inline float _frame_rate{0.f};
 
+    static inline RenderOptions _options{};
+    static inline double _time{0.0}, _delta_time{0.0};
+    static inline int _frame{0};
+    static inline const FrameSnapshot *_snapshot{nullptr};
+
+    /* 渲染线程的摄像机的长宽比，模拟线程读取 */
+    static inline std::atomic<float> _aspect{16.f / 9.f};
+
+    /* 离屏模式绘制的目标，代替窗口的默认帧缓冲 */
+    static inline std::unique_ptr<FrameBuffer> _target{nullptr};
+
     /* 初始化日志 */
     static void _spdlog_init();
 
-    /* glfw 初始化，指定 OpenGL 的版本号 */
-    static void _glfw_init();
+    /**
+     * glfw 初始化，指定 OpenGL 的版本号
+     * @param headless 离屏模式，GLFW 3.4 及以上使用 null 平台，不需要显示器
+     */
+    static void _glfw_init(bool headless);
+
+    /* 离屏模式：创建离屏的 FrameBuffer，作为屏幕的帧缓冲 */
+    static void _headless_init();
+
+    /* 读取屏幕的帧缓冲，保存为 png 或者 exr */
+    static void _capture();
 
     /* glad 初始化 */
     static void _glad_init();
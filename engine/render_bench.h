@@ -0,0 +1,115 @@
+/**
+ * 渲染的 benchmark：回放摄像机的路径，代替键盘和鼠标的输入，统计每一帧的耗时
+ *  - 预热阶段：摄像机停在路径的起点，绘制 warmup 帧，不记录（着色器编译，纹理上传，驱动的缓存）
+ *  - 测量阶段：第 i 帧的摄像机姿态取路径在 i * timestep 时刻的值，和机器的速度无关，每次运行绘制的内容相同
+ *  - 每一帧记录 CPU 的帧时间，GPU 的耗时（GL_TIME_ELAPSED 查询），draw call 数和三角形数
+ *  - 结束时输出 <out>.json（p50/p95/p99/max 等统计）和 <out>.csv（每一帧的记录），
+ *    两次运行的 json 可以用 render-bench/compare.py 比较
+ * GPU 的查询在结束时才读取，测量过程中不会等待 GPU
+ */
+#ifndef RENDER_ENGINE_RENDER_BENCH_H
+#define RENDER_ENGINE_RENDER_BENCH_H
+
+#include <chrono>
+#include <string>
+#include <vector>
+#include <cstddef>
+
+#include <glad/glad.h>
+
+#include "camera.h"
+#include "camera_path.h"
+
+
+/* benchmark 的选项，见 RenderOptions */
+struct BenchOptions {
+    std::string path;                   // 摄像机路径的文件，或者 "spin"；为空表示不运行 benchmark
+    int warmup{60};                     // 预热的帧数
+    int frames{0};                      // 测量的帧数，0 表示覆盖整个路径
+    std::string out;                    // 报告的路径前缀，为空时是 <可执行文件>-bench
+    std::string record;                 // 交互运行时将摄像机的路径记录到这个文件
+};
+
+
+/* 测量阶段的一帧 */
+struct BenchFrame {
+    int frame{0};                       // 测量阶段的第几帧
+    double time{0.0};                   // 摄像机路径的时刻
+    double cpu_ms{0.0};
+    double gpu_ms{0.0};
+    size_t draws{0};
+    size_t triangles{0};
+};
+
+
+class RenderBench {
+public:
+    /* 内置路径 spin 的时长（秒） */
+    static constexpr double SPIN_SECONDS = 10.0;
+
+    /**
+     * 读取摄像机的路径，路径有误时抛出异常
+     * @param timestep 测量阶段每一帧在路径上前进的时间
+     * @param name 报告中场景的名字
+     */
+    static void init(const BenchOptions &options, double timestep, const std::string &name);
+
+    /* 删除 GPU 查询，需要在上下文销毁之前调用 */
+    static void terminate();
+
+    [[nodiscard]] static inline bool enabled() { return _enabled; }
+
+    /* 预热和测量的总帧数 */
+    [[nodiscard]] static int frames();
+
+    /* 场景初始化之后调用：spin 需要摄像机的初始姿态 */
+    static void start(const Camera &camera);
+
+    /* 第 frame 帧摄像机的姿态，只读取路径，可以在模拟线程中调用 */
+    static void pose(int frame, Camera &camera);
+
+    /* 帧的开始：开始计时；在清空缓冲之前调用 */
+    static void frame_begin(int frame);
+
+    /* 帧的结束：在交换缓冲之后调用 */
+    static void frame_end();
+
+    /* 读取 GPU 查询的结果，输出报告 */
+    static void report();
+
+    [[nodiscard]] static inline const std::vector<BenchFrame> &records() { return _records; }
+
+private:
+    /* 一组数据的统计，nearest-rank 百分位 */
+    struct Summary {
+        double mean, p50, p95, p99, max;
+    };
+
+    static Summary _summary(std::vector<double> values);
+
+    /* 第 frame 帧在测量阶段中的序号，-1 表示预热阶段或者已经结束 */
+    static int _measured_index(int frame);
+
+    static void _json_save(const std::string &path);
+
+    static void _csv_save(const std::string &path);
+
+private:
+    inline static bool _enabled{false};
+    inline static BenchOptions _options{};
+    inline static std::string _name;
+    inline static double _timestep{1.0 / 60.0};
+    inline static CameraPath _path;
+    inline static int _measured{0};
+
+    /* 当前帧，-1 表示预热阶段 */
+    inline static int _current{-1};
+    inline static std::chrono::steady_clock::time_point _begin;
+
+    /* 每一个测量的帧一个查询 */
+    inline static std::vector<GLuint> _queries;
+    inline static std::vector<BenchFrame> _records;
+};
+
+
+#endif //RENDER_ENGINE_RENDER_BENCH_H
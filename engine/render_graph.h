@@ -0,0 +1,215 @@
+/**
+ * 渲染图：每一帧声明要执行的 pass，以及每个 pass 读写哪些纹理，由渲染图决定执行的顺序和纹理的分配
+ *  - 剔除：从写入屏幕，写入导入的纹理，或者标记了 side_effect() 的 pass 开始，向前查找它们读取的纹理由哪些 pass 写入，
+ *    其余的 pass 不执行
+ *  - 排序：写入某个纹理的 pass 排在读取它的 pass 之前，写入同一个纹理的 pass 保持声明的顺序，其余保持声明的顺序
+ *  - 临时纹理：create() 声明的纹理只在这一帧内有效，生存期是第一个到最后一个使用它的 pass；
+ *    生存期不重叠，尺寸和格式相同的临时纹理共用同一个物理纹理（OpenGL 不能让不同的纹理共用一块显存，只能复用相同规格的纹理）
+ *  - 物理纹理和帧缓冲对象保存在渲染图中，跨帧复用；POOL_FRAMES 帧没有使用的纹理被删除
+ *  - 每个 pass 执行之前绑定它写入的纹理组成的帧缓冲，设置视口，按照声明清空；执行时有同名的 CPU 和 GPU 分析区段
+ * pass 的名字必须是静态的字符串（分析器只保存指针）
+ * @example
+ *  graph.reset();
+ *  GraphTexture color, depth;
+ *  graph.add_pass("scene", [&](RenderGraph::Builder &builder) {
+ *      color = builder.write(builder.create("scene color", {GL_RGBA16F}), true);
+ *      depth = builder.write(builder.create("scene depth", {GL_DEPTH24_STENCIL8}), true);
+ *  }, [&](const RenderGraph::Resources &) { draw_scene(); });
+ *  graph.add_pass("tone map", [&](RenderGraph::Builder &builder) {
+ *      builder.read(color);
+ *      builder.write(graph.backbuffer());
+ *  }, [&](const RenderGraph::Resources &resources) { tone_map(resources.texture(color)); });
+ *  graph.execute(DynamicResolution::width(), DynamicResolution::height());
+ */
+#ifndef RENDER_ENGINE_RENDER_GRAPH_H
+#define RENDER_ENGINE_RENDER_GRAPH_H
+
+#include <map>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+#include <functional>
+
+#include <glad/glad.h>
+
+
+/* 渲染图中的纹理，只在声明它的这一帧有效 */
+struct GraphTexture {
+    uint32_t index{UINT32_MAX};
+
+    [[nodiscard]] inline bool valid() const { return index != UINT32_MAX; }
+};
+
+
+/* 纹理的规格 */
+struct GraphTextureDesc {
+    GLenum format{GL_RGBA8};            // 内部格式，比如 GL_RGBA16F，GL_DEPTH24_STENCIL8
+    int width{0}, height{0};            // 0 表示按照渲染图的尺寸乘以 scale
+    float scale{1.f};
+};
+
+
+class RenderGraph {
+public:
+    /* 物理纹理多少帧没有使用之后删除 */
+    static constexpr uint64_t POOL_FRAMES = 120;
+
+    /* 声明 pass 读写的纹理，只能在 add_pass() 的 setup 中使用 */
+    class Builder {
+    public:
+        /* 声明一个临时纹理 */
+        GraphTexture create(const char *name, const GraphTextureDesc &desc);
+
+        /* 读取纹理：写入它的 pass 会排在这个 pass 之前 */
+        GraphTexture read(GraphTexture texture);
+
+        /**
+         * 写入纹理，作为帧缓冲的附件：颜色纹理按照声明的顺序是 0，1，2 ... 号颜色附件，深度纹理是深度附件
+         * @param clear 执行之前清空：颜色是 0，深度是 1
+         */
+        GraphTexture write(GraphTexture texture, bool clear = false);
+
+        /* 这个 pass 有纹理以外的输出（比如写入缓冲），不会被剔除 */
+        void side_effect();
+
+    private:
+        friend class RenderGraph;
+
+        Builder(RenderGraph &graph, uint32_t pass) : _graph(graph), _pass(pass) {}
+
+        RenderGraph &_graph;
+        uint32_t _pass;
+    };
+
+    /* pass 执行时访问纹理 */
+    class Resources {
+    public:
+        /* 纹理的 OpenGL 对象，只能访问这个 pass 声明过的纹理 */
+        [[nodiscard]] GLuint texture(GraphTexture texture) const;
+
+        /* 这个 pass 的视口 */
+        [[nodiscard]] inline int width() const { return _width; }
+
+        [[nodiscard]] inline int height() const { return _height; }
+
+    private:
+        friend class RenderGraph;
+
+        Resources(const RenderGraph &graph, uint32_t pass, int width, int height)
+                : _graph(graph), _pass(pass), _width(width), _height(height) {}
+
+        const RenderGraph &_graph;
+        uint32_t _pass;
+        int _width, _height;
+    };
+
+    using Setup = std::function<void(Builder &)>;
+    using Execute = std::function<void(const Resources &)>;
+
+    /* 最近一次 execute() 的统计 */
+    struct Stats {
+        size_t passes;
+        size_t culled;
+        size_t textures;                // 临时纹理的数量
+        size_t physical;                // 这一帧使用的物理纹理的数量
+        size_t pooled;                  // 渲染图持有的物理纹理的数量
+        size_t texture_bytes;           // 不复用时临时纹理需要的显存
+        size_t physical_bytes;          // 这一帧使用的物理纹理的显存
+    };
+
+    RenderGraph() = default;
+
+    RenderGraph(const RenderGraph &) = delete;
+
+    RenderGraph &operator=(const RenderGraph &) = delete;
+
+    /* 删除物理纹理和帧缓冲，需要在上下文销毁之前析构 */
+    ~RenderGraph();
+
+    /* 开始声明新的一帧，清除上一帧的 pass 和纹理，物理纹理保留 */
+    void reset();
+
+    /* 导入外部的纹理，比如预计算的贴图；写入导入纹理的 pass 不会被剔除 */
+    GraphTexture import(const char *name, GLuint texture, const GraphTextureDesc &desc);
+
+    /* 屏幕（FrameBuffer::screen()），写入屏幕的 pass 不会被剔除 */
+    GraphTexture backbuffer();
+
+    void add_pass(const char *name, const Setup &setup, Execute execute);
+
+    /**
+     * 剔除，排序，分配临时纹理，然后依次执行；结束时绑定屏幕的帧缓冲
+     * @param width, height 渲染图的尺寸，相对尺寸的纹理和屏幕按照这个尺寸
+     */
+    void execute(int width, int height);
+
+    [[nodiscard]] inline const Stats &stats() const { return _stats; }
+
+    /* 渲染图的 ImGui 窗口：pass 的顺序，耗时，是否被剔除，纹理对应的物理纹理 */
+    void gui(const char *title) const;
+
+private:
+    struct Resource {
+        const char *name;
+        GraphTextureDesc desc;
+        bool imported;
+        bool backbuffer;
+        GLuint texture;                 // 导入的纹理，或者分配的物理纹理
+        int width, height;              // 实际的尺寸
+        std::vector<uint32_t> writers;  // 写入它的 pass，按照声明的顺序
+        int first, last;                // 使用它的第一个和最后一个 pass 在执行顺序中的位置
+        int physical;                   // 物理纹理在 _pool 中的下标
+    };
+
+    struct Attachment {
+        uint32_t resource;
+        bool clear;
+    };
+
+    struct Pass {
+        const char *name;
+        Execute execute;
+        std::vector<uint32_t> reads;
+        std::vector<Attachment> writes;
+        bool side_effect;
+        bool alive;
+        double cpu_ms;
+    };
+
+    struct Physical {
+        GLuint texture;
+        GLenum format;
+        int width, height;
+        int busy_until;                 // 这一帧被占用到执行顺序中的哪个位置，-1 表示空闲
+        uint64_t last_frame;            // 最近一次使用的帧
+    };
+
+    /* 剔除，排序，计算临时纹理的生存期 */
+    void _compile();
+
+    /* 为临时纹理分配物理纹理 */
+    void _allocate();
+
+    /* 绑定 pass 写入的纹理组成的帧缓冲，返回视口的尺寸 */
+    std::pair<int, int> _bind(const Pass &pass);
+
+    /* 删除长时间没有使用的物理纹理，以及引用它们的帧缓冲 */
+    void _trim();
+
+    [[nodiscard]] bool _declared(uint32_t pass, uint32_t resource) const;
+
+private:
+    std::vector<Pass> _passes;
+    std::vector<Resource> _resources;
+    std::vector<uint32_t> _order;               // 执行的顺序，只包括没有被剔除的 pass
+    int _width{0}, _height{0};
+
+    std::vector<Physical> _pool;
+    std::map<std::vector<GLuint>, GLuint> _fbos;        // 附件（颜色附件依次，最后是深度附件）-> 帧缓冲
+    uint64_t _frame{0};
+
+    Stats _stats{0, 0, 0, 0, 0, 0, 0};
+};
+
+
+#endif //RENDER_ENGINE_RENDER_GRAPH_H
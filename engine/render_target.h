@@ -0,0 +1,181 @@
+/**
+ * 渲染目标池：离屏的帧缓冲按照规格（尺寸，颜色和深度的格式，多重采样数）借出和归还，跨帧复用
+ *  - acquire() 借出规格相同的空闲渲染目标，没有时创建；release() 归还，之后规格相同的 acquire() 直接复用，
+ *    不需要每次重新创建帧缓冲和附件；通常用 RenderTargetLease 在离开作用域时归还
+ *  - 尺寸为 0 的规格表示窗口的尺寸乘以 scale：窗口大小改变时（Window::resize_listen），借出的渲染目标就地重新分配存储，
+ *    帧缓冲和附件的 id 不变；空闲的直接删除
+ *  - 空闲超过 POOL_FRAMES 帧的渲染目标在 frame_end() 中删除
+ *  - 使用者可以临时替换颜色附件（比如立方体贴图的面），归还时恢复成渲染目标自己的附件
+ * @example
+ *  RenderTargetLease target({512, 512, 1.f, 0, GL_DEPTH_COMPONENT24});
+ *  with(RenderTarget, *target) {
+ *      glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_CUBE_MAP_POSITIVE_X, cube_map, 0);
+ *      ...
+ *  }
+ */
+#ifndef RENDER_ENGINE_RENDER_TARGET_H
+#define RENDER_ENGINE_RENDER_TARGET_H
+
+#include <map>
+#include <memory>
+#include <cstdint>
+#include <cstddef>
+
+#include <glad/glad.h>
+
+#include "utils/with.h"
+
+
+/* 渲染目标的规格，也是渲染目标池查找的键 */
+struct RenderTargetDesc {
+    int width{0}, height{0};                    // 0 表示窗口的尺寸乘以 scale
+    float scale{1.f};
+    GLenum color{GL_RGBA8};                     // 颜色附件的内部格式，0 表示没有（由使用者挂上自己的纹理）
+    GLenum depth{GL_DEPTH24_STENCIL8};          // 深度附件的内部格式，0 表示没有
+    int samples{0};                             // 多重采样数，0 表示不使用多重采样
+
+    /* 尺寸跟随窗口 */
+    [[nodiscard]] inline bool relative() const { return width <= 0 || height <= 0; }
+
+    bool operator<(const RenderTargetDesc &other) const;
+};
+
+
+/**
+ * 帧缓冲及其附件，析构时删除
+ * 不使用多重采样时附件是纹理，可以采样；使用多重采样时附件是渲染缓冲对象，需要 blit() 到普通的渲染目标
+ */
+class RenderTarget : public With {
+public:
+    /* 相对尺寸的规格按照当前窗口的尺寸创建 */
+    explicit RenderTarget(const RenderTargetDesc &desc);
+
+    RenderTarget(const RenderTarget &) = delete;
+
+    RenderTarget &operator=(const RenderTarget &) = delete;
+
+    /* 删除帧缓冲对象及附件，需要在上下文销毁之前析构 */
+    ~RenderTarget() override;
+
+    /* 重新分配附件的存储，对象的 id 不变 */
+    void resize(int width, int height);
+
+    /* 将颜色和深度复制到 target，用于解析多重采样 */
+    void blit(const RenderTarget &target) const;
+
+    [[nodiscard]] inline GLuint id() const { return _frame_buffer; }
+
+    [[nodiscard]] inline GLuint color() const { return _color; }
+
+    [[nodiscard]] inline GLuint depth() const { return _depth; }
+
+    [[nodiscard]] inline int width() const { return _width; }
+
+    [[nodiscard]] inline int height() const { return _height; }
+
+    [[nodiscard]] inline const RenderTargetDesc &desc() const { return _desc; }
+
+    /* 附件占用的显存 */
+    [[nodiscard]] size_t bytes() const;
+
+    void in() override;
+
+    /* 回到屏幕的帧缓冲，见 FrameBuffer::screen() */
+    void out() override;
+
+private:
+    friend class RenderTargetPool;
+
+    /* 按照当前的尺寸分配附件的存储 */
+    void _storage();
+
+    /* 恢复成自己的附件 */
+    void _attachments_reset();
+
+private:
+    RenderTargetDesc _desc;
+    int _width, _height;
+
+    GLuint _frame_buffer{0};
+    GLuint _color{0};
+    GLuint _depth{0};
+
+    bool _busy{false};
+    uint64_t _last_frame{0};            // 最近一次归还的帧
+};
+
+
+class RenderTargetPool {
+public:
+    /* 空闲的渲染目标多少帧没有使用之后删除 */
+    static constexpr uint64_t POOL_FRAMES = 120;
+
+    struct Stats {
+        size_t targets;
+        size_t busy;
+        size_t bytes;
+        uint64_t created;               // 累计创建的次数
+        uint64_t reused;                // 累计复用的次数
+    };
+
+    /* 监听窗口的大小 */
+    static void init();
+
+    /* 删除所有的渲染目标，需要在上下文销毁之前调用，此时不能有借出的渲染目标 */
+    static void terminate();
+
+    /* 借出一个规格相同的空闲渲染目标，没有时创建 */
+    static RenderTarget &acquire(const RenderTargetDesc &desc);
+
+    /* 归还借出的渲染目标 */
+    static void release(RenderTarget &target);
+
+    /* 每一帧结束时调用：删除长时间空闲的渲染目标 */
+    static void frame_end();
+
+    [[nodiscard]] static Stats stats();
+
+    /* 渲染目标池的 ImGui 窗口 */
+    static void gui();
+
+private:
+    /* 窗口大小改变：借出的相对尺寸的渲染目标重新分配，空闲的删除 */
+    static void _resize(int width, int height);
+
+    RenderTargetPool() = default;
+
+private:
+    inline static std::multimap<RenderTargetDesc, std::unique_ptr<RenderTarget>> _targets{};
+    inline static uint64_t _frame{0};
+    inline static uint64_t _created{0};
+    inline static uint64_t _reused{0};
+    inline static bool _listening{false};
+};
+
+
+/* 在作用域内借出渲染目标，析构时归还 */
+class RenderTargetLease {
+public:
+    explicit RenderTargetLease(const RenderTargetDesc &desc) : _target(&RenderTargetPool::acquire(desc)) {}
+
+    RenderTargetLease(RenderTargetLease &&other) noexcept: _target(other._target) { other._target = nullptr; }
+
+    RenderTargetLease(const RenderTargetLease &) = delete;
+
+    RenderTargetLease &operator=(const RenderTargetLease &) = delete;
+
+    ~RenderTargetLease() {
+        if (_target != nullptr)
+            RenderTargetPool::release(*_target);
+    }
+
+    inline RenderTarget &operator*() const { return *_target; }
+
+    inline RenderTarget *operator->() const { return _target; }
+
+private:
+    RenderTarget *_target;
+};
+
+
+#endif //RENDER_ENGINE_RENDER_TARGET_H
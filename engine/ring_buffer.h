@@ -0,0 +1,100 @@
+/**
+ * 流式的环形缓冲，用于每帧都会改变的数据：model 矩阵，材质参数块，实例数据等
+ * 支持 ARB_buffer_storage 时，buffer 被持久映射，分配就是指针的移动；
+ * 否则退化为三缓冲 + 无同步的 glMapBufferRange
+ * 每一帧使用 buffer 中的一个区段，通过 fence 确保 GPU 已经用完该区段后才会再次写入
+ */
+#ifndef RENDER_ENGINE_RING_BUFFER_H
+#define RENDER_ENGINE_RING_BUFFER_H
+
+#include <array>
+#include <cstring>
+
+#include <glad/glad.h>
+
+
+/* 从 RingBuffer 中分配的一段内存 */
+struct RingAlloc {
+    void *ptr{nullptr};         // 可以写入的地址，只在 commit 之前有效
+    GLuint buffer{0};           // 所在的 buffer 对象
+    GLintptr offset{0};         // 在 buffer 中的偏移，用于 glBindBufferRange，glVertexAttribPointer 等
+    GLsizeiptr size{0};
+};
+
+
+class RingBuffer {
+public:
+    /* 同时使用的帧数：CPU 写一帧，驱动和 GPU 还持有前两帧 */
+    static const int FRAME_CNT = 3;
+
+    /**
+     * @param target buffer 的类型，比如 GL_UNIFORM_BUFFER，GL_ARRAY_BUFFER
+     * @param frame_size 每一帧最多可以分配的字节数，buffer 的总大小是 FRAME_CNT 倍
+     */
+    RingBuffer(GLenum target, GLsizeiptr frame_size);
+
+    ~RingBuffer();
+
+    RingBuffer(const RingBuffer &) = delete;
+
+    RingBuffer &operator=(const RingBuffer &) = delete;
+
+    /* 开始新的一帧：切换到下一个区段，如果 GPU 还在使用这个区段，就等待 */
+    void frame_begin();
+
+    /* 结束这一帧：为当前区段插入 fence */
+    void frame_end();
+
+    /**
+     * 在当前帧的区段中分配一段内存，写入完成后需要调用 commit
+     * @param alignment 偏移的对齐要求，uniform buffer 需要使用 uniform_alignment()
+     */
+    RingAlloc alloc(GLsizeiptr size, GLsizeiptr alignment = 16);
+
+    /* 写入完成，之后就可以在绘制中使用这段内存 */
+    void commit(const RingAlloc &allocation);
+
+    /* 分配一段内存并复制数据 */
+    inline RingAlloc write(const void *data, GLsizeiptr size, GLsizeiptr alignment = 16) {
+        RingAlloc allocation = alloc(size, alignment);
+        std::memcpy(allocation.ptr, data, (size_t) size);
+        commit(allocation);
+        return allocation;
+    }
+
+    // =====================================================
+    // 属性
+    // =====================================================
+
+    [[nodiscard]] inline GLuint id() const { return _id; }
+
+    /* 是否使用了持久映射 */
+    [[nodiscard]] inline bool persistent() const { return _persistent; }
+
+    /* 当前帧已经分配了多少字节 */
+    [[nodiscard]] inline GLsizeiptr frame_used() const { return _frame_used; }
+
+    [[nodiscard]] inline GLsizeiptr frame_size() const { return _frame_size; }
+
+    /* uniform buffer 偏移的对齐要求 */
+    static GLsizeiptr uniform_alignment();
+
+private:
+    GLenum _target;
+    GLuint _id{0};
+    GLsizeiptr _frame_size;
+    bool _persistent{false};
+
+    /* 持久映射时，整个 buffer 的起始地址 */
+    unsigned char *_mapped{nullptr};
+
+    /* 当前帧使用的区段，以及区段中已经分配的字节数 */
+    int _frame_idx{0};
+    GLsizeiptr _frame_used{0};
+
+    /* 每个区段最后一次使用时插入的 fence */
+    std::array<GLsync, FRAME_CNT> _fences{};
+};
+
+
+#endif //RENDER_ENGINE_RING_BUFFER_H
@@ -14,6 +14,11 @@
 
 #include "camera.h"
 #include "window.h"
+#include "profiler.h"
+#include "frame_pipeline.h"
+#include "frame_timer.h"
+#include "dynamic_resolution.h"
+#include "render_target.h"
 
 
 class Scene {
@@ -21,26 +26,70 @@ private:
     /* 场景自定义的初始化 */
     virtual void _init() = 0;
 
-    /* 场景自定义的更新 */
+    /* 场景自定义的更新：在渲染线程中绘制，可以通过 Render::snapshot() 读取这一帧模拟的结果 */
     virtual void _update() = 0;
 
+    /**
+     * 场景自定义的模拟：在模拟线程中执行（见 FramePipeline），结果写入 snapshot，之后由 _update() 读取
+     * 不能调用 OpenGL，glfw 和 ImGui，也不能读取 Render::time() 等渲染线程的状态，应该使用 snapshot 中的值；
+     * 和 _update() 同时执行，读取 GUI 修改的成员时需要同步
+     */
+    virtual void _simulate(FrameSnapshot &) {}
+
     virtual void _gui() {}
 
+protected:
+    /**
+     * 是否绘制引擎的调试窗口（profiler，frame pipeline，frame pacing，dynamic resolution，render targets）
+     * 默认不绘制；场景可以在 _init() 中打开，运行时按 F1 切换，也可以用命令行参数 --debug-gui 打开
+     */
+    bool _debug_gui{false};
+
 public:
     void init() {
         /* 执行场景自定义的初始化操作 */
         this->_init();
     }
 
-    void update() {
-        /* 场景更新以及绘制 */
-        this->_update();
+    void debug_gui_set(bool show) { _debug_gui = show; }
+
+    /* 模拟一帧，在模拟线程中调用 */
+    void simulate(FrameSnapshot &snapshot) {
+        PROFILE_ZONE("scene simulate");
+        this->_simulate(snapshot);
+    }
+
+    /* @param gui 是否绘制 GUI，离屏模式没有 ImGui */
+    void update(bool gui = true) {
+        /* 场景更新以及绘制；开启动态分辨率时绘制到缩放的离屏缓冲 */
+        {
+            PROFILE_ZONE("scene update");
+            PROFILE_GPU_ZONE("scene");
+            DynamicResolution::begin();
+            this->_update();
+        }
+
+        /* 放大到屏幕，ImGui 按照屏幕的分辨率绘制 */
+        DynamicResolution::resolve();
+        if (!gui)
+            return;
 
-        /* ImGui 绘制 */
+        /* ImGui 绘制；引擎的调试窗口按 F1 切换 */
+        PROFILE_ZONE("imgui");
+        PROFILE_GPU_ZONE("imgui");
         ImGui_ImplOpenGL3_NewFrame();
         ImGui_ImplGlfw_NewFrame();
         ImGui::NewFrame();
+        if (ImGui::IsKeyPressed(GLFW_KEY_F1, false))
+            _debug_gui = !_debug_gui;
         this->_gui();
+        if (_debug_gui) {
+            Profiler::gui();
+            FramePipeline::gui();
+            FrameTimer::gui();
+            DynamicResolution::gui();
+            RenderTargetPool::gui();
+        }
         ImGui::Render();
         ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
     }
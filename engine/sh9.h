@@ -0,0 +1,58 @@
+/**
+ * 3 阶（9 个系数）的实球谐函数，用于漫反射的环境光：
+ *  - 将等距柱状投影的 HDR，或者立方体贴图投影到 SH9，按照每个像素的立体角加权
+ *  - 投影按行分给多个线程；每一行的像素以 LANES 个为一组，每一组的每个系数有独立的累加器，可以被编译器向量化
+ *  - 与余弦核卷积之后，在 shader 中对法线求值就得到辐照度，代替对半球积分的辐照度图
+ * 方向和 hdr2cube.frag 一致：y 轴向上，phi = atan(z, x)
+ */
+#ifndef RENDER_ENGINE_SH9_H
+#define RENDER_ENGINE_SH9_H
+
+#include <array>
+#include <string>
+
+#include <glm/glm.hpp>
+
+#include "env_cache.h"
+
+
+struct SH9 {
+    /* 系数的顺序：(0,0), (1,-1), (1,0), (1,1), (2,-2), (2,-1), (2,0), (2,1), (2,2) */
+    std::array<glm::vec3, 9> coeffs{};
+
+    /* 在单位向量 dir 的方向上求值 */
+    [[nodiscard]] glm::vec3 eval(const glm::vec3 &dir) const;
+};
+
+/* 与参考结果的误差，按亮度的相对误差统计 */
+struct SH9Error {
+    double rms{0.0};
+    double max{0.0};
+};
+
+
+/**
+ * 投影等距柱状投影的 HDR
+ * @param rgb 像素的布局和 TextureHDR 一致：已经垂直翻转，第 0 行是图像的底部
+ * @param channels 3 或 4，只使用前 3 个通道
+ * @param threads 0 表示硬件线程数
+ */
+SH9 sh9_project_equirect(const float *rgb, int width, int height, int channels = 3, unsigned threads = 0);
+
+/* 从文件载入 HDR（和 TextureHDR 一样垂直翻转），再投影 */
+SH9 sh9_project_equirect_file(const std::string &path, unsigned threads = 0);
+
+/* 投影立方体贴图的第 0 级，面和纹素的方向和 OpenGL 的立方体贴图采样一致 */
+SH9 sh9_project_cube(const EnvCubeData &cube, unsigned threads = 0);
+
+/**
+ * 辐射度的系数与余弦核卷积，再除以 π，结果和 convolution_env.frag 生成的辐照度图一致
+ * 也就是说，在 shader 中对法线求值可以直接代替 texture(cubemap_env, N)
+ */
+SH9 sh9_irradiance(const SH9 &radiance);
+
+/* 与立方体贴图（比如 convolution_env.frag 生成的辐照度图）的第 0 级比较 */
+SH9Error sh9_compare(const SH9 &sh, const EnvCubeData &reference, unsigned threads = 0);
+
+
+#endif //RENDER_ENGINE_SH9_H
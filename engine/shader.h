@@ -17,6 +17,7 @@
 #include "model.h"
 #include "global.h"
 #include "texture.h"
+#include "texture_stream.h"
 #include "utils/with.h"
 
 
@@ -27,6 +28,13 @@ public:
     Shader(const std::string &vertex, const std::string &fragment, const std::vector<std::string> &macros = {},
            const std::string &geometry = "");
 
+    /**
+     * 从源码创建，用于引擎内置的着色器：引擎不知道 shader 文件放在哪里
+     * @param vertex, fragment 着色器的源码
+     */
+    static std::shared_ptr<Shader> from_source(const std::string &vertex, const std::string &fragment,
+                                               const std::vector<std::string> &macros = {});
+
 
     // =====================================================
     // 设置 shader 的某个 uniform 变量
@@ -53,11 +61,22 @@ public:
         glUniform1i(_uniform_location_get(name), value);
     }
 
+    inline void uniform_vec2_set(const std::string &name, const glm::vec2 &v) {
+        glUseProgram(id);
+        glUniform2f(_uniform_location_get(name), v.x, v.y);
+    }
+
     inline void uniform_vec3_set(const std::string &name, const glm::vec3 &v) {
         glUseProgram(id);
         glUniform3f(_uniform_location_get(name), v.x, v.y, v.z);
     }
 
+    /* 设置 vec3 数组，比如 uniform vec3 name[count] */
+    inline void uniform_vec3_array_set(const std::string &name, const glm::vec3 *v, GLsizei count) {
+        glUseProgram(id);
+        glUniform3fv(_uniform_location_get(name), count, glm::value_ptr(v[0]));
+    }
+
     inline void uniform_mat4_set(const std::string &name, const glm::mat4 &m) {
         glUseProgram(id);
         glUniformMatrix4fv(_uniform_location_get(name), 1, GL_FALSE, glm::value_ptr(m));
@@ -110,9 +129,36 @@ public:
         glUseProgram(id);
         const auto &draw_func = (func == nullptr) ? _method_draw_mesh : func;
         draw_func(*this, mesh);
+        TextureStreamer::mesh_draw(mesh, mesh.model());
         mesh.draw();
     }
 
+    /**
+     * 使用模版参数指定的绑定函数绘制 Mesh，绑定函数可以被内联到绘制中
+     * @param bind 可调用对象，签名为 void(Shader &, const Mesh &)
+     */
+    template<class Func>
+    inline void draw_inline(const Mesh &mesh, Func &&bind, GLsizei amount = 1) {
+        glUseProgram(id);
+        bind(*this, mesh);
+        TextureStreamer::mesh_draw(mesh, mesh.model(), amount);
+        mesh.draw(amount);
+    }
+
+    /**
+     * 使用模版参数指定的绑定函数绘制 Model，绑定函数可以被内联到每个 Mesh 的绘制循环中
+     * @param bind 可调用对象，签名为 void(Shader &, const Model &, const Mesh &)
+     */
+    template<class Func>
+    inline void draw_inline(const Model &model, Func &&bind, GLsizei amount = 1) {
+        glUseProgram(id);
+        for (const auto &mesh : model.meshes()) {
+            bind(*this, model, mesh);
+            TextureStreamer::mesh_draw(mesh, model.model() * mesh.model(), amount);
+            mesh.draw(amount);
+        }
+    }
+
     /* 设置绘制 Model 的方式 */
     inline void set_draw(const std::function<void(Shader &, const Model &, const Mesh &)> &func) {
         this->_method_draw_model = func;
@@ -130,6 +176,7 @@ public:
         const auto &draw_func = (func == nullptr) ? _method_draw_model : func;
         for (const auto &mesh : model.meshes()) {
             draw_func(*this, model, mesh);
+            TextureStreamer::mesh_draw(mesh, model.model() * mesh.model(), amount);
             mesh.draw(amount);
         }
     }
@@ -151,6 +198,8 @@ public:
     }
 
 protected:
+    Shader() = default;
+
     /* 链接着色器程序 */
     static GLuint _shader_link(GLuint vertex, GLuint fragment, GLuint geometry = 0);
 
@@ -163,6 +212,10 @@ protected:
     static GLuint
     _shader_compile(const std::string &file_name, GLenum shader_type, const std::vector<std::string> &macros);
 
+    /* 编译着色器的源码，在 #version 之后注入宏定义 */
+    static GLuint
+    _source_compile(const std::string &source, GLenum shader_type, const std::vector<std::string> &macros);
+
     /* 获得 shader 中 uniform 变量对应的 location */
     GLint _uniform_location_get(const std::string &name);
 
@@ -212,6 +265,7 @@ public:
     void draw_t(const Mesh &mesh, const T &t) {
         glUseProgram(id);
         _template_method_draw_mesh(*this, mesh, t);
+        TextureStreamer::mesh_draw(mesh, mesh.model());
         mesh.draw();
     }
 
@@ -219,6 +273,7 @@ public:
         glUseProgram(id);
         for (const auto &mesh : model.meshes()) {
             _template_method_draw_model(*this, model, mesh, t);
+            TextureStreamer::mesh_draw(mesh, model.model() * mesh.model());
             mesh.draw();
         }
     }
@@ -228,4 +283,45 @@ private:
     std::function<void(Shader &, const Model &, const Mesh &, const T &)> _template_method_draw_model;
 };
 
+
+/*
+ * 静态分发数据绑定的 Shader（CRTP）
+ * 派生类实现以下的一个或多个绑定方法，绘制循环在编译期就确定了要调用的函数，可以被内联，没有 std::function 的类型擦除开销：
+ *  void bind(const Mesh &mesh);
+ *  void bind(const Model &model, const Mesh &mesh);
+ * 派生类可以在构造函数中缓存 uniform 的 location，绘制时就不必再查表
+ * @example
+ *  class TexShader : public ShaderPass<TexShader> {
+ *  public:
+ *      using ShaderPass::ShaderPass;
+ *      void bind(const Model &model, const Mesh &mesh) { ... }
+ *  };
+ * */
+template<class Derived>
+class ShaderPass : public Shader {
+public:
+    ShaderPass(const std::string &vertex, const std::string &fragment, const std::vector<std::string> &macros = {},
+               const std::string &geometry = "")
+            : Shader(vertex, fragment, macros, geometry) {}
+
+    /* 使用派生类的 bind 方法绘制 Mesh */
+    inline void draw_pass(const Mesh &mesh, GLsizei amount = 1) {
+        glUseProgram(id);
+        static_cast<Derived &>(*this).bind(mesh);
+        TextureStreamer::mesh_draw(mesh, mesh.model(), amount);
+        mesh.draw(amount);
+    }
+
+    /* 使用派生类的 bind 方法绘制 Model 中的所有 Mesh */
+    inline void draw_pass(const Model &model, GLsizei amount = 1) {
+        glUseProgram(id);
+        auto &derived = static_cast<Derived &>(*this);
+        for (const auto &mesh : model.meshes()) {
+            derived.bind(model, mesh);
+            TextureStreamer::mesh_draw(mesh, model.model() * mesh.model(), amount);
+            mesh.draw(amount);
+        }
+    }
+};
+
 #endif //RENDER_SHADER_H
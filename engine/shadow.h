@@ -0,0 +1,118 @@
+/**
+ * 方向光的级联阴影（cascaded shadow maps）
+ *  - 视锥体在 [near, distance] 之间分成 2 ~ 4 段，分割的位置是对数划分和均匀划分按照 lambda 的混合，
+ *    每一段一个正交投影的阴影贴图，所有级联保存在同一个深度纹理数组中（DepthBuffer），每一层一个级联
+ *  - 每个级联包住这一段视锥体的最小包围球：正交投影的大小只和分割的位置有关，不随摄像机的旋转变化；
+ *    包围球的中心在光源空间中对齐到阴影贴图的纹素，摄像机移动时阴影贴图整数个纹素地平移，阴影的边缘不会闪烁
+ *  - 深度的范围只包住包围球，包围球和光源之间的投射物用 GL_DEPTH_CLAMP 压到近平面上，不会被裁剪
+ *  - 每个级联只绘制和它相交的投射物：投射物的包围球和级联的盒子（向光源的方向延伸到无穷远）相交
+ *  - 阴影 pass 有 CPU 和 GPU 的分析区段 "shadow map"，gui() 显示最近的耗时，以及每个级联绘制的投射物数量
+ * @example
+ *  shadow.update(*Render::camera, dir_light.direction);
+ *  shadow.render(meshes);
+ *  with(Shader, *shader) {
+ *      shadow.uniforms_set(*shader, 4);          // 阴影贴图在 4 号纹理单元
+ *      ...
+ *  }
+ * shader 中的采样见 examples/cascaded-shadow/blinn_phong.frag
+ */
+#ifndef RENDER_ENGINE_SHADOW_H
+#define RENDER_ENGINE_SHADOW_H
+
+#include <array>
+#include <memory>
+#include <vector>
+#include <cstddef>
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include "mesh.h"
+#include "camera.h"
+#include "shader.h"
+#include "frame_buffer.h"
+
+
+class CascadedShadowMap {
+public:
+    static constexpr int MIN_CASCADES = 2;
+    static constexpr int MAX_CASCADES = 4;
+
+    struct Cascade {
+        glm::mat4 view_projection{1.f};     // 世界空间到阴影贴图的裁剪空间
+        float split_near{0.f};              // 这一段视锥体在观察空间中的深度范围
+        float split_far{0.f};
+        float texel{0.f};                   // 一个纹素在世界空间中的长度
+        size_t casters{0};                  // 最近一次绘制的投射物数量
+
+        glm::vec3 center{0.f};              // 包围球的中心，光源空间，已经对齐到纹素
+        float radius{0.f};
+    };
+
+    /**
+     * 创建深度纹理数组和绘制深度的着色器
+     * @param resolution 每个级联的阴影贴图的尺寸
+     * @param distance 阴影的最远距离（观察空间中的深度），不超过摄像机的远平面
+     */
+    explicit CascadedShadowMap(GLuint resolution = 2048, int cascades = 4, float distance = 40.f);
+
+    CascadedShadowMap(const CascadedShadowMap &) = delete;
+
+    CascadedShadowMap &operator=(const CascadedShadowMap &) = delete;
+
+    /* 删除着色器，深度缓冲在析构时删除自己；需要在上下文销毁之前析构 */
+    ~CascadedShadowMap();
+
+    /* 级联的数量限制在 [MIN_CASCADES, MAX_CASCADES]，改变时重新创建深度纹理数组 */
+    void cascades_set(int cascades);
+
+    [[nodiscard]] inline int cascades() const { return _cascade_count; }
+
+    /* 根据摄像机的视锥体和光源的方向（光线前进的方向）计算每个级联的投影，每一帧绘制之前调用 */
+    void update(Camera &camera, const glm::vec3 &light_direction);
+
+    /* 绘制所有级联的阴影贴图，只使用 mesh 的位置属性；结束时回到屏幕的帧缓冲，恢复视口 */
+    void render(const std::vector<std::shared_ptr<Mesh>> &casters);
+
+    /**
+     * 设置 shader 中阴影的 uniform，并将深度纹理数组绑定到 texture_unit
+     * uniform：shadow_map（sampler2DArrayShadow），shadow_cascades，shadow_splits（每个级联的远端），
+     *  shadow_texels（每个级联一个纹素的世界空间长度，用于法线方向的偏移），shadow_matrices[i]
+     */
+    void uniforms_set(Shader &shader, GLint texture_unit) const;
+
+    [[nodiscard]] inline const Cascade &cascade(int index) const { return _cascades[index]; }
+
+    [[nodiscard]] inline GLuint texture() const { return _depth->texture(); }
+
+    /* 阴影的 ImGui 窗口：级联的数量，分割的参数，每个级联的范围和投射物数量，阴影 pass 的耗时 */
+    void gui(const char *title = "shadow");
+
+private:
+    /* 投射物的包围球是否和级联相交，center 和 radius 都在光源空间中 */
+    [[nodiscard]] static bool _intersects(const Cascade &cascade, const glm::vec3 &center, float radius);
+
+    /* 最近一次 GPU 结果可用的帧中阴影 pass 的耗时，没有时返回负数 */
+    [[nodiscard]] static double _gpu_ms_latest();
+
+private:
+    GLuint _resolution;
+    int _cascade_count;
+    float _distance;
+    float _lambda{0.75f};                   // 1 是对数划分，0 是均匀划分
+
+    /* 绘制深度时的偏移，glPolygonOffset() 的参数 */
+    float _bias_slope{2.f};
+    float _bias_constant{2.f};
+
+    std::unique_ptr<DepthBuffer> _depth;
+    std::shared_ptr<Shader> _shader;
+
+    glm::mat4 _light_view{1.f};             // 世界空间到光源空间，原点固定，只和光源的方向有关
+    std::array<Cascade, MAX_CASCADES> _cascades{};
+
+    double _cpu_ms{0.0};
+};
+
+
+#endif //RENDER_ENGINE_SHADOW_H
@@ -12,6 +12,12 @@ glm::mat4 Camera::view_matrix_get() {
 }
 
 
+void Camera::aspect_set(float aspect) {
+    _aspect = aspect;
+    _projection = glm::perspective(glm::radians(_fov), _aspect, _z_near, _z_far);
+}
+
+
 void Camera::translate(TransDirection direction, float distance) {
     // 当前摄像机的右边是哪个方向
     glm::vec3 cur_right = glm::normalize(glm::cross(this->_direction.front, GLOBAL_Y));
@@ -46,3 +52,9 @@ void Camera::rotate(float delta_yaw, float delta_pitch) {
     else if (this->_direction.pitch > 89.f)
         this->_direction.pitch = 89.f;
 }
+
+void Camera::pose_set(const glm::vec3 &position, float yaw, float pitch) {
+    this->_position = position;
+    this->_direction.yaw = yaw;
+    this->_direction.pitch = glm::clamp(pitch, -89.f, 89.f);
+}
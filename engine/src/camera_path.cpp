@@ -0,0 +1,78 @@
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <algorithm>
+
+#include <fmt/format.h>
+
+#include "camera_path.h"
+
+
+CameraPath CameraPath::load(const std::string &path) {
+    std::ifstream file(path);
+    if (!file)
+        throw std::runtime_error(fmt::format("fail to open camera path: {}", path));
+
+    CameraPath result;
+    std::string line;
+    for (int line_no = 1; std::getline(file, line); ++line_no) {
+        size_t begin = line.find_first_not_of(" \t\r");
+        if (begin == std::string::npos || line[begin] == '#')
+            continue;
+
+        std::istringstream stream(line);
+        CameraKey key;
+        if (!(stream >> key.time >> key.position.x >> key.position.y >> key.position.z >> key.yaw >> key.pitch))
+            throw std::runtime_error(fmt::format("bad camera key: {}:{}", path, line_no));
+        if (!result._keys.empty() && key.time < result._keys.back().time)
+            throw std::runtime_error(fmt::format("camera keys are not sorted by time: {}:{}", path, line_no));
+        result._keys.push_back(key);
+    }
+    if (result._keys.empty())
+        throw std::runtime_error(fmt::format("empty camera path: {}", path));
+    return result;
+}
+
+CameraPath CameraPath::spin(const Camera &camera, double seconds) {
+    /* 每 1/4 圈一个关键帧，线性插值时是匀速转动 */
+    CameraPath result;
+    for (int i = 0; i <= 4; ++i)
+        result._keys.push_back({seconds * i / 4.0, camera.position(), camera.yaw() + 90.f * (float) i,
+                                camera.pitch()});
+    return result;
+}
+
+void CameraPath::save(const std::string &path) const {
+    std::ofstream file(path);
+    if (!file)
+        throw std::runtime_error(fmt::format("fail to open camera path for writing: {}", path));
+
+    file << "# time x y z yaw pitch\n";
+    for (const auto &key: _keys)
+        file << fmt::format("{:.4f} {:.4f} {:.4f} {:.4f} {:.3f} {:.3f}\n", key.time, key.position.x,
+                            key.position.y, key.position.z, key.yaw, key.pitch);
+    if (!file)
+        throw std::runtime_error(fmt::format("fail to write camera path: {}", path));
+}
+
+void CameraPath::record(double time, const Camera &camera) {
+    if (!_keys.empty() && time - _keys.back().time < RECORD_INTERVAL)
+        return;
+    _keys.push_back({time, camera.position(), camera.yaw(), camera.pitch()});
+}
+
+CameraKey CameraPath::sample(double time) const {
+    if (_keys.empty())
+        return {};
+    if (time <= _keys.front().time)
+        return _keys.front();
+    if (time >= _keys.back().time)
+        return _keys.back();
+
+    /* 第一个时间大于 time 的关键帧，前面一定还有一个关键帧 */
+    auto next = std::upper_bound(_keys.begin(), _keys.end(), time,
+                                 [](double t, const CameraKey &key) { return t < key.time; });
+    const CameraKey &a = *(next - 1), &b = *next;
+    const auto t = (float) ((time - a.time) / std::max(b.time - a.time, 1e-9));
+    return {time, glm::mix(a.position, b.position, t), glm::mix(a.yaw, b.yaw, t), glm::mix(a.pitch, b.pitch, t)};
+}
@@ -0,0 +1,133 @@
+#include <queue>
+#include <atomic>
+#include <chrono>
+#include <algorithm>
+
+#include <fmt/format.h>
+#include <spdlog/spdlog.h>
+#include <glm/gtc/type_ptr.hpp>
+
+#include "profiler.h"
+#include "command_list.h"
+#include "texture_stream.h"
+#include "utils/parallel.h"
+
+
+void CommandList::sort(size_t sorted) {
+    auto by_key = [](const DrawPacket &a, const DrawPacket &b) { return a.key < b.key; };
+    auto middle = _packets.begin() + (long) std::min(sorted, _packets.size());
+    std::sort(middle, _packets.end(), by_key);
+    std::inplace_merge(_packets.begin(), middle, _packets.end(), by_key);
+}
+
+
+// =====================================================
+// 工作线程
+// =====================================================
+
+void CommandQueue::init(unsigned threads) {
+    WorkerPool::init(threads, [](unsigned index) { Profiler::thread_name_set(fmt::format("worker {}", index)); });
+    _lists = std::vector<CommandList>(WorkerPool::threads());
+    SPDLOG_INFO("command queue: {} recording threads", _lists.size());
+}
+
+void CommandQueue::terminate() {
+    WorkerPool::terminate();
+    _lists = std::vector<CommandList>(1);
+}
+
+
+// =====================================================
+// 录制和提交
+// =====================================================
+
+void CommandQueue::record(size_t count, const std::function<void(CommandList &, size_t, size_t)> &func,
+                          unsigned threads) {
+    if (count == 0)
+        return;
+    const auto begin = std::chrono::steady_clock::now();
+
+    /* 分块比线程少时，多余的线程不必唤醒 */
+    const size_t chunks = (count + CHUNK - 1) / CHUNK;
+    if (threads == 0 || threads > CommandQueue::threads())
+        threads = CommandQueue::threads();
+    threads = (unsigned) std::min<size_t>(threads, chunks);
+
+    /* 每个线程领取分块，录制到自己的 CommandList 中，结束后将新录制的命令排序 */
+    std::atomic<size_t> next{0};
+    std::atomic<bool> failed{false};
+    WorkerPool::run(threads, [&](unsigned slot) {
+        PROFILE_ZONE("command record");
+        auto &list = _lists[slot];
+        const size_t sorted = list.size();
+        for (size_t chunk = next++; chunk * CHUNK < count && !failed; chunk = next++) {
+            try {
+                func(list, chunk * CHUNK, std::min(count, (chunk + 1) * CHUNK));
+            } catch (...) {
+                failed = true;
+                list.sort(sorted);
+                throw;
+            }
+        }
+        list.sort(sorted);
+    });
+
+    _record_ms += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - begin).count();
+    _record_threads = std::max(_record_threads, threads);
+}
+
+void CommandQueue::submit() {
+    PROFILE_ZONE("command submit");
+    const auto begin = std::chrono::steady_clock::now();
+    Stats stats{0, 0, 0, _record_ms, 0.0, _record_threads};
+
+    /* 多路归并：堆中是每个 CommandList 下一个命令的排序键 */
+    using Head = std::pair<uint64_t, size_t>;
+    std::priority_queue<Head, std::vector<Head>, std::greater<>> heads;
+    std::vector<size_t> cursors(_lists.size(), 0);
+    for (size_t i = 0; i < _lists.size(); ++i)
+        if (_lists[i].size() > 0)
+            heads.emplace(_lists[i].packets()[0].key, i);
+
+    GLuint program = 0;
+    const Material *material = nullptr;
+    const Mesh *mesh = nullptr;
+    while (!heads.empty()) {
+        const size_t list_index = heads.top().second;
+        heads.pop();
+        const auto &list = _lists[list_index];
+        const DrawPacket &packet = list.packets()[cursors[list_index]];
+        if (++cursors[list_index] < list.size())
+            heads.emplace(list.packets()[cursors[list_index]].key, list_index);
+
+        if (packet.program != program) {
+            program = packet.program;
+            glUseProgram(program);
+            ++stats.program_changes;
+        }
+        if (packet.material != material) {
+            material = packet.material;
+            if (material != nullptr)
+                material->bind();
+            ++stats.material_changes;
+        }
+        const glm::mat4 &model = list.models()[packet.model_index];
+        if (packet.model_location != -1)
+            glUniformMatrix4fv(packet.model_location, 1, GL_FALSE, glm::value_ptr(model));
+
+        /* 连续绘制同一个 Mesh 时由近到远，只需要用第一次（最近的）估计纹理需要的级别 */
+        if (packet.mesh != mesh) {
+            mesh = packet.mesh;
+            TextureStreamer::mesh_draw(*mesh, model, packet.amount);
+        }
+        mesh->draw(packet.amount);
+        ++stats.packets;
+    }
+
+    for (auto &list: _lists)
+        list.clear();
+    _record_ms = 0.0;
+    _record_threads = 1;
+    stats.submit_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - begin).count();
+    _stats = stats;
+}
@@ -0,0 +1,244 @@
+#include <cmath>
+#include <algorithm>
+
+#include <imgui.h>
+#include <spdlog/spdlog.h>
+
+#include "mesh.h"
+#include "window.h"
+#include "profiler.h"
+#include "dynamic_resolution.h"
+
+
+/* 全屏的三角形，顶点由 gl_VertexID 生成，不需要顶点数据 */
+static const char *UPSCALE_VERT = R"(#version 330 core
+out vec2 uv;
+void main() {
+    vec2 p = vec2((gl_VertexID << 1) & 2, gl_VertexID & 2);
+    uv = p;
+    gl_Position = vec4(p * 2.0 - 1.0, 0.0, 1.0);
+}
+)";
+
+/**
+ * 放大：source 中只有 [0, uv_max] 是这一帧渲染的内容
+ * 锐化参考 contrast adaptive sharpening：周围 4 个像素的对比度越高，锐化越弱，避免边缘过冲
+ */
+static const char *UPSCALE_FRAG = R"(#version 330 core
+in vec2 uv;
+out vec4 frag_color;
+uniform sampler2D source;
+uniform vec2 uv_max;
+uniform vec2 texel;
+uniform int sharpen;
+void main() {
+    vec2 st = min(uv * uv_max, uv_max - 0.5 * texel);
+    vec3 c = texture(source, st).rgb;
+    if (sharpen != 0) {
+        vec3 n = texture(source, min(st + vec2(0.0, texel.y), uv_max - 0.5 * texel)).rgb;
+        vec3 s = texture(source, st - vec2(0.0, texel.y)).rgb;
+        vec3 e = texture(source, min(st + vec2(texel.x, 0.0), uv_max - 0.5 * texel)).rgb;
+        vec3 w = texture(source, st - vec2(texel.x, 0.0)).rgb;
+        vec3 lo = min(c, min(min(n, s), min(e, w)));
+        vec3 hi = max(c, max(max(n, s), max(e, w)));
+        vec3 amp = sqrt(clamp(min(lo, 1.0 - hi) / max(hi, 1e-4), 0.0, 1.0));
+        vec3 weight = -amp * 0.2;
+        c = clamp((c + (n + s + e + w) * weight) / (1.0 + 4.0 * weight), 0.0, 1.0);
+    }
+    frag_color = vec4(c, 1.0);
+}
+)";
+
+
+void DynamicResolution::init(const DynamicResolutionOptions &options) {
+    _options = options;
+    _options.min_scale = std::clamp(_options.min_scale, 0.25f, 1.f);
+    _options.max_scale = std::clamp(_options.max_scale, _options.min_scale, 1.f);
+    _scale = _options.max_scale;
+    if (_options.enabled)
+        _create();
+}
+
+void DynamicResolution::terminate() {
+    if (!_created)
+        return;
+    for (auto &timing: _timings) {
+        glDeleteQueries(1, &timing.begin);
+        glDeleteQueries(1, &timing.end);
+    }
+    glDeleteVertexArrays(1, &_vao);
+    glDeleteProgram(_shader->id);
+    _shader.reset();
+    RenderTargetPool::release(*_target);
+    _target = nullptr;
+    _created = false;
+    _options.enabled = false;
+}
+
+void DynamicResolution::enabled_set(bool enabled) {
+    if (enabled && !_created)
+        _create();
+    _options.enabled = enabled;
+}
+
+void DynamicResolution::_create() {
+    _target = &RenderTargetPool::acquire({0, 0, 1.f, GL_RGB8, GL_DEPTH24_STENCIL8});
+    _shader = Shader::from_source(UPSCALE_VERT, UPSCALE_FRAG);
+    glGenVertexArrays(1, &_vao);
+    for (auto &timing: _timings) {
+        glGenQueries(1, &timing.begin);
+        glGenQueries(1, &timing.end);
+        timing.pending = false;
+    }
+    _full_ms = 0.0;
+    _created = true;
+    SPDLOG_INFO("dynamic resolution: {}x{}, scale [{}, {}], target {} ms", _target->width(), _target->height(),
+                _options.min_scale, _options.max_scale, _options.target_ms);
+}
+
+int DynamicResolution::width() {
+    return _options.enabled && _width > 0 ? _width : Window::width();
+}
+
+int DynamicResolution::height() {
+    return _options.enabled && _height > 0 ? _height : Window::height();
+}
+
+
+// =====================================================
+// 每一帧
+// =====================================================
+
+void DynamicResolution::begin() {
+    if (!_options.enabled)
+        return;
+    _feedback();
+
+    /* 按照窗口的尺寸缩放，不超过离屏渲染目标 */
+    auto aligned = [](int size, float scale, int limit) {
+        int value = (int) std::lround(size * scale / ALIGN) * ALIGN;
+        return std::clamp(value, ALIGN, limit);
+    };
+    _width = aligned(Window::width(), _scale, _target->width());
+    _height = aligned(Window::height(), _scale, _target->height());
+
+    _screen = FrameBuffer::screen();
+    FrameBuffer::screen_set(_target->id());
+    glBindFramebuffer(GL_FRAMEBUFFER, _target->id());
+    glViewport(0, 0, _width, _height);
+    glClearColor(0, 0, 0, 0);
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT | GL_STENCIL_BUFFER_BIT);
+    _active = true;
+
+    /* 这一组查询的结果还没有读取时，这一帧不测量 */
+    Timing &timing = _timings[_timing_index];
+    _timing = !timing.pending;
+    if (_timing) {
+        glQueryCounter(timing.begin, GL_TIMESTAMP);
+        timing.scale = _scale;
+    }
+}
+
+void DynamicResolution::resolve() {
+    if (!_active)
+        return;
+    _active = false;
+
+    Timing &timing = _timings[_timing_index];
+    if (_timing) {
+        glQueryCounter(timing.end, GL_TIMESTAMP);
+        timing.pending = true;
+    }
+    _timing_index = (_timing_index + 1) % QUERY_FRAMES;
+
+    /* 回到原来的屏幕 */
+    FrameBuffer::screen_set(_screen);
+    glBindFramebuffer(GL_FRAMEBUFFER, _screen);
+    glViewport(0, 0, Window::width(), Window::height());
+
+    PROFILE_GPU_ZONE("upscale");
+    _upscale();
+}
+
+void DynamicResolution::_upscale() {
+    const GLboolean depth_test = glIsEnabled(GL_DEPTH_TEST);
+    const GLboolean blend = glIsEnabled(GL_BLEND);
+    glDisable(GL_DEPTH_TEST);
+    glDisable(GL_BLEND);
+
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, _target->color());
+    _shader->uniform_tex2d_set("source", 0);
+    const auto target_width = (float) _target->width(), target_height = (float) _target->height();
+    _shader->uniform_vec2_set("uv_max", {(float) _width / target_width, (float) _height / target_height});
+    _shader->uniform_vec2_set("texel", {1.f / target_width, 1.f / target_height});
+    _shader->uniform_int_set("sharpen", _options.sharpen ? 1 : 0);
+
+    glBindVertexArray(_vao);
+    Mesh::draw_arrays(GL_TRIANGLES, 0, 3);
+    glBindVertexArray(0);
+
+    if (depth_test)
+        glEnable(GL_DEPTH_TEST);
+    if (blend)
+        glEnable(GL_BLEND);
+}
+
+void DynamicResolution::_feedback() {
+    /* 读取所有已经可用的查询 */
+    for (auto &timing: _timings) {
+        if (!timing.pending)
+            continue;
+        GLint available = 0;
+        glGetQueryObjectiv(timing.end, GL_QUERY_RESULT_AVAILABLE, &available);
+        if (!available)
+            continue;
+        GLuint64 begin = 0, end = 0;
+        glGetQueryObjectui64v(timing.begin, GL_QUERY_RESULT, &begin);
+        glGetQueryObjectui64v(timing.end, GL_QUERY_RESULT, &end);
+        timing.pending = false;
+
+        /* 换算到全分辨率的耗时，平滑之后估计满足预算的 scale */
+        _gpu_ms = (double) (end - begin) / 1e6;
+        double full_ms = _gpu_ms / std::max(0.01, (double) timing.scale * timing.scale);
+        _full_ms = _full_ms <= 0.0 ? full_ms : _full_ms * 0.8 + full_ms * 0.2;
+    }
+    if (_full_ms <= 0.0)
+        return;
+
+    /* 变化小于 2% 时不调整，避免来回抖动；超出预算时下降得快，低于预算时上升得慢 */
+    auto desired = (float) std::sqrt(_options.target_ms / _full_ms);
+    desired = std::clamp(desired, _options.min_scale, _options.max_scale);
+    const float delta = desired - _scale;
+    if (std::abs(delta) > 0.02f)
+        _scale = std::clamp(_scale + std::clamp(delta, -0.1f, 0.02f), _options.min_scale, _options.max_scale);
+}
+
+
+// =====================================================
+// 统计
+// =====================================================
+
+DynamicResolution::Stats DynamicResolution::stats() {
+    return {_options.enabled, _scale, width(), height(), _gpu_ms, _full_ms, _options.target_ms};
+}
+
+void DynamicResolution::gui() {
+    const Stats stats = DynamicResolution::stats();
+    ImGui::Begin("dynamic resolution");
+    bool enabled = stats.enabled;
+    if (ImGui::Checkbox("enabled", &enabled))
+        enabled_set(enabled);
+    auto target = (float) _options.target_ms;
+    if (ImGui::SliderFloat("target ms", &target, 1.f, 33.f, "%.1f"))
+        _options.target_ms = target;
+    ImGui::SliderFloat("min scale", &_options.min_scale, 0.25f, _options.max_scale, "%.2f");
+    ImGui::SliderFloat("max scale", &_options.max_scale, _options.min_scale, 1.f, "%.2f");
+    _scale = std::clamp(_scale, _options.min_scale, _options.max_scale);
+    ImGui::Checkbox("sharpen", &_options.sharpen);
+    if (stats.enabled) {
+        ImGui::Text("scale %.2f, %d x %d", stats.scale, stats.width, stats.height);
+        ImGui::Text("scene gpu: %.2f ms, full resolution: %.2f ms", stats.gpu_ms, stats.full_ms);
+    }
+    ImGui::End();
+}
@@ -0,0 +1,266 @@
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <stdexcept>
+#include <filesystem>
+
+#include <fmt/format.h>
+#include <spdlog/spdlog.h>
+
+#include "env_cache.h"
+
+
+namespace fs = std::filesystem;
+
+
+/* .envmap 的文件头，之后依次是每个面每一级的数据（face * levels + level），每个元素是 3 个 half float */
+struct EnvFileHeader {
+    char magic[4];
+    uint32_t version;
+    uint64_t key;
+    uint32_t size;
+    uint32_t levels;
+    uint32_t channels;
+    uint32_t faces;                 // 6：立方体贴图；1：2D 纹理
+};
+static_assert(sizeof(EnvFileHeader) == 32);
+
+static constexpr char ENV_MAGIC[4] = {'E', 'N', 'V', 'M'};
+static constexpr uint32_t ENV_VERSION = 2;
+static constexpr uint32_t ENV_CHANNELS = 3;
+
+
+/* FNV-1a 64 */
+static uint64_t fnv1a(const void *data, size_t size, uint64_t hash = 0xcbf29ce484222325ull) {
+    auto bytes = static_cast<const unsigned char *>(data);
+    for (size_t i = 0; i < size; ++i) {
+        hash ^= bytes[i];
+        hash *= 0x100000001b3ull;
+    }
+    return hash;
+}
+
+static inline double ms_since(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+
+uint64_t EnvCache::key(const std::vector<std::string> &inputs, const std::string &params) {
+    uint64_t hash = fnv1a(&ENV_VERSION, sizeof(ENV_VERSION));
+    for (const auto &input : inputs) {
+        std::ifstream file(input, std::ios::binary);
+        if (!file) {
+            /* 文件不存在时只使用路径，缓存仍然可以根据其他输入失效 */
+            SPDLOG_WARN("env cache input not found: {}", input);
+            hash = fnv1a(input.data(), input.size(), hash);
+            continue;
+        }
+        std::vector<char> content((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+        hash = fnv1a(content.data(), content.size(), hash);
+
+        /* 分隔符，避免两个文件的内容拼接后恰好相同 */
+        const char separator = 0;
+        hash = fnv1a(&separator, 1, hash);
+    }
+    return fnv1a(params.data(), params.size(), hash);
+}
+
+std::string EnvCache::cache_path(const std::string &source, const std::string &tag) {
+    fs::path path(source);
+    return (path.parent_path() / fmt::format("{}.{}.envmap", path.stem().string(), tag)).string();
+}
+
+std::optional<EnvCubeData> EnvCache::load(const std::string &path, uint64_t key) {
+    std::ifstream file(path, std::ios::binary);
+    if (!file)
+        return std::nullopt;
+
+    EnvFileHeader header{};
+    file.read(reinterpret_cast<char *>(&header), sizeof(header));
+    if (!file || std::memcmp(header.magic, ENV_MAGIC, 4) != 0 || header.version != ENV_VERSION ||
+        header.channels != ENV_CHANNELS || header.size == 0 || header.levels == 0 ||
+        (header.faces != 1 && header.faces != 6)) {
+        SPDLOG_WARN("bad env cache file: {}", path);
+        return std::nullopt;
+    }
+    if (header.key != key) {
+        SPDLOG_INFO("env cache is stale: {}", path);
+        return std::nullopt;
+    }
+
+    EnvCubeData data;
+    data.size = (GLsizei) header.size;
+    data.levels = (GLsizei) header.levels;
+    data.faces = (GLsizei) header.faces;
+    for (GLsizei face = 0; face < data.faces; ++face) {
+        for (GLsizei level = 0; level < data.levels; ++level) {
+            GLsizei size = data.level_size(level);
+            auto &pixels = data.data.emplace_back((size_t) size * size * ENV_CHANNELS);
+            file.read(reinterpret_cast<char *>(pixels.data()), (std::streamsize) (pixels.size() * sizeof(uint16_t)));
+        }
+    }
+    if (!file) {
+        SPDLOG_WARN("truncated env cache file: {}", path);
+        return std::nullopt;
+    }
+    return data;
+}
+
+void EnvCache::save(const std::string &path, uint64_t key, const EnvCubeData &data) {
+    EnvFileHeader header{};
+    std::memcpy(header.magic, ENV_MAGIC, 4);
+    header.version = ENV_VERSION;
+    header.key = key;
+    header.size = (uint32_t) data.size;
+    header.levels = (uint32_t) data.levels;
+    header.channels = ENV_CHANNELS;
+    header.faces = (uint32_t) data.faces;
+
+    std::string tmp_path = path + ".tmp";
+    {
+        std::ofstream file(tmp_path, std::ios::binary | std::ios::trunc);
+        if (!file)
+            throw std::runtime_error(fmt::format("fail to open env cache file: {}", tmp_path));
+        file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+        for (const auto &pixels : data.data)
+            file.write(reinterpret_cast<const char *>(pixels.data()),
+                       (std::streamsize) (pixels.size() * sizeof(uint16_t)));
+        if (!file)
+            throw std::runtime_error(fmt::format("fail to write env cache file: {}", tmp_path));
+    }
+    fs::rename(tmp_path, path);
+}
+
+EnvCubeData EnvCache::cube_map_read(GLuint cube_map, GLsizei size, GLsizei levels) {
+    EnvCubeData data;
+    data.size = size;
+    data.levels = levels;
+
+    glBindTexture(GL_TEXTURE_CUBE_MAP, cube_map);
+    glPixelStorei(GL_PACK_ALIGNMENT, 1);
+    for (GLsizei face = 0; face < 6; ++face) {
+        for (GLsizei level = 0; level < levels; ++level) {
+            GLsizei level_size = data.level_size(level);
+            auto &pixels = data.data.emplace_back((size_t) level_size * level_size * ENV_CHANNELS);
+            glGetTexImage(GL_TEXTURE_CUBE_MAP_POSITIVE_X + face, level, GL_RGB, GL_HALF_FLOAT, pixels.data());
+        }
+    }
+    glPixelStorei(GL_PACK_ALIGNMENT, 4);
+    glBindTexture(GL_TEXTURE_CUBE_MAP, 0);
+    return data;
+}
+
+GLuint EnvCache::cube_map_create(const EnvCubeData &data) {
+    GLuint cube_map;
+    glGenTextures(1, &cube_map);
+    glBindTexture(GL_TEXTURE_CUBE_MAP, cube_map);
+
+    /* data 为空时只分配存储，用于渲染 */
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    for (GLsizei face = 0; face < 6; ++face) {
+        for (GLsizei level = 0; level < data.levels; ++level) {
+            GLsizei size = data.level_size(level);
+            glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + face, level, GL_RGB16F, size, size, 0, GL_RGB,
+                         GL_HALF_FLOAT, data.data.empty() ? nullptr : data.level(face, level).data());
+        }
+    }
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAX_LEVEL, data.levels - 1);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, data.levels > 1 ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
+    glBindTexture(GL_TEXTURE_CUBE_MAP, 0);
+    return cube_map;
+}
+
+EnvCubeData EnvCache::texture_2d_read(GLuint texture, GLsizei size) {
+    EnvCubeData data;
+    data.size = size;
+    data.faces = 1;
+    auto &pixels = data.data.emplace_back((size_t) size * size * ENV_CHANNELS);
+
+    glBindTexture(GL_TEXTURE_2D, texture);
+    glPixelStorei(GL_PACK_ALIGNMENT, 1);
+    glGetTexImage(GL_TEXTURE_2D, 0, GL_RGB, GL_HALF_FLOAT, pixels.data());
+    glPixelStorei(GL_PACK_ALIGNMENT, 4);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    return data;
+}
+
+GLuint EnvCache::texture_2d_create(const EnvCubeData &data) {
+    GLuint texture;
+    glGenTextures(1, &texture);
+    glBindTexture(GL_TEXTURE_2D, texture);
+
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB16F, data.size, data.size, 0, GL_RGB, GL_HALF_FLOAT,
+                 data.data.empty() ? nullptr : data.level(0, 0).data());
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
+    glBindTexture(GL_TEXTURE_2D, 0);
+    return texture;
+}
+
+GLuint EnvCache::cube_map_cached(const std::string &source, const std::string &tag,
+                                 const std::vector<std::string> &inputs, const std::string &params,
+                                 GLsizei size, GLsizei levels, const std::function<void(GLuint)> &generate) {
+    EnvCubeData shape;
+    shape.size = size;
+    shape.levels = levels;
+    return _cached(source, tag, inputs, params, shape, cube_map_create,
+                   [&](GLuint cube_map) { return cube_map_read(cube_map, size, levels); }, generate);
+}
+
+GLuint EnvCache::texture_2d_cached(const std::string &source, const std::string &tag,
+                                   const std::vector<std::string> &inputs, const std::string &params,
+                                   GLsizei size, const std::function<void(GLuint)> &generate) {
+    EnvCubeData shape;
+    shape.size = size;
+    shape.faces = 1;
+    return _cached(source, tag, inputs, params, shape, texture_2d_create,
+                   [&](GLuint texture) { return texture_2d_read(texture, size); }, generate);
+}
+
+GLuint EnvCache::_cached(const std::string &source, const std::string &tag, const std::vector<std::string> &inputs,
+                         const std::string &params, const EnvCubeData &shape,
+                         const std::function<GLuint(const EnvCubeData &)> &create,
+                         const std::function<EnvCubeData(GLuint)> &read,
+                         const std::function<void(GLuint)> &generate) {
+    auto start = std::chrono::steady_clock::now();
+
+    std::vector<std::string> all_inputs{source};
+    all_inputs.insert(all_inputs.end(), inputs.begin(), inputs.end());
+    uint64_t cache_key = key(all_inputs, fmt::format("{};size={};levels={};faces={}", params, shape.size,
+                                                     shape.levels, shape.faces));
+    std::string path = cache_path(source, tag);
+
+    if (auto data = load(path, cache_key); data && data->faces == shape.faces) {
+        GLuint texture = create(*data);
+        SPDLOG_INFO("{}: loaded from cache in {:.1f} ms", path, ms_since(start));
+        return texture;
+    }
+
+    GLuint texture = create(shape);
+    generate(texture);
+
+    /* 读回会等待 GPU 完成，所以这里的耗时包括了生成的耗时 */
+    EnvCubeData data = read(texture);
+    double generate_ms = ms_since(start);
+    try {
+        save(path, cache_key, data);
+        SPDLOG_INFO("{}: generated in {:.1f} ms, saved to cache", path, generate_ms);
+    } catch (const std::exception &e) {
+        SPDLOG_WARN("{}: generated in {:.1f} ms, fail to save cache: {}", path, generate_ms, e.what());
+    }
+    return texture;
+}
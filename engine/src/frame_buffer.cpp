@@ -1,10 +1,11 @@
 #include <exception>
+#include <algorithm>
 #include <spdlog/spdlog.h>
 #include "frame_buffer.h"
 
 
-FrameBuffer::FrameBuffer(unsigned int width, unsigned int height)
-        : width(width), height(height) {
+FrameBuffer::FrameBuffer(unsigned int width, unsigned int height, bool hdr)
+        : width(width), height(height), hdr(hdr) {
     // 创建帧缓冲对象
     glGenFramebuffers(1, &this->frame_buffer);
     glBindFramebuffer(GL_FRAMEBUFFER, this->frame_buffer);
@@ -23,7 +24,10 @@ FrameBuffer::FrameBuffer(unsigned int width, unsigned int height)
      * type：像素的数据类型
      * data：内存中图形数据的指针
      */
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, nullptr);
+    if (hdr)
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA16F, width, height, 0, GL_RGBA, GL_FLOAT, nullptr);
+    else
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, nullptr);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
     // uv坐标超出范围后如何采样：重复
@@ -46,10 +50,35 @@ FrameBuffer::FrameBuffer(unsigned int width, unsigned int height)
     // 检查帧缓冲是否完整
     if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
         SPDLOG_ERROR("frame buffer is not complete.");
-        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        glBindFramebuffer(GL_FRAMEBUFFER, _screen);
         throw std::exception();
     }
-    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    glBindFramebuffer(GL_FRAMEBUFFER, _screen);
+}
+
+FrameBuffer::~FrameBuffer() {
+    glDeleteFramebuffers(1, &this->frame_buffer);
+    glDeleteTextures(1, &this->color_buffer);
+    glDeleteRenderbuffers(1, &this->depth_stencil_buffer);
+}
+
+void FrameBuffer::resize(unsigned int width, unsigned int height) {
+    if (width == this->width && height == this->height)
+        return;
+    this->width = width;
+    this->height = height;
+
+    /* 附件仍然挂在帧缓冲上，只需要重新分配存储 */
+    glBindTexture(GL_TEXTURE_2D, this->color_buffer);
+    if (hdr)
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA16F, width, height, 0, GL_RGBA, GL_FLOAT, nullptr);
+    else
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, nullptr);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    glBindRenderbuffer(GL_RENDERBUFFER, this->depth_stencil_buffer);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, width, height);
+    glBindRenderbuffer(GL_RENDERBUFFER, 0);
 }
 
 GLuint FrameBuffer::color_tex_get() const {
@@ -61,29 +90,70 @@ void FrameBuffer::in() {
 }
 
 void FrameBuffer::out() {
-    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    glBindFramebuffer(GL_FRAMEBUFFER, _screen);
 }
 
 
-DepthBuffer::DepthBuffer(GLuint width, GLuint height) {
+DepthBuffer::DepthBuffer(GLuint width, GLuint height, GLuint layers)
+        : width(width), height(height), layers(std::max(1u, layers)) {
     glGenFramebuffers(1, &frame_buffer);
     glGenTextures(1, &depth_buffer);
 
-    // 生成 depth texture
-    glBindTexture(GL_TEXTURE_2D, depth_buffer);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT, width, height, 0, GL_DEPTH_COMPONENT, GL_FLOAT, nullptr);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-
-    // 为帧缓冲绑定颜色、深度附件
+    // 生成 depth texture，多层时是纹理数组
+    const GLenum target = this->layers > 1 ? GL_TEXTURE_2D_ARRAY : GL_TEXTURE_2D;
+    glBindTexture(target, depth_buffer);
+    if (this->layers > 1)
+        glTexImage3D(target, 0, GL_DEPTH_COMPONENT32F, (GLsizei) width, (GLsizei) height, (GLsizei) this->layers, 0,
+                     GL_DEPTH_COMPONENT, GL_FLOAT, nullptr);
+    else
+        glTexImage2D(target, 0, GL_DEPTH_COMPONENT32F, (GLsizei) width, (GLsizei) height, 0, GL_DEPTH_COMPONENT,
+                     GL_FLOAT, nullptr);
+    glTexParameteri(target, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(target, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(target, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER);
+    glTexParameteri(target, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER);
+    const GLfloat border[] = {1.f, 1.f, 1.f, 1.f};
+    glTexParameterfv(target, GL_TEXTURE_BORDER_COLOR, border);
+
+    // 深度比较：采样的结果是参考深度小于等于纹理中的深度的比例
+    glTexParameteri(target, GL_TEXTURE_COMPARE_MODE, GL_COMPARE_REF_TO_TEXTURE);
+    glTexParameteri(target, GL_TEXTURE_COMPARE_FUNC, GL_LEQUAL);
+    glBindTexture(target, 0);
+
+    // 为帧缓冲绑定深度附件，没有颜色附件
     glBindFramebuffer(GL_FRAMEBUFFER, frame_buffer);
-    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_COMPONENT, GL_TEXTURE_2D, depth_buffer, 0);
+    if (this->layers > 1)
+        glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, depth_buffer, 0, 0);
+    else
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, depth_buffer, 0);
     glDrawBuffer(GL_NONE);
     glReadBuffer(GL_NONE);
 
-    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    // 检查帧缓冲是否完整
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+        SPDLOG_ERROR("depth buffer is not complete.");
+        glBindFramebuffer(GL_FRAMEBUFFER, FrameBuffer::screen());
+        throw std::exception();
+    }
+    glBindFramebuffer(GL_FRAMEBUFFER, FrameBuffer::screen());
+}
+
+DepthBuffer::~DepthBuffer() {
+    glDeleteFramebuffers(1, &frame_buffer);
+    glDeleteTextures(1, &depth_buffer);
+}
+
+void DepthBuffer::layer_set(GLuint layer) {
+    if (layers > 1)
+        glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, depth_buffer, 0, (GLint) layer);
+}
+
+void DepthBuffer::in() {
+    glBindFramebuffer(GL_FRAMEBUFFER, frame_buffer);
+}
+
+void DepthBuffer::out() {
+    glBindFramebuffer(GL_FRAMEBUFFER, FrameBuffer::screen());
 }
 
 DepthFrameBuffer::DepthFrameBuffer(GLuint width, GLuint height) {
@@ -96,7 +166,12 @@ DepthFrameBuffer::DepthFrameBuffer(GLuint width, GLuint height) {
     glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT, width, height);
     glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, render_buffer_id);
 
-    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    glBindFramebuffer(GL_FRAMEBUFFER, FrameBuffer::screen());
+}
+
+DepthFrameBuffer::~DepthFrameBuffer() {
+    glDeleteFramebuffers(1, &frame_buffer_id);
+    glDeleteRenderbuffers(1, &render_buffer_id);
 }
 
 void DepthFrameBuffer::in() {
@@ -104,5 +179,5 @@ void DepthFrameBuffer::in() {
 }
 
 void DepthFrameBuffer::out() {
-    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    glBindFramebuffer(GL_FRAMEBUFFER, FrameBuffer::screen());
 }
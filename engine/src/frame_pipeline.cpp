@@ -0,0 +1,194 @@
+#include <algorithm>
+
+#include <imgui.h>
+#include <spdlog/spdlog.h>
+
+#include "frustum.h"
+#include "profiler.h"
+#include "frame_pipeline.h"
+
+
+void FramePipeline::start(int depth, Simulate simulate) {
+    _simulate = std::move(simulate);
+    _depth = std::clamp(depth, 0, MAX_DEPTH);
+    _stop = false;
+    _simulated = 0;
+    _rendered = 0;
+    _dropped = 0;
+    _latency_count = 0;
+    _buffer.reset();
+    {
+        std::lock_guard<std::mutex> lock(_input_mutex);
+        _input = {};
+    }
+
+    if (_depth > 0)
+        _thread = std::thread(_worker);
+    SPDLOG_INFO("frame pipeline: depth {}, {}", _depth.load(), _depth > 0 ? "simulation thread" : "serial");
+}
+
+void FramePipeline::stop() {
+    {
+        std::lock_guard<std::mutex> lock(_wait_mutex);
+        _stop = true;
+    }
+    _cv_simulate.notify_all();
+    if (_thread.joinable())
+        _thread.join();
+    _simulate = nullptr;
+}
+
+void FramePipeline::cull(FrameSnapshot &snapshot) {
+    PROFILE_ZONE("cull");
+    snapshot.visible.clear();
+    const auto count = (uint32_t) snapshot.transforms.size();
+    if (snapshot.bounds.w < 0.f) {
+        for (uint32_t i = 0; i < count; ++i)
+            snapshot.visible.push_back(i);
+        return;
+    }
+
+    /* 包围球随 model 矩阵变换，半径按照最大的缩放放大 */
+    const Frustum frustum(snapshot.camera.projection * snapshot.camera.view);
+    const glm::vec4 center(glm::vec3(snapshot.bounds), 1.f);
+    for (uint32_t i = 0; i < count; ++i) {
+        const glm::mat4 &model = snapshot.transforms[i];
+        const float scale = std::max({glm::length(glm::vec3(model[0])), glm::length(glm::vec3(model[1])),
+                                      glm::length(glm::vec3(model[2]))});
+        if (frustum.sphere_visible(glm::vec3(model * center), snapshot.bounds.w * scale))
+            snapshot.visible.push_back(i);
+    }
+}
+
+void FramePipeline::depth_set(int depth) {
+    if (!threaded())
+        return;
+    {
+        std::lock_guard<std::mutex> lock(_wait_mutex);
+        _depth = std::clamp(depth, 1, MAX_DEPTH);
+    }
+    _cv_simulate.notify_one();
+}
+
+
+// =====================================================
+// 模拟线程
+// =====================================================
+
+void FramePipeline::_worker() {
+    Profiler::thread_name_set("simulation");
+    for (int frame = 0;; ++frame) {
+        /* 最多领先渲染线程 depth 帧 */
+        {
+            std::unique_lock<std::mutex> lock(_wait_mutex);
+            _cv_simulate.wait(lock, [&] {
+                return _stop || (uint64_t) frame < _rendered.load() + (uint64_t) _depth.load();
+            });
+            if (_stop)
+                return;
+        }
+
+        _simulate_one(frame);
+
+        /* 发布在锁外完成，这里加锁只是为了不丢失唤醒 */
+        { std::lock_guard<std::mutex> lock(_wait_mutex); }
+        _cv_render.notify_one();
+    }
+}
+
+void FramePipeline::_simulate_one(int frame) {
+    PROFILE_ZONE("simulate");
+    const int64_t begin = Profiler::now_ns();
+    const FrameInput input = _input_take();
+
+    FrameSnapshot &snapshot = _buffer.back();
+    snapshot.frame = frame;
+    snapshot.input_ns = input.sample_ns >= 0 ? input.sample_ns : begin;
+    _simulate(snapshot, input);
+    snapshot.simulated_ns = Profiler::now_ns();
+    _simulate_ns = snapshot.simulated_ns - begin;
+
+    if (_buffer.publish())
+        ++_dropped;
+    ++_simulated;
+}
+
+
+// =====================================================
+// 输入
+// =====================================================
+
+void FramePipeline::input_push(const std::vector<KeyboardEvent> &keys, bool rotating, double delta_x,
+                               double delta_y) {
+    std::lock_guard<std::mutex> lock(_input_mutex);
+    _input.keys = keys;
+    _input.rotating = rotating;
+    _input.delta_x += delta_x;
+    _input.delta_y += delta_y;
+    if (_input.sample_ns < 0)
+        _input.sample_ns = Profiler::now_ns();
+}
+
+FrameInput FramePipeline::_input_take() {
+    std::lock_guard<std::mutex> lock(_input_mutex);
+    FrameInput input = _input;
+    _input.delta_x = _input.delta_y = 0.0;
+    _input.sample_ns = -1;
+    return input;
+}
+
+
+// =====================================================
+// 渲染线程
+// =====================================================
+
+const FrameSnapshot &FramePipeline::acquire() {
+    PROFILE_ZONE("wait snapshot");
+    if (!threaded()) {
+        _simulate_one((int) _simulated.load());
+        _buffer.acquire();
+        ++_rendered;
+        return _buffer.front();
+    }
+
+    {
+        std::unique_lock<std::mutex> lock(_wait_mutex);
+        _cv_render.wait(lock, [] { return _buffer.fresh(); });
+        _buffer.acquire();
+        ++_rendered;
+    }
+    _cv_simulate.notify_one();
+    return _buffer.front();
+}
+
+void FramePipeline::presented(const FrameSnapshot &snapshot) {
+    _latency[_latency_count++ % LATENCY_FRAMES] = (double) (Profiler::now_ns() - snapshot.input_ns) / 1e6;
+}
+
+FramePipeline::Stats FramePipeline::stats() {
+    Stats stats{_depth.load(), _simulated.load(), _rendered.load(), _dropped.load(),
+                (double) _simulate_ns.load() / 1e6, 0.0, 0.0};
+    const int count = std::min(_latency_count, LATENCY_FRAMES);
+    for (int i = 0; i < count; ++i) {
+        stats.latency_ms += _latency[i] / count;
+        stats.latency_max_ms = std::max(stats.latency_max_ms, _latency[i]);
+    }
+    return stats;
+}
+
+void FramePipeline::gui() {
+    const Stats stats = FramePipeline::stats();
+    ImGui::Begin("frame pipeline");
+    if (threaded()) {
+        int depth = stats.depth;
+        if (ImGui::SliderInt("depth", &depth, 1, MAX_DEPTH))
+            depth_set(depth);
+    } else {
+        ImGui::Text("serial (depth 0)");
+    }
+    ImGui::Text("simulate: %.3f ms", stats.simulate_ms);
+    ImGui::Text("input latency: %.2f ms, max %.2f ms", stats.latency_ms, stats.latency_max_ms);
+    ImGui::Text("frames: %llu simulated, %llu rendered, %llu dropped", (unsigned long long) stats.simulated,
+                (unsigned long long) stats.rendered, (unsigned long long) stats.dropped);
+    ImGui::End();
+}
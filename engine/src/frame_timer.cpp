@@ -0,0 +1,133 @@
+#include <cmath>
+#include <thread>
+#include <chrono>
+#include <algorithm>
+
+#include <GLFW/glfw3.h>
+#include <imgui.h>
+#include <spdlog/spdlog.h>
+
+#include "profiler.h"
+#include "frame_timer.h"
+
+
+int FixedStep::advance(double delta, int max_steps) {
+    _accumulator_ns += std::max<int64_t>(0, std::llround(delta * 1e9));
+    int steps = (int) std::min<int64_t>(_accumulator_ns / _step_ns, max_steps);
+    _accumulator_ns = std::min(_accumulator_ns - steps * _step_ns, _step_ns - 1);
+    return steps;
+}
+
+
+// =====================================================
+// 垂直同步和限帧
+// =====================================================
+
+void FrameTimer::init(int swap_interval, double fps_limit) {
+    _swap_tear = glfwExtensionSupported("WGL_EXT_swap_control_tear") ||
+                 glfwExtensionSupported("GLX_EXT_swap_control_tear");
+    swap_interval_set(swap_interval);
+    fps_limit_set(fps_limit);
+    _last_ns = 0;
+    _count = 0;
+    SPDLOG_INFO("frame timer: swap interval {}, fps limit {}", _swap_interval, _fps_limit);
+}
+
+void FrameTimer::swap_interval_set(int swap_interval) {
+    if (swap_interval < 0 && !_swap_tear) {
+        SPDLOG_WARN("adaptive vsync is not supported, use swap interval 1");
+        swap_interval = 1;
+    }
+    _swap_interval = swap_interval;
+    glfwSwapInterval(swap_interval);
+}
+
+void FrameTimer::fps_limit_set(double fps_limit) {
+    _fps_limit = std::max(fps_limit, 0.0);
+    _deadline_ns = 0;
+}
+
+void FrameTimer::frame_end() {
+    PROFILE_ZONE("frame limit");
+    int64_t now = Profiler::now_ns();
+    _wait_ns = 0;
+    if (_fps_limit > 0.0) {
+        const auto period = (int64_t) (1e9 / _fps_limit);
+
+        /* 落后不到一帧时保持原来的节奏，落后更多时从现在重新开始，不连续追赶 */
+        int64_t deadline = _deadline_ns + period;
+        if (deadline < now - period)
+            deadline = now;
+        if (deadline > now) {
+            _wait_until(deadline);
+            _wait_ns = Profiler::now_ns() - now;
+            now += _wait_ns;
+        }
+        _deadline_ns = deadline;
+    }
+
+    if (_last_ns > 0)
+        _intervals[_count++ % PACING_FRAMES] = (float) ((double) (now - _last_ns) / 1e6);
+    _last_ns = now;
+}
+
+void FrameTimer::_wait_until(int64_t deadline_ns) {
+    /* 睡眠到 deadline 之前 margin；margin 取最近睡眠超时的最大值，之后慢慢衰减 */
+    int64_t now = Profiler::now_ns();
+    if (deadline_ns - now > _margin_ns) {
+        const int64_t request = deadline_ns - now - _margin_ns;
+        std::this_thread::sleep_for(std::chrono::nanoseconds(request));
+        const int64_t overshoot = Profiler::now_ns() - now - request;
+        _margin_ns = std::clamp(std::max(_margin_ns - MARGIN_DECAY_NS, overshoot + MARGIN_MIN_NS),
+                                MARGIN_MIN_NS, MARGIN_MAX_NS);
+    }
+
+    /* 剩下的时间自旋 */
+    while (Profiler::now_ns() < deadline_ns)
+        std::this_thread::yield();
+}
+
+
+// =====================================================
+// 统计
+// =====================================================
+
+FrameTimer::Stats FrameTimer::stats() {
+    Stats stats{_swap_interval, _fps_limit, 0.0, 0.0, 0.0, (double) _margin_ns / 1e6, (double) _wait_ns / 1e6};
+    const int count = std::min(_count, PACING_FRAMES);
+    if (count == 0)
+        return stats;
+
+    for (int i = 0; i < count; ++i) {
+        stats.mean_ms += _intervals[i];
+        stats.max_ms = std::max(stats.max_ms, (double) _intervals[i]);
+    }
+    stats.mean_ms /= count;
+    for (int i = 0; i < count; ++i)
+        stats.stddev_ms += (_intervals[i] - stats.mean_ms) * (_intervals[i] - stats.mean_ms);
+    stats.stddev_ms = std::sqrt(stats.stddev_ms / count);
+    return stats;
+}
+
+void FrameTimer::gui() {
+    const Stats stats = FrameTimer::stats();
+    ImGui::Begin("frame pacing");
+
+    /* 垂直同步：off，vsync，adaptive 对应 0，1，-1 */
+    int vsync = stats.swap_interval < 0 ? 2 : std::min(stats.swap_interval, 1);
+    if (ImGui::Combo("vsync", &vsync, "off\0vsync\0adaptive\0"))
+        swap_interval_set(vsync == 2 ? -1 : vsync);
+
+    float limit = (float) stats.fps_limit;
+    if (ImGui::SliderFloat("fps limit", &limit, 0.f, 240.f, limit > 0.f ? "%.0f" : "off"))
+        fps_limit_set(std::round(limit));
+
+    const int count = std::min(_count, PACING_FRAMES);
+    ImGui::PlotLines("##interval", _intervals.data(), count, count < PACING_FRAMES ? 0 : _count % PACING_FRAMES,
+                     "frame interval", 0.f, (float) std::max(2.0 * stats.mean_ms, stats.max_ms),
+                     ImVec2(0, 60));
+    ImGui::Text("interval: %.2f ms, stddev %.3f ms, max %.2f ms", stats.mean_ms, stats.stddev_ms, stats.max_ms);
+    if (stats.fps_limit > 0.0)
+        ImGui::Text("limiter: wait %.2f ms, sleep margin %.2f ms", stats.wait_ms, stats.margin_ms);
+    ImGui::End();
+}
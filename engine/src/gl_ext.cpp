@@ -0,0 +1,32 @@
+#include <spdlog/spdlog.h>
+
+#include "gl_ext.h"
+
+
+void GLExt::init(GLADloadproc load) {
+    /* 核心模式下需要逐个查询扩展的名称 */
+    GLint cnt = 0;
+    glGetIntegerv(GL_NUM_EXTENSIONS, &cnt);
+    for (GLint i = 0; i < cnt; ++i)
+        _extensions.emplace(reinterpret_cast<const char *>(glGetStringi(GL_EXTENSIONS, i)));
+
+    /* ARB_buffer_storage：持久映射的 buffer */
+    if (supported("GL_ARB_buffer_storage")) {
+        BufferStorage = reinterpret_cast<PFNGLBUFFERSTORAGEPROC_EXT>(load("glBufferStorage"));
+        ARB_buffer_storage = BufferStorage != nullptr;
+    }
+
+    /* ARB_texture_storage：一次分配所有级别的不可变存储 */
+    if (supported("GL_ARB_texture_storage")) {
+        TexStorage2D = reinterpret_cast<PFNGLTEXSTORAGE2DPROC_EXT>(load("glTexStorage2D"));
+        ARB_texture_storage = TexStorage2D != nullptr;
+    }
+
+    /* 块压缩纹理 */
+    EXT_texture_compression_s3tc = supported("GL_EXT_texture_compression_s3tc");
+    ARB_texture_compression_bptc = supported("GL_ARB_texture_compression_bptc");
+
+    SPDLOG_INFO("OpenGL: {}, extensions: {}, ARB_buffer_storage: {}, ARB_texture_storage: {}, s3tc: {}, bptc: {}",
+                reinterpret_cast<const char *>(glGetString(GL_VERSION)), cnt, ARB_buffer_storage,
+                ARB_texture_storage, EXT_texture_compression_s3tc, ARB_texture_compression_bptc);
+}
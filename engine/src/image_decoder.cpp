@@ -0,0 +1,412 @@
+#include <csetjmp>
+#include <cstdio>
+#include <cstring>
+#include <algorithm>
+#include <stdexcept>
+
+#include <stb_image.h>
+#include <fmt/format.h>
+
+#ifdef ENGINE_WITH_LIBJPEG
+#include <jpeglib.h>
+#endif
+#ifdef ENGINE_WITH_LIBPNG
+#include <png.h>
+#endif
+
+#include "image_decoder.h"
+
+
+/* 文件句柄，离开作用域时关闭 */
+using FilePtr = std::unique_ptr<FILE, int (*)(FILE *)>;
+
+static FilePtr file_open(const std::string &path) {
+    FilePtr file(std::fopen(path.c_str(), "rb"), std::fclose);
+    if (!file)
+        throw std::runtime_error(fmt::format("fail to open image file: {}", path));
+    return file;
+}
+
+/* 检查目标内存是否足够 */
+static void dst_check(const std::string &path, size_t need, size_t dst_size) {
+    if (need > dst_size)
+        throw std::runtime_error(fmt::format("image buffer too small: {}, need {} bytes, got {}", path, need,
+                                             dst_size));
+}
+
+
+// =====================================================
+// stb_image：支持所有格式，也是唯一可以输出 float 的解码器
+// =====================================================
+
+class StbDecoder : public ImageDecoder {
+public:
+    [[nodiscard]] const char *name() const override { return "stb_image"; }
+
+    [[nodiscard]] bool accepts(const unsigned char *, size_t) const override { return true; }
+
+    [[nodiscard]] bool hdr_output() const override { return true; }
+
+    [[nodiscard]] ImageInfo info(const std::string &path) const override {
+        ImageInfo info;
+        if (!stbi_info(path.c_str(), &info.width, &info.height, &info.channels))
+            throw std::runtime_error(fmt::format("fail to load image info: {}, {}", path, stbi_failure_reason()));
+        info.hdr = stbi_is_hdr(path.c_str()) != 0;
+        return info;
+    }
+
+    /* stb_image 只能解码到自己分配的内存，需要复制一次 */
+    ImageInfo decode(const std::string &path, const ImageRequest &request, void *dst,
+                     size_t dst_size) const override {
+        int width, height, nr_channels;
+        stbi_set_flip_vertically_on_load_thread(request.flip);
+        void *data = request.hdr ? (void *) stbi_loadf(path.c_str(), &width, &height, &nr_channels, request.channels)
+                                 : (void *) stbi_load(path.c_str(), &width, &height, &nr_channels, request.channels);
+        if (!data)
+            throw std::runtime_error(fmt::format("fail to load image: {}, {}", path, stbi_failure_reason()));
+
+        ImageInfo info{width, height, request.channels ? request.channels : nr_channels, request.hdr};
+        size_t bytes = ImageDecoders::bytes(info, request);
+        if (bytes > dst_size) {
+            stbi_image_free(data);
+            dst_check(path, bytes, dst_size);
+        }
+        std::memcpy(dst, data, bytes);
+        stbi_image_free(data);
+        return info;
+    }
+};
+
+
+// =====================================================
+// libjpeg(-turbo)
+// =====================================================
+#ifdef ENGINE_WITH_LIBJPEG
+
+/* libjpeg 的错误通过 longjmp 返回，不能直接抛出异常穿过 C 代码 */
+struct JpegError {
+    jpeg_error_mgr mgr;     // 必须是第一个成员
+    std::jmp_buf jump;
+    char message[JMSG_LENGTH_MAX];
+};
+
+static void jpeg_error_exit(j_common_ptr cinfo) {
+    auto *error = reinterpret_cast<JpegError *>(cinfo->err);
+    (*cinfo->err->format_message)(cinfo, error->message);
+    std::longjmp(error->jump, 1);
+}
+
+/* 警告（比如数据提前结束）不输出 */
+static void jpeg_output_message(j_common_ptr) {}
+
+class JpegDecoder : public ImageDecoder {
+public:
+    [[nodiscard]] const char *name() const override { return "libjpeg"; }
+
+    [[nodiscard]] bool accepts(const unsigned char *head, size_t size) const override {
+        return size >= 3 && head[0] == 0xff && head[1] == 0xd8 && head[2] == 0xff;
+    }
+
+    [[nodiscard]] ImageInfo info(const std::string &path) const override {
+        return _read(path, nullptr, nullptr, 0);
+    }
+
+    ImageInfo decode(const std::string &path, const ImageRequest &request, void *dst,
+                     size_t dst_size) const override {
+        if (request.hdr)
+            throw std::runtime_error(fmt::format("libjpeg can not output float: {}", path));
+        return _read(path, &request, static_cast<unsigned char *>(dst), dst_size);
+    }
+
+private:
+    /**
+     * 读取文件头，request 不为空时再解码像素
+     * setjmp 之后不能构造有析构函数的对象；需要转换通道数时，行缓冲由 libjpeg 的内存池分配
+     */
+    static ImageInfo _read(const std::string &path, const ImageRequest *request, unsigned char *dst,
+                           size_t dst_size) {
+        FilePtr file = file_open(path);
+        jpeg_decompress_struct cinfo{};
+        JpegError error{};
+        cinfo.err = jpeg_std_error(&error.mgr);
+        error.mgr.error_exit = jpeg_error_exit;
+        error.mgr.output_message = jpeg_output_message;
+        if (setjmp(error.jump)) {
+            jpeg_destroy_decompress(&cinfo);
+            throw std::runtime_error(fmt::format("fail to decode jpeg: {}, {}", path, error.message));
+        }
+
+        jpeg_create_decompress(&cinfo);
+        jpeg_stdio_src(&cinfo, file.get());
+        jpeg_read_header(&cinfo, TRUE);
+        if (cinfo.num_components != 1 && cinfo.num_components != 3) {
+            jpeg_destroy_decompress(&cinfo);
+            throw std::runtime_error(fmt::format("unsupported jpeg components: {}, {}", cinfo.num_components, path));
+        }
+
+        ImageInfo info{(int) cinfo.image_width, (int) cinfo.image_height, cinfo.num_components, false};
+        if (!request) {
+            jpeg_destroy_decompress(&cinfo);
+            return info;
+        }
+
+        /* 尽量让 libjpeg 直接输出需要的通道数：单通道是亮度 Y，和 stb_image 一致；libjpeg-turbo 可以直接输出 RGBA */
+        const int out = request->channels ? request->channels : info.channels;
+        cinfo.out_color_space = info.channels == 1 ? JCS_GRAYSCALE : JCS_RGB;
+        if (out == 1)
+            cinfo.out_color_space = JCS_GRAYSCALE;
+#ifdef JCS_EXTENSIONS
+        else if (out == 4 && info.channels == 3)
+            cinfo.out_color_space = JCS_EXT_RGBA;
+#endif
+        const size_t stride = (size_t) info.width * out;
+        if (stride * info.height > dst_size) {
+            jpeg_destroy_decompress(&cinfo);
+            dst_check(path, stride * info.height, dst_size);
+        }
+
+        jpeg_start_decompress(&cinfo);
+        const int decoded = cinfo.output_components;
+        JSAMPARRAY row = decoded == out ? nullptr
+                                        : (*cinfo.mem->alloc_sarray)(reinterpret_cast<j_common_ptr>(&cinfo),
+                                                                     JPOOL_IMAGE, info.width * decoded, 1);
+        while (cinfo.output_scanline < cinfo.output_height) {
+            size_t y = cinfo.output_scanline;
+            unsigned char *target = dst + (request->flip ? info.height - 1 - y : y) * stride;
+            JSAMPROW rows[1] = {row ? row[0] : target};
+            jpeg_read_scanlines(&cinfo, rows, 1);
+            if (row)
+                image_channels_convert(row[0], decoded, target, out, info.width);
+        }
+        jpeg_finish_decompress(&cinfo);
+        jpeg_destroy_decompress(&cinfo);
+
+        info.channels = out;
+        return info;
+    }
+};
+
+#endif
+
+
+// =====================================================
+// libpng
+// =====================================================
+#ifdef ENGINE_WITH_LIBPNG
+
+/* libpng 的错误同样通过 longjmp 返回 */
+struct PngError {
+    char message[256];
+};
+
+static void png_error_fn(png_structp png, png_const_charp message) {
+    auto *error = static_cast<PngError *>(png_get_error_ptr(png));
+    std::snprintf(error->message, sizeof(error->message), "%s", message);
+    png_longjmp(png, 1);
+}
+
+/* 警告（比如 iCCP 的 sRGB 配置文件不正确）不输出 */
+static void png_warning_fn(png_structp, png_const_charp) {}
+
+class PngDecoder : public ImageDecoder {
+public:
+    [[nodiscard]] const char *name() const override { return "libpng"; }
+
+    [[nodiscard]] bool accepts(const unsigned char *head, size_t size) const override {
+        return size >= 8 && png_sig_cmp(head, 0, 8) == 0;
+    }
+
+    [[nodiscard]] ImageInfo info(const std::string &path) const override {
+        return _read(path, nullptr, nullptr, 0);
+    }
+
+    ImageInfo decode(const std::string &path, const ImageRequest &request, void *dst,
+                     size_t dst_size) const override {
+        if (request.hdr)
+            throw std::runtime_error(fmt::format("libpng can not output float: {}", path));
+
+        /* libpng 的 RGB 转灰度会考虑 gamma，和 stb_image 的结果不同；这种少见的情况先解码为 RGB(A) 再转换 */
+        if (request.channels == 1 || request.channels == 2) {
+            ImageInfo info = _read(path, nullptr, nullptr, 0);
+            if (info.channels >= 3) {
+                ImageRequest color = request;
+                color.channels = request.channels + 2;
+                dst_check(path, ImageDecoders::bytes(info, request), dst_size);
+                std::vector<unsigned char> pixels(ImageDecoders::bytes(info, color));
+                _read(path, &color, pixels.data(), pixels.size());
+                image_channels_convert(pixels.data(), color.channels, static_cast<unsigned char *>(dst),
+                                       request.channels, (size_t) info.width * info.height);
+                info.channels = request.channels;
+                return info;
+            }
+        }
+        return _read(path, &request, static_cast<unsigned char *>(dst), dst_size);
+    }
+
+private:
+    /**
+     * 读取文件头，request 不为空时再解码像素
+     * 除了 RGB 转灰度，所有的转换都由 libpng 完成，每一行直接写入目标内存；行指针的数组在 setjmp 之后分配，所以是 volatile 的
+     */
+    static ImageInfo _read(const std::string &path, const ImageRequest *request, unsigned char *dst,
+                           size_t dst_size) {
+        FilePtr file = file_open(path);
+        PngError error{};
+        png_structp png = png_create_read_struct(PNG_LIBPNG_VER_STRING, &error, png_error_fn, png_warning_fn);
+        png_infop png_info = png ? png_create_info_struct(png) : nullptr;
+        if (!png_info) {
+            png_destroy_read_struct(&png, nullptr, nullptr);
+            throw std::runtime_error(fmt::format("fail to create png reader: {}", path));
+        }
+        png_bytepp volatile rows = nullptr;
+        if (setjmp(png_jmpbuf(png))) {
+            png_free(png, rows);
+            png_destroy_read_struct(&png, &png_info, nullptr);
+            throw std::runtime_error(fmt::format("fail to decode png: {}, {}", path, error.message));
+        }
+
+        png_init_io(png, file.get());
+        png_read_info(png, png_info);
+
+        /* 调色板，不足 8 位的灰度，tRNS 都展开；16 位截断为 8 位。展开后的通道数和 stb_image 报告的一致 */
+        const int color_type = png_get_color_type(png, png_info);
+        const bool color = (color_type & PNG_COLOR_MASK_COLOR) != 0;
+        const bool alpha = (color_type & PNG_COLOR_MASK_ALPHA) != 0 || png_get_valid(png, png_info, PNG_INFO_tRNS);
+        ImageInfo info{(int) png_get_image_width(png, png_info), (int) png_get_image_height(png, png_info),
+                       (color ? 3 : 1) + (alpha ? 1 : 0), false};
+        if (!request) {
+            png_destroy_read_struct(&png, &png_info, nullptr);
+            return info;
+        }
+
+        const int out = request->channels ? request->channels : info.channels;
+        const bool out_color = out >= 3, out_alpha = out == 2 || out == 4;
+        png_set_expand(png);
+        png_set_strip_16(png);
+        if (color && !out_color)
+            png_error(png, "rgb to gray is not handled by libpng");
+        if (!color && out_color)
+            png_set_gray_to_rgb(png);
+        if (alpha && !out_alpha)
+            png_set_strip_alpha(png);
+        if (!alpha && out_alpha)
+            png_set_add_alpha(png, 0xff, PNG_FILLER_AFTER);
+        png_set_interlace_handling(png);
+        png_read_update_info(png, png_info);
+
+        const size_t stride = (size_t) info.width * out;
+        if (png_get_channels(png, png_info) != out || png_get_rowbytes(png, png_info) != stride)
+            png_error(png, "unexpected channels after transform");
+        if (stride * info.height > dst_size) {
+            png_destroy_read_struct(&png, &png_info, nullptr);
+            dst_check(path, stride * info.height, dst_size);
+        }
+
+        /* 翻转只需要倒序排列行指针 */
+        rows = static_cast<png_bytepp>(png_malloc(png, sizeof(png_bytep) * info.height));
+        for (int y = 0; y < info.height; ++y)
+            rows[y] = dst + (size_t) (request->flip ? info.height - 1 - y : y) * stride;
+        png_read_image(png, rows);
+        png_read_end(png, nullptr);
+        png_free(png, rows);
+        png_destroy_read_struct(&png, &png_info, nullptr);
+
+        info.channels = out;
+        return info;
+    }
+};
+
+#endif
+
+
+// =====================================================
+// ImageDecoders
+// =====================================================
+
+std::vector<std::unique_ptr<ImageDecoder>> &ImageDecoders::_decoders() {
+    static std::vector<std::unique_ptr<ImageDecoder>> decoders = [] {
+        std::vector<std::unique_ptr<ImageDecoder>> list;
+        list.push_back(std::make_unique<StbDecoder>());
+#ifdef ENGINE_WITH_LIBPNG
+        list.push_back(std::make_unique<PngDecoder>());
+#endif
+#ifdef ENGINE_WITH_LIBJPEG
+        list.push_back(std::make_unique<JpegDecoder>());
+#endif
+        return list;
+    }();
+    return decoders;
+}
+
+void ImageDecoders::add(std::unique_ptr<ImageDecoder> decoder) {
+    _decoders().push_back(std::move(decoder));
+}
+
+std::vector<const ImageDecoder *> ImageDecoders::all() {
+    std::vector<const ImageDecoder *> result;
+    for (auto it = _decoders().rbegin(); it != _decoders().rend(); ++it)
+        result.push_back(it->get());
+    return result;
+}
+
+const ImageDecoder &ImageDecoders::find(const unsigned char *head, size_t size, bool hdr) {
+    for (auto it = _decoders().rbegin(); it != _decoders().rend(); ++it)
+        if ((!hdr || (*it)->hdr_output()) && (*it)->accepts(head, size))
+            return **it;
+    return *_decoders().front();
+}
+
+const ImageDecoder &ImageDecoders::find(const std::string &path, bool hdr) {
+    /* 打不开的文件交给 stb_image，由它报告错误 */
+    unsigned char head[HEAD_SIZE];
+    size_t size = 0;
+    if (FILE *file = std::fopen(path.c_str(), "rb")) {
+        size = std::fread(head, 1, HEAD_SIZE, file);
+        std::fclose(file);
+    }
+    return size ? find(head, size, hdr) : *_decoders().front();
+}
+
+size_t ImageDecoders::bytes(const ImageInfo &info, const ImageRequest &request) {
+    size_t channels = request.channels ? request.channels : info.channels;
+    return (size_t) info.width * info.height * channels * (request.hdr ? sizeof(float) : 1);
+}
+
+Image ImageDecoders::load(const std::string &path, const ImageRequest &request) {
+    const ImageDecoder &decoder = find(path, request.hdr);
+    ImageInfo info = decoder.info(path);
+
+    Image image;
+    image.data.resize(bytes(info, request));
+    info = decoder.decode(path, request, image.data.data(), image.data.size());
+    image.width = info.width;
+    image.height = info.height;
+    image.channels = info.channels;
+    image.hdr = request.hdr;
+    return image;
+}
+
+
+void image_channels_convert(const unsigned char *src, int src_channels, unsigned char *dst, int dst_channels,
+                            size_t pixels) {
+    for (size_t i = 0; i < pixels; ++i, src += src_channels, dst += dst_channels) {
+        const bool gray = src_channels <= 2;
+        unsigned char r = src[0], g = gray ? src[0] : src[1], b = gray ? src[0] : src[2];
+        unsigned char a = src_channels == 2 ? src[1] : src_channels == 4 ? src[3] : 255;
+        unsigned char y = gray ? src[0] : (unsigned char) ((r * 77 + g * 150 + b * 29) >> 8);
+        switch (dst_channels) {
+            case 1:
+                dst[0] = y;
+                break;
+            case 2:
+                dst[0] = y, dst[1] = a;
+                break;
+            case 3:
+                dst[0] = r, dst[1] = g, dst[2] = b;
+                break;
+            default:
+                dst[0] = r, dst[1] = g, dst[2] = b, dst[3] = a;
+                break;
+        }
+    }
+}
@@ -0,0 +1,208 @@
+#include <array>
+#include <algorithm>
+#include <vector>
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+
+#include <fmt/format.h>
+
+#ifdef ENGINE_WITH_LIBPNG
+#include <zlib.h>
+#endif
+
+#include "image_writer.h"
+
+
+/* 字节序列，整数按照指定的字节序写入 */
+using Bytes = std::vector<unsigned char>;
+
+static void put_be32(Bytes &out, uint32_t value) {
+    for (int shift = 24; shift >= 0; shift -= 8)
+        out.push_back((unsigned char) (value >> shift));
+}
+
+template<class T>
+static void put_le(Bytes &out, T value) {
+    unsigned char bytes[sizeof(T)];
+    std::memcpy(bytes, &value, sizeof(T));      // 只支持小端的平台
+    out.insert(out.end(), bytes, bytes + sizeof(T));
+}
+
+static void put_str(Bytes &out, const char *str) {
+    out.insert(out.end(), str, str + std::strlen(str) + 1);
+}
+
+static void file_write(const std::string &path, const Bytes &bytes) {
+    FILE *file = std::fopen(path.c_str(), "wb");
+    if (file == nullptr)
+        throw std::runtime_error(fmt::format("fail to open image file for writing: {}", path));
+    size_t written = std::fwrite(bytes.data(), 1, bytes.size(), file);
+    std::fclose(file);
+    if (written != bytes.size())
+        throw std::runtime_error(fmt::format("fail to write image file: {}", path));
+}
+
+static void args_check(const std::string &path, int width, int height, int channels) {
+    if (width <= 0 || height <= 0 || channels < 1 || channels > 4)
+        throw std::runtime_error(fmt::format("bad image to save: {}, {}x{}x{}", path, width, height, channels));
+}
+
+
+// =====================================================
+// PNG
+// =====================================================
+
+static uint32_t crc32_png(const unsigned char *data, size_t size, uint32_t crc = 0) {
+    static const auto table = [] {
+        std::array<uint32_t, 256> table{};
+        for (uint32_t n = 0; n < 256; ++n) {
+            uint32_t c = n;
+            for (int k = 0; k < 8; ++k)
+                c = c & 1 ? 0xedb88320u ^ (c >> 1) : c >> 1;
+            table[n] = c;
+        }
+        return table;
+    }();
+    crc = ~crc;
+    for (size_t i = 0; i < size; ++i)
+        crc = table[(crc ^ data[i]) & 0xff] ^ (crc >> 8);
+    return ~crc;
+}
+
+/* zlib 格式的数据；没有 zlib 时使用不压缩的 deflate 块 */
+static Bytes zlib_deflate(const Bytes &raw) {
+#ifdef ENGINE_WITH_LIBPNG
+    uLongf size = compressBound((uLong) raw.size());
+    Bytes out(size);
+    if (compress2(out.data(), &size, raw.data(), (uLong) raw.size(), 6) != Z_OK)
+        throw std::runtime_error("fail to compress png data");
+    out.resize(size);
+    return out;
+#else
+    Bytes out{0x78, 0x01};
+    size_t pos = 0;
+    do {
+        const auto len = (uint16_t) std::min<size_t>(raw.size() - pos, 65535);
+        out.push_back(pos + len == raw.size() ? 1 : 0);         // BFINAL，BTYPE = 00
+        put_le<uint16_t>(out, len);
+        put_le<uint16_t>(out, (uint16_t) ~len);
+        out.insert(out.end(), raw.begin() + (long) pos, raw.begin() + (long) (pos + len));
+        pos += len;
+    } while (pos < raw.size());
+
+    uint32_t a = 1, b = 0;
+    for (unsigned char c : raw) {
+        a = (a + c) % 65521;
+        b = (b + a) % 65521;
+    }
+    put_be32(out, (b << 16) | a);
+    return out;
+#endif
+}
+
+static void png_chunk(Bytes &out, const char *type, const Bytes &data) {
+    put_be32(out, (uint32_t) data.size());
+    const size_t begin = out.size();
+    out.insert(out.end(), type, type + 4);
+    out.insert(out.end(), data.begin(), data.end());
+    put_be32(out, crc32_png(out.data() + begin, out.size() - begin));
+}
+
+void image_png_save(const std::string &path, int width, int height, int channels, const unsigned char *pixels,
+                    bool flip) {
+    args_check(path, width, height, channels);
+
+    /* 每一行前面是滤波的类型，0 表示不滤波 */
+    const size_t row_size = (size_t) width * channels;
+    Bytes raw;
+    raw.reserve((row_size + 1) * height);
+    for (int y = 0; y < height; ++y) {
+        const unsigned char *row = pixels + row_size * (flip ? height - 1 - y : y);
+        raw.push_back(0);
+        raw.insert(raw.end(), row, row + row_size);
+    }
+
+    static const unsigned char COLOR_TYPES[] = {0, 4, 2, 6};      // 灰度，灰度 + alpha，RGB，RGBA
+    Bytes header;
+    put_be32(header, (uint32_t) width);
+    put_be32(header, (uint32_t) height);
+    header.insert(header.end(), {8, COLOR_TYPES[channels - 1], 0, 0, 0});
+
+    Bytes out{0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n'};
+    png_chunk(out, "IHDR", header);
+    png_chunk(out, "IDAT", zlib_deflate(raw));
+    png_chunk(out, "IEND", {});
+    file_write(path, out);
+}
+
+
+// =====================================================
+// EXR
+// =====================================================
+
+/* 写入一个属性：名字，类型，大小，值 */
+static void exr_attribute(Bytes &out, const char *name, const char *type, const Bytes &value) {
+    put_str(out, name);
+    put_str(out, type);
+    put_le<int32_t>(out, (int32_t) value.size());
+    out.insert(out.end(), value.begin(), value.end());
+}
+
+void image_exr_save(const std::string &path, int width, int height, int channels, const float *pixels,
+                    bool flip) {
+    args_check(path, width, height, channels);
+
+    /* 通道在文件中按照名字排序，offsets 是每个通道在像素中的位置 */
+    static const char *NAMES[4][4] = {{"Y"}, {"A", "Y"}, {"B", "G", "R"}, {"A", "B", "G", "R"}};
+    static const int OFFSETS[4][4] = {{0}, {1, 0}, {2, 1, 0}, {3, 2, 1, 0}};
+
+    Bytes channel_list;
+    for (int c = 0; c < channels; ++c) {
+        put_str(channel_list, NAMES[channels - 1][c]);
+        put_le<int32_t>(channel_list, 2);                  // FLOAT
+        channel_list.insert(channel_list.end(), {0, 0, 0, 0});  // pLinear 和保留的 3 个字节
+        put_le<int32_t>(channel_list, 1);                  // xSampling
+        put_le<int32_t>(channel_list, 1);                  // ySampling
+    }
+    channel_list.push_back(0);
+
+    Bytes window;
+    for (int32_t value : {0, 0, width - 1, height - 1})
+        put_le<int32_t>(window, value);
+    Bytes center, one;
+    put_le<float>(center, 0.f);
+    put_le<float>(center, 0.f);
+    put_le<float>(one, 1.f);
+
+    /* 魔数和版本，单个部分的 scanline 文件 */
+    Bytes out;
+    put_le<int32_t>(out, 20000630);
+    put_le<int32_t>(out, 2);
+    exr_attribute(out, "channels", "chlist", channel_list);
+    exr_attribute(out, "compression", "compression", {0});         // NO_COMPRESSION
+    exr_attribute(out, "dataWindow", "box2i", window);
+    exr_attribute(out, "displayWindow", "box2i", window);
+    exr_attribute(out, "lineOrder", "lineOrder", {0});             // INCREASING_Y
+    exr_attribute(out, "pixelAspectRatio", "float", one);
+    exr_attribute(out, "screenWindowCenter", "v2f", center);
+    exr_attribute(out, "screenWindowWidth", "float", one);
+    out.push_back(0);
+
+    /* 不压缩时每个块是一行：行号，数据的大小，然后依次是每个通道的这一行 */
+    const size_t line_size = (size_t) width * channels * sizeof(float);
+    const size_t block_size = 8 + line_size;
+    const size_t table_end = out.size() + (size_t) height * 8;
+    for (int y = 0; y < height; ++y)
+        put_le<uint64_t>(out, (uint64_t) (table_end + block_size * y));
+    for (int y = 0; y < height; ++y) {
+        const float *row = pixels + (size_t) width * channels * (flip ? height - 1 - y : y);
+        put_le<int32_t>(out, y);
+        put_le<int32_t>(out, (int32_t) line_size);
+        for (int c = 0; c < channels; ++c)
+            for (int x = 0; x < width; ++x)
+                put_le<float>(out, row[(size_t) x * channels + OFFSETS[channels - 1][c]]);
+    }
+    file_write(path, out);
+}
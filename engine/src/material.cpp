@@ -0,0 +1,170 @@
+#include <cassert>
+#include <algorithm>
+
+#include <spdlog/spdlog.h>
+
+#include "material.h"
+
+
+/* 初始的 uniform buffer 大小 */
+const GLsizeiptr MATERIAL_BUFFER_INIT_CAPACITY = 64 * 1024;
+
+
+Material::Material(std::vector<MaterialTexture> texture_bindings, GLsizeiptr param_size)
+        : _texture_bindings(std::move(texture_bindings)),
+          _params((size_t) param_size, 0) {
+    _id_update();
+}
+
+Material::~Material() {
+    if (_dirty) {
+        auto &dirty = MaterialManager::_dirty;
+        dirty.erase(std::remove(dirty.begin(), dirty.end(), this), dirty.end());
+    }
+    if (!_params.empty())
+        MaterialManager::_free(_param_offset, param_size());
+    MaterialManager::_id_release(_key);
+}
+
+void Material::_id_update() {
+    std::string key;
+    key.reserve(_texture_bindings.size() * sizeof(MaterialTexture) + _params.size());
+    for (const auto &binding : _texture_bindings) {
+        const GLuint fields[] = {binding.unit, binding.target, binding.id};
+        key.append(reinterpret_cast<const char *>(fields), sizeof(fields));
+    }
+    key.append(reinterpret_cast<const char *>(_params.data()), _params.size());
+    if (_id != 0 && key == _key)
+        return;
+
+    const uint64_t id = MaterialManager::_id_acquire(key);
+    if (_id != 0)
+        MaterialManager::_id_release(_key);
+    _key = std::move(key);
+    _id = id;
+}
+
+void Material::_mark_dirty() {
+    if (_dirty)
+        return;
+    _dirty = true;
+    MaterialManager::_dirty.push_back(this);
+}
+
+void Material::bind_textures() const {
+    for (const auto &binding : _texture_bindings)
+        TextureManager::texture_bind(binding.unit, binding.target, binding.id);
+}
+
+void Material::bind_params(GLuint block_binding) const {
+    if (!_params.empty())
+        glBindBufferRange(GL_UNIFORM_BUFFER, block_binding, MaterialManager::buffer(), _param_offset, param_size());
+}
+
+
+std::shared_ptr<Material>
+MaterialManager::material_create(std::vector<MaterialTexture> texture_bindings, GLsizeiptr param_size) {
+    assert(param_size >= 0);
+    auto material = std::shared_ptr<Material>(new Material(std::move(texture_bindings), param_size));
+    if (param_size > 0) {
+        material->_param_offset = _alloc(param_size);
+        material->_mark_dirty();
+    }
+    return material;
+}
+
+std::shared_ptr<Material>
+MaterialManager::material_create(const std::map<TextureType, std::vector<std::shared_ptr<Texture2D>>> &textures,
+                                 GLsizeiptr param_size) {
+    std::vector<MaterialTexture> texture_bindings;
+    for (const auto &[texture_type, texs] : textures) {
+        if (texs.empty())
+            continue;
+        texture_bindings.push_back({Material::texture_unit(texture_type), GL_TEXTURE_2D, texs[0]->id()});
+    }
+
+    auto material = material_create(std::move(texture_bindings), param_size);
+    material->_textures = textures;
+    return material;
+}
+
+void MaterialManager::upload() {
+    if (_dirty.empty())
+        return;
+
+    glBindBuffer(GL_UNIFORM_BUFFER, _buffer);
+    for (Material *material : _dirty) {
+        glBufferSubData(GL_UNIFORM_BUFFER, material->_param_offset, material->param_size(),
+                        material->_params.data());
+        material->_dirty = false;
+    }
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+    _dirty.clear();
+}
+
+GLintptr MaterialManager::_alloc(GLsizeiptr size) {
+    /* 第一次分配时创建 buffer */
+    if (_buffer == 0) {
+        glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &_alignment);
+        _grow(MATERIAL_BUFFER_INIT_CAPACITY);
+    }
+
+    /* 优先使用回收的区段 */
+    if (auto iter = _free_list.find(size); iter != _free_list.end()) {
+        GLintptr offset = iter->second;
+        _free_list.erase(iter);
+        return offset;
+    }
+
+    GLintptr offset = (_used + _alignment - 1) / _alignment * _alignment;
+    if (offset + size > _capacity)
+        _grow(offset + size);
+    _used = offset + size;
+    return offset;
+}
+
+void MaterialManager::_free(GLintptr offset, GLsizeiptr size) {
+    _free_list.emplace(size, offset);
+}
+
+uint64_t MaterialManager::_id_acquire(const std::string &key) {
+    auto [iter, inserted] = _ids.try_emplace(key, IdEntry{0, 0});
+    if (inserted)
+        iter->second.id = _next_id++;
+    ++iter->second.refs;
+    return iter->second.id;
+}
+
+void MaterialManager::_id_release(const std::string &key) {
+    auto iter = _ids.find(key);
+    if (iter == _ids.end())
+        return;
+    if (--iter->second.refs == 0)
+        _ids.erase(iter);
+}
+
+void MaterialManager::_grow(GLsizeiptr min_capacity) {
+    GLsizeiptr capacity = std::max(_capacity, MATERIAL_BUFFER_INIT_CAPACITY);
+    while (capacity < min_capacity)
+        capacity *= 2;
+
+    GLuint buffer;
+    glGenBuffers(1, &buffer);
+    glBindBuffer(GL_UNIFORM_BUFFER, buffer);
+    glBufferData(GL_UNIFORM_BUFFER, capacity, nullptr, GL_DYNAMIC_DRAW);
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+
+    /* 复制旧 buffer 中的参数 */
+    if (_buffer != 0) {
+        glBindBuffer(GL_COPY_READ_BUFFER, _buffer);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+        glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, _used);
+        glBindBuffer(GL_COPY_READ_BUFFER, 0);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+        glDeleteBuffers(1, &_buffer);
+    }
+
+    SPDLOG_INFO("material uniform buffer capacity: {} bytes", capacity);
+    _buffer = buffer;
+    _capacity = capacity;
+}
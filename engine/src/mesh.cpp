@@ -1,3 +1,5 @@
+#include <cmath>
+#include <algorithm>
 #include <stdexcept>
 #include "mesh.h"
 #include "global.h"
@@ -13,6 +15,29 @@ Mesh::Mesh(std::vector<Vertex> vertices, std::vector<Face> &faces,
     /* 设置 mesh 的位置 */
     _model_matrix = glm::translate(glm::one<glm::mat4>(), position);
 
+    /* 包围球：AABB 的中心，到最远顶点的距离 */
+    if (!vertices.empty()) {
+        glm::vec3 lo = vertices[0].positon, hi = vertices[0].positon;
+        for (const auto &vertex : vertices) {
+            lo = glm::min(lo, vertex.positon);
+            hi = glm::max(hi, vertex.positon);
+        }
+        _bounds_center = (lo + hi) * 0.5f;
+        for (const auto &vertex : vertices)
+            _bounds_radius = std::max(_bounds_radius, glm::length(vertex.positon - _bounds_center));
+    }
+
+    /* 纹理坐标的密度：纹理坐标的总面积和三角形的总面积之比，再开方 */
+    double area = 0.0, uv_area = 0.0;
+    for (const auto &face : faces) {
+        const Vertex &a = vertices[face.a], &b = vertices[face.b], &c = vertices[face.c];
+        area += 0.5 * glm::length(glm::cross(b.positon - a.positon, c.positon - a.positon));
+        glm::vec2 e1 = b.texcoord - a.texcoord, e2 = c.texcoord - a.texcoord;
+        uv_area += 0.5 * std::abs(e1.x * e2.y - e1.y * e2.x);
+    }
+    if (area > 0.0)
+        _uv_density = (float) std::sqrt(uv_area / area);
+
     // VAO
     glGenVertexArrays(1, &_vao);
     glBindVertexArray(_vao);
@@ -51,10 +76,9 @@ Mesh::Mesh(std::vector<Vertex> vertices, std::vector<Face> &faces,
 }
 
 
-Mesh Mesh::mesh_load(const aiMesh &mesh, const aiScene &scene, const std::string &dir) {
+Mesh Mesh::mesh_load(const aiMesh &mesh, const std::shared_ptr<Material> &material) {
     std::vector<Vertex> vertices;
     std::vector<Face> faces;
-    std::map<TextureType, std::vector<std::shared_ptr<Texture2D>>> textures;
 
     // 处理顶点
     for (unsigned int i = 0; i < mesh.mNumVertices; ++i) {
@@ -74,15 +98,15 @@ Mesh Mesh::mesh_load(const aiMesh &mesh, const aiScene &scene, const std::string
         faces.push_back(Face::face_gen(mesh.mFaces[i]));
     }
 
-    // 处理材质
-    if (mesh.mMaterialIndex < 0) {
+    // 处理材质：纹理已经在创建材质时载入了
+    if (material == nullptr) {
         SPDLOG_INFO("this mesh has no material.");
-    } else {
-        aiMaterial *material = scene.mMaterials[mesh.mMaterialIndex];
-        textures = TextureManager::textures_get(*material, dir);
+        return Mesh(vertices, faces, {});
     }
 
-    return Mesh(vertices, faces, textures);
+    Mesh result(vertices, faces, material->textures());
+    result.set_material(material);
+    return result;
 }
 
 
@@ -99,6 +123,25 @@ Mesh::Mesh(const std::vector<float> &vertices, const glm::vec3 &position,
     assert(vertices.size() % (all_component * 3) == 0);
     _primitive_cnt = GLsizei(vertices.size() / all_component / 3);
 
+    /* 包围球：AABB 的中心，到最远顶点的距离；位置不足 3 个分量时缺少的分量是 0 */
+    if (position_component != 0) {
+        auto vertex_position = [&](size_t i) {
+            glm::vec3 p{0.f};
+            for (int c = 0; c < std::min(position_component, 3); ++c)
+                p[c] = vertices[i * all_component + c];
+            return p;
+        };
+        const size_t vertex_cnt = vertices.size() / all_component;
+        glm::vec3 lo = vertex_position(0), hi = lo;
+        for (size_t i = 1; i < vertex_cnt; ++i) {
+            lo = glm::min(lo, vertex_position(i));
+            hi = glm::max(hi, vertex_position(i));
+        }
+        _bounds_center = (lo + hi) * 0.5f;
+        for (size_t i = 0; i < vertex_cnt; ++i)
+            _bounds_radius = std::max(_bounds_radius, glm::length(vertex_position(i) - _bounds_center));
+    }
+
     /* VAO */
     glGenVertexArrays(1, &_vao);
     glBindVertexArray(_vao);
@@ -136,16 +179,13 @@ void Mesh::draw(GLsizei amount) const {
     glBindVertexArray(this->_vao);
     switch (_type) {
         case MeshType::TriangleElement:
-            if (amount == 1)
-                glDrawElements(GL_TRIANGLES, _primitive_cnt * 3, GL_UNSIGNED_INT, nullptr);
-            else
-                glDrawElementsInstanced(GL_TRIANGLES, _primitive_cnt * 3, GL_UNSIGNED_INT, nullptr, amount);
+            draw_elements(GL_TRIANGLES, _primitive_cnt * 3, GL_UNSIGNED_INT, amount);
             break;
         case MeshType::TriangleArray:
-            glDrawArrays(GL_TRIANGLES, 0, _primitive_cnt * 3);
+            draw_arrays(GL_TRIANGLES, 0, _primitive_cnt * 3, amount);
             break;
         case MeshType::Line:
-            glDrawArrays(GL_LINES, 0, _primitive_cnt * 2);
+            draw_arrays(GL_LINES, 0, _primitive_cnt * 2);
             break;
         default:
             throw std::runtime_error("never");
@@ -153,6 +193,39 @@ void Mesh::draw(GLsizei amount) const {
     glBindVertexArray(0);
 }
 
+void Mesh::draw_arrays(GLenum mode, GLint first, GLsizei count, GLsizei amount) {
+    _draw_count(mode, count, amount);
+    if (amount == 1)
+        glDrawArrays(mode, first, count);
+    else
+        glDrawArraysInstanced(mode, first, count, amount);
+}
+
+void Mesh::draw_elements(GLenum mode, GLsizei count, GLenum type, GLsizei amount) {
+    _draw_count(mode, count, amount);
+    if (amount == 1)
+        glDrawElements(mode, count, type, nullptr);
+    else
+        glDrawElementsInstanced(mode, count, type, nullptr, amount);
+}
+
+void Mesh::_draw_count(GLenum mode, GLsizei count, GLsizei amount) {
+    size_t triangles = 0;
+    switch (mode) {
+        case GL_TRIANGLES:
+            triangles = (size_t) count / 3;
+            break;
+        case GL_TRIANGLE_STRIP:
+        case GL_TRIANGLE_FAN:
+            triangles = count > 2 ? (size_t) count - 2 : 0;
+            break;
+        default:
+            break;
+    }
+    _draws.fetch_add(1, std::memory_order_relaxed);
+    _triangles.fetch_add(triangles * (size_t) std::max<GLsizei>(amount, 0), std::memory_order_relaxed);
+}
+
 Mesh::Mesh(const std::vector<Line> &lines)
         : _type(MeshType::Line), _primitive_cnt(lines.size()) {
 
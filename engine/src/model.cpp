@@ -1,3 +1,5 @@
+#include <algorithm>
+
 #include "model.h"
 
 
@@ -11,20 +13,22 @@ void Model::rotate(const glm::vec3 &axis, float angle) {
 }
 
 void
-Model::process_node(std::vector<Mesh> &meshes, const aiNode &node, const aiScene &scene, const std::string &dir_path) {
+Model::process_node(std::vector<Mesh> &meshes, const aiNode &node, const aiScene &scene,
+                    const std::vector<std::shared_ptr<Material>> &materials) {
     /* 处理当前节点 */
     for (unsigned i = 0; i < node.mNumMeshes; ++i) {
         aiMesh *mesh = scene.mMeshes[node.mMeshes[i]];
-        meshes.push_back(Mesh::mesh_load(*mesh, scene, dir_path));
+        auto material = mesh->mMaterialIndex < materials.size() ? materials[mesh->mMaterialIndex] : nullptr;
+        meshes.push_back(Mesh::mesh_load(*mesh, material));
     }
 
     /* 处理子节点 */
     for (unsigned i = 0; i < node.mNumChildren; ++i) {
-        process_node(meshes, *node.mChildren[i], scene, dir_path);
+        process_node(meshes, *node.mChildren[i], scene, materials);
     }
 }
 
-std::shared_ptr<Model> Model::load_model(const std::string &path) {
+std::shared_ptr<Model> Model::load_model(const std::string &path, bool texture_array) {
     auto model = std::make_shared<Model>();
     Assimp::Importer importer;
 
@@ -41,8 +45,51 @@ std::shared_ptr<Model> Model::load_model(const std::string &path) {
     /* 获取模型所在目录的路径，用于读取 texture */
     std::string dir_path = path.substr(0, path.find_last_of('/')) + "/";
 
+    /* 每个 aiMaterial 只创建一次材质，纹理绑定在这里就确定了 */
+    std::vector<std::shared_ptr<Material>> materials;
+    if (texture_array) {
+        /**
+         * 每个材质的每种纹理引用一个 (纹理数组, 层)：纹理数组绑定到这种纹理的单元，层在参数块中；
+         * 纹理数组按照尺寸和格式分组，数量很少，尺寸相同的材质绑定的纹理完全相同，区别只在于参数块中的层
+         */
+        auto array_set = TextureManager::texture_arrays_get(*scene, dir_path);
+        for (unsigned i = 0; i < scene->mNumMaterials; ++i) {
+            std::vector<MaterialTexture> texture_bindings;
+            TextureLayers layers;
+            for (const auto &[tex_type, slot] : array_set.layers[i]) {
+                texture_bindings.push_back({Material::texture_unit(tex_type), GL_TEXTURE_2D_ARRAY,
+                                            array_set.arrays[slot.array]->id()});
+                switch (tex_type) {
+                    case TextureType::diffuse:
+                        layers.diffuse = slot.layer;
+                        break;
+                    case TextureType::specular:
+                        layers.specular = slot.layer;
+                        break;
+                    case TextureType::normal:
+                        layers.normal = slot.layer;
+                        break;
+                }
+            }
+            auto material = MaterialManager::material_create(texture_bindings, sizeof(TextureLayers));
+            material->params_set(layers);
+            materials.push_back(material);
+        }
+        model->_texture_arrays = std::move(array_set.arrays);
+    } else {
+        for (unsigned i = 0; i < scene->mNumMaterials; ++i) {
+            materials.push_back(MaterialManager::material_create(
+                    TextureManager::textures_get(*scene->mMaterials[i], dir_path)));
+        }
+    }
+
     /* 获取所有的 mesh */
-    process_node(model->_meshes, *scene->mRootNode, *scene, dir_path);
+    process_node(model->_meshes, *scene->mRootNode, *scene, materials);
+
+    /* 按照材质排序，相同材质的 mesh 连续绘制，减少纹理的切换 */
+    std::stable_sort(model->_meshes.begin(), model->_meshes.end(), [](const Mesh &a, const Mesh &b) {
+        return (a.material() ? a.material()->id() : 0) < (b.material() ? b.material()->id() : 0);
+    });
 
     return model;
 }
@@ -0,0 +1,465 @@
+#include <map>
+#include <cfloat>
+#include <cstdio>
+#include <fstream>
+#include <algorithm>
+#include <stdexcept>
+#include <functional>
+
+#include <fmt/format.h>
+#include <spdlog/spdlog.h>
+#include <imgui.h>
+
+#include "profiler.h"
+#include "utils/json.h"
+
+
+// =====================================================
+// ProfileFrame 和 ProfileRing
+// =====================================================
+
+double ProfileFrame::gpu_ms() const {
+    int64_t total = 0;
+    for (const auto &event : gpu)
+        if (event.depth == 0)
+            total += event.end_ns - event.begin_ns;
+    return (double) total / 1e6;
+}
+
+bool ProfileRing::push(const ProfileEvent &event) {
+    /* 只有生产者修改 _head；_tail 使用 acquire，保证消费者已经读完了这个位置 */
+    size_t head = _head.load(std::memory_order_relaxed);
+    if (head - _tail.load(std::memory_order_acquire) >= CAPACITY) {
+        _dropped.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+    _events[head % CAPACITY] = event;
+    _head.store(head + 1, std::memory_order_release);
+    return true;
+}
+
+void ProfileRing::drain(std::vector<ProfileEvent> &out) {
+    size_t tail = _tail.load(std::memory_order_relaxed);
+    size_t head = _head.load(std::memory_order_acquire);
+    for (; tail != head; ++tail)
+        out.push_back(_events[tail % CAPACITY]);
+    _tail.store(tail, std::memory_order_release);
+}
+
+
+// =====================================================
+// Profiler
+// =====================================================
+
+void Profiler::init() {
+    if (enabled())
+        return;
+    _epoch = std::chrono::steady_clock::now();
+    for (auto &gpu_frame : _gpu_frames)
+        gpu_frame = GpuFrame{};
+    _gpu_offset_ns = _gpu_offset();
+    _frame_index = 0;
+    _enabled = true;
+    thread_name_set("main");
+    SPDLOG_INFO("profiler enabled, history: {} frames.", HISTORY);
+}
+
+void Profiler::terminate() {
+    if (!enabled())
+        return;
+    _enabled = false;
+    for (auto &gpu_frame : _gpu_frames) {
+        if (!gpu_frame.queries.empty())
+            glDeleteQueries((GLsizei) gpu_frame.queries.size(), gpu_frame.queries.data());
+        gpu_frame = GpuFrame{};
+    }
+    _gpu_current = nullptr;
+    _gpu_stack.clear();
+    _frames.clear();
+}
+
+void Profiler::frame_begin() {
+    if (!enabled())
+        return;
+    _current = ProfileFrame{};
+    _current.index = _frame_index;
+    _current.begin_ns = now_ns();
+
+    /* 这一组查询还没有读取时，说明 GPU 落后了 GPU_FRAMES 帧以上，放弃这一帧的结果，不等待 */
+    GpuFrame &gpu_frame = _gpu_frames[_frame_index % GPU_FRAMES];
+    if (gpu_frame.pending && !_gpu_resolve(gpu_frame)) {
+        _dropped_gpu += gpu_frame.zones.size();
+        if (ProfileFrame *frame = _frame_find(gpu_frame.frame))
+            frame->gpu_resolved = true;
+    }
+    if (_frame_index % GPU_CALIBRATE_FRAMES == 0)
+        _gpu_offset_ns = _gpu_offset();
+    gpu_frame.used = 0;
+    gpu_frame.zones.clear();
+    gpu_frame.frame = _frame_index;
+    gpu_frame.offset_ns = _gpu_offset_ns;
+    gpu_frame.pending = true;
+    _gpu_current = &gpu_frame;
+    _gpu_stack.clear();
+}
+
+void Profiler::frame_end() {
+    if (!enabled())
+        return;
+    _current.end_ns = now_ns();
+    _collect(_current.cpu);
+    std::sort(_current.cpu.begin(), _current.cpu.end(), [](const ProfileEvent &a, const ProfileEvent &b) {
+        return a.begin_ns != b.begin_ns ? a.begin_ns < b.begin_ns : a.depth < b.depth;
+    });
+
+    /* 之前几帧的 GPU 查询，结果可用时读取；当前这一帧的查询还在进行 */
+    for (auto &gpu_frame : _gpu_frames)
+        if (gpu_frame.pending && &gpu_frame != _gpu_current)
+            _gpu_resolve(gpu_frame);
+    _gpu_current = nullptr;
+
+    if (!_paused) {
+        _frames.push_back(std::move(_current));
+        while (_frames.size() > HISTORY)
+            _frames.pop_front();
+    }
+    ++_frame_index;
+}
+
+void Profiler::thread_name_set(const std::string &name) {
+    Thread &thread = _thread();
+    std::lock_guard lock(_threads_mutex);
+    _thread_names[thread.index] = name;
+}
+
+std::string Profiler::thread_name(uint16_t thread) {
+    std::lock_guard lock(_threads_mutex);
+    if (thread < _thread_names.size() && !_thread_names[thread].empty())
+        return _thread_names[thread];
+    return fmt::format("thread {}", thread);
+}
+
+size_t Profiler::dropped() {
+    std::lock_guard lock(_threads_mutex);
+    size_t total = _dropped_exited + _dropped_gpu;
+    for (const auto &thread : _threads)
+        total += thread->ring.dropped();
+    return total;
+}
+
+int64_t Profiler::now_ns() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - _epoch).count();
+}
+
+uint16_t Profiler::_cpu_begin() {
+    return _thread().depth++;
+}
+
+void Profiler::_cpu_end(const char *name, int64_t begin_ns, uint16_t depth) {
+    Thread &thread = _thread();
+    thread.depth = depth;
+    thread.ring.push({name, begin_ns, now_ns(), depth, thread.index});
+}
+
+void Profiler::_gpu_begin(const char *name) {
+    if (_gpu_current == nullptr)
+        return;
+    GpuZone zone{name, 0, 0, (uint16_t) _gpu_stack.size()};
+    glQueryCounter(_gpu_query(*_gpu_current, zone.begin_query), GL_TIMESTAMP);
+    _gpu_stack.push_back(_gpu_current->zones.size());
+    _gpu_current->zones.push_back(zone);
+}
+
+void Profiler::_gpu_end() {
+    if (_gpu_current == nullptr || _gpu_stack.empty())
+        return;
+    GpuZone &zone = _gpu_current->zones[_gpu_stack.back()];
+    _gpu_stack.pop_back();
+    glQueryCounter(_gpu_query(*_gpu_current, zone.end_query), GL_TIMESTAMP);
+}
+
+Profiler::Thread &Profiler::_thread() {
+    /* 线程退出时标记为结束，剩下的事件由 _collect() 取出 */
+    struct Local {
+        std::shared_ptr<Thread> thread;
+
+        ~Local() {
+            if (thread)
+                thread->exited = true;
+        }
+    };
+    thread_local Local local;
+
+    if (!local.thread) {
+        local.thread = std::make_shared<Thread>();
+        std::lock_guard lock(_threads_mutex);
+        local.thread->index = (uint16_t) _thread_names.size();
+        _thread_names.emplace_back();
+        _threads.push_back(local.thread);
+    }
+    return *local.thread;
+}
+
+void Profiler::_collect(std::vector<ProfileEvent> &out) {
+    std::lock_guard lock(_threads_mutex);
+    for (auto iter = _threads.begin(); iter != _threads.end();) {
+        /* 先读取 exited：标记之后线程不会再写入，取出事件之后就可以删除 */
+        bool exited = (*iter)->exited;
+        (*iter)->ring.drain(out);
+        if (exited) {
+            _dropped_exited += (*iter)->ring.dropped();
+            iter = _threads.erase(iter);
+        } else {
+            ++iter;
+        }
+    }
+}
+
+bool Profiler::_gpu_resolve(GpuFrame &gpu_frame) {
+    ProfileFrame *frame = _frame_find(gpu_frame.frame);
+    if (gpu_frame.used == 0) {
+        gpu_frame.pending = false;
+        if (frame)
+            frame->gpu_resolved = true;
+        return true;
+    }
+
+    /* 查询按照发出的顺序完成，最后一个可用时，所有的结果都可用 */
+    GLuint available = GL_FALSE;
+    glGetQueryObjectuiv(gpu_frame.queries[gpu_frame.used - 1], GL_QUERY_RESULT_AVAILABLE, &available);
+    if (!available)
+        return false;
+
+    gpu_frame.pending = false;
+    if (frame == nullptr)
+        return true;
+    for (const auto &zone : gpu_frame.zones) {
+        GLuint64 begin = 0, end = 0;
+        glGetQueryObjectui64v(gpu_frame.queries[zone.begin_query], GL_QUERY_RESULT, &begin);
+        glGetQueryObjectui64v(gpu_frame.queries[zone.end_query], GL_QUERY_RESULT, &end);
+        frame->gpu.push_back({zone.name, (int64_t) begin + gpu_frame.offset_ns, (int64_t) end + gpu_frame.offset_ns,
+                              zone.depth, 0});
+    }
+    std::sort(frame->gpu.begin(), frame->gpu.end(), [](const ProfileEvent &a, const ProfileEvent &b) {
+        return a.begin_ns != b.begin_ns ? a.begin_ns < b.begin_ns : a.depth < b.depth;
+    });
+    frame->gpu_resolved = true;
+    return true;
+}
+
+int64_t Profiler::_gpu_offset() {
+    GLint64 gpu_ns = 0;
+    glGetInteger64v(GL_TIMESTAMP, &gpu_ns);
+    return now_ns() - (int64_t) gpu_ns;
+}
+
+const ProfileFrame *Profiler::frame_find(uint64_t index) {
+    return _frame_find(index);
+}
+
+ProfileFrame *Profiler::_frame_find(uint64_t index) {
+    /* 暂停期间的帧没有记录，编号不连续，不能用编号的差作为下标；编号是递增的，二分查找 */
+    auto iter = std::lower_bound(_frames.begin(), _frames.end(), index,
+                                 [](const ProfileFrame &frame, uint64_t i) { return frame.index < i; });
+    return iter != _frames.end() && iter->index == index ? &*iter : nullptr;
+}
+
+GLuint Profiler::_gpu_query(GpuFrame &gpu_frame, size_t &index) {
+    if (gpu_frame.used == gpu_frame.queries.size()) {
+        size_t grow = std::max<size_t>(16, gpu_frame.queries.size());
+        gpu_frame.queries.resize(gpu_frame.queries.size() + grow);
+        glGenQueries((GLsizei) grow, gpu_frame.queries.data() + gpu_frame.used);
+    }
+    index = gpu_frame.used++;
+    return gpu_frame.queries[index];
+}
+
+
+// =====================================================
+// Chrome trace
+// =====================================================
+
+void Profiler::trace_save(const std::string &path) {
+    std::ofstream file(path);
+    if (!file)
+        throw std::runtime_error(fmt::format("fail to open trace file: {}", path));
+
+    /* 时间的单位是微秒；ph 为 X 的事件包含开始的时间和持续的时间 */
+    std::vector<std::string> events;
+    events.push_back(R"({"name":"process_name","ph":"M","pid":0,"args":{"name":"CPU"}})");
+    events.push_back(R"({"name":"process_name","ph":"M","pid":1,"args":{"name":"GPU"}})");
+    {
+        std::lock_guard lock(_threads_mutex);
+        for (size_t i = 0; i < _thread_names.size(); ++i)
+            events.push_back(fmt::format(R"({{"name":"thread_name","ph":"M","pid":0,"tid":{},"args":{{"name":"{}"}}}})",
+                                         i, json_escape(_thread_names[i].empty() ? fmt::format("thread {}", i)
+                                                                                 : _thread_names[i])));
+    }
+    auto event_write = [&](const ProfileEvent &event, int pid, uint64_t frame) {
+        events.push_back(fmt::format(
+                R"({{"name":"{}","cat":"{}","ph":"X","ts":{:.3f},"dur":{:.3f},"pid":{},"tid":{},"args":{{"frame":{}}}}})",
+                json_escape(event.name), pid == 0 ? "cpu" : "gpu", (double) event.begin_ns / 1e3,
+                (double) (event.end_ns - event.begin_ns) / 1e3, pid, event.thread, frame));
+    };
+    for (const auto &frame : _frames) {
+        events.push_back(fmt::format(R"({{"name":"frame {}","cat":"frame","ph":"X","ts":{:.3f},"dur":{:.3f},"pid":0,"tid":0}})",
+                                     frame.index, (double) frame.begin_ns / 1e3,
+                                     (double) (frame.end_ns - frame.begin_ns) / 1e3));
+        for (const auto &event : frame.cpu)
+            event_write(event, 0, frame.index);
+        for (const auto &event : frame.gpu)
+            event_write(event, 1, frame.index);
+    }
+
+    file << R"({"displayTimeUnit":"ms","traceEvents":[)" << "\n";
+    for (size_t i = 0; i < events.size(); ++i)
+        file << events[i] << (i + 1 < events.size() ? ",\n" : "\n");
+    file << "]}\n";
+    SPDLOG_INFO("save profiler trace: {}, {} frames, {} events.", path, _frames.size(), events.size());
+}
+
+
+// =====================================================
+// ImGui
+// =====================================================
+
+/* 根据名字选择颜色，同一个区段的颜色总是相同 */
+static ImU32 zone_color(const char *name) {
+    float hue = (float) (std::hash<std::string>{}(name) % 1000) / 1000.f;
+    return ImColor::HSV(hue, 0.45f, 0.9f);
+}
+
+void Profiler::gui() {
+    if (!enabled())
+        return;
+    ImGui::SetNextWindowSize(ImVec2(720, 420), ImGuiCond_FirstUseEver);
+    ImGui::Begin("profiler");
+    if (_frames.empty()) {
+        ImGui::Text("no frame recorded.");
+        ImGui::End();
+        return;
+    }
+
+    /* 帧时间的曲线 */
+    std::vector<float> cpu_ms, gpu_ms;
+    for (const auto &frame : _frames) {
+        cpu_ms.push_back((float) frame.cpu_ms());
+        gpu_ms.push_back((float) frame.gpu_ms());
+    }
+    ImGui::PlotLines("cpu (ms)", cpu_ms.data(), (int) cpu_ms.size(), 0, nullptr, 0.f, FLT_MAX, ImVec2(0, 48));
+    ImGui::PlotLines("gpu (ms)", gpu_ms.data(), (int) gpu_ms.size(), 0, nullptr, 0.f, FLT_MAX, ImVec2(0, 48));
+
+    bool paused = _paused;
+    if (ImGui::Checkbox("pause", &paused))
+        _paused = paused;
+    ImGui::SameLine();
+    if (ImGui::Button("export trace")) {
+        try {
+            trace_save("profile-trace.json");
+        } catch (const std::exception &e) {
+            SPDLOG_ERROR("{}", e.what());
+        }
+    }
+
+    /* 默认显示 GPU 结果已经可用的最新一帧 */
+    int latest = (int) _frames.size() - 1;
+    while (latest > 0 && !_frames[latest].gpu_resolved)
+        --latest;
+    ImGui::SliderInt("frame offset", &_gui_frame_offset, 0, latest);
+    _gui_frame_offset = std::clamp(_gui_frame_offset, 0, latest);
+    const ProfileFrame &frame = _frames[latest - _gui_frame_offset];
+    ImGui::SliderFloat("zoom", &_gui_zoom, 1.f, 32.f, "%.1fx");
+    ImGui::Text("frame %llu: cpu %.2f ms, gpu %.2f ms, dropped events: %zu", (unsigned long long) frame.index,
+                frame.cpu_ms(), frame.gpu_ms(), dropped());
+
+    /* 时间线：每个线程一组，GPU 一组，每个嵌套层一行 */
+    struct Lane {
+        std::string name;
+        std::vector<const ProfileEvent *> events;
+        int rows{1};
+    };
+    std::map<int, Lane> lanes;              // key：线程的编号，GPU 是 -1
+    for (const auto &event : frame.cpu) {
+        Lane &lane = lanes[event.thread];
+        lane.events.push_back(&event);
+        lane.rows = std::max(lane.rows, event.depth + 1);
+    }
+    for (const auto &event : frame.gpu) {
+        Lane &lane = lanes[-1];
+        lane.events.push_back(&event);
+        lane.rows = std::max(lane.rows, event.depth + 1);
+    }
+    int64_t begin_ns = frame.begin_ns, end_ns = frame.end_ns;
+    for (const auto &[key, lane] : lanes)
+        for (const auto *event : lane.events)
+            end_ns = std::max(end_ns, event->end_ns);
+    const double span_ns = (double) std::max<int64_t>(1, end_ns - begin_ns);
+
+    const float row_height = ImGui::GetTextLineHeightWithSpacing();
+    ImGui::BeginChild("timeline", ImVec2(0, row_height * 12), true, ImGuiWindowFlags_HorizontalScrollbar);
+    const float width = (ImGui::GetContentRegionAvail().x - 8.f) * _gui_zoom;
+    ImDrawList *draw_list = ImGui::GetWindowDrawList();
+    ImVec2 origin = ImGui::GetCursorScreenPos();
+    float y = origin.y;
+    for (auto &[key, lane] : lanes) {
+        draw_list->AddText(ImVec2(origin.x, y), ImGui::GetColorU32(ImGuiCol_Text),
+                           (key < 0 ? std::string("GPU") : thread_name((uint16_t) key)).c_str());
+        y += row_height;
+        for (const auto *event : lane.events) {
+            float x0 = origin.x + (float) ((double) (event->begin_ns - begin_ns) / span_ns) * width;
+            float x1 = origin.x + (float) ((double) (event->end_ns - begin_ns) / span_ns) * width;
+            x1 = std::max(x1, x0 + 1.f);
+            ImVec2 min(x0, y + (float) event->depth * row_height), max(x1, min.y + row_height - 1.f);
+            draw_list->AddRectFilled(min, max, zone_color(event->name));
+            if (ImGui::CalcTextSize(event->name).x < x1 - x0 - 4.f) {
+                draw_list->PushClipRect(min, max, true);
+                draw_list->AddText(ImVec2(x0 + 2.f, min.y), IM_COL32(0, 0, 0, 255), event->name);
+                draw_list->PopClipRect();
+            }
+            if (ImGui::IsMouseHoveringRect(min, max))
+                ImGui::SetTooltip("%s: %.3f ms", event->name, (double) (event->end_ns - event->begin_ns) / 1e6);
+        }
+        y += (float) lane.rows * row_height;
+    }
+    ImGui::Dummy(ImVec2(width, y - origin.y));
+    ImGui::EndChild();
+
+    /* 每个区段在这一帧中的调用次数和总耗时 */
+    struct Total {
+        int calls{0};
+        double ms{0.0};
+    };
+    std::map<std::pair<std::string, bool>, Total> totals;
+    for (const auto &event : frame.cpu) {
+        Total &total = totals[{event.name, false}];
+        total.calls += 1;
+        total.ms += (double) (event.end_ns - event.begin_ns) / 1e6;
+    }
+    for (const auto &event : frame.gpu) {
+        Total &total = totals[{event.name, true}];
+        total.calls += 1;
+        total.ms += (double) (event.end_ns - event.begin_ns) / 1e6;
+    }
+    std::vector<std::pair<std::pair<std::string, bool>, Total>> sorted(totals.begin(), totals.end());
+    std::sort(sorted.begin(), sorted.end(), [](const auto &a, const auto &b) { return a.second.ms > b.second.ms; });
+    if (ImGui::BeginTable("zones", 4, ImGuiTableFlags_Borders | ImGuiTableFlags_RowBg)) {
+        ImGui::TableSetupColumn("zone");
+        ImGui::TableSetupColumn("type");
+        ImGui::TableSetupColumn("calls");
+        ImGui::TableSetupColumn("ms");
+        ImGui::TableHeadersRow();
+        for (const auto &[key, total] : sorted) {
+            ImGui::TableNextRow();
+            ImGui::TableNextColumn();
+            ImGui::TextUnformatted(key.first.c_str());
+            ImGui::TableNextColumn();
+            ImGui::TextUnformatted(key.second ? "gpu" : "cpu");
+            ImGui::TableNextColumn();
+            ImGui::Text("%d", total.calls);
+            ImGui::TableNextColumn();
+            ImGui::Text("%.3f", total.ms);
+        }
+        ImGui::EndTable();
+    }
+    ImGui::End();
+}
@@ -1,4 +1,8 @@
+#include <filesystem>
+
 #include "render.h"
+#include "gl_ext.h"
+#include "image_writer.h"
 #include <glad/glad.h>
 #include <GLFW/glfw3.h>
 #include <spdlog/spdlog.h>
@@ -24,8 +28,156 @@ void Render::_spdlog_init() {
     spdlog::set_pattern("[%H:%M:%S][%^%L%$][%15!s:%-3!#][%!] %v");
 }
 
-void Render::_glfw_init() {
-    glfwInit();
+RenderOptions RenderOptions::parse(int argc, char **argv) {
+    RenderOptions options;
+    if (argc > 0)
+        options.name = std::filesystem::path(argv[0]).filename().string();
+
+    auto usage = [&](const std::string &message) {
+        SPDLOG_ERROR("{}", message);
+        SPDLOG_ERROR("usage: {} [--headless] [--size WxH] [--frames n] [--timestep s] [--capture 0,30,59|all] "
+                     "[--capture-dir dir] [--capture-format png|exr] [--bench path|spin] [--warmup n] "
+                     "[--bench-out prefix] [--record-path file] [--pipeline n] [--swap-interval n] "
+                     "[--fps-limit n] [--dynamic-res ms] [--res-scale min,max] [--upscale sharpen|bilinear] [--debug-gui]",
+                     options.name);
+        exit(-1);
+    };
+
+    bool frames_set = false, timestep_set = false;
+    try {
+        for (int i = 1; i < argc; ++i) {
+            std::string arg = argv[i];
+            auto value = [&]() -> std::string {
+                if (i + 1 >= argc)
+                    usage(fmt::format("missing value of {}", arg));
+                return argv[++i];
+            };
+            if (arg == "--headless") {
+                options.headless = true;
+            } else if (arg == "--debug-gui") {
+                options.debug_gui = true;
+            } else if (arg == "--size") {
+                std::string size = value();
+                size_t x = size.find('x');
+                if (x == std::string::npos)
+                    usage(fmt::format("bad size: {}", size));
+                options.width = std::stoi(size.substr(0, x));
+                options.height = std::stoi(size.substr(x + 1));
+                if (options.width <= 0 || options.height <= 0)
+                    usage(fmt::format("bad size: {}", size));
+            } else if (arg == "--frames") {
+                options.frames = std::stoi(value());
+                frames_set = true;
+            } else if (arg == "--timestep") {
+                options.timestep = std::stod(value());
+                timestep_set = true;
+            } else if (arg == "--capture") {
+                std::string frames = value();
+                if (frames == "all") {
+                    options.capture_all = true;
+                    continue;
+                }
+                for (size_t begin = 0; begin < frames.size();) {
+                    size_t end = std::min(frames.find(',', begin), frames.size());
+                    options.captures.push_back(std::stoi(frames.substr(begin, end - begin)));
+                    begin = end + 1;
+                }
+            } else if (arg == "--capture-dir") {
+                options.capture_dir = value();
+            } else if (arg == "--capture-format") {
+                options.capture_format = value();
+                if (options.capture_format != "png" && options.capture_format != "exr")
+                    usage(fmt::format("bad capture format: {}", options.capture_format));
+            } else if (arg == "--bench") {
+                options.bench.path = value();
+            } else if (arg == "--warmup") {
+                options.bench.warmup = std::stoi(value());
+            } else if (arg == "--bench-out") {
+                options.bench.out = value();
+            } else if (arg == "--record-path") {
+                options.bench.record = value();
+            } else if (arg == "--pipeline") {
+                options.pipeline = std::stoi(value());
+                if (options.pipeline < 0 || options.pipeline > FramePipeline::MAX_DEPTH)
+                    usage(fmt::format("bad pipeline depth: {}", options.pipeline));
+            } else if (arg == "--swap-interval") {
+                options.swap_interval = std::stoi(value());
+                if (options.swap_interval < -1)
+                    usage(fmt::format("bad swap interval: {}", options.swap_interval));
+            } else if (arg == "--fps-limit") {
+                options.fps_limit = std::stod(value());
+                if (options.fps_limit < 0.0)
+                    usage(fmt::format("bad fps limit: {}", options.fps_limit));
+            } else if (arg == "--dynamic-res") {
+                options.dynamic_res.enabled = true;
+                options.dynamic_res.target_ms = std::stod(value());
+                if (options.dynamic_res.target_ms <= 0.0)
+                    usage(fmt::format("bad dynamic resolution target: {}", options.dynamic_res.target_ms));
+            } else if (arg == "--res-scale") {
+                std::string range = value();
+                size_t comma = range.find(',');
+                if (comma == std::string::npos)
+                    usage(fmt::format("bad resolution scale: {}", range));
+                options.dynamic_res.min_scale = std::stof(range.substr(0, comma));
+                options.dynamic_res.max_scale = std::stof(range.substr(comma + 1));
+                const auto &res = options.dynamic_res;
+                if (res.min_scale <= 0.f || res.min_scale > res.max_scale || res.max_scale > 1.f)
+                    usage(fmt::format("bad resolution scale: {}", range));
+            } else if (arg == "--upscale") {
+                std::string upscale = value();
+                if (upscale != "sharpen" && upscale != "bilinear")
+                    usage(fmt::format("bad upscale filter: {}", upscale));
+                options.dynamic_res.sharpen = upscale == "sharpen";
+            } else {
+                usage(fmt::format("unknown option: {}", arg));
+            }
+        }
+    } catch (const std::logic_error &e) {
+        /* std::stoi，std::stod 解析失败 */
+        usage(fmt::format("bad number: {}", e.what()));
+    }
+
+    /**
+     * benchmark 中 --frames 是测量的帧数；摄像机路径按照固定的步长回放，和机器的速度无关
+     * 测量的是渲染的耗时，不能等待显示器的刷新或者限帧
+     */
+    if (!options.bench.path.empty()) {
+        if (frames_set)
+            options.bench.frames = options.frames;
+        if (!timestep_set)
+            options.timestep = 1.0 / 60.0;
+        options.swap_interval = 0;
+        options.fps_limit = 0.0;
+    }
+    /* 离屏模式的画面不能取决于 GPU 的速度 */
+    if (options.headless) {
+        options.fps_limit = 0.0;
+        options.dynamic_res.enabled = false;
+    }
+
+    /* 深度大于 1 时会丢弃帧，绘制哪些帧取决于线程的调度 */
+    if (options.headless || !options.bench.path.empty())
+        options.pipeline = std::min(options.pipeline, 1);
+
+    /* 离屏模式总是要退出的，时间也不应该取决于机器的速度 */
+    if (options.headless && !frames_set)
+        options.frames = 60;
+    if (options.headless && !timestep_set)
+        options.timestep = 1.0 / 60.0;
+    return options;
+}
+
+void Render::_glfw_init(bool headless) {
+#if GLFW_VERSION_MAJOR * 100 + GLFW_VERSION_MINOR >= 304
+    if (headless)
+        glfwInitHint(GLFW_PLATFORM, GLFW_PLATFORM_NULL);
+#else
+    (void) headless;
+#endif
+    if (!glfwInit()) {
+        SPDLOG_ERROR("fail to init glfw.");
+        exit(-1);
+    }
     glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
     glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
     glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
@@ -39,6 +191,43 @@ void Render::_glad_init() {
         SPDLOG_ERROR("fail to _init glad");
         exit(-1);
     }
+
+    /* 载入 glad 没有生成的扩展 */
+    GLExt::init((GLADloadproc) glfwGetProcAddress);
+}
+
+void Render::_headless_init() {
+    _target = std::make_unique<FrameBuffer>(_options.width, _options.height, _options.capture_format == "exr");
+    FrameBuffer::screen_set(_target->id());
+    glBindFramebuffer(GL_FRAMEBUFFER, _target->id());
+    glViewport(0, 0, _options.width, _options.height);
+}
+
+void Render::_capture() {
+    PROFILE_ZONE("capture");
+    const int width = Window::width(), height = Window::height();
+    std::filesystem::create_directories(_options.capture_dir);
+    std::string path = fmt::format("{}/{}-{:05d}.{}", _options.capture_dir, _options.name, _frame,
+                                   _options.capture_format);
+
+    /* 读取屏幕的帧缓冲；第 0 行是画面的底部，保存时翻转 */
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, FrameBuffer::screen());
+    glPixelStorei(GL_PACK_ALIGNMENT, 1);
+    try {
+        if (_options.capture_format == "exr") {
+            std::vector<float> pixels((size_t) width * height * 3);
+            glReadPixels(0, 0, width, height, GL_RGB, GL_FLOAT, pixels.data());
+            image_exr_save(path, width, height, 3, pixels.data(), true);
+        } else {
+            std::vector<unsigned char> pixels((size_t) width * height * 3);
+            glReadPixels(0, 0, width, height, GL_RGB, GL_UNSIGNED_BYTE, pixels.data());
+            image_png_save(path, width, height, 3, pixels.data(), true);
+        }
+        SPDLOG_INFO("capture frame {}: {}", _frame, path);
+    } catch (const std::exception &e) {
+        SPDLOG_ERROR("fail to capture frame {}: {}", _frame, e.what());
+    }
+    glPixelStorei(GL_PACK_ALIGNMENT, 4);
 }
 
 void Render::_imgui_init() {
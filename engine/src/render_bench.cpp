@@ -0,0 +1,179 @@
+#include <cmath>
+#include <fstream>
+#include <numeric>
+#include <stdexcept>
+#include <algorithm>
+
+#include <fmt/format.h>
+#include <spdlog/spdlog.h>
+
+#include "mesh.h"
+#include "window.h"
+#include "render_bench.h"
+#include "utils/json.h"
+
+
+void RenderBench::init(const BenchOptions &options, double timestep, const std::string &name) {
+    _options = options;
+    _name = name;
+    _timestep = timestep > 0.0 ? timestep : 1.0 / 60.0;
+    if (_options.out.empty())
+        _options.out = _name + "-bench";
+
+    double duration = SPIN_SECONDS;
+    if (_options.path != "spin") {
+        _path = CameraPath::load(_options.path);
+        duration = _path.duration();
+    }
+    _measured = _options.frames > 0 ? _options.frames : (int) std::ceil(duration / _timestep - 1e-6) + 1;
+    _records.clear();
+    _records.reserve(_measured);
+    _enabled = true;
+
+    SPDLOG_INFO("bench: path {} ({:.2f} s), {} warm-up frames, {} measured frames", _options.path, duration,
+                _options.warmup, _measured);
+}
+
+void RenderBench::terminate() {
+    if (!_queries.empty())
+        glDeleteQueries((GLsizei) _queries.size(), _queries.data());
+    _queries.clear();
+    _enabled = false;
+}
+
+int RenderBench::frames() {
+    return _enabled ? std::max(0, _options.warmup) + _measured : 0;
+}
+
+void RenderBench::start(const Camera &camera) {
+    if (!_enabled)
+        return;
+    if (_options.path == "spin")
+        _path = CameraPath::spin(camera, SPIN_SECONDS);
+
+    _queries.resize(_measured);
+    glGenQueries((GLsizei) _queries.size(), _queries.data());
+}
+
+int RenderBench::_measured_index(int frame) {
+    const int measured = frame - std::max(0, _options.warmup);
+    return measured >= 0 && measured < _measured ? measured : -1;
+}
+
+void RenderBench::pose(int frame, Camera &camera) {
+    /* 预热阶段停在路径的起点 */
+    const int measured = _measured_index(frame);
+    _path.apply(measured < 0 ? 0.0 : _timestep * measured, camera);
+}
+
+void RenderBench::frame_begin(int frame) {
+    _current = _measured_index(frame);
+    Mesh::draw_stats_reset();
+    if (_current >= 0) {
+        glBeginQuery(GL_TIME_ELAPSED, _queries[_current]);
+        _records.push_back({_current, _timestep * _current});
+    }
+    _begin = std::chrono::steady_clock::now();
+}
+
+void RenderBench::frame_end() {
+    if (_current < 0)
+        return;
+    glEndQuery(GL_TIME_ELAPSED);
+
+    auto &record = _records.back();
+    record.cpu_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - _begin).count();
+    record.draws = Mesh::draw_stats().draws;
+    record.triangles = Mesh::draw_stats().triangles;
+}
+
+void RenderBench::report() {
+    if (!_enabled)
+        return;
+    if (_records.empty()) {
+        SPDLOG_WARN("bench: no frame was measured");
+        return;
+    }
+
+    /* 所有的查询都已经发出，这里等待 GPU 完成 */
+    for (auto &record: _records) {
+        GLuint64 elapsed = 0;
+        glGetQueryObjectui64v(_queries[record.frame], GL_QUERY_RESULT, &elapsed);
+        record.gpu_ms = (double) elapsed / 1e6;
+    }
+
+    try {
+        _json_save(_options.out + ".json");
+        _csv_save(_options.out + ".csv");
+    } catch (const std::exception &e) {
+        SPDLOG_ERROR("bench: {}", e.what());
+    }
+
+    std::vector<double> cpu, gpu;
+    for (const auto &record: _records) {
+        cpu.push_back(record.cpu_ms);
+        gpu.push_back(record.gpu_ms);
+    }
+    auto cpu_summary = _summary(cpu), gpu_summary = _summary(gpu);
+    SPDLOG_INFO("bench: {} frames, cpu p50 {:.3f} p95 {:.3f} p99 {:.3f} max {:.3f} ms, "
+                "gpu p50 {:.3f} p95 {:.3f} p99 {:.3f} max {:.3f} ms -> {}.json", _records.size(),
+                cpu_summary.p50, cpu_summary.p95, cpu_summary.p99, cpu_summary.max,
+                gpu_summary.p50, gpu_summary.p95, gpu_summary.p99, gpu_summary.max, _options.out);
+}
+
+RenderBench::Summary RenderBench::_summary(std::vector<double> values) {
+    if (values.empty())
+        return {0, 0, 0, 0, 0};
+    std::sort(values.begin(), values.end());
+    auto percentile = [&](double p) {
+        auto rank = (size_t) std::ceil(p * (double) values.size());
+        return values[std::clamp<size_t>(rank, 1, values.size()) - 1];
+    };
+    double mean = std::accumulate(values.begin(), values.end(), 0.0) / (double) values.size();
+    return {mean, percentile(0.50), percentile(0.95), percentile(0.99), values.back()};
+}
+
+void RenderBench::_json_save(const std::string &path) {
+    std::ofstream file(path);
+    if (!file)
+        throw std::runtime_error(fmt::format("fail to open bench report: {}", path));
+
+    auto metric = [&](const char *name, auto field) {
+        std::vector<double> values;
+        for (const auto &record: _records)
+            values.push_back((double) (record.*field));
+        auto s = _summary(values);
+        return fmt::format("    \"{}\": {{\"mean\": {:.4f}, \"p50\": {:.4f}, \"p95\": {:.4f}, \"p99\": {:.4f}, "
+                           "\"max\": {:.4f}}}", name, s.mean, s.p50, s.p95, s.p99, s.max);
+    };
+
+    file << "{\n";
+    file << fmt::format("  \"scene\": \"{}\",\n", json_escape(_name));
+    file << fmt::format("  \"path\": \"{}\",\n", json_escape(_options.path));
+    file << fmt::format("  \"size\": [{}, {}],\n", Window::width(), Window::height());
+    file << fmt::format("  \"warmup\": {},\n", _options.warmup);
+    file << fmt::format("  \"frames\": {},\n", _records.size());
+    file << fmt::format("  \"timestep\": {:.6f},\n", _timestep);
+    file << "  \"metrics\": {\n";
+    file << metric("cpu_ms", &BenchFrame::cpu_ms) << ",\n";
+    file << metric("gpu_ms", &BenchFrame::gpu_ms) << ",\n";
+    file << metric("draws", &BenchFrame::draws) << ",\n";
+    file << metric("triangles", &BenchFrame::triangles) << "\n";
+    file << "  }\n";
+    file << "}\n";
+    if (!file)
+        throw std::runtime_error(fmt::format("fail to write bench report: {}", path));
+}
+
+void RenderBench::_csv_save(const std::string &path) {
+    std::ofstream file(path);
+    if (!file)
+        throw std::runtime_error(fmt::format("fail to open bench report: {}", path));
+
+    file << "frame,time,cpu_ms,gpu_ms,draws,triangles\n";
+    for (const auto &record: _records)
+        file << fmt::format("{},{:.4f},{:.4f},{:.4f},{},{}\n", record.frame, record.time, record.cpu_ms,
+                            record.gpu_ms, record.draws, record.triangles);
+    if (!file)
+        throw std::runtime_error(fmt::format("fail to write bench report: {}", path));
+}
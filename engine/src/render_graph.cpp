@@ -0,0 +1,453 @@
+#include <cmath>
+#include <queue>
+#include <climits>
+#include <cassert>
+#include <stdexcept>
+#include <algorithm>
+
+#include <imgui.h>
+#include <fmt/format.h>
+#include <spdlog/spdlog.h>
+
+#include "profiler.h"
+#include "frame_buffer.h"
+#include "render_graph.h"
+
+
+/* 内部格式对应的像素格式，每个像素的字节数，以及作为帧缓冲的哪种附件 */
+struct GraphFormat {
+    GLenum format;
+    GLenum type;
+    size_t bytes;
+    GLenum attachment;          // GL_COLOR_ATTACHMENT0 表示颜色附件
+};
+
+static GraphFormat graph_format(GLenum internal) {
+    switch (internal) {
+        case GL_R8:
+            return {GL_RED, GL_UNSIGNED_BYTE, 1, GL_COLOR_ATTACHMENT0};
+        case GL_RG8:
+            return {GL_RG, GL_UNSIGNED_BYTE, 2, GL_COLOR_ATTACHMENT0};
+        case GL_RGBA8:
+            return {GL_RGBA, GL_UNSIGNED_BYTE, 4, GL_COLOR_ATTACHMENT0};
+        case GL_R16F:
+            return {GL_RED, GL_HALF_FLOAT, 2, GL_COLOR_ATTACHMENT0};
+        case GL_RG16F:
+            return {GL_RG, GL_HALF_FLOAT, 4, GL_COLOR_ATTACHMENT0};
+        case GL_RGBA16F:
+            return {GL_RGBA, GL_HALF_FLOAT, 8, GL_COLOR_ATTACHMENT0};
+        case GL_R32F:
+            return {GL_RED, GL_FLOAT, 4, GL_COLOR_ATTACHMENT0};
+        case GL_RGBA32F:
+            return {GL_RGBA, GL_FLOAT, 16, GL_COLOR_ATTACHMENT0};
+        case GL_R11F_G11F_B10F:
+            return {GL_RGB, GL_FLOAT, 4, GL_COLOR_ATTACHMENT0};
+        case GL_DEPTH_COMPONENT24:
+            return {GL_DEPTH_COMPONENT, GL_UNSIGNED_INT, 4, GL_DEPTH_ATTACHMENT};
+        case GL_DEPTH_COMPONENT32F:
+            return {GL_DEPTH_COMPONENT, GL_FLOAT, 4, GL_DEPTH_ATTACHMENT};
+        case GL_DEPTH24_STENCIL8:
+            return {GL_DEPTH_STENCIL, GL_UNSIGNED_INT_24_8, 4, GL_DEPTH_STENCIL_ATTACHMENT};
+        default:
+            throw std::runtime_error(fmt::format("render graph: unsupported texture format 0x{:x}", internal));
+    }
+}
+
+
+// =====================================================
+// 声明
+// =====================================================
+
+GraphTexture RenderGraph::Builder::create(const char *name, const GraphTextureDesc &desc) {
+    graph_format(desc.format);
+    _graph._resources.push_back({name, desc, false, false, 0, 0, 0, {}, INT_MAX, -1, -1});
+    return {(uint32_t) _graph._resources.size() - 1};
+}
+
+GraphTexture RenderGraph::Builder::read(GraphTexture texture) {
+    assert(texture.valid() && texture.index < _graph._resources.size());
+    _graph._passes[_pass].reads.push_back(texture.index);
+    return texture;
+}
+
+GraphTexture RenderGraph::Builder::write(GraphTexture texture, bool clear) {
+    assert(texture.valid() && texture.index < _graph._resources.size());
+    _graph._passes[_pass].writes.push_back({texture.index, clear});
+    _graph._resources[texture.index].writers.push_back(_pass);
+    return texture;
+}
+
+void RenderGraph::Builder::side_effect() {
+    _graph._passes[_pass].side_effect = true;
+}
+
+GLuint RenderGraph::Resources::texture(GraphTexture texture) const {
+    assert(texture.valid() && _graph._declared(_pass, texture.index));
+    return _graph._resources[texture.index].texture;
+}
+
+RenderGraph::~RenderGraph() {
+    for (auto &[attachments, fbo]: _fbos)
+        glDeleteFramebuffers(1, &fbo);
+    for (auto &physical: _pool)
+        glDeleteTextures(1, &physical.texture);
+}
+
+void RenderGraph::reset() {
+    _passes.clear();
+    _resources.clear();
+    _order.clear();
+}
+
+GraphTexture RenderGraph::import(const char *name, GLuint texture, const GraphTextureDesc &desc) {
+    assert(desc.width > 0 && desc.height > 0);
+    _resources.push_back({name, desc, true, false, texture, desc.width, desc.height, {}, INT_MAX, -1, -1});
+    return {(uint32_t) _resources.size() - 1};
+}
+
+GraphTexture RenderGraph::backbuffer() {
+    for (uint32_t i = 0; i < _resources.size(); ++i)
+        if (_resources[i].backbuffer)
+            return {i};
+    _resources.push_back({"backbuffer", {}, true, true, 0, 0, 0, {}, INT_MAX, -1, -1});
+    return {(uint32_t) _resources.size() - 1};
+}
+
+void RenderGraph::add_pass(const char *name, const Setup &setup, Execute execute) {
+    _passes.push_back({name, std::move(execute), {}, {}, false, false, 0.0});
+    Builder builder(*this, (uint32_t) _passes.size() - 1);
+    setup(builder);
+}
+
+bool RenderGraph::_declared(uint32_t pass, uint32_t resource) const {
+    const Pass &p = _passes[pass];
+    return std::find(p.reads.begin(), p.reads.end(), resource) != p.reads.end() ||
+           std::any_of(p.writes.begin(), p.writes.end(), [&](const Attachment &a) { return a.resource == resource; });
+}
+
+
+// =====================================================
+// 编译
+// =====================================================
+
+void RenderGraph::_compile() {
+    /* 剔除：从有外部输出的 pass 开始，向前标记它们读取的纹理的写入者 */
+    std::vector<uint32_t> stack;
+    for (uint32_t i = 0; i < _passes.size(); ++i) {
+        Pass &pass = _passes[i];
+        pass.alive = pass.side_effect || std::any_of(pass.writes.begin(), pass.writes.end(), [&](const Attachment &a) {
+            return _resources[a.resource].imported;
+        });
+        if (pass.alive)
+            stack.push_back(i);
+    }
+    while (!stack.empty()) {
+        const uint32_t index = stack.back();
+        stack.pop_back();
+        for (uint32_t resource: _passes[index].reads) {
+            if (_resources[resource].writers.empty() && !_resources[resource].imported)
+                SPDLOG_WARN("render graph: {} reads {}, which is never written", _passes[index].name,
+                            _resources[resource].name);
+            for (uint32_t writer: _resources[resource].writers)
+                if (!_passes[writer].alive) {
+                    _passes[writer].alive = true;
+                    stack.push_back(writer);
+                }
+        }
+    }
+
+    /* 依赖：写入者在读取者之前，同一个纹理的写入者按照声明的顺序 */
+    const size_t count = _passes.size();
+    std::vector<std::vector<uint32_t>> next(count);
+    std::vector<int> in_degree(count, 0);
+    auto edge = [&](uint32_t from, uint32_t to) {
+        if (from == to)
+            return;
+        next[from].push_back(to);
+        ++in_degree[to];
+    };
+    for (uint32_t r = 0; r < _resources.size(); ++r) {
+        std::vector<uint32_t> writers;
+        for (uint32_t writer: _resources[r].writers)
+            if (_passes[writer].alive && (writers.empty() || writers.back() != writer))
+                writers.push_back(writer);
+        for (size_t i = 1; i < writers.size(); ++i)
+            edge(writers[i - 1], writers[i]);
+        for (uint32_t p = 0; p < count; ++p) {
+            const Pass &pass = _passes[p];
+            if (!pass.alive || std::find(pass.reads.begin(), pass.reads.end(), r) == pass.reads.end() ||
+                std::find(writers.begin(), writers.end(), p) != writers.end())
+                continue;
+            for (uint32_t writer: writers)
+                edge(writer, p);
+        }
+    }
+
+    /* 拓扑排序，可以执行的 pass 中先执行先声明的 */
+    std::priority_queue<uint32_t, std::vector<uint32_t>, std::greater<>> ready;
+    size_t alive = 0;
+    for (uint32_t p = 0; p < count; ++p) {
+        if (!_passes[p].alive)
+            continue;
+        ++alive;
+        if (in_degree[p] == 0)
+            ready.push(p);
+    }
+    while (!ready.empty()) {
+        const uint32_t p = ready.top();
+        ready.pop();
+        _order.push_back(p);
+        for (uint32_t to: next[p])
+            if (--in_degree[to] == 0)
+                ready.push(to);
+    }
+    if (_order.size() != alive)
+        throw std::runtime_error("render graph: passes have a cyclic dependency");
+
+    /* 纹理的生存期：执行顺序中第一个和最后一个使用它的 pass */
+    for (int position = 0; position < (int) _order.size(); ++position) {
+        const Pass &pass = _passes[_order[position]];
+        auto touch = [&](uint32_t r) {
+            _resources[r].first = std::min(_resources[r].first, position);
+            _resources[r].last = std::max(_resources[r].last, position);
+        };
+        for (uint32_t r: pass.reads)
+            touch(r);
+        for (const Attachment &a: pass.writes)
+            touch(a.resource);
+    }
+}
+
+void RenderGraph::_allocate() {
+    for (auto &physical: _pool)
+        physical.busy_until = -1;
+
+    /* 按照第一次使用的顺序分配，空闲的物理纹理中规格相同的可以复用 */
+    std::vector<uint32_t> transient;
+    for (uint32_t r = 0; r < _resources.size(); ++r) {
+        Resource &resource = _resources[r];
+        if (resource.backbuffer) {
+            resource.width = _width;
+            resource.height = _height;
+        }
+        if (resource.imported || resource.last < 0)
+            continue;
+        resource.width = resource.desc.width > 0 ? resource.desc.width
+                                                 : std::max(1, (int) std::lround(_width * resource.desc.scale));
+        resource.height = resource.desc.height > 0 ? resource.desc.height
+                                                   : std::max(1, (int) std::lround(_height * resource.desc.scale));
+        transient.push_back(r);
+    }
+    std::sort(transient.begin(), transient.end(),
+              [&](uint32_t a, uint32_t b) { return _resources[a].first < _resources[b].first; });
+
+    for (uint32_t r: transient) {
+        Resource &resource = _resources[r];
+        auto iter = std::find_if(_pool.begin(), _pool.end(), [&](const Physical &physical) {
+            return physical.busy_until < resource.first && physical.format == resource.desc.format &&
+                   physical.width == resource.width && physical.height == resource.height;
+        });
+        if (iter == _pool.end()) {
+            const GraphFormat format = graph_format(resource.desc.format);
+            const bool color = format.attachment == GL_COLOR_ATTACHMENT0;
+            GLuint texture;
+            glGenTextures(1, &texture);
+            glBindTexture(GL_TEXTURE_2D, texture);
+            glTexImage2D(GL_TEXTURE_2D, 0, (GLint) resource.desc.format, resource.width, resource.height, 0,
+                         format.format, format.type, nullptr);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, color ? GL_LINEAR : GL_NEAREST);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, color ? GL_LINEAR : GL_NEAREST);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+            glBindTexture(GL_TEXTURE_2D, 0);
+            _pool.push_back({texture, resource.desc.format, resource.width, resource.height, -1, _frame});
+            iter = _pool.end() - 1;
+            SPDLOG_INFO("render graph: new texture {}x{} 0x{:x} for {}", resource.width, resource.height,
+                        resource.desc.format, resource.name);
+        }
+        iter->busy_until = resource.last;
+        iter->last_frame = _frame;
+        resource.physical = (int) (iter - _pool.begin());
+        resource.texture = iter->texture;
+    }
+}
+
+
+// =====================================================
+// 执行
+// =====================================================
+
+std::pair<int, int> RenderGraph::_bind(const Pass &pass) {
+    if (pass.writes.empty())
+        return {_width, _height};
+
+    /* 写入屏幕：屏幕不能和其他纹理组成帧缓冲 */
+    const bool screen = std::any_of(pass.writes.begin(), pass.writes.end(),
+                                    [&](const Attachment &a) { return _resources[a.resource].backbuffer; });
+    if (screen) {
+        if (pass.writes.size() != 1)
+            throw std::runtime_error(fmt::format("render graph: {} writes the backbuffer with other textures",
+                                                 pass.name));
+        glBindFramebuffer(GL_FRAMEBUFFER, FrameBuffer::screen());
+        glViewport(0, 0, _width, _height);
+        if (pass.writes[0].clear) {
+            glClearColor(0, 0, 0, 0);
+            glDepthMask(GL_TRUE);
+            glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+        }
+        return {_width, _height};
+    }
+
+    /* 颜色附件依次排列，最后是深度附件（没有时是 0） */
+    std::vector<GLuint> key;
+    const Attachment *depth = nullptr;
+    for (const Attachment &a: pass.writes) {
+        if (graph_format(_resources[a.resource].desc.format).attachment == GL_COLOR_ATTACHMENT0)
+            key.push_back(_resources[a.resource].texture);
+        else
+            depth = &a;
+    }
+    key.push_back(depth ? _resources[depth->resource].texture : 0);
+
+    auto iter = _fbos.find(key);
+    if (iter == _fbos.end()) {
+        GLuint fbo;
+        glGenFramebuffers(1, &fbo);
+        glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+        std::vector<GLenum> draw_buffers;
+        for (const Attachment &a: pass.writes) {
+            const GraphFormat format = graph_format(_resources[a.resource].desc.format);
+            GLenum attachment = format.attachment;
+            if (attachment == GL_COLOR_ATTACHMENT0) {
+                attachment = GL_COLOR_ATTACHMENT0 + (GLenum) draw_buffers.size();
+                draw_buffers.push_back(attachment);
+            }
+            glFramebufferTexture2D(GL_FRAMEBUFFER, attachment, GL_TEXTURE_2D, _resources[a.resource].texture, 0);
+        }
+        if (draw_buffers.empty()) {
+            glDrawBuffer(GL_NONE);
+            glReadBuffer(GL_NONE);
+        } else {
+            glDrawBuffers((GLsizei) draw_buffers.size(), draw_buffers.data());
+        }
+        if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+            glDeleteFramebuffers(1, &fbo);
+            glBindFramebuffer(GL_FRAMEBUFFER, FrameBuffer::screen());
+            throw std::runtime_error(fmt::format("render graph: frame buffer of {} is not complete", pass.name));
+        }
+        iter = _fbos.emplace(key, fbo).first;
+    }
+    glBindFramebuffer(GL_FRAMEBUFFER, iter->second);
+
+    /* 所有的附件一样大 */
+    const Resource &first = _resources[pass.writes[0].resource];
+    glViewport(0, 0, first.width, first.height);
+
+    /* 按照声明清空：复用的物理纹理中是其他纹理留下的内容 */
+    GLint color_index = 0;
+    for (const Attachment &a: pass.writes) {
+        const GraphFormat format = graph_format(_resources[a.resource].desc.format);
+        if (format.attachment == GL_COLOR_ATTACHMENT0) {
+            if (a.clear) {
+                const GLfloat zero[4] = {0.f, 0.f, 0.f, 0.f};
+                glClearBufferfv(GL_COLOR, color_index, zero);
+            }
+            ++color_index;
+        } else if (a.clear) {
+            glDepthMask(GL_TRUE);
+            if (format.attachment == GL_DEPTH_STENCIL_ATTACHMENT) {
+                glClearBufferfi(GL_DEPTH_STENCIL, 0, 1.f, 0);
+            } else {
+                const GLfloat one = 1.f;
+                glClearBufferfv(GL_DEPTH, 0, &one);
+            }
+        }
+    }
+    return {first.width, first.height};
+}
+
+void RenderGraph::execute(int width, int height) {
+    ++_frame;
+    _width = width;
+    _height = height;
+    _compile();
+    _allocate();
+
+    for (uint32_t index: _order) {
+        Pass &pass = _passes[index];
+        ProfileZone zone(pass.name);
+        GpuProfileZone gpu_zone(pass.name);
+        const int64_t begin = Profiler::now_ns();
+        auto[pass_width, pass_height] = _bind(pass);
+        pass.execute(Resources(*this, index, pass_width, pass_height));
+        pass.cpu_ms = (double) (Profiler::now_ns() - begin) / 1e6;
+    }
+    glBindFramebuffer(GL_FRAMEBUFFER, FrameBuffer::screen());
+    glViewport(0, 0, _width, _height);
+
+    /* 统计 */
+    _stats = {_passes.size(), _passes.size() - _order.size(), 0, 0, _pool.size(), 0, 0};
+    std::vector<bool> used(_pool.size(), false);
+    for (const Resource &resource: _resources) {
+        if (resource.imported || resource.physical < 0)
+            continue;
+        const size_t bytes = (size_t) resource.width * resource.height * graph_format(resource.desc.format).bytes;
+        ++_stats.textures;
+        _stats.texture_bytes += bytes;
+        if (!used[resource.physical]) {
+            used[resource.physical] = true;
+            ++_stats.physical;
+            _stats.physical_bytes += bytes;
+        }
+    }
+
+    _trim();
+}
+
+void RenderGraph::_trim() {
+    for (size_t i = _pool.size(); i-- > 0;) {
+        if (_frame - _pool[i].last_frame <= POOL_FRAMES)
+            continue;
+        const GLuint texture = _pool[i].texture;
+        for (auto iter = _fbos.begin(); iter != _fbos.end();) {
+            if (std::find(iter->first.begin(), iter->first.end(), texture) != iter->first.end()) {
+                glDeleteFramebuffers(1, &iter->second);
+                iter = _fbos.erase(iter);
+            } else {
+                ++iter;
+            }
+        }
+        glDeleteTextures(1, &texture);
+        _pool.erase(_pool.begin() + (ptrdiff_t) i);
+    }
+}
+
+void RenderGraph::gui(const char *title) const {
+    ImGui::Begin(title);
+    ImGui::Text("passes: %zu, culled %zu", _stats.passes, _stats.culled);
+    ImGui::Text("textures: %zu -> %zu physical (%.1f MB -> %.1f MB), pool %zu", _stats.textures, _stats.physical,
+                (double) _stats.texture_bytes / 1048576.0, (double) _stats.physical_bytes / 1048576.0,
+                _stats.pooled);
+
+    if (ImGui::TreeNodeEx("passes", ImGuiTreeNodeFlags_DefaultOpen)) {
+        for (uint32_t index: _order)
+            ImGui::Text("%-20s %.3f ms", _passes[index].name, _passes[index].cpu_ms);
+        for (const Pass &pass: _passes)
+            if (!pass.alive)
+                ImGui::TextDisabled("%-20s culled", pass.name);
+        ImGui::TreePop();
+    }
+    if (ImGui::TreeNode("textures")) {
+        for (const Resource &resource: _resources) {
+            if (resource.imported)
+                ImGui::Text("%-20s imported", resource.name);
+            else if (resource.physical < 0)
+                ImGui::TextDisabled("%-20s unused", resource.name);
+            else
+                ImGui::Text("%-20s %dx%d -> #%d, pass %d..%d", resource.name, resource.width, resource.height,
+                            resource.physical, resource.first, resource.last);
+        }
+        ImGui::TreePop();
+    }
+    ImGui::End();
+}
@@ -0,0 +1,292 @@
+#include <cmath>
+#include <tuple>
+#include <cassert>
+#include <algorithm>
+#include <stdexcept>
+
+#include <imgui.h>
+#include <spdlog/spdlog.h>
+
+#include "window.h"
+#include "frame_buffer.h"
+#include "render_target.h"
+
+
+/* 内部格式对应的像素格式，像素类型，每个像素的字节数，附件的位置 */
+struct TargetFormat {
+    GLenum format;
+    GLenum type;
+    size_t bytes;
+    GLenum attachment;
+};
+
+static TargetFormat target_format(GLenum internal) {
+    switch (internal) {
+        case GL_RGB8:
+            return {GL_RGB, GL_UNSIGNED_BYTE, 3, GL_COLOR_ATTACHMENT0};
+        case GL_RGBA8:
+            return {GL_RGBA, GL_UNSIGNED_BYTE, 4, GL_COLOR_ATTACHMENT0};
+        case GL_RGBA16F:
+            return {GL_RGBA, GL_HALF_FLOAT, 8, GL_COLOR_ATTACHMENT0};
+        case GL_RGBA32F:
+            return {GL_RGBA, GL_FLOAT, 16, GL_COLOR_ATTACHMENT0};
+        case GL_R11F_G11F_B10F:
+            return {GL_RGB, GL_FLOAT, 4, GL_COLOR_ATTACHMENT0};
+        case GL_DEPTH_COMPONENT24:
+            return {GL_DEPTH_COMPONENT, GL_UNSIGNED_INT, 4, GL_DEPTH_ATTACHMENT};
+        case GL_DEPTH_COMPONENT32F:
+            return {GL_DEPTH_COMPONENT, GL_FLOAT, 4, GL_DEPTH_ATTACHMENT};
+        case GL_DEPTH24_STENCIL8:
+            return {GL_DEPTH_STENCIL, GL_UNSIGNED_INT_24_8, 4, GL_DEPTH_STENCIL_ATTACHMENT};
+        default:
+            throw std::runtime_error(fmt::format("render target: unsupported format 0x{:x}", internal));
+    }
+}
+
+/* 渲染目标的实际尺寸，相对尺寸按照窗口计算 */
+static std::pair<int, int> target_size(const RenderTargetDesc &desc) {
+    if (!desc.relative())
+        return {desc.width, desc.height};
+    return {std::max(1, (int) std::lround((float) Window::width() * desc.scale)),
+            std::max(1, (int) std::lround((float) Window::height() * desc.scale))};
+}
+
+bool RenderTargetDesc::operator<(const RenderTargetDesc &other) const {
+    return std::tie(width, height, scale, color, depth, samples) <
+           std::tie(other.width, other.height, other.scale, other.color, other.depth, other.samples);
+}
+
+
+// =====================================================
+// 渲染目标
+// =====================================================
+
+RenderTarget::RenderTarget(const RenderTargetDesc &desc)
+        : _desc(desc), _width(target_size(desc).first), _height(target_size(desc).second) {
+    const GLenum depth_attachment = _desc.depth ? target_format(_desc.depth).attachment : GL_NONE;
+    if (_desc.color)
+        target_format(_desc.color);
+
+    glGenFramebuffers(1, &_frame_buffer);
+    glBindFramebuffer(GL_FRAMEBUFFER, _frame_buffer);
+    if (_desc.samples > 0) {
+        if (_desc.color) {
+            glGenRenderbuffers(1, &_color);
+            glBindRenderbuffer(GL_RENDERBUFFER, _color);
+            glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, _color);
+        }
+        if (_desc.depth) {
+            glGenRenderbuffers(1, &_depth);
+            glBindRenderbuffer(GL_RENDERBUFFER, _depth);
+            glFramebufferRenderbuffer(GL_FRAMEBUFFER, depth_attachment, GL_RENDERBUFFER, _depth);
+        }
+        glBindRenderbuffer(GL_RENDERBUFFER, 0);
+    } else {
+        auto texture_create = [](GLenum filter) {
+            GLuint texture;
+            glGenTextures(1, &texture);
+            glBindTexture(GL_TEXTURE_2D, texture);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, (GLint) filter);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, (GLint) filter);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+            return texture;
+        };
+        if (_desc.color) {
+            _color = texture_create(GL_LINEAR);
+            glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, _color, 0);
+        }
+        if (_desc.depth) {
+            _depth = texture_create(GL_NEAREST);
+            glFramebufferTexture2D(GL_FRAMEBUFFER, depth_attachment, GL_TEXTURE_2D, _depth, 0);
+        }
+        glBindTexture(GL_TEXTURE_2D, 0);
+    }
+    _storage();
+
+    /* 没有颜色附件时由使用者挂上自己的纹理，之后才完整 */
+    if (_desc.color && glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+        SPDLOG_ERROR("render target is not complete.");
+        glBindFramebuffer(GL_FRAMEBUFFER, FrameBuffer::screen());
+        throw std::runtime_error("render target is not complete");
+    }
+    glBindFramebuffer(GL_FRAMEBUFFER, FrameBuffer::screen());
+}
+
+RenderTarget::~RenderTarget() {
+    glDeleteFramebuffers(1, &_frame_buffer);
+    if (_desc.samples > 0) {
+        glDeleteRenderbuffers(1, &_color);
+        glDeleteRenderbuffers(1, &_depth);
+    } else {
+        glDeleteTextures(1, &_color);
+        glDeleteTextures(1, &_depth);
+    }
+}
+
+void RenderTarget::_storage() {
+    if (_desc.samples > 0) {
+        for (auto [buffer, internal]: {std::pair{_color, _desc.color}, std::pair{_depth, _desc.depth}}) {
+            if (!buffer)
+                continue;
+            glBindRenderbuffer(GL_RENDERBUFFER, buffer);
+            glRenderbufferStorageMultisample(GL_RENDERBUFFER, _desc.samples, internal, _width, _height);
+        }
+        glBindRenderbuffer(GL_RENDERBUFFER, 0);
+    } else {
+        for (auto [texture, internal]: {std::pair{_color, _desc.color}, std::pair{_depth, _desc.depth}}) {
+            if (!texture)
+                continue;
+            const TargetFormat format = target_format(internal);
+            glBindTexture(GL_TEXTURE_2D, texture);
+            glTexImage2D(GL_TEXTURE_2D, 0, (GLint) internal, _width, _height, 0, format.format, format.type, nullptr);
+        }
+        glBindTexture(GL_TEXTURE_2D, 0);
+    }
+}
+
+void RenderTarget::resize(int width, int height) {
+    width = std::max(1, width);
+    height = std::max(1, height);
+    if (width == _width && height == _height)
+        return;
+    _width = width;
+    _height = height;
+    _storage();
+}
+
+void RenderTarget::_attachments_reset() {
+    glBindFramebuffer(GL_FRAMEBUFFER, _frame_buffer);
+    if (_desc.samples > 0)
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, _color);
+    else
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, _color, 0);
+    glBindFramebuffer(GL_FRAMEBUFFER, FrameBuffer::screen());
+}
+
+void RenderTarget::blit(const RenderTarget &target) const {
+    GLbitfield mask = 0;
+    if (_desc.color && target._desc.color)
+        mask |= GL_COLOR_BUFFER_BIT;
+    if (_desc.depth && target._desc.depth)
+        mask |= _desc.depth == GL_DEPTH24_STENCIL8 && target._desc.depth == GL_DEPTH24_STENCIL8
+                ? GL_DEPTH_BUFFER_BIT | GL_STENCIL_BUFFER_BIT : GL_DEPTH_BUFFER_BIT;
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, _frame_buffer);
+    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, target._frame_buffer);
+    glBlitFramebuffer(0, 0, _width, _height, 0, 0, target._width, target._height, mask, GL_NEAREST);
+    glBindFramebuffer(GL_FRAMEBUFFER, FrameBuffer::screen());
+}
+
+size_t RenderTarget::bytes() const {
+    size_t pixel = 0;
+    if (_desc.color)
+        pixel += target_format(_desc.color).bytes;
+    if (_desc.depth)
+        pixel += target_format(_desc.depth).bytes;
+    return (size_t) _width * _height * pixel * std::max(1, _desc.samples);
+}
+
+void RenderTarget::in() {
+    glBindFramebuffer(GL_FRAMEBUFFER, _frame_buffer);
+}
+
+void RenderTarget::out() {
+    glBindFramebuffer(GL_FRAMEBUFFER, FrameBuffer::screen());
+}
+
+
+// =====================================================
+// 渲染目标池
+// =====================================================
+
+void RenderTargetPool::init() {
+    if (_listening)
+        return;
+    Window::resize_listen(_resize);
+    _listening = true;
+}
+
+void RenderTargetPool::terminate() {
+    for (auto &[desc, target]: _targets) {
+        if (target->_busy)
+            SPDLOG_WARN("render target {}x{} is still acquired.", target->width(), target->height());
+    }
+    _targets.clear();
+}
+
+RenderTarget &RenderTargetPool::acquire(const RenderTargetDesc &desc) {
+    auto [begin, end] = _targets.equal_range(desc);
+    for (auto iter = begin; iter != end; ++iter) {
+        if (iter->second->_busy)
+            continue;
+        iter->second->_busy = true;
+        ++_reused;
+        return *iter->second;
+    }
+
+    auto target = std::make_unique<RenderTarget>(desc);
+    target->_busy = true;
+    ++_created;
+    return *_targets.emplace(desc, std::move(target))->second;
+}
+
+void RenderTargetPool::release(RenderTarget &target) {
+    assert(target._busy);
+    target._attachments_reset();
+    target._busy = false;
+    target._last_frame = _frame;
+}
+
+void RenderTargetPool::frame_end() {
+    ++_frame;
+    for (auto iter = _targets.begin(); iter != _targets.end();) {
+        const RenderTarget &target = *iter->second;
+        if (!target._busy && _frame - target._last_frame > POOL_FRAMES)
+            iter = _targets.erase(iter);
+        else
+            ++iter;
+    }
+}
+
+void RenderTargetPool::_resize(int, int) {
+    for (auto iter = _targets.begin(); iter != _targets.end();) {
+        RenderTarget &target = *iter->second;
+        if (!iter->first.relative()) {
+            ++iter;
+        } else if (target._busy) {
+            auto [width, height] = target_size(iter->first);
+            target.resize(width, height);
+            ++iter;
+        } else {
+            iter = _targets.erase(iter);
+        }
+    }
+}
+
+
+// =====================================================
+// 统计
+// =====================================================
+
+RenderTargetPool::Stats RenderTargetPool::stats() {
+    Stats stats{_targets.size(), 0, 0, _created, _reused};
+    for (auto &[desc, target]: _targets) {
+        stats.busy += target->_busy ? 1 : 0;
+        stats.bytes += target->bytes();
+    }
+    return stats;
+}
+
+void RenderTargetPool::gui() {
+    const Stats stats = RenderTargetPool::stats();
+    ImGui::Begin("render targets");
+    ImGui::Text("targets: %zu, acquired: %zu, %.1f MB", stats.targets, stats.busy,
+                (double) stats.bytes / (1024.0 * 1024.0));
+    ImGui::Text("created: %llu, reused: %llu", (unsigned long long) stats.created,
+                (unsigned long long) stats.reused);
+    for (auto &[desc, target]: _targets) {
+        ImGui::Text("%s %4d x %-4d color 0x%04x depth 0x%04x x%d", target->_busy ? "*" : " ", target->width(),
+                    target->height(), desc.color, desc.depth, std::max(1, desc.samples));
+    }
+    ImGui::End();
+}
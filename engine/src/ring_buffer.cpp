@@ -0,0 +1,134 @@
+#include <cassert>
+#include <stdexcept>
+
+#include <fmt/format.h>
+#include <spdlog/spdlog.h>
+
+#include "gl_ext.h"
+#include "ring_buffer.h"
+
+
+/* 等待 fence 的超时时间：1 ms，超时后继续等待 */
+const GLuint64 FENCE_WAIT_TIMEOUT_NS = 1000000;
+
+
+RingBuffer::RingBuffer(GLenum target, GLsizeiptr frame_size)
+        : _target(target), _frame_size(frame_size), _frame_idx(FRAME_CNT - 1) {
+    assert(frame_size > 0);
+
+    /* 每个区段的起始位置都按 256 字节对齐，满足所有类型 buffer 的偏移要求 */
+    _frame_size = (frame_size + 255) / 256 * 256;
+    GLsizeiptr total_size = _frame_size * FRAME_CNT;
+
+    glGenBuffers(1, &_id);
+    glBindBuffer(_target, _id);
+
+    if (GLExt::ARB_buffer_storage) {
+        /* 持久映射 + 一致性映射：CPU 的写入对 GPU 直接可见，不需要 flush */
+        GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+        GLExt::BufferStorage(_target, total_size, nullptr, flags);
+        _mapped = static_cast<unsigned char *>(glMapBufferRange(_target, 0, total_size, flags));
+        _persistent = _mapped != nullptr;
+        if (!_persistent) {
+            /* glBufferStorage 之后 buffer 的存储不可变，不能再 glBufferData，换一个新的 buffer 对象 */
+            SPDLOG_WARN("fail to map buffer persistently");
+            glBindBuffer(_target, 0);
+            glDeleteBuffers(1, &_id);
+            glGenBuffers(1, &_id);
+            glBindBuffer(_target, _id);
+        }
+    }
+    if (!_persistent) {
+        /* 不支持持久映射时，buffer 的存储是可变的 */
+        glBufferData(_target, total_size, nullptr, GL_STREAM_DRAW);
+    }
+
+    glBindBuffer(_target, 0);
+    SPDLOG_INFO("ring buffer: {} x {} bytes, persistent: {}", FRAME_CNT, _frame_size, _persistent);
+}
+
+RingBuffer::~RingBuffer() {
+    for (auto &fence : _fences) {
+        if (fence != nullptr)
+            glDeleteSync(fence);
+    }
+    if (_persistent) {
+        glBindBuffer(_target, _id);
+        glUnmapBuffer(_target);
+        glBindBuffer(_target, 0);
+    }
+    glDeleteBuffers(1, &_id);
+}
+
+void RingBuffer::frame_begin() {
+    _frame_idx = (_frame_idx + 1) % FRAME_CNT;
+    _frame_used = 0;
+
+    /* 等待 GPU 用完这个区段 */
+    GLsync &fence = _fences[_frame_idx];
+    if (fence == nullptr)
+        return;
+    GLbitfield wait_flags = GL_SYNC_FLUSH_COMMANDS_BIT;
+    while (true) {
+        GLenum result = glClientWaitSync(fence, wait_flags, FENCE_WAIT_TIMEOUT_NS);
+        if (result == GL_ALREADY_SIGNALED || result == GL_CONDITION_SATISFIED)
+            break;
+        if (result == GL_WAIT_FAILED) {
+            SPDLOG_ERROR("fail to wait ring buffer fence");
+            break;
+        }
+        wait_flags = 0;
+    }
+    glDeleteSync(fence);
+    fence = nullptr;
+}
+
+void RingBuffer::frame_end() {
+    GLsync &fence = _fences[_frame_idx];
+    if (fence != nullptr)
+        glDeleteSync(fence);
+    fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+}
+
+RingAlloc RingBuffer::alloc(GLsizeiptr size, GLsizeiptr alignment) {
+    assert(size > 0 && alignment > 0);
+    GLsizeiptr offset_in_frame = (_frame_used + alignment - 1) / alignment * alignment;
+    if (offset_in_frame + size > _frame_size) {
+        throw std::runtime_error(fmt::format("ring buffer out of space: {} + {} > {}", offset_in_frame, size,
+                                             _frame_size));
+    }
+    _frame_used = offset_in_frame + size;
+
+    RingAlloc allocation;
+    allocation.buffer = _id;
+    allocation.offset = _frame_idx * _frame_size + offset_in_frame;
+    allocation.size = size;
+
+    if (_persistent) {
+        allocation.ptr = _mapped + allocation.offset;
+    } else {
+        /* fence 保证了 GPU 不会再读取这段内存，所以不需要同步 */
+        glBindBuffer(_target, _id);
+        allocation.ptr = glMapBufferRange(_target, allocation.offset, size,
+                                          GL_MAP_WRITE_BIT | GL_MAP_UNSYNCHRONIZED_BIT | GL_MAP_INVALIDATE_RANGE_BIT);
+        glBindBuffer(_target, 0);
+        if (allocation.ptr == nullptr)
+            throw std::runtime_error("fail to map ring buffer range");
+    }
+    return allocation;
+}
+
+void RingBuffer::commit(const RingAlloc &allocation) {
+    if (_persistent)
+        return;
+    glBindBuffer(_target, allocation.buffer);
+    glUnmapBuffer(_target);
+    glBindBuffer(_target, 0);
+}
+
+GLsizeiptr RingBuffer::uniform_alignment() {
+    static GLint alignment = 0;
+    if (alignment == 0)
+        glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+    return alignment;
+}
@@ -0,0 +1,258 @@
+#include <cmath>
+#include <vector>
+#include <cstring>
+#include <stdexcept>
+
+#include <fmt/format.h>
+
+#include "sh9.h"
+#include "image_decoder.h"
+#include "utils/parallel.h"
+
+
+/* 一组像素的数量：每个系数的每个通道有 LANES 个独立的累加器 */
+static constexpr size_t LANES = 8;
+
+static constexpr float PI = 3.14159265358979f;
+
+
+/* 9 个基函数在 (x, y, z) 处的值，x，y，z 是单位向量的分量 */
+static inline void sh9_basis(float x, float y, float z, float *basis, size_t stride = 1) {
+    basis[0 * stride] = 0.282095f;
+    basis[1 * stride] = 0.488603f * y;
+    basis[2 * stride] = 0.488603f * z;
+    basis[3 * stride] = 0.488603f * x;
+    basis[4 * stride] = 1.092548f * x * y;
+    basis[5 * stride] = 1.092548f * y * z;
+    basis[6 * stride] = 0.315392f * (3.f * z * z - 1.f);
+    basis[7 * stride] = 1.092548f * x * z;
+    basis[8 * stride] = 0.546274f * (x * x - y * y);
+}
+
+/* half float 转换为 float 的查找表 */
+static const std::vector<float> &half_table() {
+    static const std::vector<float> table = [] {
+        std::vector<float> t(65536);
+        for (uint32_t h = 0; h < 65536; ++h) {
+            uint32_t sign = (h & 0x8000u) << 16, exponent = (h >> 10) & 0x1fu, mantissa = h & 0x3ffu;
+            uint32_t bits;
+            if (exponent == 0) {
+                if (mantissa == 0) {
+                    bits = sign;
+                } else {
+                    /* 非规格化数：规格化之后再转换 */
+                    exponent = 127 - 15 + 1;
+                    while (!(mantissa & 0x400u)) {
+                        mantissa <<= 1;
+                        --exponent;
+                    }
+                    bits = sign | (exponent << 23) | ((mantissa & 0x3ffu) << 13);
+                }
+            } else if (exponent == 31) {
+                bits = sign | 0x7f800000u | (mantissa << 13);
+            } else {
+                bits = sign | ((exponent + 127 - 15) << 23) | (mantissa << 13);
+            }
+            std::memcpy(&t[h], &bits, sizeof(float));
+        }
+        return t;
+    }();
+    return table;
+}
+
+/* 立方体贴图上 (sc, tc) ∈ [-1, 1] 对应的方向（未归一化），见 OpenGL 规范中立方体贴图的面选择 */
+static inline void cube_dir(int face, float sc, float tc, float &x, float &y, float &z) {
+    switch (face) {
+        case 0: x = 1.f, y = -tc, z = -sc; break;
+        case 1: x = -1.f, y = -tc, z = sc; break;
+        case 2: x = sc, y = 1.f, z = tc; break;
+        case 3: x = sc, y = -1.f, z = -tc; break;
+        case 4: x = sc, y = -tc, z = 1.f; break;
+        default: x = -sc, y = -tc, z = -1.f; break;
+    }
+}
+
+
+/* 一行像素，SoA 布局；长度向上取整到 LANES 的倍数，多出来的像素权重为 0 */
+struct SHRow {
+    std::vector<float> x, y, z, r, g, b, w;
+
+    explicit SHRow(size_t n) {
+        size_t padded = (n + LANES - 1) / LANES * LANES;
+        for (auto *v : {&x, &y, &z, &r, &g, &b, &w})
+            v->assign(padded, 0.f);
+    }
+};
+
+/* 一行像素投影的结果：9 个系数，每个系数 3 个通道 */
+using SHRowSum = std::array<double, 27>;
+
+static SHRowSum row_project(const SHRow &row) {
+    float acc[27][LANES] = {};
+    for (size_t i = 0; i < row.w.size(); i += LANES) {
+        float basis[9][LANES], color[3][LANES];
+        for (size_t l = 0; l < LANES; ++l) {
+            sh9_basis(row.x[i + l], row.y[i + l], row.z[i + l], &basis[0][l], LANES);
+            color[0][l] = row.r[i + l] * row.w[i + l];
+            color[1][l] = row.g[i + l] * row.w[i + l];
+            color[2][l] = row.b[i + l] * row.w[i + l];
+        }
+        for (size_t k = 0; k < 9; ++k)
+            for (size_t c = 0; c < 3; ++c)
+                for (size_t l = 0; l < LANES; ++l)
+                    acc[k * 3 + c][l] += basis[k][l] * color[c][l];
+    }
+
+    SHRowSum sum{};
+    for (size_t j = 0; j < 27; ++j)
+        for (size_t l = 0; l < LANES; ++l)
+            sum[j] += acc[j][l];
+    return sum;
+}
+
+/* 按行的顺序求和，结果和线程数无关 */
+static SH9 rows_reduce(const std::vector<SHRowSum> &rows) {
+    SHRowSum total{};
+    for (const auto &row : rows)
+        for (size_t j = 0; j < 27; ++j)
+            total[j] += row[j];
+
+    SH9 sh;
+    for (size_t k = 0; k < 9; ++k)
+        sh.coeffs[k] = glm::vec3((float) total[k * 3], (float) total[k * 3 + 1], (float) total[k * 3 + 2]);
+    return sh;
+}
+
+
+glm::vec3 SH9::eval(const glm::vec3 &dir) const {
+    float basis[9];
+    sh9_basis(dir.x, dir.y, dir.z, basis);
+    glm::vec3 result(0.f);
+    for (size_t k = 0; k < 9; ++k)
+        result += coeffs[k] * basis[k];
+    return result;
+}
+
+SH9 sh9_project_equirect(const float *rgb, int width, int height, int channels, unsigned threads) {
+    if (channels < 3)
+        throw std::runtime_error(fmt::format("bad channels for sh projection: {}", channels));
+
+    /* 每一列的经度，所有行共用 */
+    std::vector<float> cos_phi(width), sin_phi(width);
+    for (int i = 0; i < width; ++i) {
+        float phi = ((float) i + 0.5f) / (float) width * 2.f * PI - PI;
+        cos_phi[i] = std::cos(phi);
+        sin_phi[i] = std::sin(phi);
+    }
+
+    /* 第 j 行的纬度 theta = asin(y)，像素的立体角是 cos(theta) * dtheta * dphi */
+    std::vector<SHRowSum> rows(height);
+    parallel_for(0, (size_t) height, [&](size_t j) {
+        float theta = ((float) j + 0.5f) / (float) height * PI - 0.5f * PI;
+        float cos_theta = std::cos(theta), sin_theta = std::sin(theta);
+        float weight = cos_theta * (2.f * PI / (float) width) * (PI / (float) height);
+
+        SHRow row(width);
+        const float *pixels = rgb + j * width * channels;
+        for (int i = 0; i < width; ++i) {
+            row.x[i] = cos_theta * cos_phi[i];
+            row.y[i] = sin_theta;
+            row.z[i] = cos_theta * sin_phi[i];
+            row.r[i] = pixels[i * channels];
+            row.g[i] = pixels[i * channels + 1];
+            row.b[i] = pixels[i * channels + 2];
+            row.w[i] = weight;
+        }
+        rows[j] = row_project(row);
+    }, threads);
+    return rows_reduce(rows);
+}
+
+SH9 sh9_project_equirect_file(const std::string &path, unsigned threads) {
+    Image image = ImageDecoders::load(path, {3, true, true});
+    return sh9_project_equirect(image.pixels_f(), image.width, image.height, 3, threads);
+}
+
+SH9 sh9_project_cube(const EnvCubeData &cube, unsigned threads) {
+    const auto &half = half_table();
+    const int size = cube.size;
+
+    /* 纹素 (s, t) 的立体角是 (2 / size)^2 / (1 + s^2 + t^2)^(3/2) */
+    std::vector<SHRowSum> rows((size_t) 6 * size);
+    parallel_for(0, rows.size(), [&](size_t index) {
+        int face = (int) (index / size), t = (int) (index % size);
+        const auto &pixels = cube.level(face, 0);
+        float tc = 2.f * ((float) t + 0.5f) / (float) size - 1.f;
+
+        SHRow row(size);
+        for (int s = 0; s < size; ++s) {
+            float sc = 2.f * ((float) s + 0.5f) / (float) size - 1.f;
+            float x, y, z;
+            cube_dir(face, sc, tc, x, y, z);
+            float r2 = 1.f + sc * sc + tc * tc, inv_r = 1.f / std::sqrt(r2);
+            row.x[s] = x * inv_r;
+            row.y[s] = y * inv_r;
+            row.z[s] = z * inv_r;
+
+            size_t offset = ((size_t) t * size + s) * 3;
+            row.r[s] = half[pixels[offset]];
+            row.g[s] = half[pixels[offset + 1]];
+            row.b[s] = half[pixels[offset + 2]];
+            row.w[s] = 4.f / ((float) size * (float) size) * inv_r * inv_r * inv_r;
+        }
+        rows[index] = row_project(row);
+    }, threads);
+    return rows_reduce(rows);
+}
+
+SH9 sh9_irradiance(const SH9 &radiance) {
+    /* 余弦核的系数：π，2π/3，π/4，再除以 π */
+    const float band[9] = {1.f, 2.f / 3.f, 2.f / 3.f, 2.f / 3.f, 0.25f, 0.25f, 0.25f, 0.25f, 0.25f};
+    SH9 irradiance;
+    for (size_t k = 0; k < 9; ++k)
+        irradiance.coeffs[k] = radiance.coeffs[k] * band[k];
+    return irradiance;
+}
+
+SH9Error sh9_compare(const SH9 &sh, const EnvCubeData &reference, unsigned threads) {
+    const auto &half = half_table();
+    const int size = reference.size;
+    auto luminance = [](float r, float g, float b) { return 0.2126f * r + 0.7152f * g + 0.0722f * b; };
+
+    /* 每一行：按立体角加权的相对误差的平方和，权重和，最大相对误差 */
+    struct RowError {
+        double squared{0.0}, weight{0.0}, max{0.0};
+    };
+    std::vector<RowError> rows((size_t) 6 * size);
+    parallel_for(0, rows.size(), [&](size_t index) {
+        int face = (int) (index / size), t = (int) (index % size);
+        const auto &pixels = reference.level(face, 0);
+        float tc = 2.f * ((float) t + 0.5f) / (float) size - 1.f;
+
+        RowError &error = rows[index];
+        for (int s = 0; s < size; ++s) {
+            float sc = 2.f * ((float) s + 0.5f) / (float) size - 1.f;
+            float x, y, z;
+            cube_dir(face, sc, tc, x, y, z);
+            float inv_r = 1.f / std::sqrt(1.f + sc * sc + tc * tc);
+            glm::vec3 value = sh.eval(glm::vec3(x * inv_r, y * inv_r, z * inv_r));
+
+            size_t offset = ((size_t) t * size + s) * 3;
+            float expected = luminance(half[pixels[offset]], half[pixels[offset + 1]], half[pixels[offset + 2]]);
+            double relative = std::abs(luminance(value.x, value.y, value.z) - expected) /
+                              std::max(expected, 1e-4f);
+            double weight = inv_r * inv_r * inv_r;
+            error.squared += relative * relative * weight;
+            error.weight += weight;
+            error.max = std::max(error.max, relative);
+        }
+    }, threads);
+
+    RowError total;
+    for (const auto &row : rows) {
+        total.squared += row.squared;
+        total.weight += row.weight;
+        total.max = std::max(total.max, row.max);
+    }
+    return {total.weight > 0.0 ? std::sqrt(total.squared / total.weight) : 0.0, total.max};
+}
@@ -53,27 +53,48 @@ Shader::Shader(const std::string &vertex, const std::string &fragment, const std
     glDeleteShader(id_fragment);
 }
 
+std::shared_ptr<Shader> Shader::from_source(const std::string &vertex, const std::string &fragment,
+                                            const std::vector<std::string> &macros) {
+    GLuint id_vertex = _source_compile(vertex, GL_VERTEX_SHADER, macros);
+    GLuint id_fragment = _source_compile(fragment, GL_FRAGMENT_SHADER, macros);
+
+    std::shared_ptr<Shader> shader(new Shader());
+    shader->id = _shader_link(id_vertex, id_fragment);
+    glDeleteShader(id_vertex);
+    glDeleteShader(id_fragment);
+    return shader;
+}
+
 
 GLuint
 Shader::_shader_compile(const std::string &file_name, GLenum shader_type, const std::vector<std::string> &macros) {
+    /* 逐行读取文件 */
+    std::string shader_source;
+    for (const auto &line : File::file_load_lines(file_name))
+        shader_source += line;
+    return _source_compile(shader_source, shader_type, macros);
+}
+
+
+GLuint
+Shader::_source_compile(const std::string &shader_source, GLenum shader_type, const std::vector<std::string> &macros) {
     assert(shader_type == GL_VERTEX_SHADER
            || shader_type == GL_FRAGMENT_SHADER
            || shader_type == GL_GEOMETRY_SHADER);
 
-    /* 逐行读取文件，在版本声明后追加宏定义 */
-    std::vector<std::string> lines = File::file_load_lines(file_name);
-    std::string shader_source;
-    for (const auto &line : lines) {
-        shader_source += line;
-
-        /* 在 #version 后面追加宏定义 */
-        if (line.find("#version") != std::string::npos) {
-            for (auto const &macro : macros) {
-                shader_source += fmt::format("#define {}\n", macro);
-            }
-        }
+    /* 在 #version 这一行后面追加宏定义 */
+    std::string defines;
+    for (auto const &macro : macros)
+        defines += fmt::format("#define {}\n", macro);
+    std::string full_source = shader_source;
+    if (size_t version = full_source.find("#version"); version != std::string::npos) {
+        size_t line_end = full_source.find('\n', version);
+        if (line_end == std::string::npos)
+            full_source += "\n" + defines;
+        else
+            full_source.insert(line_end + 1, defines);
     }
-    const char *source = shader_source.c_str();
+    const char *source = full_source.c_str();
 
     // 编译
     SPDLOG_INFO("compile shader");
@@ -123,8 +144,7 @@ void Shader::set_textures(const std::vector<std::tuple<std::string, GLuint>> &te
     assert(start_unit >= 0);
     GLsizei texture_unit = start_unit;
     for (auto &[texture_name, texture_id] : texture_profile) {
-        glActiveTexture(GL_TEXTURE0 + texture_unit);
-        glBindTexture(GL_TEXTURE_2D, texture_id);
+        TextureManager::texture_bind(texture_unit, GL_TEXTURE_2D, texture_id);
         glUniform1i(_uniform_location_get(texture_name), texture_unit);
         texture_unit++;
     }
@@ -140,13 +160,12 @@ void Shader::set_textures(const Mesh &mesh,
 
     for (auto &[texture_name, texture_type, idx]: texture_profile) {
         /* 如果 mesh 的特定类型特定序号的材质不存在，就跳过 */
-        auto textures = mesh.textures(texture_type);
-        if (idx >= textures.size())
+        const Texture2D *texture = mesh.texture(texture_type, idx);
+        if (texture == nullptr)
             continue;
 
         /* 为 shader 绑定材质 */
-        glActiveTexture(GL_TEXTURE0 + texture_unit);
-        glBindTexture(GL_TEXTURE_2D, textures[idx]->id());
+        texture->bind(texture_unit);
         glUniform1i(_uniform_location_get(texture_name), texture_unit);
         texture_unit++;
     }
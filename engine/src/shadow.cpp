@@ -0,0 +1,238 @@
+#include <cmath>
+#include <cstring>
+#include <algorithm>
+
+#include <imgui.h>
+#include <fmt/format.h>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include "profiler.h"
+#include "shadow.h"
+
+
+/* 只输出深度，片段着色器是空的 */
+static const char *SHADOW_VERT = R"(#version 330 core
+layout (location = 0) in vec3 aPos;
+uniform mat4 model;
+uniform mat4 light_view_projection;
+void main() {
+    gl_Position = light_view_projection * model * vec4(aPos, 1.0);
+}
+)";
+
+static const char *SHADOW_FRAG = R"(#version 330 core
+void main() {
+}
+)";
+
+
+CascadedShadowMap::CascadedShadowMap(GLuint resolution, int cascades, float distance)
+        : _resolution(resolution),
+          _cascade_count(std::clamp(cascades, MIN_CASCADES, MAX_CASCADES)),
+          _distance(distance),
+          _depth(std::make_unique<DepthBuffer>(resolution, resolution, (GLuint) _cascade_count)),
+          _shader(Shader::from_source(SHADOW_VERT, SHADOW_FRAG)) {}
+
+CascadedShadowMap::~CascadedShadowMap() {
+    glDeleteProgram(_shader->id);
+}
+
+void CascadedShadowMap::cascades_set(int cascades) {
+    cascades = std::clamp(cascades, MIN_CASCADES, MAX_CASCADES);
+    if (cascades == _cascade_count)
+        return;
+    _cascade_count = cascades;
+    _depth = std::make_unique<DepthBuffer>(_resolution, _resolution, (GLuint) _cascade_count);
+}
+
+
+// =====================================================
+// 划分视锥体
+// =====================================================
+
+void CascadedShadowMap::update(Camera &camera, const glm::vec3 &light_direction) {
+    const glm::mat4 inv_view = glm::inverse(camera.view_matrix_get());
+    const float z_near = camera.z_near();
+    const float z_far = std::max(z_near * 2.f, std::min(camera.z_far(), _distance));
+
+    /* 光源空间：原点固定，光线沿着 -z 前进；平移摄像机时投影只会平移，才能对齐到纹素 */
+    const glm::vec3 dir = glm::normalize(light_direction);
+    const glm::vec3 up = std::abs(dir.y) > 0.99f ? glm::vec3(0.f, 0.f, 1.f) : glm::vec3(0.f, 1.f, 0.f);
+    _light_view = glm::lookAt(glm::vec3(0.f), dir, up);
+
+    /* 深度为 z 的截面上，角点到视线的距离是 k * z */
+    const float tan_half = std::tan(glm::radians(camera.fov()) * 0.5f);
+    const float k2 = tan_half * tan_half * (1.f + camera.aspect() * camera.aspect());
+
+    float split_near = z_near;
+    for (int i = 0; i < _cascade_count; ++i) {
+        const float t = (float) (i + 1) / (float) _cascade_count;
+        const float split_log = z_near * std::pow(z_far / z_near, t);
+        const float split_uniform = z_near + (z_far - z_near) * t;
+        const float split_far = _lambda * split_log + (1.f - _lambda) * split_uniform;
+
+        /**
+         * 这一段视锥体的最小包围球，中心在视线上：到近端角点和远端角点的距离相等时中心的深度是 (n + f)(1 + k²) / 2，
+         * 超过远端时远端截面的外接圆决定了包围球
+         */
+        float center_depth = (split_near + split_far) * (1.f + k2) * 0.5f;
+        float radius;
+        if (center_depth >= split_far) {
+            center_depth = split_far;
+            radius = split_far * std::sqrt(k2);
+        } else {
+            const float d = split_far - center_depth;
+            radius = std::sqrt(d * d + k2 * split_far * split_far);
+        }
+
+        /* 包围球的中心在光源空间中对齐到纹素：最多移动一个纹素，投影的范围放大一个纹素，仍然包住包围球 */
+        radius *= (float) _resolution / (float) (_resolution - 2);
+        const float texel = 2.f * radius / (float) _resolution;
+        glm::vec3 center = glm::vec3(_light_view * inv_view * glm::vec4(0.f, 0.f, -center_depth, 1.f));
+        center.x = std::floor(center.x / texel) * texel;
+        center.y = std::floor(center.y / texel) * texel;
+
+        /* 光源空间中看向 -z，近平面和远平面的距离是 -z 方向上的 */
+        const glm::mat4 projection = glm::ortho(center.x - radius, center.x + radius, center.y - radius,
+                                                center.y + radius, -center.z - radius, -center.z + radius);
+
+        Cascade &cascade = _cascades[i];
+        cascade.view_projection = projection * _light_view;
+        cascade.split_near = split_near;
+        cascade.split_far = split_far;
+        cascade.texel = texel;
+        cascade.center = center;
+        cascade.radius = radius;
+        split_near = split_far;
+    }
+}
+
+bool CascadedShadowMap::_intersects(const Cascade &cascade, const glm::vec3 &center, float radius) {
+    /* 在光源和包围球之间的投射物也要绘制（深度被压到近平面上），只剔除远平面之后的 */
+    const float extent = cascade.radius + radius;
+    return std::abs(center.x - cascade.center.x) <= extent && std::abs(center.y - cascade.center.y) <= extent &&
+           -center.z - radius <= -cascade.center.z + cascade.radius;
+}
+
+
+// =====================================================
+// 绘制
+// =====================================================
+
+void CascadedShadowMap::render(const std::vector<std::shared_ptr<Mesh>> &casters) {
+    PROFILE_ZONE("shadow map");
+    PROFILE_GPU_ZONE("shadow map");
+    const int64_t begin = Profiler::now_ns();
+
+    /* 投射物在光源空间中的包围球，每个级联共用 */
+    struct Bounds {
+        glm::vec3 center;
+        float radius;
+    };
+    std::vector<Bounds> bounds;
+    bounds.reserve(casters.size());
+    for (const auto &mesh: casters) {
+        const glm::mat4 &model = mesh->model();
+        const float scale = std::max({glm::length(glm::vec3(model[0])), glm::length(glm::vec3(model[1])),
+                                      glm::length(glm::vec3(model[2]))});
+        bounds.push_back({glm::vec3(_light_view * model * glm::vec4(mesh->bounds_center(), 1.f)),
+                          mesh->bounds_radius() * scale});
+    }
+
+    GLint viewport[4];
+    glGetIntegerv(GL_VIEWPORT, viewport);
+    glViewport(0, 0, (GLsizei) _resolution, (GLsizei) _resolution);
+    glEnable(GL_DEPTH_CLAMP);
+    glEnable(GL_POLYGON_OFFSET_FILL);
+    glPolygonOffset(_bias_slope, _bias_constant);
+
+    with(DepthBuffer, *_depth) {
+        with(Shader, *_shader) {
+            for (int i = 0; i < _cascade_count; ++i) {
+                Cascade &cascade = _cascades[i];
+                _depth->layer_set((GLuint) i);
+                glClear(GL_DEPTH_BUFFER_BIT);
+                _shader->uniform_mat4_set("light_view_projection", cascade.view_projection);
+
+                cascade.casters = 0;
+                for (size_t c = 0; c < casters.size(); ++c) {
+                    if (!_intersects(cascade, bounds[c].center, bounds[c].radius))
+                        continue;
+                    _shader->uniform_mat4_set("model", casters[c]->model());
+                    casters[c]->draw();
+                    ++cascade.casters;
+                }
+            }
+        }
+    }
+
+    glDisable(GL_POLYGON_OFFSET_FILL);
+    glDisable(GL_DEPTH_CLAMP);
+    glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+    _cpu_ms = (double) (Profiler::now_ns() - begin) / 1e6;
+}
+
+void CascadedShadowMap::uniforms_set(Shader &shader, GLint texture_unit) const {
+    glActiveTexture(GL_TEXTURE0 + texture_unit);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, _depth->texture());
+    shader.uniform_tex2d_set("shadow_map", texture_unit);
+    shader.uniform_int_set("shadow_cascades", _cascade_count);
+
+    glm::vec4 splits{0.f}, texels{0.f};
+    for (int i = 0; i < _cascade_count; ++i) {
+        splits[i] = _cascades[i].split_far;
+        texels[i] = _cascades[i].texel;
+        shader.uniform_mat4_set(fmt::format("shadow_matrices[{}]", i), _cascades[i].view_projection);
+    }
+    shader.uniform_vec4_set("shadow_splits", splits);
+    shader.uniform_vec4_set("shadow_texels", texels);
+}
+
+
+// =====================================================
+// 统计
+// =====================================================
+
+double CascadedShadowMap::_gpu_ms_latest() {
+    const auto &frames = Profiler::frames();
+    for (auto iter = frames.rbegin(); iter != frames.rend(); ++iter) {
+        if (!iter->gpu_resolved || iter->gpu.empty())
+            continue;
+        double ms = 0.0;
+        bool found = false;
+        for (const ProfileEvent &event: iter->gpu) {
+            if (std::strcmp(event.name, "shadow map") != 0)
+                continue;
+            ms += (double) (event.end_ns - event.begin_ns) / 1e6;
+            found = true;
+        }
+        if (found)
+            return ms;
+    }
+    return -1.0;
+}
+
+void CascadedShadowMap::gui(const char *title) {
+    ImGui::Begin(title);
+    int cascades = _cascade_count;
+    if (ImGui::SliderInt("cascades", &cascades, MIN_CASCADES, MAX_CASCADES))
+        cascades_set(cascades);
+    ImGui::SliderFloat("lambda", &_lambda, 0.f, 1.f);
+    ImGui::SliderFloat("distance", &_distance, 5.f, 100.f);
+    ImGui::SliderFloat("slope bias", &_bias_slope, 0.f, 8.f);
+    ImGui::SliderFloat("constant bias", &_bias_constant, 0.f, 16.f);
+
+    const double gpu_ms = _gpu_ms_latest();
+    if (gpu_ms >= 0.0)
+        ImGui::Text("shadow pass: gpu %.3f ms, cpu %.3f ms", gpu_ms, _cpu_ms);
+    else
+        ImGui::Text("shadow pass: gpu -, cpu %.3f ms", _cpu_ms);
+    ImGui::Text("%d x %u x %u, %.1f MB", _cascade_count, _resolution, _resolution,
+                (double) _resolution * _resolution * 4 * _cascade_count / (1024.0 * 1024.0));
+    for (int i = 0; i < _cascade_count; ++i) {
+        const Cascade &cascade = _cascades[i];
+        ImGui::Text("#%d %6.2f - %6.2f, texel %.4f, casters %zu", i, cascade.split_near, cascade.split_far,
+                    cascade.texel, cascade.casters);
+    }
+    ImGui::End();
+}
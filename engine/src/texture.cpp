@@ -1,113 +1,378 @@
+#include <cmath>
+#include <array>
+#include <tuple>
+#include <cstring>
+#include <cassert>
+#include <algorithm>
+#include <stdexcept>
+
+#include "gl_ext.h"
 #include "texture.h"
+#include "image_decoder.h"
+#include "texture_mip.h"
+#include "texture_file.h"
+#include "texture_stream.h"
+#include "texture_upload.h"
+#include "utils/parallel.h"
+#include "utils/stopwatch.h"
 
 
 Texture2D::Texture2D(const std::string &path, TextureWrap wrap, TextureColorFormat color_format, bool mip_map,
-                     bool flip) {
-    // 载入文件
-    int width, height, nr_channels;
-    stbi_set_flip_vertically_on_load(flip);
-    unsigned char *data = stbi_load(path.c_str(), &width, &height, &nr_channels, 0);
-    if (!data) {
-        throw std::runtime_error(fmt::format("fail to load texture file: {}", path));
+                     bool flip, bool srgb) {
+    /* 优先使用 texture-cook 生成的压缩纹理；压缩纹理不能翻转，颜色格式也由压缩格式决定 */
+    std::optional<CompressedImage> compressed;
+    if (TextureFile::is_container(path))
+        compressed = TextureFile::load(path);
+    else if (!flip && color_format == TextureColorFormat::Auto)
+        compressed = TextureFile::cooked_find(path);
+    if (compressed) {
+        glActiveTexture(GL_TEXTURE0);
+        _id = compressed_texture_create(*compressed, GL_TEXTURE_2D, mip_map ? 0 : 1);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, static_cast<GLint>(wrap));
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, static_cast<GLint>(wrap));
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER,
+                        mip_map && compressed->levels > 1 ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glBindTexture(GL_TEXTURE_2D, 0);
+        for (GLsizei level = 0; level < (mip_map ? compressed->levels : 1); ++level)
+            _bytes += compressed->level(0, level).size();
+        return;
     }
 
+    /* 载入文件；指定了颜色格式时，按照该格式的通道数读取 */
+    int desired_channels = color_format == TextureColorFormat::RED ? 1
+                         : color_format == TextureColorFormat::RGB ? 3
+                         : color_format == TextureColorFormat::RGBA ? 4 : 0;
+    const ImageRequest request{desired_channels, flip};
+    const ImageInfo info = ImageDecoders::info(path);
+    const int width = info.width, height = info.height;
+    const int nr_channels = desired_channels ? desired_channels : info.channels;
+
+    GLenum format;
+    switch (nr_channels) {
+        case 1:
+            format = GL_RED;
+            break;
+        case 3:
+            format = GL_RGB;
+            break;
+        case 4:
+            format = GL_RGBA;
+            break;
+        default:
+            throw std::runtime_error(fmt::format("bad nr_channels: {}", nr_channels));
+    }
+
+    /**
+     * 启用了 PBO 上传时，不生成 mip 的纹理直接解码到映射的 PBO 中
+     * 否则解码到内存，在 CPU 上生成所有级别的 mip，不使用 glGenerateMipmap
+     */
+    const bool deferred = TextureUploader::enabled();
+    UploadStaging staging;
+    MipChain<uint8_t> chain;
+    if (deferred && !mip_map) {
+        staging = TextureUploader::staging(ImageDecoders::bytes(info, request));
+        try {
+            ImageDecoders::decode(path, request, staging.ptr, staging.size);
+        } catch (...) {
+            TextureUploader::discard(std::move(staging));
+            throw;
+        }
+    } else {
+        Image image = ImageDecoders::load(path, request);
+        if (mip_map) {
+            MipOptions options;
+            options.srgb = srgb;
+            chain = mip_chain_generate(image.data.data(), width, height, nr_channels, options);
+        }
+        else
+            chain.levels.push_back(std::move(image.data));
+    }
+    const GLint levels = staging.ptr ? 1 : (GLint) chain.levels.size();
+
     /* 生成 texture */
     glGenTextures(1, &_id);
     glActiveTexture(GL_TEXTURE0);
     glBindTexture(GL_TEXTURE_2D, _id);
 
-    /* 传输纹理数据 */
-    if (color_format == TextureColorFormat::Auto) {
-        switch (nr_channels) {
-            case 1:
-                color_format = TextureColorFormat::RED;
-                break;
-            case 3:
-                color_format = TextureColorFormat::RGB;
-                break;
-            case 4:
-                color_format = TextureColorFormat::RGBA;
-                break;
-            default:
-                throw std::runtime_error(fmt::format("bad nr_channels: {}", nr_channels));
-        }
-    }
-    switch (color_format) {
-        case TextureColorFormat::RED:
-            glTexImage2D(GL_TEXTURE_2D, 0, GL_RED, width, height, 0, GL_RED, GL_UNSIGNED_BYTE, data);
-            break;
-        case TextureColorFormat::RGB:
-            glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, data);
-            break;
-        case TextureColorFormat::RGBA:
-            glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, data);
-            break;
-        default:
-            throw std::runtime_error("bad texture color format.");
+    /* 传输纹理数据：每一级都是紧密排列的，RGB 的行不一定是 4 字节对齐；使用 PBO 上传时这里只分配存储 */
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    for (GLint level = 0; level < levels; ++level) {
+        GLsizei w = std::max(1, width >> level), h = std::max(1, height >> level);
+        glTexImage2D(GL_TEXTURE_2D, level, (GLint) format, w, h, 0, format, GL_UNSIGNED_BYTE,
+                     deferred ? nullptr : chain.levels[level].data());
+        _bytes += (size_t) w * h * (nr_channels == 1 ? 1 : 4);        // 驱动通常将 RGB 按 RGBA 存放
     }
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, levels - 1);
 
     /* 超出范围后如何采样 */
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, static_cast<GLint>(wrap));
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, static_cast<GLint>(wrap));
 
     /* 缩放后如何采样 */
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, mip_map ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
 
-    /* 生成 mipmap */
-    if (mip_map) {
-        glGenerateMipmap(GL_TEXTURE_2D);
+    /**
+     * 每一级是一个上传任务，从最小的级别开始；每一级上传之后才降低 BASE_LEVEL，采样已经上传的最精细的级别
+     * 第一级上传之前 BASE_LEVEL 超过 MAX_LEVEL，纹理是不完整的，采样的结果是 (0, 0, 0, 1)，不会读到未定义的数据
+     */
+    if (deferred) {
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, levels);
+        for (GLint level = levels - 1; level >= 0; --level) {
+            GLsizei w = std::max(1, width >> level), h = std::max(1, height >> level);
+            size_t size = (size_t) w * h * nr_channels;
+            if (!staging.ptr) {
+                staging = TextureUploader::staging(size);
+                std::memcpy(staging.ptr, chain.levels[level].data(), size);
+            }
+            TextureUploader::submit(_id, GL_TEXTURE_2D, std::move(staging),
+                                    {{GL_TEXTURE_2D, level, w, h, format, GL_UNSIGNED_BYTE, 0, size}}, true,
+                                    [level] { glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, level); });
+            staging = UploadStaging{};
+        }
     }
 
     /* 解除绑定 */
     glBindTexture(GL_TEXTURE_2D, 0);
+}
+
+Texture2D::Texture2D() = default;
 
-    stbi_image_free(data);
+Texture2D::~Texture2D() {
+    TextureUploader::cancel(_id);
+    glDeleteTextures(1, &_id);
 }
 
-std::shared_ptr<Texture2D> TextureManager::texture_load(const std::string &path) {
+void Texture2D::bind(GLuint unit) const {
+    glActiveTexture(GL_TEXTURE0 + unit);
+    glBindTexture(GL_TEXTURE_2D, _id);
+    _last_used = ++TextureManager::_clock;
+}
+
+std::shared_ptr<Texture2D> TextureManager::texture_load(const std::string &path, TextureType type) {
     auto iter = _textures.find(path);
 
     // 使用缓存
-    if (iter != _textures.end())
+    if (iter != _textures.end()) {
+        ++_stats.hits;
+        iter->second->_last_used = ++_clock;
         return iter->second;
+    }
 
-    auto texture = std::make_shared<Texture2D>(path);
+    ++_stats.misses;
+    const bool srgb = texture_type_srgb(type);
+    auto texture = TextureStreamer::enabled()
+                   ? TextureStreamer::texture_create(path, srgb)
+                   : std::make_shared<Texture2D>(path, TextureWrap::REPEAT, TextureColorFormat::Auto, true, false, srgb);
+    texture->_last_used = ++_clock;
     _textures.emplace(path, texture);
+    _ids.emplace(texture->id(), texture.get());
+    _stats.resident_bytes += texture->bytes();
+    trim();
     return texture;
 }
 
+void TextureManager::texture_bind(GLuint unit, GLenum target, GLuint id) {
+    glActiveTexture(GL_TEXTURE0 + unit);
+    glBindTexture(target, id);
+    if (target != GL_TEXTURE_2D)
+        return;
+    auto iter = _ids.find(id);
+    if (iter != _ids.end())
+        iter->second->_last_used = ++_clock;
+}
+
+void TextureManager::budget_set(size_t bytes) {
+    _stats.budget_bytes = bytes;
+    trim();
+}
+
+void TextureManager::trim() {
+    if (_stats.resident_bytes <= _stats.budget_bytes)
+        return;
+
+    /* 只有缓存持有的纹理才能回收，按最近一次使用的时间排序 */
+    std::vector<std::map<std::string, std::shared_ptr<Texture2D>>::iterator> candidates;
+    for (auto iter = _textures.begin(); iter != _textures.end(); ++iter)
+        if (iter->second.use_count() == 1)
+            candidates.push_back(iter);
+    std::sort(candidates.begin(), candidates.end(),
+              [](const auto &a, const auto &b) { return a->second->_last_used < b->second->_last_used; });
+
+    for (auto iter : candidates) {
+        if (_stats.resident_bytes <= _stats.budget_bytes)
+            break;
+        SPDLOG_INFO("evict texture: {}, {} KB", iter->first, iter->second->bytes() >> 10);
+        _stats.resident_bytes -= iter->second->bytes();
+        ++_stats.evictions;
+        _ids.erase(iter->second->id());
+        _textures.erase(iter);
+    }
+}
+
+void TextureManager::clear() {
+    _textures.clear();
+    _ids.clear();
+    _stats.resident_bytes = 0;
+}
+
+TextureManager::CacheStats TextureManager::stats() {
+    CacheStats stats = _stats;
+    stats.textures = _textures.size();
+    return stats;
+}
+
+
+/* Assimp 和 自定义材质类型的对应表 */
+static const std::map<TextureType, aiTextureType> AI_TEXTURE_TYPE_MAP{
+        {TextureType::diffuse,  aiTextureType_DIFFUSE},
+        {TextureType::specular, aiTextureType_SPECULAR},
+        {TextureType::normal,   aiTextureType_NORMALS},
+};
+
+/* 导入模型时，需要从文件中提取出的 texture 类型 */
+static const std::vector<TextureType> MODEL_TEXTURE_TYPES{TextureType::diffuse, TextureType::specular};
+
 
 std::map<TextureType, std::vector<std::shared_ptr<Texture2D>>>
 TextureManager::textures_get(const aiMaterial& material, const std::string &dir) {
 
-    /* Assimp 和 自定义材质类型的对应表 */
-    static std::map<TextureType, aiTextureType> type_map {
-            {TextureType::diffuse, aiTextureType_DIFFUSE},
-            {TextureType::specular, aiTextureType_SPECULAR},
-            {TextureType::normal, aiTextureType_NORMALS},
-    };
-
-    /* 需要从文件中提取出的 texture 类型 */
-    std::map<TextureType, std::vector<std::shared_ptr<Texture2D>>> textures {
-            {TextureType::diffuse, {}},
-            {TextureType::specular, {}},
-    };
+    std::map<TextureType, std::vector<std::shared_ptr<Texture2D>>> textures;
+    for (auto tex_type : MODEL_TEXTURE_TYPES)
+        textures[tex_type] = {};
 
     for (auto &[tex_type, texs] : textures) {
-        aiTextureType ai_tex_type = type_map[tex_type];
+        aiTextureType ai_tex_type = AI_TEXTURE_TYPE_MAP.at(tex_type);
         aiString file_name;
         std::string full_path;
         for (unsigned i = 0; i < material.GetTextureCount(ai_tex_type); ++i) {
             material.GetTexture(ai_tex_type, i, &file_name);
             full_path = dir + file_name.C_Str();
-            texs.push_back(TextureManager::texture_load(full_path));
+            texs.push_back(TextureManager::texture_load(full_path, tex_type));
         }
     }
 
     return textures;
 }
 
+TextureManager::TextureArraySet TextureManager::texture_arrays_get(const aiScene &scene, const std::string &dir) {
+    TextureArraySet result;
+    result.layers.resize(scene.mNumMaterials);
+
+    /* 收集所有材质的纹理文件，相同的文件只载入一次；每个材质只使用每种类型的第 0 个纹理 */
+    struct File {
+        std::string path;
+        bool srgb;
+        Image image;
+    };
+    std::vector<File> files;
+    std::map<std::pair<std::string, bool>, size_t> file_index;
+    std::vector<std::map<TextureType, size_t>> material_files(scene.mNumMaterials);
+    for (auto tex_type : MODEL_TEXTURE_TYPES) {
+        aiTextureType ai_tex_type = AI_TEXTURE_TYPE_MAP.at(tex_type);
+        for (unsigned i = 0; i < scene.mNumMaterials; ++i) {
+            const aiMaterial &material = *scene.mMaterials[i];
+            if (material.GetTextureCount(ai_tex_type) == 0)
+                continue;
+
+            aiString file_name;
+            material.GetTexture(ai_tex_type, 0, &file_name);
+            std::string full_path = dir + file_name.C_Str();
+            const bool srgb = texture_type_srgb(tex_type);
+            auto [iter, inserted] = file_index.emplace(std::make_pair(full_path, srgb), files.size());
+            if (inserted)
+                files.push_back({full_path, srgb, {}});
+            material_files[i][tex_type] = iter->second;
+        }
+    }
+
+    /* 解码所有的文件，统一为 RGBA */
+    parallel_for(0, files.size(), [&](size_t i) {
+        files[i].image = ImageDecoders::load(files[i].path, {4, false});
+    });
+
+    /* 按照（宽，高，格式）分组，每组一个纹理数组，组内的层按照文件出现的顺序 */
+    std::map<std::tuple<int, int, bool>, std::vector<size_t>> groups;
+    for (size_t i = 0; i < files.size(); ++i)
+        groups[{files[i].image.width, files[i].image.height, files[i].srgb}].push_back(i);
+
+    std::vector<TextureArraySlot> file_slots(files.size());
+    for (const auto &[key, members] : groups) {
+        const auto &[width, height, srgb] = key;
+        std::vector<Image> images;
+        for (size_t i : members) {
+            file_slots[i] = {result.arrays.size(), (GLint) images.size()};
+            images.push_back(std::move(files[i].image));
+        }
+        SPDLOG_INFO("texture array: {}x{} {}, {} layers", width, height, srgb ? "sRGB" : "linear", images.size());
+        result.arrays.push_back(std::make_shared<Texture2DArray>(images, TextureWrap::REPEAT, true, srgb));
+    }
+
+    for (unsigned i = 0; i < scene.mNumMaterials; ++i)
+        for (const auto &[tex_type, file] : material_files[i])
+            result.layers[i][tex_type] = file_slots[file];
+
+    return result;
+}
+
+Texture2DArray::Texture2DArray(const std::vector<Image> &images, TextureWrap wrap, bool mip_map, bool srgb)
+        : _layers((GLsizei) images.size()), _srgb(srgb) {
+    assert(!images.empty());
+
+    /* 所有的层尺寸相同，不缩放 */
+    _width = images[0].width;
+    _height = images[0].height;
+    for (const auto &image : images) {
+        if (image.channels != 4 || image.hdr || image.width != _width || image.height != _height)
+            throw std::invalid_argument(fmt::format("texture array layer must be RGBA8 {}x{}, got {}x{}, {} channels",
+                                                    _width, _height, image.width, image.height, image.channels));
+    }
+
+    /* 分配纹理数组的空间，包括所有级别的 mip */
+    const GLenum internal_format = srgb ? GL_SRGB8_ALPHA8 : GL_RGBA8;
+    const GLsizei levels = mip_map ? (GLsizei) std::log2(std::max(_width, _height)) + 1 : 1;
+    glGenTextures(1, &_id);
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, _id);
+    for (GLsizei level = 0; level < levels; ++level)
+        glTexImage3D(GL_TEXTURE_2D_ARRAY, level, (GLint) internal_format, std::max(1, _width >> level),
+                     std::max(1, _height >> level), _layers, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAX_LEVEL, levels - 1);
+
+    /* 逐层传输纹理数据，mip 在 CPU 上生成 */
+    for (GLsizei layer = 0; layer < _layers; ++layer) {
+        const unsigned char *pixels = images[layer].data.data();
+        if (mip_map) {
+            MipOptions options;
+            options.srgb = srgb;
+            auto chain = mip_chain_generate(pixels, _width, _height, 4, options);
+            for (GLsizei level = 0; level < levels; ++level)
+                glTexSubImage3D(GL_TEXTURE_2D_ARRAY, level, 0, 0, layer, chain.level_width(level),
+                                chain.level_height(level), 1, GL_RGBA, GL_UNSIGNED_BYTE, chain.levels[level].data());
+        } else {
+            glTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, 0, 0, layer, _width, _height, 1, GL_RGBA, GL_UNSIGNED_BYTE,
+                            pixels);
+        }
+    }
+
+    /* 超出范围后如何采样 */
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, static_cast<GLint>(wrap));
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, static_cast<GLint>(wrap));
+
+    /* 缩放后如何采样 */
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, mip_map ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
+    /* 解除绑定 */
+    glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+}
+
+Texture2DArray::~Texture2DArray() {
+    glDeleteTextures(1, &_id);
+}
+
 GLuint TextureCube::cube_map_create(GLsizei width) {
     unsigned int cube_map;
 
@@ -129,67 +394,191 @@ GLuint TextureCube::cube_map_create(GLsizei width) {
 
 TextureCube::TextureCube(const std::string &file_path_positive_x, const std::string &file_path_negative_x,
                          const std::string &file_path_positive_y, const std::string &file_path_negative_y,
-                         const std::string &file_path_positive_z, const std::string &file_path_negative_z) {
-    std::map<GLenum, std::string> texture_map{
-            {GL_TEXTURE_CUBE_MAP_POSITIVE_X, file_path_positive_x},
-            {GL_TEXTURE_CUBE_MAP_NEGATIVE_X, file_path_negative_x},
-            {GL_TEXTURE_CUBE_MAP_POSITIVE_Y, file_path_positive_y},
-            {GL_TEXTURE_CUBE_MAP_NEGATIVE_Y, file_path_negative_y},
-            {GL_TEXTURE_CUBE_MAP_POSITIVE_Z, file_path_positive_z},
-            {GL_TEXTURE_CUBE_MAP_NEGATIVE_Z, file_path_negative_z},
-    };
+                         const std::string &file_path_positive_z, const std::string &file_path_negative_z,
+                         bool mip_map) {
+    /* 顺序和 GL_TEXTURE_CUBE_MAP_POSITIVE_X + i 一致 */
+    const std::array<std::string, 6> paths{file_path_positive_x, file_path_negative_x, file_path_positive_y,
+                                           file_path_negative_y, file_path_positive_z, file_path_negative_z};
+    Stopwatch decode_watch;
+    decode_watch.start();
+
+    /* 每个面在一个线程中读取，优先使用压缩纹理 */
+    std::array<std::optional<CompressedImage>, 6> compressed_faces;
+    parallel_for(0, 6, [&](size_t face) {
+        compressed_faces[face] = TextureFile::is_container(paths[face]) ? TextureFile::load(paths[face])
+                                                                        : TextureFile::cooked_find(paths[face]);
+    }, 6);
+
+    /* 6 个面都有压缩纹理，并且格式和尺寸一致时，合并为一个立方体贴图上传 */
+    bool all_compressed = true;
+    for (const auto &face : compressed_faces)
+        all_compressed = all_compressed && face && face->faces == 1 &&
+                         face->internal_format == compressed_faces[0]->internal_format &&
+                         face->width == compressed_faces[0]->width && face->height == compressed_faces[0]->height;
+    if (all_compressed) {
+        const CompressedImage &first = *compressed_faces[0];
+        CompressedImage compressed{first.internal_format, first.width, first.height, 6, first.levels};
+        for (const auto &face : compressed_faces)
+            compressed.levels = std::min(compressed.levels, face->levels);     // 每个面的 mip 级数可能不同
+        for (auto &face : compressed_faces)
+            for (GLsizei level = 0; level < compressed.levels; ++level)
+                compressed.data.push_back(std::move(face->level(0, level)));
+
+        _id = compressed_texture_create(compressed, GL_TEXTURE_CUBE_MAP);
+        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER,
+                        compressed.levels > 1 ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+        glBindTexture(GL_TEXTURE_CUBE_MAP, 0);
+        return;
+    }
+
+    /* 每个面在一个线程中解码，需要时在同一个线程中生成 mip */
+    std::array<MipChain<uint8_t>, 6> chains;
+    parallel_for(0, 6, [&](size_t face) {
+        Image image = ImageDecoders::load(paths[face]);
+        if (image.channels != 3 && image.channels != 4)
+            throw std::runtime_error(fmt::format("bad nr channels: {}, {}", image.channels, paths[face]));
+
+        if (mip_map) {
+            MipOptions options;
+            options.threads = 1;
+            chains[face] = mip_chain_generate(image.data.data(), image.width, image.height, image.channels, options);
+        } else {
+            chains[face].width = image.width;
+            chains[face].height = image.height;
+            chains[face].channels = image.channels;
+            chains[face].levels.push_back(std::move(image.data));
+        }
+    }, 6);
+    decode_watch.stop();
+
+    /* 所有的面必须是尺寸相同的正方形，通道数也要相同 */
+    const MipChain<uint8_t> &first = chains[0];
+    if (first.width != first.height)
+        throw std::runtime_error(fmt::format("cube map face is not square: {}, {}x{}", paths[0], first.width,
+                                             first.height));
+    for (size_t face = 1; face < 6; ++face)
+        if (chains[face].width != first.width || chains[face].height != first.height ||
+            chains[face].channels != first.channels)
+            throw std::runtime_error(fmt::format("cube map faces mismatch: {} is {}x{}x{}, {} is {}x{}x{}",
+                                                 paths[0], first.width, first.height, first.channels, paths[face],
+                                                 chains[face].width, chains[face].height, chains[face].channels));
+
+    Stopwatch upload_watch;
+    upload_watch.start();
+    const GLenum format = first.channels == 3 ? GL_RGB : GL_RGBA;
+    const GLenum internal_format = first.channels == 3 ? GL_RGB8 : GL_RGBA8;
+    const auto levels = (GLsizei) first.levels.size();
 
     glGenTextures(1, &_id);
     glBindTexture(GL_TEXTURE_CUBE_MAP, _id);
 
-    /* 读取文件，生成纹理 */
-    int width, height, nr_channels;
-    unsigned char *data;
-    for (const auto&[texure_target, file_path] : texture_map) {
-        data = stbi_load(file_path.c_str(), &width, &height, &nr_channels, 0);
-        if (!data) {
-            throw std::runtime_error(fmt::format("fail to load texture: {}", file_path));
+    /**
+     * 所有的面一起上传；支持 ARB_texture_storage 时，一次分配所有级别的不可变存储
+     * 启用了 PBO 上传时这里只分配存储，数据由 TextureUploader 上传
+     */
+    const bool deferred = TextureUploader::enabled();
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    if (GLExt::ARB_texture_storage)
+        GLExt::TexStorage2D(GL_TEXTURE_CUBE_MAP, levels, internal_format, first.width, first.height);
+    for (GLenum face = 0; face < 6; ++face) {
+        for (GLsizei level = 0; level < levels; ++level) {
+            GLsizei w = first.level_width(level), h = first.level_height(level);
+            const unsigned char *pixels = deferred ? nullptr : chains[face].levels[level].data();
+            if (!GLExt::ARB_texture_storage)
+                glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + face, level, (GLint) internal_format, w, h, 0, format,
+                             GL_UNSIGNED_BYTE, pixels);
+            else if (pixels)
+                glTexSubImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + face, level, 0, 0, w, h, format, GL_UNSIGNED_BYTE,
+                                pixels);
         }
-        switch (nr_channels) {
-            case 3:
-                glTexImage2D(texure_target, 0, GL_RGB, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, data);
-                break;
-            case 4:
-                glTexImage2D(texure_target, 0, GL_RGBA, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, data);
-                break;
-            default:
-                throw std::runtime_error("bad nr channels");
+    }
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAX_LEVEL, levels - 1);
+
+    /**
+     * 和 Texture2D 一样，每一级（6 个面）是一个上传任务，从最小的级别开始，上传之后才降低 BASE_LEVEL
+     * 不可变的存储会把 BASE_LEVEL 限制在已有的级别之内，不能让纹理不完整，所以最小的一级立即上传
+     */
+    if (deferred) {
+        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_BASE_LEVEL, levels - 1);
+        for (GLsizei level = levels - 1; level >= 0; --level) {
+            GLsizei w = first.level_width(level), h = first.level_height(level);
+            const size_t face_size = chains[0].levels[level].size();
+            UploadStaging staging = TextureUploader::staging(face_size * 6);
+            std::vector<UploadRegion> regions;
+            for (GLenum face = 0; face < 6; ++face) {
+                std::memcpy(staging.ptr + face * face_size, chains[face].levels[level].data(), face_size);
+                regions.push_back({GL_TEXTURE_CUBE_MAP_POSITIVE_X + face, level, w, h, format, GL_UNSIGNED_BYTE,
+                                   face * face_size, face_size});
+            }
+            TextureUploader::submit(_id, GL_TEXTURE_CUBE_MAP, std::move(staging), std::move(regions),
+                                    level != levels - 1,
+                                    [level] { glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_BASE_LEVEL, level); });
         }
-        stbi_image_free(data);
+        glBindTexture(GL_TEXTURE_CUBE_MAP, _id);
     }
 
     /* 多级纹理 */
     glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, levels > 1 ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR);
 
     /* uv 超过后如何采样 */
     glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
     glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
     glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+    glBindTexture(GL_TEXTURE_CUBE_MAP, 0);
+    upload_watch.stop();
+
+    SPDLOG_INFO("cube map {}x{}x{}, {} mips: decode {:.1f} ms (6 threads), upload {:.1f} ms", first.width,
+                first.height, first.channels, levels, decode_watch.average_us() / 1000.0,
+                upload_watch.average_us() / 1000.0);
+}
+
+TextureCube::~TextureCube() {
+    TextureUploader::cancel(_id);
+    glDeleteTextures(1, &_id);
 }
 
 TextureHDR::TextureHDR(const std::string &file_path) {
+    /* texture-cook 生成的 BC6H 压缩纹理，编码前已经进行了垂直翻转 */
+    auto compressed = TextureFile::is_container(file_path) ? TextureFile::load(file_path)
+                                                           : TextureFile::cooked_find(file_path);
+    if (compressed) {
+        _id = compressed_texture_create(*compressed, GL_TEXTURE_2D, 1);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glBindTexture(GL_TEXTURE_2D, 0);
+        return;
+    }
+
     // note 这里进行了垂直翻转
-    stbi_set_flip_vertically_on_load(true);
-    int width, height, nr_channels;
-    // 载入文件
-    float *data = stbi_loadf(file_path.c_str(), &width, &height, &nr_channels, 0);
-    if (!data) {
-        throw std::runtime_error(fmt::format("fail to load hdr texture from file: {}", file_path));
+    /* 直接解码到暂存内存（启用了 PBO 上传时是映射的 PBO）；纹理通常创建之后马上就会使用，所以立即上传 */
+    const ImageRequest request{3, true, true};
+    const ImageInfo info = ImageDecoders::info(file_path);
+    UploadStaging staging = TextureUploader::staging(ImageDecoders::bytes(info, request));
+    try {
+        ImageDecoders::decode(file_path, request, staging.ptr, staging.size);
+    } catch (...) {
+        TextureUploader::discard(std::move(staging));
+        throw;
     }
-    stbi_set_flip_vertically_on_load(false);
 
     // 创建材质对象
     glGenTextures(1, &_id);
     glBindTexture(GL_TEXTURE_2D, _id);
 
-    /* 将像素写入纹理 */
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB16F, width, height, 0, GL_RGB, GL_FLOAT, data);
+    /* 分配存储，再从暂存内存上传 */
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB16F, info.width, info.height, 0, GL_RGB, GL_FLOAT, nullptr);
+    const size_t size = staging.size;
+    TextureUploader::submit(_id, GL_TEXTURE_2D, std::move(staging),
+                            {{GL_TEXTURE_2D, 0, info.width, info.height, GL_RGB, GL_FLOAT, 0, size}}, false);
+    glBindTexture(GL_TEXTURE_2D, _id);
 
     /* 超过 tex_coord 范围后，如何采样 */
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
@@ -199,7 +588,4 @@ TextureHDR::TextureHDR(const std::string &file_path) {
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
     glBindTexture(GL_TEXTURE_2D, 0);
-
-    // 关闭文件
-    stbi_image_free(data);
 }
\ No newline at end of file
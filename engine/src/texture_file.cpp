@@ -0,0 +1,385 @@
+#include <array>
+#include <cctype>
+#include <cassert>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <algorithm>
+#include <stdexcept>
+#include <filesystem>
+
+#include <fmt/format.h>
+#include <spdlog/spdlog.h>
+
+#include "gl_ext.h"
+#include "texture_file.h"
+
+
+/* OpenGL 的压缩格式，和 DDS（DXGI_FORMAT），KTX2（VkFormat）中格式的对应关系 */
+struct FormatEntry {
+    GLenum gl;
+    uint32_t dxgi;
+    uint32_t vk;
+};
+
+/* 同一个 DXGI 格式对应多个 OpenGL 格式时，排在前面的优先 */
+static const std::array<FormatEntry, 14> FORMAT_TABLE{{
+        {GL_COMPRESSED_RGBA_S3TC_DXT1_EXT,        71, 133},
+        {GL_COMPRESSED_RGB_S3TC_DXT1_EXT,         71, 131},
+        {GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT1_EXT,  72, 134},
+        {GL_COMPRESSED_SRGB_S3TC_DXT1_EXT,        72, 132},
+        {GL_COMPRESSED_RGBA_S3TC_DXT5_EXT,        77, 137},
+        {GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT5_EXT,  78, 138},
+        {GL_COMPRESSED_RED_RGTC1,                 80, 139},
+        {GL_COMPRESSED_SIGNED_RED_RGTC1,          81, 140},
+        {GL_COMPRESSED_RG_RGTC2,                  83, 141},
+        {GL_COMPRESSED_SIGNED_RG_RGTC2,           84, 142},
+        {GL_COMPRESSED_RGB_BPTC_UNSIGNED_FLOAT,   95, 143},
+        {GL_COMPRESSED_RGB_BPTC_SIGNED_FLOAT,     96, 144},
+        {GL_COMPRESSED_RGBA_BPTC_UNORM,           98, 145},
+        {GL_COMPRESSED_SRGB_ALPHA_BPTC_UNORM,     99, 146},
+}};
+
+template<class Pred>
+static const FormatEntry *format_find(Pred &&pred) {
+    auto iter = std::find_if(FORMAT_TABLE.begin(), FORMAT_TABLE.end(), pred);
+    return iter == FORMAT_TABLE.end() ? nullptr : &*iter;
+}
+
+
+// =====================================================
+// 文件格式的常量
+// =====================================================
+
+static constexpr uint32_t fourcc(char a, char b, char c, char d) {
+    return (uint32_t) (uint8_t) a | (uint32_t) (uint8_t) b << 8 | (uint32_t) (uint8_t) c << 16 |
+           (uint32_t) (uint8_t) d << 24;
+}
+
+static constexpr uint32_t DDS_MAGIC = fourcc('D', 'D', 'S', ' ');
+static constexpr size_t DDS_HEADER_SIZE = 124;
+static constexpr size_t DDS_DX10_SIZE = 20;
+
+static constexpr uint32_t DDSD_CAPS = 0x1, DDSD_HEIGHT = 0x2, DDSD_WIDTH = 0x4, DDSD_PIXELFORMAT = 0x1000;
+static constexpr uint32_t DDSD_MIPMAPCOUNT = 0x20000, DDSD_LINEARSIZE = 0x80000;
+static constexpr uint32_t DDPF_FOURCC = 0x4;
+static constexpr uint32_t DDSCAPS_COMPLEX = 0x8, DDSCAPS_TEXTURE = 0x1000, DDSCAPS_MIPMAP = 0x400000;
+static constexpr uint32_t DDSCAPS2_CUBEMAP = 0x200, DDSCAPS2_CUBEMAP_ALLFACES = 0xFC00;
+static constexpr uint32_t DDS_DIMENSION_TEXTURE2D = 3, DDS_RESOURCE_MISC_TEXTURECUBE = 0x4;
+
+static const std::array<uint8_t, 12> KTX2_IDENTIFIER{0xAB, 'K', 'T', 'X', ' ', '2', '0', 0xBB, '\r', '\n', 0x1A,
+                                                     '\n'};
+static constexpr size_t KTX2_LEVEL_INDEX_OFFSET = 80;
+
+
+/* 按小端读取 */
+template<class T>
+static T read_le(const std::vector<unsigned char> &bytes, size_t offset) {
+    if (offset + sizeof(T) > bytes.size())
+        throw std::runtime_error("texture file truncated");
+    T value;
+    std::memcpy(&value, bytes.data() + offset, sizeof(T));
+    return value;
+}
+
+template<class T>
+static void write_le(std::vector<unsigned char> &bytes, size_t offset, T value) {
+    std::memcpy(bytes.data() + offset, &value, sizeof(T));
+}
+
+static std::vector<unsigned char> file_read(const std::string &path) {
+    std::ifstream file(path, std::ios::binary);
+    if (!file)
+        throw std::runtime_error(fmt::format("fail to open texture file: {}", path));
+    return {std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>()};
+}
+
+/* 从文件中截取一段数据，检查是否越界 */
+static std::vector<unsigned char> bytes_slice(const std::vector<unsigned char> &bytes, size_t offset, size_t size,
+                                              const std::string &path) {
+    if (offset > bytes.size() || size > bytes.size() - offset)
+        throw std::runtime_error(fmt::format("texture file truncated: {}", path));
+    return {bytes.begin() + (std::ptrdiff_t) offset, bytes.begin() + (std::ptrdiff_t) (offset + size)};
+}
+
+
+// =====================================================
+// DDS
+// =====================================================
+
+static CompressedImage dds_load(const std::vector<unsigned char> &bytes, const std::string &path) {
+    const size_t h = 4;     // 文件头紧跟在 magic 之后
+    if (bytes.size() < h + DDS_HEADER_SIZE || read_le<uint32_t>(bytes, h) != DDS_HEADER_SIZE)
+        throw std::runtime_error(fmt::format("bad dds header: {}", path));
+
+    CompressedImage image;
+    uint32_t flags = read_le<uint32_t>(bytes, h + 4);
+    image.height = (GLsizei) read_le<uint32_t>(bytes, h + 8);
+    image.width = (GLsizei) read_le<uint32_t>(bytes, h + 12);
+    uint32_t mip_count = read_le<uint32_t>(bytes, h + 24);
+    image.levels = (flags & DDSD_MIPMAPCOUNT) && mip_count > 0 ? (GLsizei) mip_count : 1;
+    uint32_t four_cc = read_le<uint32_t>(bytes, h + 80);
+    uint32_t caps2 = read_le<uint32_t>(bytes, h + 108);
+    image.faces = (caps2 & DDSCAPS2_CUBEMAP) ? 6 : 1;
+
+    size_t offset = h + DDS_HEADER_SIZE;
+    switch (four_cc) {
+        case fourcc('D', 'X', 'T', '1'):
+            image.internal_format = GL_COMPRESSED_RGBA_S3TC_DXT1_EXT;
+            break;
+        case fourcc('D', 'X', 'T', '5'):
+            image.internal_format = GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+            break;
+        case fourcc('A', 'T', 'I', '1'):
+        case fourcc('B', 'C', '4', 'U'):
+            image.internal_format = GL_COMPRESSED_RED_RGTC1;
+            break;
+        case fourcc('A', 'T', 'I', '2'):
+        case fourcc('B', 'C', '5', 'U'):
+            image.internal_format = GL_COMPRESSED_RG_RGTC2;
+            break;
+        case fourcc('D', 'X', '1', '0'): {
+            uint32_t dxgi = read_le<uint32_t>(bytes, offset);
+            uint32_t dimension = read_le<uint32_t>(bytes, offset + 4);
+            uint32_t misc = read_le<uint32_t>(bytes, offset + 8);
+            uint32_t array_size = read_le<uint32_t>(bytes, offset + 12);
+            if (dimension != DDS_DIMENSION_TEXTURE2D || array_size > 1)
+                throw std::runtime_error(fmt::format("only single 2d/cube dds is supported: {}", path));
+            auto entry = format_find([dxgi](const FormatEntry &e) { return e.dxgi == dxgi; });
+            if (!entry)
+                throw std::runtime_error(fmt::format("unsupported dxgi format {}: {}", dxgi, path));
+            image.internal_format = entry->gl;
+            if (misc & DDS_RESOURCE_MISC_TEXTURECUBE)
+                image.faces = 6;
+            offset += DDS_DX10_SIZE;
+            break;
+        }
+        default:
+            throw std::runtime_error(fmt::format("unsupported dds format: {}", path));
+    }
+
+    /* DDS 中的顺序：每个面的所有 mip 依次存放 */
+    image.data.resize((size_t) image.faces * image.levels);
+    for (GLsizei face = 0; face < image.faces; ++face) {
+        for (GLsizei level = 0; level < image.levels; ++level) {
+            size_t size = TextureFile::level_bytes(image.internal_format, std::max(1, image.width >> level),
+                                                   std::max(1, image.height >> level));
+            image.level(face, level) = bytes_slice(bytes, offset, size, path);
+            offset += size;
+        }
+    }
+    return image;
+}
+
+void TextureFile::dds_save(const std::string &path, const CompressedImage &image) {
+    auto entry = format_find([&image](const FormatEntry &e) { return e.gl == image.internal_format; });
+    if (!entry)
+        throw std::runtime_error(fmt::format("unsupported format for dds: {:#x}", image.internal_format));
+
+    std::vector<unsigned char> header(4 + DDS_HEADER_SIZE + DDS_DX10_SIZE, 0);
+    const size_t h = 4;
+    write_le<uint32_t>(header, 0, DDS_MAGIC);
+    write_le<uint32_t>(header, h, (uint32_t) DDS_HEADER_SIZE);
+    write_le<uint32_t>(header, h + 4, DDSD_CAPS | DDSD_HEIGHT | DDSD_WIDTH | DDSD_PIXELFORMAT | DDSD_MIPMAPCOUNT |
+                                      DDSD_LINEARSIZE);
+    write_le<uint32_t>(header, h + 8, (uint32_t) image.height);
+    write_le<uint32_t>(header, h + 12, (uint32_t) image.width);
+    write_le<uint32_t>(header, h + 16, (uint32_t) level_bytes(image.internal_format, image.width, image.height));
+    write_le<uint32_t>(header, h + 24, (uint32_t) image.levels);
+    write_le<uint32_t>(header, h + 72, 32);                       // DDS_PIXELFORMAT 的大小
+    write_le<uint32_t>(header, h + 76, DDPF_FOURCC);
+    write_le<uint32_t>(header, h + 80, fourcc('D', 'X', '1', '0'));
+    write_le<uint32_t>(header, h + 104, DDSCAPS_TEXTURE | DDSCAPS_COMPLEX | (image.levels > 1 ? DDSCAPS_MIPMAP : 0));
+    write_le<uint32_t>(header, h + 108, image.faces == 6 ? DDSCAPS2_CUBEMAP | DDSCAPS2_CUBEMAP_ALLFACES : 0);
+
+    const size_t dx10 = h + DDS_HEADER_SIZE;
+    write_le<uint32_t>(header, dx10, entry->dxgi);
+    write_le<uint32_t>(header, dx10 + 4, DDS_DIMENSION_TEXTURE2D);
+    write_le<uint32_t>(header, dx10 + 8, image.faces == 6 ? DDS_RESOURCE_MISC_TEXTURECUBE : 0);
+    write_le<uint32_t>(header, dx10 + 12, 1);
+
+    std::ofstream file(path, std::ios::binary | std::ios::trunc);
+    if (!file)
+        throw std::runtime_error(fmt::format("fail to create dds file: {}", path));
+    file.write(reinterpret_cast<const char *>(header.data()), (std::streamsize) header.size());
+    for (GLsizei face = 0; face < image.faces; ++face)
+        for (GLsizei level = 0; level < image.levels; ++level) {
+            const auto &data = image.level(face, level);
+            file.write(reinterpret_cast<const char *>(data.data()), (std::streamsize) data.size());
+        }
+    if (!file)
+        throw std::runtime_error(fmt::format("fail to write dds file: {}", path));
+}
+
+
+// =====================================================
+// KTX2
+// =====================================================
+
+static CompressedImage ktx2_load(const std::vector<unsigned char> &bytes, const std::string &path) {
+    uint32_t vk_format = read_le<uint32_t>(bytes, 12);
+    uint32_t width = read_le<uint32_t>(bytes, 20);
+    uint32_t height = read_le<uint32_t>(bytes, 24);
+    uint32_t depth = read_le<uint32_t>(bytes, 28);
+    uint32_t layer_count = read_le<uint32_t>(bytes, 32);
+    uint32_t face_count = read_le<uint32_t>(bytes, 36);
+    uint32_t level_count = std::max(1u, read_le<uint32_t>(bytes, 40));
+    uint32_t supercompression = read_le<uint32_t>(bytes, 44);
+
+    if (depth > 1 || layer_count > 1 || (face_count != 1 && face_count != 6))
+        throw std::runtime_error(fmt::format("only single 2d/cube ktx2 is supported: {}", path));
+    if (supercompression != 0)
+        throw std::runtime_error(fmt::format("ktx2 supercompression is not supported: {}", path));
+    auto entry = format_find([vk_format](const FormatEntry &e) { return e.vk == vk_format; });
+    if (!entry)
+        throw std::runtime_error(fmt::format("unsupported vk format {}: {}", vk_format, path));
+
+    CompressedImage image;
+    image.internal_format = entry->gl;
+    image.width = (GLsizei) width;
+    image.height = (GLsizei) std::max(1u, height);
+    image.faces = (GLsizei) face_count;
+    image.levels = (GLsizei) level_count;
+    image.data.resize((size_t) image.faces * image.levels);
+
+    /* KTX2 中的顺序：每一级 mip 依次存放，同一级中是所有的面 */
+    for (GLsizei level = 0; level < image.levels; ++level) {
+        size_t index = KTX2_LEVEL_INDEX_OFFSET + (size_t) level * 24;
+        auto offset = (size_t) read_le<uint64_t>(bytes, index);
+        auto length = (size_t) read_le<uint64_t>(bytes, index + 8);
+        size_t face_size = TextureFile::level_bytes(image.internal_format, std::max(1, image.width >> level),
+                                                    std::max(1, image.height >> level));
+        if (face_size * image.faces != length)
+            throw std::runtime_error(fmt::format("bad ktx2 level {} size: {}", level, path));
+        for (GLsizei face = 0; face < image.faces; ++face)
+            image.level(face, level) = bytes_slice(bytes, offset + face * face_size, face_size, path);
+    }
+    return image;
+}
+
+
+// =====================================================
+// TextureFile
+// =====================================================
+
+static std::string extension_lower(const std::string &path) {
+    std::string ext = std::filesystem::path(path).extension().string();
+    std::transform(ext.begin(), ext.end(), ext.begin(), [](unsigned char c) { return (char) std::tolower(c); });
+    return ext;
+}
+
+bool TextureFile::is_container(const std::string &path) {
+    std::string ext = extension_lower(path);
+    return ext == ".dds" || ext == ".ktx2";
+}
+
+std::string TextureFile::cooked_path(const std::string &source_path) {
+    return std::filesystem::path(source_path).replace_extension(".dds").string();
+}
+
+CompressedImage TextureFile::load(const std::string &path) {
+    auto bytes = file_read(path);
+
+    CompressedImage image;
+    if (bytes.size() >= 4 && read_le<uint32_t>(bytes, 0) == DDS_MAGIC)
+        image = dds_load(bytes, path);
+    else if (bytes.size() >= KTX2_IDENTIFIER.size() &&
+             std::equal(KTX2_IDENTIFIER.begin(), KTX2_IDENTIFIER.end(), bytes.begin()))
+        image = ktx2_load(bytes, path);
+    else
+        throw std::runtime_error(fmt::format("unknown texture container: {}", path));
+
+    if (image.width <= 0 || image.height <= 0)
+        throw std::runtime_error(fmt::format("bad texture size: {}", path));
+    return image;
+}
+
+std::optional<CompressedImage> TextureFile::cooked_find(const std::string &source_path) {
+    namespace fs = std::filesystem;
+    std::string cooked = cooked_path(source_path);
+    std::error_code ec;
+    if (!fs::exists(cooked, ec))
+        return std::nullopt;
+    if (fs::exists(source_path, ec) && fs::last_write_time(cooked, ec) < fs::last_write_time(source_path, ec)) {
+        SPDLOG_WARN("cooked texture is older than source, run texture-cook again: {}", cooked);
+        return std::nullopt;
+    }
+
+    try {
+        CompressedImage image = load(cooked);
+        if (!format_supported(image.internal_format)) {
+            SPDLOG_INFO("compressed format {:#x} is not supported, decode source: {}", image.internal_format,
+                        source_path);
+            return std::nullopt;
+        }
+        return image;
+    } catch (const std::exception &e) {
+        SPDLOG_WARN("fail to load cooked texture, decode source: {}", e.what());
+        return std::nullopt;
+    }
+}
+
+GLsizei TextureFile::block_bytes(GLenum internal_format) {
+    switch (internal_format) {
+        case GL_COMPRESSED_RGB_S3TC_DXT1_EXT:
+        case GL_COMPRESSED_RGBA_S3TC_DXT1_EXT:
+        case GL_COMPRESSED_SRGB_S3TC_DXT1_EXT:
+        case GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT1_EXT:
+        case GL_COMPRESSED_RED_RGTC1:
+        case GL_COMPRESSED_SIGNED_RED_RGTC1:
+            return 8;
+        default:
+            return 16;
+    }
+}
+
+size_t TextureFile::level_bytes(GLenum internal_format, GLsizei width, GLsizei height) {
+    return (size_t) ((width + 3) / 4) * (size_t) ((height + 3) / 4) * block_bytes(internal_format);
+}
+
+bool TextureFile::format_supported(GLenum internal_format) {
+    switch (internal_format) {
+        case GL_COMPRESSED_RGB_S3TC_DXT1_EXT:
+        case GL_COMPRESSED_RGBA_S3TC_DXT1_EXT:
+        case GL_COMPRESSED_SRGB_S3TC_DXT1_EXT:
+        case GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT1_EXT:
+        case GL_COMPRESSED_RGBA_S3TC_DXT5_EXT:
+        case GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT5_EXT:
+            return GLExt::EXT_texture_compression_s3tc;
+        case GL_COMPRESSED_RED_RGTC1:
+        case GL_COMPRESSED_SIGNED_RED_RGTC1:
+        case GL_COMPRESSED_RG_RGTC2:
+        case GL_COMPRESSED_SIGNED_RG_RGTC2:
+            return true;
+        case GL_COMPRESSED_RGB_BPTC_UNSIGNED_FLOAT:
+        case GL_COMPRESSED_RGB_BPTC_SIGNED_FLOAT:
+        case GL_COMPRESSED_RGBA_BPTC_UNORM:
+        case GL_COMPRESSED_SRGB_ALPHA_BPTC_UNORM:
+            return GLExt::ARB_texture_compression_bptc;
+        default:
+            return false;
+    }
+}
+
+
+GLuint compressed_texture_create(const CompressedImage &image, GLenum target, GLsizei mip_levels) {
+    GLsizei levels = mip_levels <= 0 ? image.levels : std::min(mip_levels, image.levels);
+    assert(target == GL_TEXTURE_CUBE_MAP ? image.faces == 6 : image.faces == 1);
+
+    GLuint id;
+    glGenTextures(1, &id);
+    glBindTexture(target, id);
+    for (GLsizei face = 0; face < image.faces; ++face) {
+        GLenum face_target = target == GL_TEXTURE_CUBE_MAP ? GL_TEXTURE_CUBE_MAP_POSITIVE_X + face : target;
+        for (GLsizei level = 0; level < levels; ++level) {
+            const auto &data = image.level(face, level);
+            glCompressedTexImage2D(face_target, level, image.internal_format, std::max(1, image.width >> level),
+                                   std::max(1, image.height >> level), 0, (GLsizei) data.size(), data.data());
+        }
+    }
+
+    /* 没有上传的级别不能被采样 */
+    glTexParameteri(target, GL_TEXTURE_BASE_LEVEL, 0);
+    glTexParameteri(target, GL_TEXTURE_MAX_LEVEL, levels - 1);
+    return id;
+}
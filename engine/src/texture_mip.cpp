@@ -0,0 +1,335 @@
+#include <array>
+#include <cmath>
+#include <cstddef>
+
+#include "texture_mip.h"
+#include "utils/parallel.h"
+
+#if defined(__SSE2__) || defined(_M_X64)
+#define MIP_SIMD_SSE
+#include <immintrin.h>
+#elif defined(__ARM_NEON)
+#define MIP_SIMD_NEON
+#include <arm_neon.h>
+#endif
+
+
+// =====================================================
+// 一个 RGBA 像素：4 个 float，对应一个 SIMD 寄存器
+// =====================================================
+
+struct F4 {
+#if defined(MIP_SIMD_SSE)
+    __m128 v;
+
+    static inline F4 load(const float *p) { return {_mm_loadu_ps(p)}; }
+
+    static inline F4 zero() { return {_mm_setzero_ps()}; }
+
+    inline void store(float *p) const { _mm_storeu_ps(p, v); }
+
+    inline F4 operator+(F4 o) const { return {_mm_add_ps(v, o.v)}; }
+
+    inline F4 operator*(float s) const { return {_mm_mul_ps(v, _mm_set1_ps(s))}; }
+
+#elif defined(MIP_SIMD_NEON)
+    float32x4_t v;
+
+    static inline F4 load(const float *p) { return {vld1q_f32(p)}; }
+
+    static inline F4 zero() { return {vdupq_n_f32(0.f)}; }
+
+    inline void store(float *p) const { vst1q_f32(p, v); }
+
+    inline F4 operator+(F4 o) const { return {vaddq_f32(v, o.v)}; }
+
+    inline F4 operator*(float s) const { return {vmulq_n_f32(v, s)}; }
+
+#else
+    float v[4];
+
+    static inline F4 load(const float *p) { return {{p[0], p[1], p[2], p[3]}}; }
+
+    static inline F4 zero() { return {{0.f, 0.f, 0.f, 0.f}}; }
+
+    inline void store(float *p) const { std::copy(v, v + 4, p); }
+
+    inline F4 operator+(F4 o) const { return {{v[0] + o.v[0], v[1] + o.v[1], v[2] + o.v[2], v[3] + o.v[3]}}; }
+
+    inline F4 operator*(float s) const { return {{v[0] * s, v[1] * s, v[2] * s, v[3] * s}}; }
+
+#endif
+};
+
+
+/* 行数太少时，线程的开销超过收益 */
+static unsigned threads_for_rows(int rows, unsigned threads) {
+    return rows < 32 ? 1u : threads;
+}
+
+
+// =====================================================
+// 降采样：输入输出都是 RGBA 的 float
+// =====================================================
+
+static void box_row(const float *src, int width, int height, float *dst, int w, int y) {
+    const float *r0 = src + (size_t) std::min(2 * y, height - 1) * width * 4;
+    const float *r1 = src + (size_t) std::min(2 * y + 1, height - 1) * width * 4;
+    float *out = dst + (size_t) y * w * 4;
+    int x = 0;
+
+#if defined(__AVX2__)
+    /* 一次输出 2 个像素：每一行读取 4 个相邻的像素 */
+    for (; 2 * x + 3 < width && x + 1 < w; x += 2) {
+        __m256 s0 = _mm256_add_ps(_mm256_loadu_ps(r0 + 8 * x), _mm256_loadu_ps(r1 + 8 * x));
+        __m256 s1 = _mm256_add_ps(_mm256_loadu_ps(r0 + 8 * x + 8), _mm256_loadu_ps(r1 + 8 * x + 8));
+        __m256 left = _mm256_permute2f128_ps(s0, s1, 0x20);        // 像素 2x，2x+2
+        __m256 right = _mm256_permute2f128_ps(s0, s1, 0x31);       // 像素 2x+1，2x+3
+        _mm256_storeu_ps(out + 4 * x, _mm256_mul_ps(_mm256_add_ps(left, right), _mm256_set1_ps(0.25f)));
+    }
+#endif
+
+    for (; x < w; ++x) {
+        int x0 = std::min(2 * x, width - 1), x1 = std::min(2 * x + 1, width - 1);
+        F4 sum = F4::load(r0 + 4 * x0) + F4::load(r0 + 4 * x1) + F4::load(r1 + 4 * x0) + F4::load(r1 + 4 * x1);
+        (sum * 0.25f).store(out + 4 * x);
+    }
+}
+
+/* Kaiser 窗的 sinc，降采样 2 倍时的 6 个权重，对应源像素 2x-2 ~ 2x+3 */
+static const std::array<float, 6> &kaiser_weights() {
+    static const std::array<float, 6> weights = []() {
+        /* 第一类修正贝塞尔函数 I0 */
+        auto bessel_i0 = [](double x) {
+            double sum = 1, term = 1;
+            for (int k = 1; k < 32; ++k) {
+                term *= (x / (2 * k)) * (x / (2 * k));
+                sum += term;
+            }
+            return sum;
+        };
+        const double alpha = 4.0, radius = 3.0;
+        std::array<float, 6> w{};
+        double total = 0;
+        for (int k = 0; k < 6; ++k) {
+            double d = k - 2.5;                         // 到输出像素中心的距离，单位是源像素
+            double t = d / 2.0;
+            double sinc = std::sin(M_PI * t) / (M_PI * t);
+            double r = d / radius;
+            double window = bessel_i0(alpha * std::sqrt(std::max(0.0, 1.0 - r * r))) / bessel_i0(alpha);
+            w[k] = (float) (sinc * window);
+            total += w[k];
+        }
+        for (auto &v : w)
+            v = (float) (v / total);
+        return w;
+    }();
+    return weights;
+}
+
+static std::vector<float> downsample(const std::vector<float> &src, int width, int height, MipFilter filter,
+                                     unsigned threads) {
+    const int w = std::max(1, width / 2), h = std::max(1, height / 2);
+    std::vector<float> dst((size_t) w * h * 4);
+
+    if (filter == MipFilter::Box) {
+        parallel_for(0, (size_t) h, [&](size_t y) { box_row(src.data(), width, height, dst.data(), w, (int) y); },
+                     threads_for_rows(h, threads));
+        return dst;
+    }
+
+    /* Kaiser：可分离的滤波器，先水平再垂直；只有 1 个像素的方向不需要滤波 */
+    const auto &k = kaiser_weights();
+    std::vector<float> tmp((size_t) w * height * 4);
+    parallel_for(0, (size_t) height, [&](size_t y) {
+        const float *row = src.data() + y * width * 4;
+        for (int x = 0; x < w; ++x) {
+            F4 sum = F4::zero();
+            for (int i = 0; i < 6; ++i) {
+                int sx = width == 1 ? 0 : std::clamp(2 * x - 2 + i, 0, width - 1);
+                sum = sum + F4::load(row + 4 * sx) * k[i];
+            }
+            sum.store(tmp.data() + (y * w + x) * 4);
+        }
+    }, threads_for_rows(height, threads));
+    parallel_for(0, (size_t) h, [&](size_t y) {
+        for (int x = 0; x < w; ++x) {
+            F4 sum = F4::zero();
+            for (int i = 0; i < 6; ++i) {
+                int sy = height == 1 ? 0 : std::clamp(2 * (int) y - 2 + i, 0, height - 1);
+                sum = sum + F4::load(tmp.data() + ((size_t) sy * w + x) * 4) * k[i];
+            }
+            sum.store(dst.data() + (y * w + x) * 4);
+        }
+    }, threads_for_rows(h, threads));
+
+    /* Kaiser 有负的权重，结果可能越界 */
+    for (auto &v : dst)
+        v = std::max(0.f, v);
+    return dst;
+}
+
+
+// =====================================================
+// sRGB 和 alpha
+// =====================================================
+
+/* sRGB 编码的 8 位值 -> 线性值 */
+static const std::array<float, 256> &srgb_to_linear_table() {
+    static const std::array<float, 256> table = []() {
+        std::array<float, 256> t{};
+        for (int i = 0; i < 256; ++i) {
+            float c = (float) i / 255.f;
+            t[i] = c <= 0.04045f ? c / 12.92f : std::pow((c + 0.055f) / 1.055f, 2.4f);
+        }
+        return t;
+    }();
+    return table;
+}
+
+/* 线性值 -> sRGB 编码的 8 位值，查表的精度是 1/4096 */
+static uint8_t linear_to_srgb(float v) {
+    static const std::array<uint8_t, 4097> table = []() {
+        std::array<uint8_t, 4097> t{};
+        for (int i = 0; i <= 4096; ++i) {
+            float c = (float) i / 4096.f;
+            float s = c <= 0.0031308f ? c * 12.92f : 1.055f * std::pow(c, 1.f / 2.4f) - 0.055f;
+            t[i] = (uint8_t) std::lround(std::clamp(s, 0.f, 1.f) * 255.f);
+        }
+        return t;
+    }();
+    return table[(size_t) std::lround(std::clamp(v, 0.f, 1.f) * 4096.f)];
+}
+
+static uint8_t unorm8(float v) {
+    return (uint8_t) std::lround(std::clamp(v, 0.f, 1.f) * 255.f);
+}
+
+/* alpha * scale 大于阈值的像素的比例 */
+static float alpha_coverage(const std::vector<float> &rgba, float scale, float cutoff) {
+    size_t cnt = 0, total = rgba.size() / 4;
+    for (size_t i = 0; i < total; ++i)
+        if (rgba[i * 4 + 3] * scale > cutoff)
+            ++cnt;
+    return (float) cnt / (float) total;
+}
+
+/* 二分查找 alpha 的缩放系数，使覆盖率接近目标 */
+static float alpha_scale_find(const std::vector<float> &rgba, float coverage, float cutoff) {
+    float lo = 0.f, hi = 4.f;
+    for (int iter = 0; iter < 16; ++iter) {
+        float mid = 0.5f * (lo + hi);
+        if (alpha_coverage(rgba, mid, cutoff) < coverage)
+            lo = mid;
+        else
+            hi = mid;
+    }
+    return 0.5f * (lo + hi);
+}
+
+bool mip_alpha_is_test(const uint8_t *pixels, int width, int height, int channels) {
+    if (channels != 4)
+        return false;
+    size_t total = (size_t) width * height, transparent = 0, partial = 0;
+    for (size_t i = 0; i < total; ++i) {
+        uint8_t a = pixels[i * 4 + 3];
+        if (a <= 12)
+            ++transparent;
+        else if (a < 243)
+            ++partial;
+    }
+    /* 有完全透明的部分，并且半透明的像素很少 */
+    return transparent > 0 && partial * 20 < total;
+}
+
+
+// =====================================================
+// mip 链
+// =====================================================
+
+MipChain<uint8_t> mip_chain_generate(const uint8_t *pixels, int width, int height, int channels,
+                                     const MipOptions &options) {
+    const unsigned threads = options.threads ? options.threads : parallel_threads();
+    const bool srgb = options.srgb && channels >= 3;
+    const bool has_alpha = channels == 4;
+    const bool alpha_test = has_alpha && (options.alpha == MipAlpha::Test ||
+                                          (options.alpha == MipAlpha::Auto &&
+                                           mip_alpha_is_test(pixels, width, height, channels)));
+    const auto &to_linear = srgb_to_linear_table();
+
+    MipChain<uint8_t> chain;
+    chain.width = width;
+    chain.height = height;
+    chain.channels = channels;
+    chain.levels.emplace_back(pixels, pixels + (size_t) width * height * channels);
+
+    /* 转换为线性的 RGBA float，颜色预乘 alpha */
+    std::vector<float> cur((size_t) width * height * 4);
+    parallel_for(0, (size_t) height, [&](size_t y) {
+        for (size_t x = 0; x < (size_t) width; ++x) {
+            const uint8_t *p = pixels + (y * width + x) * channels;
+            float *q = cur.data() + (y * width + x) * 4;
+            float alpha = has_alpha ? (float) p[3] / 255.f : 1.f;
+            for (int c = 0; c < 3; ++c) {
+                uint8_t v = p[std::min(c, channels - 1)];
+                q[c] = (srgb ? to_linear[v] : (float) v / 255.f) * alpha;
+            }
+            q[3] = alpha;
+        }
+    }, threads_for_rows(height, threads));
+    const float coverage = alpha_test ? alpha_coverage(cur, 1.f, options.alpha_cutoff) : 0.f;
+
+    for (int w = width, h = height; w > 1 || h > 1;) {
+        cur = downsample(cur, w, h, options.filter, threads);
+        w = std::max(1, w / 2);
+        h = std::max(1, h / 2);
+
+        /* 只在输出时缩放 alpha，不影响之后的降采样 */
+        const float alpha_scale = alpha_test ? alpha_scale_find(cur, coverage, options.alpha_cutoff) : 1.f;
+
+        std::vector<uint8_t> level((size_t) w * h * channels);
+        parallel_for(0, (size_t) h, [&](size_t y) {
+            for (size_t x = 0; x < (size_t) w; ++x) {
+                const float *p = cur.data() + (y * w + x) * 4;
+                uint8_t *q = level.data() + (y * w + x) * channels;
+                float alpha = p[3];
+                float inv = alpha > 1e-6f ? 1.f / alpha : 0.f;
+                for (int c = 0; c < std::min(channels, 3); ++c)
+                    q[c] = srgb ? linear_to_srgb(p[c] * inv) : unorm8(p[c] * inv);
+                if (has_alpha)
+                    q[3] = unorm8(alpha * alpha_scale);
+            }
+        }, threads_for_rows(h, threads));
+        chain.levels.push_back(std::move(level));
+    }
+    return chain;
+}
+
+MipChain<float> mip_chain_generate(const float *pixels, int width, int height, int channels,
+                                   const MipOptions &options) {
+    const unsigned threads = options.threads ? options.threads : parallel_threads();
+
+    MipChain<float> chain;
+    chain.width = width;
+    chain.height = height;
+    chain.channels = channels;
+    chain.levels.emplace_back(pixels, pixels + (size_t) width * height * channels);
+
+    std::vector<float> cur((size_t) width * height * 4);
+    for (size_t i = 0; i < (size_t) width * height; ++i)
+        for (int c = 0; c < 4; ++c)
+            cur[i * 4 + c] = c < channels ? pixels[i * channels + c] : (c == 3 ? 1.f : 0.f);
+
+    for (int w = width, h = height; w > 1 || h > 1;) {
+        cur = downsample(cur, w, h, options.filter, threads);
+        w = std::max(1, w / 2);
+        h = std::max(1, h / 2);
+
+        std::vector<float> level((size_t) w * h * channels);
+        for (size_t i = 0; i < (size_t) w * h; ++i)
+            for (int c = 0; c < channels; ++c)
+                level[i * channels + c] = cur[i * 4 + c];
+        chain.levels.push_back(std::move(level));
+    }
+    return chain;
+}
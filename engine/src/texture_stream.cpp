@@ -0,0 +1,431 @@
+#include <cmath>
+#include <limits>
+#include <cstring>
+#include <iterator>
+#include <algorithm>
+#include <stdexcept>
+
+#include "texture_stream.h"
+#include "texture_mip.h"
+#include "texture_file.h"
+#include "image_decoder.h"
+#include "texture_upload.h"
+#include "profiler.h"
+
+
+/**
+ * 解码源文件（不是压缩纹理），生成所有级别的 mip；会填充 source 的尺寸，通道数等信息
+ * 后台线程中调用时 threads 为 1，避免和主线程争抢
+ */
+static std::vector<std::vector<unsigned char>> image_decode(TextureStreamSource &source, unsigned threads) {
+    Image image = ImageDecoders::load(source.path, {source.channels});
+    const int nr_channels = image.channels;
+
+    switch (nr_channels) {
+        case 1:
+            source.internal_format = GL_RED;
+            break;
+        case 3:
+            source.internal_format = GL_RGB;
+            break;
+        case 4:
+            source.internal_format = GL_RGBA;
+            break;
+        default:
+            throw std::runtime_error(fmt::format("bad nr_channels: {}", nr_channels));
+    }
+    source.channels = nr_channels;
+    source.width = image.width;
+    source.height = image.height;
+
+    MipOptions options;
+    options.srgb = source.srgb;
+    options.threads = threads;
+    auto chain = mip_chain_generate(image.data.data(), image.width, image.height, nr_channels, options);
+
+    source.levels = (GLint) chain.levels.size();
+    return std::move(chain.levels);
+}
+
+
+void TextureStreamer::init(unsigned threads) {
+    if (_enabled)
+        return;
+    _stop = false;
+    for (unsigned i = 0; i < std::max(1u, threads); ++i)
+        _workers.emplace_back(_worker);
+    _enabled = true;
+    SPDLOG_INFO("texture streaming enabled, {} threads.", _workers.size());
+}
+
+void TextureStreamer::terminate() {
+    if (!_enabled)
+        return;
+    {
+        std::lock_guard lock(_mutex);
+        _stop = true;
+        _jobs.clear();
+    }
+    _cv.notify_all();
+    for (auto &worker : _workers)
+        worker.join();
+    _workers.clear();
+    _results.clear();
+    _textures.clear();
+    _decoded.clear();
+    _decoded_bytes = 0;
+    _enabled = false;
+}
+
+std::shared_ptr<Texture2D> TextureStreamer::texture_create(const std::string &path, bool srgb) {
+    auto stream = std::make_unique<TextureStream>();
+    TextureStreamSource &source = stream->source;
+    source.path = path;
+    source.srgb = srgb;
+
+    /* 和 Texture2D 一样，优先使用 texture-cook 生成的压缩纹理 */
+    auto decoded = std::make_shared<Levels>();
+    if (auto compressed = TextureFile::cooked_find(path)) {
+        source.compressed = true;
+        source.internal_format = compressed->internal_format;
+        source.width = compressed->width;
+        source.height = compressed->height;
+        source.levels = compressed->levels;
+        *decoded = std::move(compressed->data);
+    } else {
+        *decoded = image_decode(source, 0);
+    }
+
+    /* 尾部：尺寸不超过 TAIL_SIZE 的级别，只上传这些；完整的 mip 链留给之后的流送 */
+    GLint tail = 0;
+    while (tail < source.levels - 1 && std::max(source.width >> tail, source.height >> tail) > TAIL_SIZE)
+        ++tail;
+    const Levels levels(decoded->begin() + tail, decoded->end());
+    stream->tail_base = stream->resident_base = stream->wanted = tail;
+    {
+        std::lock_guard lock(_mutex);
+        _decoded_insert(path, std::move(decoded));
+    }
+
+    /* 尾部很小，直接上传，创建之后马上就可以使用 */
+    std::shared_ptr<Texture2D> texture(new Texture2D());
+    glGenTextures(1, &texture->_id);
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, texture->_id);
+    _levels_upload(texture->_id, source, tail, levels);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, tail);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, source.levels - 1);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, source.levels > 1 ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    /* 这里直接设置，TextureManager 缓存纹理时会计入统计 */
+    texture->_bytes = _bytes_from(source, tail);
+    texture->_stream = std::move(stream);
+    _textures.push_back(texture);
+    return texture;
+}
+
+void TextureStreamer::frame_begin(const glm::vec3 &camera_pos, float fov_y, int screen_height) {
+    _camera_pos = camera_pos;
+    _tan_half_fov = std::tan(fov_y * 0.5f);
+    _screen_height = std::max(1, screen_height);
+}
+
+float TextureStreamer::_uv_per_pixel(const Mesh &mesh, const glm::mat4 &model) {
+    /**
+     * 估计屏幕上一个像素覆盖了多少纹理坐标，按照包围球上离摄像机最近的点计算，结果偏保守：
+     *  - 距离 d 处，一个像素对应的世界空间长度是 2 * d * tan(fov / 2) / screen_height
+     *  - 乘以纹理坐标的密度（除以 model 矩阵的缩放），就是一个像素对应的纹理坐标
+     * 为负数表示需要第 0 级：摄像机在包围球内，或者纹理坐标的密度未知
+     */
+    if (mesh.uv_density() <= 0.f)
+        return -1.f;
+    glm::vec3 center = glm::vec3(model * glm::vec4(mesh.bounds_center(), 1.f));
+    float scale = std::sqrt(std::max({glm::dot(glm::vec3(model[0]), glm::vec3(model[0])),
+                                      glm::dot(glm::vec3(model[1]), glm::vec3(model[1])),
+                                      glm::dot(glm::vec3(model[2]), glm::vec3(model[2]))}));
+    float distance = glm::length(center - _camera_pos) - mesh.bounds_radius() * scale;
+    if (distance <= 0.f || scale <= 0.f)
+        return -1.f;
+    float world_per_pixel = 2.f * distance * _tan_half_fov / (float) _screen_height;
+    return world_per_pixel * mesh.uv_density() / scale;
+}
+
+void TextureStreamer::_footprint(const Mesh &mesh, const glm::mat4 &model, GLsizei amount) {
+    /* 实例化绘制：离摄像机最近的实例需要的级别最精细；实例的位置未知时需要第 0 级 */
+    float uv_per_pixel = -1.f;
+    if (amount == 1) {
+        uv_per_pixel = _uv_per_pixel(mesh, model);
+    } else if (_instances && _instance_count >= (size_t) amount) {
+        uv_per_pixel = std::numeric_limits<float>::max();
+        for (GLsizei i = 0; i < amount && uv_per_pixel > 0.f; ++i)
+            uv_per_pixel = std::min(uv_per_pixel, _uv_per_pixel(mesh, _instances[i]));
+    }
+
+    for (const auto &[type, textures] : mesh.texture_map()) {
+        for (const auto &texture : textures) {
+            if (!texture || !texture->_stream)
+                continue;
+            TextureStream &stream = *texture->_stream;
+
+            /* 一个像素覆盖 2^n 个纹素时，需要第 n 级 */
+            GLint level = 0;
+            if (uv_per_pixel > 0.f) {
+                float texels = uv_per_pixel * (float) std::max(stream.source.width, stream.source.height);
+                if (texels > 1.f)
+                    level = (GLint) std::floor(std::log2(texels));
+            }
+            stream.wanted = std::min({stream.wanted, level, stream.tail_base});
+        }
+    }
+}
+
+void TextureStreamer::update() {
+    if (!_enabled)
+        return;
+    glActiveTexture(GL_TEXTURE0);
+
+    /* 后台载入完成的级别交给 TextureUploader 上传，上传之后再从原来的级别渐入 */
+    std::vector<Result> results;
+    {
+        std::lock_guard lock(_mutex);
+        results.swap(_results);
+    }
+    for (auto &result : results) {
+        auto texture = result.texture.lock();
+        if (!texture)
+            continue;
+        TextureStream &stream = *texture->_stream;
+        if (result.levels.empty()) {
+            stream.pending = false;
+            stream.failed = true;
+            continue;
+        }
+
+        /* 上传的命令发出之前，纹理仍然在载入中，不会发起新的载入，也不会释放级别 */
+        glBindTexture(GL_TEXTURE_2D, texture->_id);
+        _levels_upload(texture->_id, stream.source, result.first, result.levels,
+                       [weak = result.texture, first = result.first] {
+                           auto texture = weak.lock();
+                           if (!texture)
+                               return;
+                           TextureStream &stream = *texture->_stream;
+                           stream.pending = false;
+                           stream.min_lod += (float) (stream.resident_base - first);
+                           stream.resident_base = first;
+                           glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, stream.resident_base);
+                           glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MIN_LOD, stream.min_lod);
+                           _bytes_set(*texture, _bytes_from(stream.source, stream.resident_base));
+                           ++_stats.loads;
+                       });
+    }
+
+    std::vector<Job> jobs;
+    size_t pending = 0, resident_bytes = 0, full_bytes = 0;
+    for (auto iter = _textures.begin(); iter != _textures.end();) {
+        auto texture = iter->lock();
+        if (!texture) {
+            iter = _textures.erase(iter);
+            continue;
+        }
+        ++iter;
+        TextureStream &stream = *texture->_stream;
+
+        if (stream.min_lod > 0.f) {
+            stream.min_lod = std::max(0.f, stream.min_lod - 1.f / FADE_FRAMES);
+            glBindTexture(GL_TEXTURE_2D, texture->_id);
+            glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MIN_LOD, stream.min_lod);
+        }
+
+        if (stream.pending || stream.failed) {
+            stream.idle_frames = 0;
+        } else if (stream.wanted < stream.resident_base) {
+            /* 需要更精细的级别：交给后台线程 */
+            jobs.push_back({texture, stream.source, stream.wanted, stream.resident_base});
+            stream.pending = true;
+            stream.idle_frames = 0;
+        } else if (stream.wanted > stream.resident_base) {
+            /* 一段时间内都不需要的级别：重新指定为空的图像来释放，并提高 BASE_LEVEL */
+            if (++stream.idle_frames >= DROP_DELAY_FRAMES) {
+                glBindTexture(GL_TEXTURE_2D, texture->_id);
+                for (GLint level = stream.resident_base; level < stream.wanted; ++level)
+                    glTexImage2D(GL_TEXTURE_2D, level, GL_RGBA, 0, 0, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+                stream.min_lod = std::max(0.f, stream.min_lod - (float) (stream.wanted - stream.resident_base));
+                stream.resident_base = stream.wanted;
+                glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, stream.resident_base);
+                glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MIN_LOD, stream.min_lod);
+                _bytes_set(*texture, _bytes_from(stream.source, stream.resident_base));
+                stream.idle_frames = 0;
+                ++_stats.drops;
+            }
+        } else {
+            stream.idle_frames = 0;
+        }
+
+        /* 下一帧重新估计 */
+        stream.wanted = stream.tail_base;
+
+        pending += stream.pending;
+        resident_bytes += texture->_bytes;
+        full_bytes += _bytes_from(stream.source, 0);
+    }
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    if (!jobs.empty()) {
+        {
+            std::lock_guard lock(_mutex);
+            std::move(jobs.begin(), jobs.end(), std::back_inserter(_jobs));
+        }
+        _cv.notify_all();
+    }
+
+    _stats.textures = _textures.size();
+    _stats.pending = pending;
+    _stats.resident_bytes = resident_bytes;
+    _stats.full_bytes = full_bytes;
+}
+
+TextureStreamer::Stats TextureStreamer::stats() {
+    std::lock_guard lock(_mutex);
+    Stats stats = _stats;
+    stats.decoded_bytes = _decoded_bytes;
+    return stats;
+}
+
+std::shared_ptr<const TextureStreamer::Levels> TextureStreamer::_decoded_find(const std::string &path) {
+    auto iter = _decoded.find(path);
+    if (iter == _decoded.end())
+        return nullptr;
+    iter->second.last_used = ++_decoded_clock;
+    return iter->second.levels;
+}
+
+void TextureStreamer::_decoded_insert(const std::string &path, std::shared_ptr<const Levels> levels) {
+    size_t bytes = 0;
+    for (const auto &level : *levels)
+        bytes += level.size();
+    if (bytes > DECODED_BUDGET)
+        return;
+
+    auto [iter, inserted] = _decoded.try_emplace(path, Decoded{nullptr, 0, 0});
+    _decoded_bytes -= iter->second.bytes;
+    iter->second = Decoded{std::move(levels), bytes, ++_decoded_clock};
+    _decoded_bytes += bytes;
+
+    /* 超出预算：回收最久没有使用的，正在被后台任务使用的 mip 链在任务结束后才会释放 */
+    while (_decoded_bytes > DECODED_BUDGET) {
+        auto oldest = std::min_element(_decoded.begin(), _decoded.end(), [](const auto &a, const auto &b) {
+            return a.second.last_used < b.second.last_used;
+        });
+        _decoded_bytes -= oldest->second.bytes;
+        _decoded.erase(oldest);
+    }
+}
+
+void TextureStreamer::_worker() {
+    Profiler::thread_name_set("texture stream");
+    while (true) {
+        Job job;
+        {
+            std::unique_lock lock(_mutex);
+            _cv.wait(lock, [] { return _stop || !_jobs.empty(); });
+            if (_stop)
+                return;
+            job = std::move(_jobs.front());
+            _jobs.pop_front();
+        }
+
+        PROFILE_ZONE("stream decode");
+        Result result{job.texture, job.first, {}};
+        try {
+            /* 优先使用缓存的 mip 链，被回收之后才重新解码 */
+            std::shared_ptr<const Levels> levels;
+            {
+                std::lock_guard lock(_mutex);
+                levels = _decoded_find(job.source.path);
+                ++(levels ? _stats.decode_hits : _stats.decode_misses);
+            }
+            if (!levels) {
+                TextureStreamSource source = job.source;
+                auto decoded = std::make_shared<Levels>();
+                if (source.compressed) {
+                    CompressedImage image = TextureFile::load(TextureFile::cooked_path(source.path));
+                    if (image.internal_format != source.internal_format || image.width != source.width ||
+                        image.height != source.height)
+                        throw std::runtime_error("cooked file changed");
+                    *decoded = std::move(image.data);
+                } else {
+                    *decoded = image_decode(source, 1);
+                }
+                levels = decoded;
+                std::lock_guard lock(_mutex);
+                _decoded_insert(source.path, std::move(decoded));
+            }
+            if ((GLint) levels->size() < job.last)
+                throw std::runtime_error("not enough mip levels");
+            result.levels.assign(levels->begin() + job.first, levels->begin() + job.last);
+        } catch (const std::exception &e) {
+            SPDLOG_WARN("fail to stream texture {}: {}", job.source.path, e.what());
+        }
+
+        std::lock_guard lock(_mutex);
+        if (!_stop)
+            _results.push_back(std::move(result));
+    }
+}
+
+void TextureStreamer::_levels_upload(GLuint texture, const TextureStreamSource &source, GLint first,
+                                     const std::vector<std::vector<unsigned char>> &levels,
+                                     std::function<void()> done) {
+    /* 先分配这些级别的存储；通过 PBO 上传时数据由 TextureUploader 在预算内上传 */
+    const bool deferred = done && TextureUploader::enabled();
+    std::vector<UploadRegion> regions;
+    size_t total = 0;
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    for (size_t i = 0; i < levels.size(); ++i) {
+        GLint level = first + (GLint) i;
+        GLsizei w = std::max(1, source.width >> level), h = std::max(1, source.height >> level);
+        const unsigned char *pixels = deferred ? nullptr : levels[i].data();
+        if (source.compressed)
+            glCompressedTexImage2D(GL_TEXTURE_2D, level, source.internal_format, w, h, 0,
+                                   (GLsizei) levels[i].size(), pixels);
+        else
+            glTexImage2D(GL_TEXTURE_2D, level, (GLint) source.internal_format, w, h, 0, source.internal_format,
+                         GL_UNSIGNED_BYTE, pixels);
+        regions.push_back({GL_TEXTURE_2D, level, w, h, source.internal_format,
+                           source.compressed ? 0u : (GLenum) GL_UNSIGNED_BYTE, total, levels[i].size()});
+        total += levels[i].size();
+    }
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+
+    if (!deferred) {
+        if (done)
+            done();
+        return;
+    }
+    UploadStaging staging = TextureUploader::staging(total);
+    for (size_t i = 0; i < levels.size(); ++i)
+        std::memcpy(staging.ptr + regions[i].offset, levels[i].data(), levels[i].size());
+    TextureUploader::submit(texture, GL_TEXTURE_2D, std::move(staging), std::move(regions), true, std::move(done));
+}
+
+void TextureStreamer::_bytes_set(Texture2D &texture, size_t bytes) {
+    /* 只有仍然在 TextureManager 缓存中的纹理才计入缓存的统计 */
+    auto iter = TextureManager::_textures.find(texture._stream->source.path);
+    if (iter != TextureManager::_textures.end() && iter->second.get() == &texture)
+        TextureManager::_stats.resident_bytes = TextureManager::_stats.resident_bytes - texture._bytes + bytes;
+    texture._bytes = bytes;
+}
+
+size_t TextureStreamer::_bytes_from(const TextureStreamSource &source, GLint first) {
+    size_t bytes = 0;
+    for (GLint level = first; level < source.levels; ++level) {
+        GLsizei w = std::max(1, source.width >> level), h = std::max(1, source.height >> level);
+        bytes += source.compressed ? TextureFile::level_bytes(source.internal_format, w, h)
+                                   : (size_t) w * h * (source.channels == 1 ? 1 : 4);
+    }
+    return bytes;
+}
@@ -0,0 +1,284 @@
+#include <algorithm>
+#include <stdexcept>
+
+#include <fmt/format.h>
+#include <spdlog/spdlog.h>
+
+#include "texture_upload.h"
+
+
+void TextureUploader::init(size_t frame_budget) {
+    if (_enabled)
+        return;
+    _frame_budget = frame_budget;
+    _enabled = true;
+    SPDLOG_INFO("texture upload through pbo, budget: {:.1f} MB/frame", (double) _frame_budget / 1048576.0);
+}
+
+void TextureUploader::terminate() {
+    if (!_enabled)
+        return;
+    _jobs.clear();
+    for (auto &buffer : _buffers) {
+        if (buffer.fence != nullptr)
+            glDeleteSync(buffer.fence);
+        if (buffer.id != 0)
+            glDeleteBuffers(1, &buffer.id);
+    }
+    _buffers.clear();
+    _stats = Stats{0, 0, 0, 0, 0, 0};
+    _enabled = false;
+}
+
+UploadStaging TextureUploader::staging(size_t size) {
+    UploadStaging staging;
+    staging.size = size;
+    if (_enabled)
+        staging.buffer = _acquire(size);
+
+    /* 没有启用，或者 PBO 池已经达到上限并且无法回收：使用普通的内存，上传时由驱动复制 */
+    if (staging.buffer < 0) {
+        staging.memory.resize(size);
+        staging.ptr = staging.memory.data();
+        return staging;
+    }
+
+    /* fence 保证了 GPU 已经不再读取这个 PBO，可以直接覆盖 */
+    Buffer &buffer = _buffers[staging.buffer];
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, buffer.id);
+    staging.ptr = static_cast<unsigned char *>(glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, (GLsizeiptr) size,
+                                                                GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT));
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    if (staging.ptr == nullptr)
+        throw std::runtime_error(fmt::format("fail to map pixel unpack buffer: {} bytes", size));
+    buffer.busy = true;
+    buffer.idle_frames = 0;
+    return staging;
+}
+
+void TextureUploader::submit(GLuint texture, GLenum bind_target, UploadStaging staging,
+                             std::vector<UploadRegion> regions, bool deferred, std::function<void()> done) {
+    /* 写入已经完成，解除映射之后 PBO 才能作为上传的数据源 */
+    if (staging.buffer >= 0) {
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, _buffers[staging.buffer].id);
+        if (!glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER))
+            SPDLOG_WARN("pixel unpack buffer corrupted while mapped, texture: {}", texture);
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    }
+    staging.ptr = nullptr;
+
+    Job job{texture, bind_target, std::move(staging), std::move(regions), std::move(done)};
+    if (deferred && _enabled) {
+        _stats.queued_jobs += 1;
+        _stats.queued_bytes += job.staging.size;
+        _jobs.push_back(std::move(job));
+    } else {
+        _issue(job);
+    }
+}
+
+void TextureUploader::discard(UploadStaging staging) {
+    if (staging.buffer < 0)
+        return;
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, _buffers[staging.buffer].id);
+    glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    _release(staging.buffer);
+}
+
+void TextureUploader::cancel(GLuint texture) {
+    if (!_enabled)
+        return;
+    for (auto iter = _jobs.begin(); iter != _jobs.end();) {
+        if (iter->texture != texture) {
+            ++iter;
+            continue;
+        }
+        _stats.queued_jobs -= 1;
+        _stats.queued_bytes -= iter->staging.size;
+        _release(iter->staging.buffer);
+        iter = _jobs.erase(iter);
+    }
+}
+
+void TextureUploader::update() {
+    if (!_enabled)
+        return;
+    _stats.frame_bytes = _frame_bytes;
+    _frame_bytes = 0;
+    _poll();
+
+    /* 释放长时间空闲的 PBO，位置保留给之后新建的 PBO，下标不会改变 */
+    for (auto &buffer : _buffers) {
+        if (buffer.id == 0 || buffer.busy || ++buffer.idle_frames < IDLE_FRAMES)
+            continue;
+        glDeleteBuffers(1, &buffer.id);
+        _stats.buffers -= 1;
+        _stats.pool_bytes -= buffer.size;
+        buffer = Buffer{};
+    }
+
+    /* 按照提交的顺序上传，直到用完这一帧的预算；至少上传一个任务 */
+    bool issued = false;
+    while (!_jobs.empty() && (!issued || _frame_bytes + _jobs.front().staging.size <= _frame_budget)) {
+        Job job = std::move(_jobs.front());
+        _jobs.pop_front();
+        _stats.queued_jobs -= 1;
+        _stats.queued_bytes -= job.staging.size;
+        _issue(job);
+        issued = true;
+    }
+}
+
+void TextureUploader::flush() {
+    while (!_jobs.empty()) {
+        Job job = std::move(_jobs.front());
+        _jobs.pop_front();
+        _stats.queued_jobs -= 1;
+        _stats.queued_bytes -= job.staging.size;
+        _issue(job);
+    }
+}
+
+TextureUploader::Stats TextureUploader::stats() {
+    return _stats;
+}
+
+void TextureUploader::_issue(Job &job) {
+    const bool pbo = job.staging.buffer >= 0;
+
+    /* 上传会改变 0 号纹理单元的绑定，结束后恢复；调用者可能正在设置另一个纹理（比如在 staging() 中提前上传） */
+    GLint active_unit = GL_TEXTURE0, previous = 0;
+    glGetIntegerv(GL_ACTIVE_TEXTURE, &active_unit);
+    glActiveTexture(GL_TEXTURE0);
+    glGetIntegerv(job.bind_target == GL_TEXTURE_CUBE_MAP ? GL_TEXTURE_BINDING_CUBE_MAP : GL_TEXTURE_BINDING_2D,
+                  &previous);
+    glBindTexture(job.bind_target, job.texture);
+    if (pbo)
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, _buffers[job.staging.buffer].id);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+
+    /* 绑定了 PBO 时，数据的指针参数是在 PBO 中的偏移 */
+    for (const auto &region : job.regions) {
+        const void *pixels = pbo ? reinterpret_cast<const void *>(region.offset)
+                                 : job.staging.memory.data() + region.offset;
+        if (region.type == 0)
+            glCompressedTexSubImage2D(region.target, region.level, 0, 0, region.width, region.height, region.format,
+                                      (GLsizei) region.size, pixels);
+        else
+            glTexSubImage2D(region.target, region.level, 0, 0, region.width, region.height, region.format,
+                            region.type, pixels);
+    }
+
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    if (pbo) {
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        _buffers[job.staging.buffer].fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    }
+    _frame_bytes += job.staging.size;
+    _stats.total_bytes += job.staging.size;
+    if (job.done)
+        job.done();
+    glBindTexture(job.bind_target, (GLuint) previous);
+    glActiveTexture((GLenum) active_unit);
+}
+
+void TextureUploader::_poll() {
+    for (auto &buffer : _buffers) {
+        if (buffer.fence == nullptr)
+            continue;
+        GLenum result = glClientWaitSync(buffer.fence, 0, 0);
+        if (result == GL_ALREADY_SIGNALED || result == GL_CONDITION_SATISFIED || result == GL_WAIT_FAILED) {
+            if (result == GL_WAIT_FAILED)
+                SPDLOG_ERROR("fail to wait pixel unpack buffer fence");
+            glDeleteSync(buffer.fence);
+            buffer.fence = nullptr;
+            buffer.busy = false;
+            buffer.idle_frames = 0;
+        }
+    }
+}
+
+int TextureUploader::_acquire(size_t size) {
+    /* 新建的 PBO 尺寸向上取整到 2 的幂；超出池的上限的请求不使用 PBO */
+    size_t rounded = MIN_BUFFER_SIZE;
+    while (rounded < size)
+        rounded <<= 1;
+    if (rounded > POOL_LIMIT)
+        return -1;
+
+    while (true) {
+        _poll();
+
+        /* 选择足够大的空闲 PBO 中最小的一个，同时记录最大的空闲 PBO 和空出来的位置 */
+        int best = -1, idle = -1, empty = -1;
+        for (int i = 0; i < (int) _buffers.size(); ++i) {
+            const Buffer &buffer = _buffers[i];
+            if (buffer.id == 0) {
+                empty = empty < 0 ? i : empty;
+                continue;
+            }
+            if (buffer.busy)
+                continue;
+            if (buffer.size >= size && (best < 0 || buffer.size < _buffers[best].size))
+                best = i;
+            if (idle < 0 || buffer.size > _buffers[idle].size)
+                idle = i;
+        }
+        if (best >= 0)
+            return best;
+
+        /* 没有合适的 PBO：在上限之内新建 */
+        if (_stats.pool_bytes + rounded <= POOL_LIMIT) {
+            Buffer buffer;
+            buffer.size = rounded;
+            glGenBuffers(1, &buffer.id);
+            glBindBuffer(GL_PIXEL_UNPACK_BUFFER, buffer.id);
+            glBufferData(GL_PIXEL_UNPACK_BUFFER, (GLsizeiptr) buffer.size, nullptr, GL_STREAM_DRAW);
+            glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+            _stats.buffers += 1;
+            _stats.pool_bytes += buffer.size;
+            if (empty >= 0) {
+                _buffers[empty] = buffer;
+                return empty;
+            }
+            _buffers.push_back(buffer);
+            return (int) _buffers.size() - 1;
+        }
+
+        /* 达到上限：先释放太小的空闲 PBO，再不考虑预算提前上传队列中的任务，最后等待 GPU 读取完正在上传的 PBO */
+        if (idle >= 0) {
+            glDeleteBuffers(1, &_buffers[idle].id);
+            _stats.buffers -= 1;
+            _stats.pool_bytes -= _buffers[idle].size;
+            _buffers[idle] = Buffer{};
+            continue;
+        }
+        if (!_jobs.empty()) {
+            Job job = std::move(_jobs.front());
+            _jobs.pop_front();
+            _stats.queued_jobs -= 1;
+            _stats.queued_bytes -= job.staging.size;
+            _issue(job);
+            continue;
+        }
+        auto fenced = std::find_if(_buffers.begin(), _buffers.end(),
+                                   [](const Buffer &buffer) { return buffer.fence != nullptr; });
+        if (fenced != _buffers.end()) {
+            glClientWaitSync(fenced->fence, GL_SYNC_FLUSH_COMMANDS_BIT, WAIT_TIMEOUT_NS);
+            continue;
+        }
+
+        /* 所有的 PBO 都已经分配出去，还没有提交 */
+        SPDLOG_WARN("pixel unpack buffer pool exhausted ({:.1f} MB), stage {} bytes in memory",
+                    (double) _stats.pool_bytes / 1048576.0, size);
+        return -1;
+    }
+}
+
+void TextureUploader::_release(int buffer) {
+    if (buffer < 0)
+        return;
+    _buffers[buffer].busy = false;
+    _buffers[buffer].idle_frames = 0;
+}
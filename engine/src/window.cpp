@@ -1,6 +1,33 @@
 #include "window.h"
 
 
+void Window::init_headless(int width, int height) {
+    assert(width > 0 && height > 0);
+    _width = width;
+    _height = height;
+    _headless = true;
+
+    glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+#if GLFW_VERSION_MAJOR * 100 + GLFW_VERSION_MINOR >= 304
+    for (int api : {GLFW_EGL_CONTEXT_API, GLFW_OSMESA_CONTEXT_API}) {
+        glfwWindowHint(GLFW_CONTEXT_CREATION_API, api);
+        _window = glfwCreateWindow(width, height, "AccRender", nullptr, nullptr);
+        if (_window != nullptr) {
+            SPDLOG_INFO("headless context: {}, {}x{}", api == GLFW_EGL_CONTEXT_API ? "EGL" : "OSMesa", width, height);
+            break;
+        }
+    }
+#else
+    _window = glfwCreateWindow(width, height, "AccRender", nullptr, nullptr);
+#endif
+    if (_window == nullptr) {
+        SPDLOG_ERROR("fail to create headless context.");
+        glfwTerminate();
+        exit(-1);
+    }
+    glfwMakeContextCurrent(_window);
+}
+
 void Window::_mouse_pos_cbk(GLFWwindow *, double x, double y) {
     _mouse_cur_x = x;
     _mouse_cur_y = y;
@@ -39,4 +66,8 @@ void Window::_frame_buffer_size_cbk(GLFWwindow *, int width, int height) {
     _width = width;
     _height = height;
     glViewport(0, 0, width, height);
+    if (width <= 0 || height <= 0)
+        return;
+    for (auto &listener: _resize_listeners)
+        listener(width, height);
 }
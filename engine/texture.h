@@ -2,17 +2,28 @@
 #define RENDER_ENGINE_TEXTURE_H
 
 #include <map>
+#include <memory>
+#include <unordered_map>
+#include <vector>
 #include <string>
 #include <exception>
 #include <utility>
+#include <cstdint>
+#include <cstddef>
 
 #include <glad/glad.h>
-#include <stb_image.h>
 #include <assimp/scene.h>
 #include <spdlog/spdlog.h>
 #include <fmt/format.h>
 
 
+/* 纹理流送的状态，见 texture_stream.h */
+struct TextureStream;
+
+/* 解码后的图像，见 image_decoder.h */
+struct Image;
+
+
 /* 纹理的类型 */
 enum TextureType {
     diffuse,
@@ -20,6 +31,11 @@ enum TextureType {
     normal,
 };
 
+/* 这种类型的纹理是否是 sRGB 编码的颜色：只有 diffuse 是，specular 和 normal 是线性的数据，mip 不能在 sRGB 空间中过滤 */
+inline bool texture_type_srgb(TextureType type) {
+    return type == TextureType::diffuse;
+}
+
 /* 超出范围后如何采样（这个类存在的意义：通过静态类型系统来保证参数有效） */
 enum class TextureWrap {
     REPEAT = GL_REPEAT,
@@ -39,6 +55,7 @@ enum class TextureColorFormat {
 class Texture2D {
 public:
     friend class TextureManager;
+    friend class TextureStreamer;
 
     /**
      * 从文件中创建 texture 对象
@@ -47,17 +64,81 @@ public:
      * @param color_format 颜色格式，比如是否有透明通道
      * @param mip_map 生成一系列缩放图
      * @param flip 在加载纹理是是否进行翻转
+     * @param srgb 颜色是否是 sRGB 编码的，在 CPU 上生成 mip 时先转换到线性空间；法线，粗糙度等数据应该传 false，
+     *             见 texture_type_srgb()
      */
     explicit Texture2D(const std::string &path,
                        TextureWrap wrap = TextureWrap::REPEAT,
                        TextureColorFormat color_format = TextureColorFormat::Auto,
-                       bool mip_map = true, bool flip = false);
+                       bool mip_map = true, bool flip = false, bool srgb = true);
+
+    ~Texture2D();
+
+    Texture2D(const Texture2D &) = delete;
+
+    Texture2D &operator=(const Texture2D &) = delete;
 
     [[nodiscard]] inline GLuint id() const { return _id; }
 
+    /* 纹理占用的显存（估计值），包括所有的 mip */
+    [[nodiscard]] inline size_t bytes() const { return _bytes; }
+
+    /* 绑定到某个纹理单元，并记录使用的时间，TextureManager 会优先回收最久没有使用的纹理 */
+    void bind(GLuint unit) const;
+
 private:
+    /* 由 TextureStreamer 创建，见 texture_stream.h */
+    Texture2D();
+
     GLuint _id{0};
+    size_t _bytes{0};
+
+    /* 最近一次使用的时间，来自 TextureManager 的计数器 */
+    mutable uint64_t _last_used{0};
+
+    /* 流送的状态，只有 TextureStreamer 创建的纹理才有 */
+    std::unique_ptr<TextureStream> _stream;
+};
+
+
+/**
+ * 2D 纹理数组，每个图像是其中的一层；所有的层尺寸相同，元素类型都是 RGBA8
+ * 尺寸或格式不同的纹理放在不同的纹理数组中，见 TextureManager::texture_arrays_get()
+ */
+class Texture2DArray {
+public:
+    /**
+     * 从解码好的图像创建纹理数组
+     * @param images 每一层的图像，层的序号和 images 中的下标一致；需要是 4 通道，尺寸相同，否则抛出异常
+     * @param wrap 超出 tex_coord 范围后，如何采样
+     * @param mip_map 生成一系列缩放图
+     * @param srgb 颜色是 sRGB 编码的：存储为 GL_SRGB8_ALPHA8，采样得到线性的颜色，mip 在线性空间中生成；否则是 GL_RGBA8
+     */
+    explicit Texture2DArray(const std::vector<Image> &images,
+                            TextureWrap wrap = TextureWrap::REPEAT,
+                            bool mip_map = true, bool srgb = true);
+
+    ~Texture2DArray();
+
+    Texture2DArray(const Texture2DArray &) = delete;
+
+    Texture2DArray &operator=(const Texture2DArray &) = delete;
+
+    [[nodiscard]] inline GLuint id() const { return _id; }
+
+    [[nodiscard]] inline GLsizei layers() const { return _layers; }
+
+    [[nodiscard]] inline GLsizei width() const { return _width; }
+
+    [[nodiscard]] inline GLsizei height() const { return _height; }
+
+    [[nodiscard]] inline bool srgb() const { return _srgb; }
 
+private:
+    GLuint _id{0};
+    GLsizei _layers{0};
+    GLsizei _width{0}, _height{0};
+    bool _srgb{true};
 };
 
 
@@ -79,9 +160,22 @@ private:
 /* 立方体贴图 */
 class TextureCube {
 public:
+    /**
+     * 从 6 个文件创建立方体贴图：每个面在一个线程中解码，所有的面必须是尺寸和通道数相同的正方形
+     * 支持 ARB_texture_storage 时使用不可变的存储
+     * @param mip_map 在 CPU 上生成所有级别的 mip；压缩纹理总是使用文件中的所有级别
+     */
     TextureCube(const std::string &file_path_positive_x, const std::string &file_path_negative_x,
                 const std::string &file_path_positive_y, const std::string &file_path_negative_y,
-                const std::string &file_path_positive_z, const std::string &file_path_negative_z);
+                const std::string &file_path_positive_z, const std::string &file_path_negative_z,
+                bool mip_map = false);
+
+    /* 取消还没有上传的任务，删除纹理 */
+    ~TextureCube();
+
+    TextureCube(const TextureCube &) = delete;
+
+    TextureCube &operator=(const TextureCube &) = delete;
 
     /* 创建空的立方体贴图，每个面都是正方形，元素类型是 float */
     static GLuint cube_map_create(GLsizei width);
@@ -93,11 +187,47 @@ private:
 };
 
 
-/* 多个 mesh 使用同一个 texture，这个类可以缓存 */
+/**
+ * 多个 mesh 使用同一个 texture，这个类可以缓存
+ * 缓存有显存预算：超出预算时，回收没有被缓存之外引用的纹理，最久没有使用的优先
+ */
 class TextureManager {
 public:
-    /* 从文件中读取纹理，会优先查看缓存 */
-    static std::shared_ptr<Texture2D> texture_load(const std::string &path);
+    friend class Texture2D;
+    friend class TextureStreamer;
+
+    /* 缓存的统计信息 */
+    struct CacheStats {
+        size_t hits{0};
+        size_t misses{0};
+        size_t evictions{0};
+        size_t textures{0};             // 缓存中的纹理数量
+        size_t resident_bytes{0};       // 缓存中所有纹理占用的显存
+        size_t budget_bytes{0};
+    };
+
+    /**
+     * 从文件中读取纹理，会优先查看缓存
+     * @param type 纹理的类型，决定 mip 在 sRGB 还是线性空间中生成；缓存以路径为键，同一个文件只会按第一次的类型载入
+     */
+    static std::shared_ptr<Texture2D> texture_load(const std::string &path, TextureType type = TextureType::diffuse);
+
+    /**
+     * 将纹理对象绑定到某个纹理单元；是缓存中的纹理时记录使用的时间，和 Texture2D::bind() 一样
+     * 只有纹理 id 的绑定（材质，纹理数组，Shader::set_textures()）都需要通过这里，回收时才能看到所有的使用
+     */
+    static void texture_bind(GLuint unit, GLenum target, GLuint id);
+
+    /* 设置缓存的显存预算，会立即进行回收 */
+    static void budget_set(size_t bytes);
+
+    /* 超出预算时回收纹理；每一帧调用一次，回收已经没有 mesh 引用的纹理 */
+    static void trim();
+
+    /* 释放缓存的所有纹理，需要在 OpenGL 的上下文销毁之前调用 */
+    static void clear();
+
+    [[nodiscard]] static CacheStats stats();
 
     /**
      * 使用 Assimp 载入 mesh 的所有 texture，也就是各种类型的 texture，比如 diffuse 和 normal
@@ -106,10 +236,40 @@ public:
     static std::map<TextureType, std::vector<std::shared_ptr<Texture2D>>>
     textures_get(const aiMaterial &material, const std::string &dir);
 
+    /* 纹理在 TextureArraySet 中的位置 */
+    struct TextureArraySlot {
+        size_t array;       // TextureArraySet::arrays 中的下标
+        GLint layer;        // 纹理数组中的层
+    };
+
+    /* 以纹理数组的方式导入模型的纹理，结果见 TextureArraySet */
+    struct TextureArraySet {
+        /* 尺寸和格式（sRGB 或线性）相同的纹理合并为一个纹理数组，不同类型的纹理格式相同时也可以在同一个数组中 */
+        std::vector<std::shared_ptr<Texture2DArray>> arrays;
+
+        /* 每个 aiMaterial 的每种纹理所在的数组和层，下标和 aiScene::mMaterials 一致；没有这种纹理时不存在 */
+        std::vector<std::map<TextureType, TextureArraySlot>> layers;
+    };
+
+    /**
+     * 使用 Assimp 载入模型所有材质的纹理（diffuse，specular），按照（宽，高，格式）分组，每组一个纹理数组；
+     * 不会缩放纹理，每一层只占用自己尺寸的显存。多个材质引用同一个文件时，只会占用一层
+     * @param dir 模型文件的目录
+     */
+    static TextureArraySet texture_arrays_get(const aiScene &scene, const std::string &dir);
+
 private:
     /* 文件名 - Texture 的表，用来缓存 texture 的 */
     inline static std::map<std::string, std::shared_ptr<Texture2D>> _textures;
 
+    /* 纹理对象 - 缓存中的 Texture，用于只有 id 的绑定 */
+    inline static std::unordered_map<GLuint, const Texture2D *> _ids;
+
+    inline static CacheStats _stats{0, 0, 0, 0, 0, 512ull << 20};
+
+    /* 纹理使用时间的计数器，每次使用加一 */
+    inline static uint64_t _clock{0};
+
 };
 
 
@@ -0,0 +1,82 @@
+/**
+ * 块压缩纹理的容器文件：DDS 和 KTX2
+ * 由 texture-cook 离线生成，运行时直接上传压缩数据，不再解码 PNG/JPG/HDR
+ */
+#ifndef RENDER_ENGINE_TEXTURE_FILE_H
+#define RENDER_ENGINE_TEXTURE_FILE_H
+
+#include <string>
+#include <vector>
+#include <cstddef>
+#include <optional>
+
+#include <glad/glad.h>
+
+
+/* 压缩纹理的数据：所有的面，所有级别的 mip */
+struct CompressedImage {
+    GLenum internal_format{0};      // GL_COMPRESSED_RGBA_BPTC_UNORM 等
+    GLsizei width{0}, height{0};    // 第 0 级的尺寸
+    GLsizei faces{1};               // 1：2D 纹理；6：立方体贴图，顺序是 +x, -x, +y, -y, +z, -z
+    GLsizei levels{0};
+
+    /* 每个面每一级的数据，下标是 face * levels + level */
+    std::vector<std::vector<unsigned char>> data;
+
+    [[nodiscard]] inline const std::vector<unsigned char> &level(GLsizei face, GLsizei level) const {
+        return data[(size_t) face * levels + level];
+    }
+
+    [[nodiscard]] inline std::vector<unsigned char> &level(GLsizei face, GLsizei level) {
+        return data[(size_t) face * levels + level];
+    }
+};
+
+
+class TextureFile {
+public:
+    /* 文件是否是压缩纹理的容器（根据扩展名：.dds，.ktx2） */
+    static bool is_container(const std::string &path);
+
+    /* 源文件对应的压缩纹理：同一目录，扩展名替换为 .dds，比如 body_dif.png -> body_dif.dds */
+    static std::string cooked_path(const std::string &source_path);
+
+    /**
+     * 读取 DDS 或 KTX2 文件，根据文件头的标识判断
+     * 只支持 BC1，BC3，BC4，BC5，BC6H，BC7；KTX2 不支持 supercompression
+     */
+    static CompressedImage load(const std::string &path);
+
+    /**
+     * 查找源文件对应的压缩纹理：存在，不比源文件旧，并且当前上下文支持它的格式
+     * @return 找不到或者不能使用时返回空，调用者应该回退到解码源文件
+     */
+    static std::optional<CompressedImage> cooked_find(const std::string &source_path);
+
+    /* 以 DDS（DX10 扩展头）格式保存 */
+    static void dds_save(const std::string &path, const CompressedImage &image);
+
+    // =====================================================
+    // 格式
+    // =====================================================
+
+    /* 每个 4x4 块的字节数：BC1，BC4 是 8，其余是 16 */
+    static GLsizei block_bytes(GLenum internal_format);
+
+    /* 某一级 mip 的字节数 */
+    static size_t level_bytes(GLenum internal_format, GLsizei width, GLsizei height);
+
+    /* 当前的上下文是否支持这种压缩格式，需要在 GLExt::init() 之后调用 */
+    static bool format_supported(GLenum internal_format);
+};
+
+
+/**
+ * 用压缩数据创建纹理对象，上传 mip_levels 级（0 表示所有级别），并设置 GL_TEXTURE_MAX_LEVEL
+ * @param target GL_TEXTURE_2D 或 GL_TEXTURE_CUBE_MAP
+ * @return 纹理对象，仍然处于绑定状态
+ */
+GLuint compressed_texture_create(const CompressedImage &image, GLenum target, GLsizei mip_levels = 0);
+
+
+#endif //RENDER_ENGINE_TEXTURE_FILE_H
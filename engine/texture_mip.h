@@ -0,0 +1,73 @@
+/**
+ * 在 CPU 上生成 mip 链，代替 glGenerateMipmap：
+ *  - 颜色通道视为 sRGB 编码，在线性空间中滤波；RGBA 纹理使用预乘 alpha 滤波，避免透明区域的颜色渗出
+ *  - alpha test 的纹理（比如草），每一级都保持和第 0 级相同的 alpha 覆盖率，远处不会逐渐消失
+ *  - 像素以 4 个 float 参与计算，使用 SSE/AVX2（x86）或 NEON（ARM），每一行是一个任务，分给多个线程
+ */
+#ifndef RENDER_ENGINE_TEXTURE_MIP_H
+#define RENDER_ENGINE_TEXTURE_MIP_H
+
+#include <vector>
+#include <cstdint>
+#include <algorithm>
+
+
+/* 降采样使用的滤波器 */
+enum class MipFilter {
+    Box,            // 2x2 盒式滤波，最快
+    Kaiser,         // Kaiser 窗的 sinc，6x6 个采样，更锐利
+};
+
+/* 如何处理 alpha 通道 */
+enum class MipAlpha {
+    Auto,           // alpha 几乎只有 0 和 1 两种值时视为 Test，否则视为 Blend
+    Blend,          // 普通的透明度，直接滤波
+    Test,           // alpha test，保持覆盖率
+};
+
+
+struct MipOptions {
+    MipFilter filter{MipFilter::Box};
+
+    /* 颜色通道是否是 sRGB 编码，只对 3，4 通道的纹理有效；单通道的纹理总是视为线性的 */
+    bool srgb{true};
+
+    MipAlpha alpha{MipAlpha::Auto};
+    float alpha_cutoff{0.5f};       // alpha test 的阈值
+
+    unsigned threads{0};            // 0 表示硬件线程数
+};
+
+
+/* 从第 0 级到 1x1 的所有 mip，每一级都紧密排列（没有行对齐） */
+template<class T>
+struct MipChain {
+    int width{0}, height{0};
+    int channels{0};
+    std::vector<std::vector<T>> levels;
+
+    [[nodiscard]] inline int level_width(size_t level) const { return std::max(1, width >> level); }
+
+    [[nodiscard]] inline int level_height(size_t level) const { return std::max(1, height >> level); }
+};
+
+
+/**
+ * 生成 8 位纹理的 mip 链
+ * @param channels 1，3，4；第 0 级就是输入的像素
+ */
+MipChain<uint8_t> mip_chain_generate(const uint8_t *pixels, int width, int height, int channels,
+                                     const MipOptions &options = {});
+
+/**
+ * 生成 HDR 纹理的 mip 链，数据本身是线性的，忽略 srgb 和 alpha 的选项
+ * @param channels 1，3，4
+ */
+MipChain<float> mip_chain_generate(const float *pixels, int width, int height, int channels,
+                                   const MipOptions &options = {});
+
+/* 根据 alpha 的分布判断是否是 alpha test 的纹理 */
+bool mip_alpha_is_test(const uint8_t *pixels, int width, int height, int channels);
+
+
+#endif //RENDER_ENGINE_TEXTURE_MIP_H
@@ -0,0 +1,210 @@
+/**
+ * 纹理流送：按照纹理在屏幕上的大小，只让需要的 mip 级别驻留在显存中
+ *  - 创建时只上传尺寸不超过 TAIL_SIZE 的 mip（尾部），始终驻留
+ *  - 绘制时根据 mesh 的包围球和纹理坐标密度，估计纹理需要的最精细级别
+ *  - 实例化绘制时，按照 instances_set() 设置的实例中离摄像机最近的一个估计；没有设置时使用最精细的级别
+ *  - 需要更精细的级别时，在后台线程中准备数据，主线程通过 TextureUploader 在每帧的预算内上传，并通过 GL_TEXTURE_MIN_LOD 渐入
+ *  - 解码之后的整个 mip 链缓存在内存中（有预算），之后的请求只需要复制，不必重新解码和生成 mip
+ *  - 连续一段时间不再需要的级别会被释放，GL_TEXTURE_BASE_LEVEL 始终指向驻留的最精细级别
+ * 只有 TextureManager 载入的纹理（也就是模型的纹理）会被流送
+ */
+#ifndef RENDER_ENGINE_TEXTURE_STREAM_H
+#define RENDER_ENGINE_TEXTURE_STREAM_H
+
+#include <map>
+#include <mutex>
+#include <deque>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+#include <functional>
+#include <condition_variable>
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include "mesh.h"
+#include "texture.h"
+
+
+/* 流送纹理的数据来源，创建之后不再改变，可以复制给后台线程 */
+struct TextureStreamSource {
+    std::string path;               // 源文件
+    bool compressed{false};         // 是否使用 texture-cook 生成的压缩纹理
+    GLenum internal_format{0};      // 压缩格式，或者 GL_RED，GL_RGB，GL_RGBA
+    int channels{0};
+    GLsizei width{0}, height{0};
+    GLint levels{0};
+    bool srgb{true};                // 颜色是否是 sRGB 编码的，决定 mip 在哪个空间中生成
+};
+
+/* 一个流送纹理的状态 */
+struct TextureStream {
+    TextureStreamSource source;
+    GLint tail_base{0};             // 始终驻留的最精细级别
+    GLint resident_base{0};         // 当前驻留的最精细级别，也就是 GL_TEXTURE_BASE_LEVEL
+    GLint wanted{0};                // 这一帧绘制需要的最精细级别
+    bool pending{false};            // 正在后台载入
+    bool failed{false};             // 后台载入失败，不再流送
+    int idle_frames{0};             // 驻留的级别连续多少帧比需要的更精细
+    float min_lod{0.f};             // 新载入的级别渐入
+};
+
+
+class TextureStreamer {
+public:
+    /* 尾部 mip 的最大尺寸 */
+    static constexpr GLsizei TAIL_SIZE = 128;
+
+    /* 不再需要的级别保留多少帧之后才释放，避免来回载入 */
+    static constexpr int DROP_DELAY_FRAMES = 120;
+
+    /* 新载入的级别在多少帧之内渐入，每一帧 GL_TEXTURE_MIN_LOD 减少 1 / FADE_FRAMES */
+    static constexpr int FADE_FRAMES = 30;
+
+    /* 内存中缓存的 mip 链的预算，超出时回收最久没有使用的 */
+    static constexpr size_t DECODED_BUDGET = 256ull << 20;
+
+    struct Stats {
+        size_t textures{0};
+        size_t resident_bytes{0};       // 流送纹理当前占用的显存
+        size_t full_bytes{0};           // 如果所有级别都驻留，需要的显存
+        size_t loads{0};                // 载入的次数
+        size_t drops{0};                // 释放的次数
+        size_t pending{0};              // 正在后台载入的纹理
+        size_t decoded_bytes{0};        // 内存中缓存的 mip 链
+        size_t decode_hits{0};          // 后台载入使用缓存的次数
+        size_t decode_misses{0};        // 后台载入重新解码的次数
+    };
+
+    /* 启动后台线程，之后 TextureManager 载入的纹理都会被流送 */
+    static void init(unsigned threads = 2);
+
+    /* 停止后台线程 */
+    static void terminate();
+
+    [[nodiscard]] static inline bool enabled() { return _enabled; }
+
+    /**
+     * 创建流送的纹理：解码源文件，只上传尾部的 mip
+     * @param srgb 颜色是否是 sRGB 编码的，见 texture_type_srgb()
+     */
+    static std::shared_ptr<Texture2D> texture_create(const std::string &path, bool srgb = true);
+
+    /* 每一帧开始时记录摄像机的参数 */
+    static void frame_begin(const glm::vec3 &camera_pos, float fov_y, int screen_height);
+
+    /* 每一帧绘制结束后调用：上传后台载入完成的级别，发起新的载入，释放不再需要的级别 */
+    static void update();
+
+    /**
+     * 绘制 mesh 时调用，估计 mesh 的纹理需要的级别；Shader 的各个绘制方法已经调用了
+     * @param model mesh 的 model 矩阵
+     * @param amount 实例化绘制时使用 instances_set() 设置的实例矩阵，没有设置时直接请求最精细的级别
+     */
+    static inline void mesh_draw(const Mesh &mesh, const glm::mat4 &model, GLsizei amount = 1) {
+        if (_enabled && !mesh.texture_map().empty())
+            _footprint(mesh, model, amount);
+    }
+
+    /**
+     * 实例化绘制之前设置这一批实例的矩阵，之后 amount > 1 的 mesh_draw() 按照离摄像机最近的实例估计需要的级别
+     * @param instances 每个实例在世界空间中的 model 矩阵，代替 mesh_draw() 的 model；需要存活到 instances_clear()
+     * @example
+     *  TextureStreamer::instances_set(models.data(), models.size());
+     *  shader->draw_pass(*model_rock, amount);
+     *  TextureStreamer::instances_clear();
+     */
+    static inline void instances_set(const glm::mat4 *instances, size_t count) {
+        _instances = instances;
+        _instance_count = count;
+    }
+
+    static inline void instances_clear() { instances_set(nullptr, 0); }
+
+    [[nodiscard]] static Stats stats();
+
+private:
+    /* 所有级别的 mip，下标是级别 */
+    using Levels = std::vector<std::vector<unsigned char>>;
+
+    /* 内存中缓存的 mip 链，多个后台任务共享 */
+    struct Decoded {
+        std::shared_ptr<const Levels> levels;
+        size_t bytes;
+        uint64_t last_used;
+    };
+
+    /* 后台线程的任务：解码 [first, last) 级别 */
+    struct Job {
+        std::weak_ptr<Texture2D> texture;
+        TextureStreamSource source;
+        GLint first, last;
+    };
+
+    struct Result {
+        std::weak_ptr<Texture2D> texture;
+        GLint first;
+        std::vector<std::vector<unsigned char>> levels;
+    };
+
+    static void _footprint(const Mesh &mesh, const glm::mat4 &model, GLsizei amount);
+
+    /* 屏幕上一个像素覆盖的纹理坐标，为负数表示需要第 0 级 */
+    static float _uv_per_pixel(const Mesh &mesh, const glm::mat4 &model);
+
+    /* 查找缓存的 mip 链，需要持有 _mutex */
+    static std::shared_ptr<const Levels> _decoded_find(const std::string &path);
+
+    /* 缓存 mip 链，超出预算时回收最久没有使用的，需要持有 _mutex */
+    static void _decoded_insert(const std::string &path, std::shared_ptr<const Levels> levels);
+
+    static void _worker();
+
+    /**
+     * 上传 [first, first + levels.size()) 级别，纹理已经绑定
+     * @param done 不为空并且启用了 PBO 上传时，延迟上传，上传的命令发出之后调用；否则立即上传，然后调用
+     */
+    static void _levels_upload(GLuint texture, const TextureStreamSource &source, GLint first,
+                               const std::vector<std::vector<unsigned char>> &levels,
+                               std::function<void()> done = {});
+
+    /* 修改纹理占用的显存，同时更新 TextureManager 的统计 */
+    static void _bytes_set(Texture2D &texture, size_t bytes);
+
+    /* [first, levels) 级别占用的显存 */
+    static size_t _bytes_from(const TextureStreamSource &source, GLint first);
+
+private:
+    inline static bool _enabled{false};
+
+    /* 摄像机的参数 */
+    inline static glm::vec3 _camera_pos{0.f};
+    inline static float _tan_half_fov{0.41421356f};
+    inline static int _screen_height{720};
+
+    /* 实例化绘制的实例矩阵，见 instances_set() */
+    inline static const glm::mat4 *_instances{nullptr};
+    inline static size_t _instance_count{0};
+
+    inline static std::vector<std::weak_ptr<Texture2D>> _textures;
+    inline static Stats _stats{0, 0, 0, 0, 0, 0, 0, 0, 0};
+
+    inline static std::vector<std::thread> _workers;
+    inline static std::deque<Job> _jobs;
+    inline static std::vector<Result> _results;
+    inline static std::mutex _mutex;
+    inline static std::condition_variable _cv;
+    inline static bool _stop{false};
+
+    /* 源文件 - 缓存的 mip 链，由 _mutex 保护 */
+    inline static std::map<std::string, Decoded> _decoded;
+    inline static size_t _decoded_bytes{0};
+    inline static uint64_t _decoded_clock{0};
+};
+
+
+#endif //RENDER_ENGINE_TEXTURE_STREAM_H
@@ -0,0 +1,150 @@
+/**
+ * 通过 PBO（GL_PIXEL_UNPACK_BUFFER）异步上传纹理数据：
+ *  - 像素先写入 PBO 池中的一个 buffer（可以直接解码到映射的内存），glTexSubImage2D 从 PBO 读取，
+ *    驱动不需要在调用中同步复制客户端内存，数据由 GPU 异步读取
+ *  - 每个 PBO 发出上传命令后插入 fence，fence 发出信号（GPU 已经读取完毕）之后才会回到池中
+ *  - PBO 池的总大小不超过 POOL_LIMIT：达到上限时释放空闲的 PBO，提前上传队列中的任务，必要时等待 GPU；
+ *    仍然无法分配（或者单个请求超过上限）时使用普通的内存
+ *  - 延迟的上传在 update() 中执行，每一帧上传的字节数不超过 frame_budget()，避免载入纹理时卡顿；
+ *    一次上传至少会执行一个任务，所以单个任务超出预算也不会一直等待
+ * 没有调用 init() 时（比如离线工具），暂存内存是普通的内存，所有的上传都立即执行
+ */
+#ifndef RENDER_ENGINE_TEXTURE_UPLOAD_H
+#define RENDER_ENGINE_TEXTURE_UPLOAD_H
+
+#include <deque>
+#include <vector>
+#include <cstddef>
+#include <functional>
+
+#include <glad/glad.h>
+
+
+/* 一次上传中的一个区域：某一级 mip 的某个面，总是整个级别 */
+struct UploadRegion {
+    GLenum target{GL_TEXTURE_2D};       // GL_TEXTURE_2D，或者 GL_TEXTURE_CUBE_MAP_POSITIVE_X + i
+    GLint level{0};
+    GLsizei width{0}, height{0};
+    GLenum format{GL_RGBA};             // 压缩纹理是压缩格式
+    GLenum type{GL_UNSIGNED_BYTE};      // 压缩纹理是 0
+    size_t offset{0};                   // 在暂存内存中的偏移
+    size_t size{0};
+};
+
+/* 暂存内存：映射的 PBO；未初始化时是普通的内存 */
+struct UploadStaging {
+    unsigned char *ptr{nullptr};        // 可以写入的地址，submit 之后失效
+    size_t size{0};
+    int buffer{-1};                     // PBO 在池中的下标，-1 表示使用 memory
+    std::vector<unsigned char> memory;
+};
+
+
+class TextureUploader {
+public:
+    /* 每一帧默认的上传预算 */
+    static constexpr size_t DEFAULT_FRAME_BUDGET = 16ull << 20;
+
+    /* 新建 PBO 的最小尺寸，小的上传可以共用同样大小的 PBO */
+    static constexpr size_t MIN_BUFFER_SIZE = 1ull << 20;
+
+    /* 空闲的 PBO 多少帧没有使用之后释放 */
+    static constexpr int IDLE_FRAMES = 300;
+
+    /* PBO 池的上限，包括排队的任务持有的 PBO */
+    static constexpr size_t POOL_LIMIT = 64ull << 20;
+
+    /* 达到上限时，每次等待 GPU 读取 PBO 的最长时间 */
+    static constexpr GLuint64 WAIT_TIMEOUT_NS = 100'000'000;
+
+    struct Stats {
+        size_t buffers{0};              // 池中 PBO 的数量
+        size_t pool_bytes{0};           // 池中 PBO 的总大小
+        size_t queued_jobs{0};          // 等待上传的任务
+        size_t queued_bytes{0};
+        size_t frame_bytes{0};          // 上一帧上传的字节数
+        size_t total_bytes{0};          // 累计上传的字节数
+    };
+
+    /* 启用 PBO 上传，需要在 OpenGL 上下文创建之后调用 */
+    static void init(size_t frame_budget = DEFAULT_FRAME_BUDGET);
+
+    /* 放弃队列中的任务，释放所有的 PBO；需要在上下文销毁之前调用 */
+    static void terminate();
+
+    [[nodiscard]] static inline bool enabled() { return _enabled; }
+
+    [[nodiscard]] static inline size_t frame_budget() { return _frame_budget; }
+
+    static inline void budget_set(size_t bytes) { _frame_budget = bytes; }
+
+    /* 分配暂存内存；写入完成后交给 submit；PBO 池达到上限时可能会提前上传队列中的任务 */
+    static UploadStaging staging(size_t size);
+
+    /**
+     * 从暂存内存上传到纹理的若干区域，纹理的存储需要已经分配
+     * @param bind_target GL_TEXTURE_2D 或者 GL_TEXTURE_CUBE_MAP
+     * @param deferred true 时放入队列，在 update() 中按照每帧的预算上传；false 时立即发出上传的命令
+     * @param done 上传的命令发出之后在主线程中调用，之后的绘制就可以使用这些数据；调用时纹理绑定在
+     *             0 号纹理单元的 bind_target 上，可以直接修改纹理的参数，之后会恢复原来的绑定；任务被取消时不会调用
+     */
+    static void submit(GLuint texture, GLenum bind_target, UploadStaging staging, std::vector<UploadRegion> regions,
+                       bool deferred, std::function<void()> done = {});
+
+    /* 放弃还没有提交的暂存内存，比如写入的过程中出错 */
+    static void discard(UploadStaging staging);
+
+    /* 取消某个纹理还没有上传的任务，删除纹理之前调用 */
+    static void cancel(GLuint texture);
+
+    /* 每一帧调用一次：回收 GPU 已经读取完的 PBO，在预算内上传队列中的任务 */
+    static void update();
+
+    /* 立即上传队列中的所有任务，不考虑预算 */
+    static void flush();
+
+    [[nodiscard]] static Stats stats();
+
+private:
+    struct Buffer {
+        GLuint id{0};                   // 0 表示这个位置已经释放，可以重新使用
+        size_t size{0};
+        GLsync fence{nullptr};          // GPU 还在读取
+        bool busy{false};               // 已经分配出去，或者 GPU 还在读取
+        int idle_frames{0};
+    };
+
+    struct Job {
+        GLuint texture;
+        GLenum bind_target;
+        UploadStaging staging;
+        std::vector<UploadRegion> regions;
+        std::function<void()> done;
+    };
+
+    /* 发出上传的命令，之后 PBO 由 fence 跟踪 */
+    static void _issue(Job &job);
+
+    /* 在池中找到或者新建一个至少 size 字节的空闲 PBO，返回下标；无法在上限之内分配时返回 -1 */
+    static int _acquire(size_t size);
+
+    /* 回收 fence 已经发出信号的 PBO */
+    static void _poll();
+
+    /* PBO 回到池中 */
+    static void _release(int buffer);
+
+private:
+    inline static bool _enabled{false};
+    inline static size_t _frame_budget{DEFAULT_FRAME_BUDGET};
+
+    inline static std::vector<Buffer> _buffers;
+    inline static std::deque<Job> _jobs;
+
+    /* 这一帧已经上传的字节数，update() 开始时清零 */
+    inline static size_t _frame_bytes{0};
+    inline static Stats _stats{0, 0, 0, 0, 0, 0};
+};
+
+
+#endif //RENDER_ENGINE_TEXTURE_UPLOAD_H
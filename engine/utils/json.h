@@ -0,0 +1,24 @@
+#ifndef RENDER_JSON_H
+#define RENDER_JSON_H
+
+#include <string>
+
+#include <fmt/format.h>
+
+
+/* JSON 字符串的转义：引号和反斜杠前加反斜杠，控制字符写成 \u00xx */
+inline std::string json_escape(const std::string &str) {
+    std::string result;
+    for (char c : str) {
+        if (c == '"' || c == '\\')
+            result += '\\';
+        if ((unsigned char) c < 0x20)
+            result += fmt::format("\\u{:04x}", (int) c);
+        else
+            result += c;
+    }
+    return result;
+}
+
+
+#endif //RENDER_JSON_H
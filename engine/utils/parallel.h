@@ -0,0 +1,203 @@
+#ifndef RENDER_PARALLEL_H
+#define RENDER_PARALLEL_H
+
+#include <deque>
+#include <mutex>
+#include <atomic>
+#include <thread>
+#include <vector>
+#include <cstddef>
+#include <exception>
+#include <algorithm>
+#include <functional>
+#include <condition_variable>
+
+
+/* 默认的工作线程数：硬件线程数，至少为 1 */
+inline unsigned parallel_threads() {
+    return std::max(1u, std::thread::hardware_concurrency());
+}
+
+
+/**
+ * 进程内共用的工作线程，parallel_for() 和 CommandQueue::record() 都在这些线程上执行，不会每次都创建线程
+ *  - 第一次使用时创建，也可以提前调用 init() 指定线程数
+ *  - 调用 run() 的线程也会参与；工作线程都在忙时（比如在工作线程中嵌套调用），由调用线程独自完成
+ *  - 多个线程可以同时调用 run()，任务按照提交的顺序领取
+ */
+class WorkerPool {
+public:
+    /**
+     * 创建工作线程，已经创建过时什么也不做
+     * @param threads 并行的线程数（包括调用 run() 的线程），0 表示硬件线程数
+     * @param on_start 每个工作线程开始时调用一次，参数是线程的序号（从 1 开始），比如设置分析器中的线程名
+     */
+    static void init(unsigned threads = 0, const std::function<void(unsigned)> &on_start = {}) {
+        std::lock_guard<std::mutex> lock(_state.mutex);
+        if (!_state.workers.empty())
+            return;
+        if (threads == 0)
+            threads = parallel_threads();
+        _state.stop = false;
+        for (unsigned i = 1; i < threads; ++i)
+            _state.workers.emplace_back(_worker, i, on_start);
+    }
+
+    /* 停止并回收工作线程；之后的 run() 会重新创建 */
+    static void terminate() { _state.join(); }
+
+    /* 并行的线程数（包括调用 run() 的线程） */
+    [[nodiscard]] static unsigned threads() {
+        std::lock_guard<std::mutex> lock(_state.mutex);
+        return (unsigned) _state.workers.size() + 1;
+    }
+
+    /**
+     * 最多 threads 个线程同时执行 func(slot)：调用线程的 slot 是 0，其余的线程依次是 1, 2, ...
+     * func 需要自己领取工作（比如原子的计数器），调用线程返回时所有的工作都必须完成；所有参与的线程结束后返回
+     * func 抛出异常时，返回前重新抛出第一个异常
+     * @param threads 最多使用多少个线程，0 表示全部
+     */
+    static void run(unsigned threads, const std::function<void(unsigned slot)> &func) {
+        init();
+        Job job{&func};
+        {
+            std::lock_guard<std::mutex> lock(_state.mutex);
+            const unsigned available = (unsigned) _state.workers.size() + 1;
+            job.wanted = (threads == 0 || threads > available ? available : threads) - 1;
+            if (job.wanted > 0)
+                _state.jobs.push_back(&job);
+        }
+        if (job.wanted > 1)
+            _state.cv_job.notify_all();
+        else if (job.wanted == 1)
+            _state.cv_job.notify_one();
+
+        _execute(job, 0);
+
+        /* 调用线程结束时工作已经领取完了，还没有加入的线程不再需要 */
+        {
+            std::unique_lock<std::mutex> lock(_state.mutex);
+            auto iter = std::find(_state.jobs.begin(), _state.jobs.end(), &job);
+            if (iter != _state.jobs.end())
+                _state.jobs.erase(iter);
+            job.cv_done.wait(lock, [&] { return job.active == 0; });
+        }
+        if (job.error)
+            std::rethrow_exception(job.error);
+    }
+
+private:
+    struct Job {
+        const std::function<void(unsigned)> *func;
+        unsigned wanted{0};             // 除调用线程之外需要的线程数
+        unsigned joined{0};             // 已经加入的工作线程数
+        unsigned active{0};             // 正在执行的工作线程数
+        std::exception_ptr error;
+        std::condition_variable cv_done;
+    };
+
+    struct State {
+        std::mutex mutex;
+        std::condition_variable cv_job;
+        std::deque<Job *> jobs;
+        std::vector<std::thread> workers;
+        bool stop;
+
+        State() : stop(false) {}
+
+        void join() {
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                stop = true;
+            }
+            cv_job.notify_all();
+            for (auto &worker: workers)
+                worker.join();
+            workers.clear();
+        }
+
+        /* 进程退出时回收工作线程，没有调用 terminate() 也不会因为线程没有 join 而崩溃 */
+        ~State() { join(); }
+    };
+
+    static void _execute(Job &job, unsigned slot) {
+        try {
+            (*job.func)(slot);
+        } catch (...) {
+            std::lock_guard<std::mutex> lock(_state.mutex);
+            if (!job.error)
+                job.error = std::current_exception();
+        }
+    }
+
+    static void _worker(unsigned index, std::function<void(unsigned)> on_start) {
+        if (on_start)
+            on_start(index);
+        std::unique_lock<std::mutex> lock(_state.mutex);
+        while (true) {
+            _state.cv_job.wait(lock, [] { return _state.stop || !_state.jobs.empty(); });
+            if (_state.stop)
+                return;
+
+            /* 加入队首的任务，人数够了就出队 */
+            Job &job = *_state.jobs.front();
+            const unsigned slot = ++job.joined;
+            if (job.joined == job.wanted)
+                _state.jobs.pop_front();
+            ++job.active;
+
+            lock.unlock();
+            _execute(job, slot);
+            lock.lock();
+
+            if (--job.active == 0)
+                job.cv_done.notify_one();
+        }
+    }
+
+private:
+    inline static State _state;
+};
+
+
+/**
+ * 将 [begin, end) 中的下标分给多个线程执行，每个线程每次领取一个下标，调用线程也会参与
+ * 线程来自 WorkerPool，不会每次都创建新的线程
+ * 任意一个下标抛出异常后，其余线程不再领取新的下标，所有线程结束后重新抛出第一个异常
+ * @param func void(size_t index)，需要是线程安全的
+ * @param threads 线程数，0 表示 WorkerPool 的全部线程
+ * @example
+ *  parallel_for(0, rows, [&](size_t row) { ... });
+ */
+template<class Func>
+void parallel_for(size_t begin, size_t end, Func &&func, unsigned threads = 0) {
+    if (begin >= end)
+        return;
+    if (threads == 0)
+        threads = parallel_threads();
+    threads = (unsigned) std::min<size_t>(threads, end - begin);
+
+    /* 只有一个线程时不经过 WorkerPool */
+    if (threads == 1) {
+        for (size_t i = begin; i < end; ++i)
+            func(i);
+        return;
+    }
+
+    std::atomic<size_t> next{begin};
+    std::atomic<bool> failed{false};
+    WorkerPool::run(threads, [&](unsigned) {
+        for (size_t i = next++; i < end && !failed; i = next++) {
+            try {
+                func(i);
+            } catch (...) {
+                failed = true;
+                throw;
+            }
+        }
+    });
+}
+
+
+#endif //RENDER_PARALLEL_H
@@ -0,0 +1,47 @@
+#ifndef RENDER_STOPWATCH_H
+#define RENDER_STOPWATCH_H
+
+#include <chrono>
+
+
+/**
+ * 统计 CPU 耗时的秒表，多次 start-stop 的耗时会累加，用于计算平均耗时
+ * @example
+ *  stopwatch.start();
+ *  ...
+ *  stopwatch.stop(mesh_cnt);       // 这一段耗时对应 mesh_cnt 个对象
+ *  stopwatch.average_us();         // 平均每个对象的耗时
+ */
+class Stopwatch {
+public:
+    inline void start() { _start = std::chrono::steady_clock::now(); }
+
+    /**
+     * 结束一次计时
+     * @param cnt 这一次计时对应了多少个对象，用于计算每个对象的平均耗时
+     */
+    inline void stop(unsigned cnt = 1) {
+        _total += std::chrono::steady_clock::now() - _start;
+        _cnt += cnt;
+    }
+
+    /* 平均每个对象的耗时，单位：微秒 */
+    [[nodiscard]] inline double average_us() const {
+        return _cnt == 0 ? 0.0 : std::chrono::duration<double, std::micro>(_total).count() / _cnt;
+    }
+
+    [[nodiscard]] inline unsigned long count() const { return _cnt; }
+
+    inline void reset() {
+        _total = std::chrono::steady_clock::duration::zero();
+        _cnt = 0;
+    }
+
+private:
+    std::chrono::steady_clock::time_point _start{};
+    std::chrono::steady_clock::duration _total{std::chrono::steady_clock::duration::zero()};
+    unsigned long _cnt{0};
+};
+
+
+#endif //RENDER_STOPWATCH_H
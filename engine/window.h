@@ -6,6 +6,7 @@
 #include <memory>
 #include <string>
 #include <cassert>
+#include <functional>
 
 #include <GLFW/glfw3.h>
 #include <spdlog/spdlog.h>
@@ -72,6 +73,13 @@ public:
         glfwSetFramebufferSizeCallback(_window, _frame_buffer_size_cbk);
     }
 
+    /**
+     * 离屏模式：创建不可见的窗口，只是为了得到 OpenGL 的上下文，绘制的目标是离屏的 FrameBuffer
+     * GLFW 3.4 及以上使用 null 平台（见 Render::_glfw_init），不需要显示器：优先使用 EGL（GPU，或者 Mesa 的
+     * surfaceless 平台），失败时使用 OSMesa；更早的 GLFW 只能创建隐藏的窗口，仍然需要 X11（比如 Xvfb）
+     */
+    static void init_headless(int width, int height);
+
     /* 每一帧需要更新的内容 */
     static void update() {
         glfwPollEvents();
@@ -96,6 +104,14 @@ public:
         glfwDestroyWindow(_window);
     }
 
+    /**
+     * 帧缓冲的尺寸改变之后调用 listener(width, height)，比如重新分配和窗口一样大的渲染目标
+     * 最小化时尺寸是 0，不会调用
+     */
+    inline static void resize_listen(std::function<void(int, int)> listener) {
+        _resize_listeners.push_back(std::move(listener));
+    }
+
     inline static bool should_close() {
         return glfwWindowShouldClose(_window);
     }
@@ -107,6 +123,8 @@ public:
 
     inline static GLFWwindow *window() { return _window; }
 
+    inline static bool headless() { return _headless; }
+
     inline static int width() { return _width; }
 
     inline static int height() { return _height; }
@@ -149,7 +167,7 @@ private:
      */
     static void _mouse_buttion_cbk(GLFWwindow *, int button, int action, int mods);
 
-    /* 窗口大小（framebuffer）改变的回调：同步改变 OpenGL 的 viewPort */
+    /* 窗口大小（framebuffer）改变的回调：同步改变 OpenGL 的 viewPort，通知 resize_listen() 注册的函数 */
     static void _frame_buffer_size_cbk(GLFWwindow *, int width, int height);
 
     /* 不允许使用构造函数 */
@@ -157,6 +175,7 @@ private:
 
 private:
     inline static GLFWwindow *_window{nullptr};
+    inline static bool _headless{false};
 
     inline static int _width = 1200, _height = 900;
 
@@ -165,6 +184,8 @@ private:
     inline static double _mouse_cur_x = -1, _mouse_cur_y = -1;
     inline static double _mouse_delta_x = 0, _mouse_delta_y = 0;
 
+    inline static std::vector<std::function<void(int, int)>> _resize_listeners{};
+
     /* 比较关注哪些鼠标按键 */
     inline static const std::map<int, MouseButton> MOUSE_BUTTON_MAP{
             {GLFW_MOUSE_BUTTON_LEFT,  MouseButton::Left},
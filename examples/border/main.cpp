@@ -31,8 +31,7 @@ public:
 
         /* shader-diffuse 数据绑定：mesh */
         shader_diffuse->set_draw([](Shader &shader, const Mesh &mesh) {
-            glActiveTexture(GL_TEXTURE0);
-            glBindTexture(GL_TEXTURE_2D, mesh.textures(TextureType::diffuse)[0]->id());
+            mesh.textures(TextureType::diffuse)[0]->bind(0);
             shader.uniform_tex2d_set("texture1", 0);
 
             shader.uniform_mat4_set("model", mesh.model());
@@ -131,8 +130,8 @@ private:
 };
 
 
-int main() {
-    Render::init();
+int main(int argc, char **argv) {
+    Render::init(RenderOptions::parse(argc, argv));
     Render::render<SceneEdgeThicken>();
     Render::terminate();
     return 0;
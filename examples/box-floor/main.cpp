@@ -121,8 +121,8 @@ private:
 };
 
 
-int main() {
-    Render::init();
+int main(int argc, char **argv) {
+    Render::init(RenderOptions::parse(argc, argv));
     Render::render<SceneBoxFloor>();
     Render::terminate();
     return 0;
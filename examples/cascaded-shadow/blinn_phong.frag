@@ -0,0 +1,93 @@
+#version 330 core
+
+// 类型定义 =======================================================================
+struct LightColor {
+    vec3 ambient;
+    vec3 diffuse;
+    vec3 specular;
+};
+
+/* 定向光 */
+struct DirLight {
+    vec3 direction;
+
+    LightColor color;
+};
+
+
+// 全局变量 =======================================================================
+
+in vec3 FragPos;
+in vec3 Normal;
+in vec2 TexCoord;
+in float ViewDepth;
+
+out vec4 FragColor;
+
+uniform sampler2D texture_diffuse_0;
+uniform DirLight dir_light;
+uniform vec3 eye_pos;// 观察者的位置
+uniform int show_cascades;// 按照级联着色
+
+/* 级联阴影，见 CascadedShadowMap::uniforms_set() */
+uniform sampler2DArrayShadow shadow_map;
+uniform int shadow_cascades;
+uniform vec4 shadow_splits;// 每个级联在观察空间中的远端
+uniform vec4 shadow_texels;// 每个级联一个纹素在世界空间中的长度
+uniform mat4 shadow_matrices[4];
+
+
+// 函数 =======================================================================
+
+/* 片段所在的级联，超出阴影的距离时返回 -1 */
+int cascade_select() {
+    for (int i = 0; i < shadow_cascades; ++i)
+        if (ViewDepth < shadow_splits[i])
+            return i;
+    return -1;
+}
+
+/**
+ * 片段被照亮的比例：沿法线偏移一个半纹素之后投影到阴影贴图，3x3 次深度比较的采样，每次采样是硬件的 2x2 PCF
+ * 沿法线偏移和纹素的大小成正比，远处的级联纹素更大，偏移也更大
+ */
+float shadow_calc(int cascade, vec3 normal) {
+    if (cascade < 0)
+        return 1.0;
+    vec3 position = FragPos + normal * shadow_texels[cascade] * 1.5;
+    vec3 coord = (shadow_matrices[cascade] * vec4(position, 1.0)).xyz * 0.5 + 0.5;
+
+    vec2 texel = 1.0 / vec2(textureSize(shadow_map, 0).xy);
+    float lit = 0.0;
+    for (int x = -1; x <= 1; ++x)
+        for (int y = -1; y <= 1; ++y)
+            lit += texture(shadow_map, vec4(coord.xy + vec2(x, y) * texel, float(cascade), coord.z));
+    return lit / 9.0;
+}
+
+
+void main()
+{
+    vec3 normal = normalize(Normal);
+    vec3 light_dir = normalize(dir_light.direction);
+    vec3 view_dir = normalize(eye_pos - FragPos);
+    vec3 halfway = normalize(view_dir - light_dir);
+    vec3 albedo = texture(texture_diffuse_0, TexCoord).rgb;
+
+    float diffuse_coef = max(0.0, dot(normal, -light_dir));
+    float specular_coef = diffuse_coef > 0.0 ? pow(max(0.0, dot(normal, halfway)), 64.0) : 0.0;
+
+    int cascade = cascade_select();
+    float lit = shadow_calc(cascade, normal);
+
+    vec3 color = dir_light.color.ambient * albedo +
+                 lit * (dir_light.color.diffuse * diffuse_coef * albedo + dir_light.color.specular * specular_coef * 0.3);
+
+    /* 调试：每个级联一种颜色 */
+    if (show_cascades == 1 && cascade >= 0) {
+        const vec3 tints[4] = vec3[4](vec3(1.0, 0.4, 0.4), vec3(0.4, 1.0, 0.4), vec3(0.4, 0.4, 1.0), vec3(1.0, 1.0, 0.4));
+        color *= tints[cascade];
+    }
+
+    FragColor = vec4(color, 1.0);
+}
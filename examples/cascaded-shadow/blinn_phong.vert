@@ -0,0 +1,24 @@
+#version 330 core
+layout (location = 0) in vec3 aPos;
+layout (location = 1) in vec3 aNormal;
+layout (location = 2) in vec2 aTexCoord;
+
+uniform mat4 model;
+uniform mat4 view;
+uniform mat4 projection;
+uniform float uv_scale;// 纹理坐标的缩放，放大的地面需要重复纹理
+
+out vec3 FragPos;
+out vec3 Normal;
+out vec2 TexCoord;
+out float ViewDepth;// 观察空间中的深度，用于选择级联
+
+void main() {
+    vec4 view_pos = view * model * vec4(aPos, 1.0);
+    gl_Position = projection * view_pos;
+
+    FragPos = vec3(model * vec4(aPos, 1.0));
+    TexCoord = aTexCoord * uv_scale;
+    Normal = mat3(transpose(inverse(model))) * aNormal;
+    ViewDepth = -view_pos.z;
+}
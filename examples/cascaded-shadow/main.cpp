@@ -0,0 +1,130 @@
+#include <random>
+#include <memory>
+#include <vector>
+
+#include "engine/render.h"
+#include "engine/scene.h"
+#include "engine/light.h"
+#include "engine/color.h"
+#include "engine/shadow.h"
+
+#include "assets/obj/box.h"
+#include "assets/obj/floor.h"
+#include "config.hpp"
+
+
+std::string CUR_DIR(const std::string &file_name) {
+    return fmt::format("{}/cascaded-shadow/{}", EXAMPLE_DIR, file_name);
+}
+
+
+/**
+ * 方向光的级联阴影：一大片地面上随机高度的箱子
+ *  - 每一帧先按照摄像机和光源的方向划分级联，绘制阴影贴图（每个级联只绘制和它相交的箱子），再绘制场景
+ *  - GUI 中可以调整光源的方向，级联的数量和划分，按照级联着色；阴影 pass 的耗时在 shadow 窗口和分析器中
+ */
+class SceneCascadedShadow : public Scene {
+    /* 箱子的网格，GRID x GRID 个，间隔 SPACING */
+    static constexpr int GRID = 12;
+    static constexpr float SPACING = 5.f;
+
+    /* 地面放大的倍数，纹理重复同样的次数 */
+    static constexpr float FLOOR_SCALE = 8.f;
+
+private:
+    void _init() override {
+        Render::camera->pose_set({0.f, 3.f, 25.f}, 0.f, -10.f);
+
+        /* 随机高度的箱子，放在地面上；固定的种子，每次运行都一样 */
+        std::mt19937 random(2021);
+        std::uniform_real_distribution<float> height(1.f, 5.f);
+        for (int x = 0; x < GRID; ++x) {
+            for (int z = 0; z < GRID; ++z) {
+                const float h = height(random);
+                glm::vec3 position{((float) x - (GRID - 1) * 0.5f) * SPACING, -1.f + h * 0.5f,
+                                   ((float) z - (GRID - 1) * 0.5f) * SPACING};
+                auto mesh = std::make_shared<Mesh>(box_mesh);
+                mesh->set_model(glm::scale(glm::translate(glm::one<glm::mat4>(), position), glm::vec3(1.f, h, 1.f)));
+                mesh->add_texture(TextureType::diffuse, tex_box);
+                box_meshes.push_back(mesh);
+            }
+        }
+        mesh_floor->set_model(glm::scale(glm::translate(glm::one<glm::mat4>(), glm::vec3(0.f, -1.f, 0.f)),
+                                         glm::vec3(FLOOR_SCALE, 1.f, FLOOR_SCALE)));
+        mesh_floor->add_texture(TextureType::diffuse, tex_floor);
+
+        /* 数据绑定 shader：每帧，场景 */
+        shader->set_update_per_frame([this](Shader &shader) {
+            shader.uniform_vec3_set("eye_pos", Render::camera->position());
+            shader.uniform_mat4_set("view", Render::camera->view_matrix_get());
+            shader.uniform_mat4_set("projection", Render::camera->projection_matrix());
+            shader.uniform_int_set("show_cascades", show_cascades);
+            ShaderExtLight::set_dir_light_uniform(shader, dir_light, "dir_light");
+        });
+
+        /* 数据绑定 shader：mesh */
+        shader->set_draw([this](Shader &shader, const Mesh &mesh) {
+            shader.uniform_mat4_set("model", mesh.model());
+            shader.uniform_float_set("uv_scale", &mesh == mesh_floor.get() ? FLOOR_SCALE : 1.f);
+            shader.set_textures(mesh, {
+                    {"texture_diffuse_0", TextureType::diffuse, 0},
+            });
+        });
+    }
+
+    void _gui() override {
+        ImGui::Begin("directional light");
+        ImGui::SliderFloat("yaw", &light_yaw, -180.f, 180.f);
+        ImGui::SliderFloat("pitch", &light_pitch, -89.f, -5.f);
+        ImGui::Checkbox("show cascades", &show_cascades);
+        ImGui::End();
+
+        shadow.gui();
+    }
+
+    void _update() override {
+        /* 光源的方向：光线前进的方向 */
+        dir_light.direction = glm::vec3(std::cos(glm::radians(light_pitch)) * std::sin(glm::radians(light_yaw)),
+                                        std::sin(glm::radians(light_pitch)),
+                                        std::cos(glm::radians(light_pitch)) * std::cos(glm::radians(light_yaw)));
+
+        /* 阴影贴图：地面只接收阴影，不投射 */
+        shadow.update(*Render::camera, dir_light.direction);
+        shadow.render(box_meshes);
+
+        shader->update_per_frame();
+        with(Shader, *shader) {
+            /* 0 号纹理单元是漫反射贴图 */
+            shadow.uniforms_set(*shader, 1);
+            for (auto &mesh: box_meshes)
+                shader->draw(*mesh);
+            shader->draw(*mesh_floor);
+        }
+    }
+
+private:
+    /* 光源：角度制，俯仰角是负数时向下照射 */
+    float light_yaw{30.f};
+    float light_pitch{-40.f};
+    DirLight dir_light{{glm::vec3(0.15f), Color::white, Color::white}, glm::vec3(0.f, -1.f, 0.f)};
+    bool show_cascades{false};
+
+    CascadedShadowMap shadow{2048, 4, 60.f};
+
+    std::shared_ptr<Texture2D> tex_box = std::make_shared<Texture2D>(TEXTURE("container2.jpg"));
+    std::shared_ptr<Texture2D> tex_floor = std::make_shared<Texture2D>(TEXTURE("wood_floor.jpg"));
+
+    std::vector<std::shared_ptr<Mesh>> box_meshes;
+    std::shared_ptr<Mesh> mesh_floor = std::make_shared<Mesh>(floor_mesh);
+
+    std::shared_ptr<Shader> shader = std::make_shared<Shader>(CUR_DIR("blinn_phong.vert"),
+                                                              CUR_DIR("blinn_phong.frag"));
+};
+
+
+int main(int argc, char **argv) {
+    Render::init(RenderOptions::parse(argc, argv));
+    Render::render<SceneCascadedShadow>();
+    Render::terminate();
+    return 0;
+}
@@ -78,8 +78,8 @@ private:
 };
 
 
-int main() {
-    Render::init();
+int main(int argc, char **argv) {
+    Render::init(RenderOptions::parse(argc, argv));
     Render::render<SceneFaceCull>();
     Render::terminate();
     return 0;
@@ -1,7 +1,10 @@
 
+#include <atomic>
 #include <cmath>
 #include <random>
+#include <cstring>
 #include <memory>
+#include <algorithm>
 #include <pthread.h>
 
 #include <fmt/format.h>
@@ -11,11 +14,15 @@
 #include "engine/light.h"
 #include "engine/color.h"
 #include "engine/camera.h"
+#include "engine/frustum.h"
 #include "engine/model.h"
 #include "engine/shader.h"
 #include "engine/texture.h"
+#include "engine/ring_buffer.h"
+#include "engine/command_list.h"
 
 #include "engine/utils/with.h"
+#include "engine/utils/stopwatch.h"
 #include "config.hpp"
 
 
@@ -32,7 +39,7 @@ public:
     explicit UBOMatrices(GLuint index) {
         glGenBuffers(1, &id);
         glBindBuffer(GL_UNIFORM_BUFFER, id);
-        glBufferData(GL_UNIFORM_BUFFER, 2 * sizeof(glm::mat4), nullptr, GL_STATIC_DRAW);
+        glBufferData(GL_UNIFORM_BUFFER, 2 * sizeof(glm::mat4), nullptr, GL_DYNAMIC_DRAW);
         glBindBufferBase(GL_UNIFORM_BUFFER, index, id);
         glBindBuffer(GL_UNIFORM_BUFFER, 0);
     }
@@ -50,6 +57,36 @@ public:
 const int core = 16;
 
 
+/* 每一帧动态数据的上传方式 */
+enum StreamMode {
+    StreamBufferSubData = 0,        // glBufferSubData 到固定的 buffer
+    StreamRingBuffer = 1,           // 从 RingBuffer 中分配
+};
+
+
+/* 静态分发数据绑定的 shader：用于 rock 和 planet，只需要绑定 diffuse 纹理，model 矩阵可选 */
+class SpaceShader : public ShaderPass<SpaceShader> {
+public:
+    SpaceShader(const std::string &vertex, const std::string &fragment, bool has_model)
+            : ShaderPass(vertex, fragment),
+              _loc_model(has_model ? _uniform_location_get("model") : -1) {
+        uniform_block("Matrices", 0);
+        uniform_tex2d_set("material.texture_diffuse_0", 0);
+    }
+
+    inline void bind(const Model &model, const Mesh &mesh) {
+        if (_loc_model != -1)
+            glUniformMatrix4fv(_loc_model, 1, GL_FALSE, glm::value_ptr(model.model()));
+        /* 没有漫反射贴图的 mesh 不绑定，和 Shader::set_textures() 一样跳过 */
+        if (const Texture2D *texture = mesh.texture(TextureType::diffuse))
+            texture->bind(0);
+    }
+
+private:
+    GLint _loc_model;
+};
+
+
 class SceneSpace : public Scene {
 public:
     void _init() override {
@@ -57,60 +94,157 @@ public:
         shader_planet->uniform_block("Matrices", 0);
         shader_planet->set_draw([](Shader &shader, const Model &model, const Mesh &mesh) {
             shader.uniform_mat4_set("model", model.model());
-            glActiveTexture(GL_TEXTURE0);
-            glBindTexture(GL_TEXTURE_2D, mesh.textures(TextureType::diffuse)[0]->id());
+            mesh.textures(TextureType::diffuse)[0]->bind(0);
             shader.uniform_tex2d_set("material.texture_diffuse_0", 0);
         });
 
         /* 数据绑定：shader-rock */
         shader_rock->uniform_block("Matrices", 0);
         shader_rock->set_draw([](Shader &shader, const Model &model, const Mesh &mesh) {
-            glActiveTexture(GL_TEXTURE0);
-            glBindTexture(GL_TEXTURE_2D, mesh.textures(TextureType::diffuse)[0]->id());
+            mesh.textures(TextureType::diffuse)[0]->bind(0);
             shader.uniform_tex2d_set("material.texture_diffuse_0", 0);
         });
 
         // uniform block 初始化
-        ubo_matrices = std::make_shared<UBOMatrices>(0);
-        with(UBOMatrices, *ubo_matrices) {
-            glBufferSubData(GL_UNIFORM_BUFFER, sizeof(glm::mat4), sizeof(glm::mat4),
-                            glm::value_ptr(Render::camera->projection_matrix()));
-        }
+        ubo_matrices = std::make_shared<UBOMatrices>(UniformBlockBinding::matrices);
 
         // 实例化绘制，初始化 model 矩阵
-        GLuint model_array = init_instance(amount);
-        glBindBuffer(GL_ARRAY_BUFFER, model_array);
+        model_array = init_instance(instance_models);
         for (const Mesh &mesh: model_rock->meshes()) {
             glBindVertexArray(mesh.VAO());
-            /* matrix4 类型的需要四个顶点属性来存储 */
             for (unsigned int i = 0; i < 4; ++i) {
                 glEnableVertexAttribArray(3 + i);
-                glVertexAttribPointer(3 + i, 4, GL_FLOAT, GL_FALSE, sizeof(glm::mat4),
-                                      (void *) (i * sizeof(glm::vec4)));
                 glVertexAttribDivisor(3 + i, 1);        // 这个顶点属性只有在每个实例才更新
             }
         }
         glBindVertexArray(0);
+        instance_attrib_set(model_array, 0);
+
+        /* CPU 旋转时，glBufferSubData 方式使用的实例 buffer */
+        glGenBuffers(1, &stream_array);
+        glBindBuffer(GL_ARRAY_BUFFER, stream_array);
+        glBufferData(GL_ARRAY_BUFFER, amount * sizeof(glm::mat4), nullptr, GL_STREAM_DRAW);
         glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+        /* 数据绑定：命令列表中逐个绘制的 rock，录制的 model 矩阵已经包含了旋转 */
+        shader_rock_draw->uniform_block("Matrices", 0);
+        shader_rock_draw->uniform_tex2d_set("material.texture_diffuse_0", 0);
+        shader_rock_draw->uniform_float_set("time", 0.f);
+        loc_rock_draw_model = glGetUniformLocation(shader_rock_draw->id, "model");
+        loc_planet_model = glGetUniformLocation(shader_planet_static->id, "model");
+        record_threads = (int) CommandQueue::threads();
+
+        /* rock 所有 mesh 的包围球，模拟线程用来剔除实例 */
+        const auto &rock_meshes = model_rock->meshes();
+        glm::vec3 center = rock_meshes.empty() ? glm::vec3(0.f) : rock_meshes[0].bounds_center();
+        float radius = 0.f;
+        for (const Mesh &mesh: rock_meshes)
+            radius = std::max(radius, glm::distance(center, mesh.bounds_center()) + mesh.bounds_radius());
+        rock_bounds = glm::vec4(center, radius);
     }
 
     void _update() override {
 
-        // 通过 ubo 更新 view 矩阵
-        with(UBOMatrices, *ubo_matrices) {
-            glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(glm::mat4), glm::value_ptr(Render::camera->view_matrix_get()));
+        /* 上传每一帧的动态数据；CPU 旋转的实例矩阵已经在模拟线程中计算好了 */
+        float time = (float) Render::time();
+        const auto &rotated = Render::snapshot().transforms;
+        const bool cpu_rotated = rotated.size() == (size_t) amount;
+        stream_begin(cpu_rotated ? rotated.data() : nullptr);
+
+        auto mesh_cnt = (unsigned) (model_rock->meshes().size() + model_planet->meshes().size());
+
+        /* CPU 旋转时，实例矩阵已经包含了旋转 */
+        float rock_time = cpu_rotated ? 0.f : time;
+
+        if (command_list) {
+            /* 多线程录制，在这里统一提交 */
+            command_record(Render::snapshot());
+            CommandQueue::submit();
+        } else if (static_binding) {
+            stopwatch_static.start();
+
+            /* 绘制 rock：旋转是绕实例自身的轴，不改变位置，流送的纹理按照初始的实例矩阵估计级别 */
+            shader_rock_static->uniform_float_set("time", rock_time);
+            TextureStreamer::instances_set(instance_models.data(), instance_models.size());
+            shader_rock_static->draw_pass(*model_rock, amount);
+            TextureStreamer::instances_clear();
+
+            /* 绘制 planet */
+            shader_planet_static->draw_pass(*model_planet);
+
+            stopwatch_static.stop(mesh_cnt);
+        } else {
+            stopwatch_function.start();
+
+            /* 绘制 rock */
+            with(Shader, *shader_rock) {
+                shader_rock->uniform_float_set("time", rock_time);
+                TextureStreamer::instances_set(instance_models.data(), instance_models.size());
+                shader_rock->draw(*model_rock, nullptr, amount);
+                TextureStreamer::instances_clear();
+            }
+
+            /* 绘制 planet */
+            with(Shader, *shader_planet) {
+                shader_planet->draw(*model_planet);
+            }
+
+            stopwatch_function.stop(mesh_cnt);
         }
 
-        /* 绘制 rock */
-        with(Shader, *shader_rock) {
-            shader_rock->uniform_float_set("time", (float) glfwGetTime());
-            shader_rock->draw(*model_rock, nullptr, amount);
+        stream_end();
+    }
+
+    /**
+     * 模拟线程：CPU 旋转或者使用命令列表时计算这一帧所有实例的矩阵
+     * 之后引擎按照 rock 的包围球剔除实例（FramePipeline::cull()），命令列表只录制 snapshot.visible 中的实例
+     */
+    void _simulate(FrameSnapshot &snapshot) override {
+        if (!simulate_rotate && !simulate_command_list) {
+            snapshot.transforms.clear();
+            return;
         }
+        snapshot.transforms.resize(amount);
+        snapshot.bounds = rock_bounds;
+        rotate_instances(snapshot.transforms.data(), (float) snapshot.time);
+    }
 
-        /* 绘制 planet */
-        with(Shader, *shader_planet) {
-            shader_planet->draw(*model_planet);
+    void _gui() override {
+        ImGui::Begin("draw submission");
+        ImGui::Checkbox("command list", &command_list);
+        simulate_command_list = command_list;
+        if (command_list) {
+            const auto &stats = CommandQueue::stats();
+            ImGui::SliderInt("record threads", &record_threads, 1, (int) CommandQueue::threads());
+            ImGui::Text("draws: %zu / %d, program changes: %zu, material changes: %zu", stats.packets,
+                        amount * (int) model_rock->meshes().size() + (int) model_planet->meshes().size(),
+                        stats.program_changes,
+                        stats.material_changes);
+            ImGui::Text("record: %.3f ms (%u threads), submit: %.3f ms", stats.record_ms, stats.threads,
+                        stats.submit_ms);
+        }
+        ImGui::Checkbox("static binding", &static_binding);
+        ImGui::Text("std::function: %.3f us/mesh", stopwatch_function.average_us());
+        ImGui::Text("static (CRTP): %.3f us/mesh", stopwatch_static.average_us());
+        if (ImGui::Button("reset")) {
+            stopwatch_function.reset();
+            stopwatch_static.reset();
         }
+        ImGui::End();
+
+        ImGui::Begin("dynamic data");
+        ImGui::Text("instances: %d, persistent map: %s", amount, ring_instance->persistent() ? "yes" : "no");
+        ImGui::Checkbox("cpu rotate", &cpu_rotate);
+        simulate_rotate = cpu_rotate;
+        ImGui::RadioButton("glBufferSubData", &stream_mode, StreamBufferSubData);
+        ImGui::RadioButton("ring buffer", &stream_mode, StreamRingBuffer);
+        ImGui::Text("glBufferSubData: %.3f ms/frame", stopwatch_stream[StreamBufferSubData].average_us() / 1000.0);
+        ImGui::Text("ring buffer: %.3f ms/frame", stopwatch_stream[StreamRingBuffer].average_us() / 1000.0);
+        if (ImGui::Button("reset stream")) {
+            stopwatch_stream[StreamBufferSubData].reset();
+            stopwatch_stream[StreamRingBuffer].reset();
+        }
+        ImGui::End();
     }
 
 private:
@@ -121,9 +255,43 @@ private:
     std::shared_ptr<Shader> shader_planet = std::make_shared<Shader>(CUR_DIR("planet.vert"), CUR_DIR("planet.frag"));
     std::shared_ptr<Shader> shader_rock = std::make_shared<Shader>(CUR_DIR("rock.vert"), CUR_DIR("rock.frag"));
 
+    std::shared_ptr<SpaceShader> shader_planet_static =
+            std::make_shared<SpaceShader>(CUR_DIR("planet.vert"), CUR_DIR("planet.frag"), true);
+    std::shared_ptr<SpaceShader> shader_rock_static =
+            std::make_shared<SpaceShader>(CUR_DIR("rock.vert"), CUR_DIR("rock.frag"), false);
+
+    /* 对比两种数据绑定方式下，每个 mesh 的提交耗时（CPU） */
+    bool static_binding = true;
+    Stopwatch stopwatch_function;
+    Stopwatch stopwatch_static;
+
+    /* 命令列表：每个可见的 rock 单独绘制，排序键在多个线程中录制；旋转和剔除在模拟线程中完成 */
+    bool command_list = false;
+    std::atomic<bool> simulate_command_list{false};     // command_list 的副本，模拟线程读取
+    glm::vec4 rock_bounds{0.f, 0.f, 0.f, -1.f};         // rock 在模型空间中的包围球
+    int record_threads = 1;
+    std::shared_ptr<Shader> shader_rock_draw = std::make_shared<Shader>(
+            CUR_DIR("rock.vert"), CUR_DIR("rock.frag"), std::vector<std::string>{"PER_DRAW_MODEL"});
+    GLint loc_rock_draw_model{-1};
+    GLint loc_planet_model{-1};
+
     std::shared_ptr<UBOMatrices> ubo_matrices;
 
-    GLsizei amount = 1000;
+    GLsizei amount = 100000;
+
+    /* 实例的 model 矩阵（没有旋转），以及存放它的 buffer */
+    std::vector<glm::mat4> instance_models = gen_models(amount);
+    GLuint model_array{0};
+    GLuint stream_array{0};
+
+    /* 动态数据的上传方式，以及每帧上传的 CPU 耗时（CPU 旋转在模拟线程中计算，不包括在内） */
+    int stream_mode = StreamRingBuffer;
+    bool cpu_rotate = false;
+    std::atomic<bool> simulate_rotate{false};       // cpu_rotate 的副本，模拟线程读取
+    Stopwatch stopwatch_stream[2];
+    std::shared_ptr<RingBuffer> ring_uniform = std::make_shared<RingBuffer>(GL_UNIFORM_BUFFER, 4 * 1024);
+    std::shared_ptr<RingBuffer> ring_instance = std::make_shared<RingBuffer>(GL_ARRAY_BUFFER,
+                                                                             amount * sizeof(glm::mat4));
 
 private:
 
@@ -161,24 +329,124 @@ private:
         return model_matrices;
     }
 
-    /* 生成很多 model matrix，并将其作为 GL_ARRAY_BUFFER */
-    static GLuint init_instance(GLsizei amount) {
+    /* 将 model matrix 作为 GL_ARRAY_BUFFER */
+    static GLuint init_instance(const std::vector<glm::mat4> &model_matrices) {
         GLuint model_array;
 
         /* 创建一个 array buffer，存放 instance 的位置信息 */
         glGenBuffers(1, &model_array);
         glBindBuffer(GL_ARRAY_BUFFER, model_array);
-        auto model_matrices = gen_models(amount);
-        glBufferData(GL_ARRAY_BUFFER, amount * sizeof(glm::mat4), &model_matrices[0], GL_DYNAMIC_DRAW);
+        glBufferData(GL_ARRAY_BUFFER, GLsizeiptr(model_matrices.size() * sizeof(glm::mat4)), &model_matrices[0],
+                     GL_STATIC_DRAW);
         glBindBuffer(GL_ARRAY_BUFFER, 0);
 
         return model_array;
     }
+
+    /* 设置 rock 的实例属性来自哪个 buffer 的哪个位置 */
+    void instance_attrib_set(GLuint buffer, GLintptr offset) {
+        glBindBuffer(GL_ARRAY_BUFFER, buffer);
+        for (const Mesh &mesh: model_rock->meshes()) {
+            glBindVertexArray(mesh.VAO());
+            /* matrix4 类型的需要四个顶点属性来存储 */
+            for (unsigned int i = 0; i < 4; ++i) {
+                glVertexAttribPointer(3 + i, 4, GL_FLOAT, GL_FALSE, sizeof(glm::mat4),
+                                      (void *) (offset + i * sizeof(glm::vec4)));
+            }
+        }
+        glBindVertexArray(0);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+    }
+
+    /**
+     * 录制这一帧的命令：rock 是模拟线程剔除之后可见的实例，矩阵已经旋转好，多个线程计算排序键；planet 是一个命令
+     * 刚打开命令列表时，模拟线程可能还没有产生实例的矩阵，这一帧不绘制 rock
+     */
+    void command_record(const FrameSnapshot &snapshot) {
+        const glm::vec3 eye = Render::camera->position();
+        const GLuint program = shader_rock_draw->id;
+        const bool has_rocks = snapshot.transforms.size() == (size_t) amount;
+
+        const size_t rocks = has_rocks ? snapshot.visible.size() : 0;
+        CommandQueue::record(rocks, [&](CommandList &list, size_t begin, size_t end) {
+            for (size_t i = begin; i < end; ++i) {
+                const glm::mat4 &model = snapshot.transforms[snapshot.visible[i]];
+                for (const Mesh &mesh: model_rock->meshes()) {
+                    glm::vec3 center = glm::vec3(model * glm::vec4(mesh.bounds_center(), 1.f));
+                    const Material *material = mesh.material().get();
+                    list.draw(CommandList::key(program, material ? material->id() : 0, glm::distance(eye, center)),
+                              mesh, program, material, loc_rock_draw_model, model);
+                }
+            }
+        }, (unsigned) record_threads);
+
+        CommandQueue::record(model_planet->meshes().size(), [&](CommandList &list, size_t begin, size_t end) {
+            for (size_t i = begin; i < end; ++i) {
+                const Mesh &mesh = model_planet->meshes()[i];
+                const Material *material = mesh.material().get();
+                list.draw(CommandList::key(shader_planet_static->id, material ? material->id() : 0, 0.f), mesh,
+                          shader_planet_static->id, material, loc_planet_model, model_planet->model());
+            }
+        });
+    }
+
+    /* CPU 旋转：和 rock.vert 中的 rotate_x 一致 */
+    void rotate_instances(glm::mat4 *out, float time) const {
+        for (GLsizei i = 0; i < amount; ++i)
+            out[i] = glm::rotate(instance_models[i], 0.04f * time, glm::vec3(1.f, 0.f, 0.f));
+    }
+
+    /**
+     * 上传这一帧的 view，projection 矩阵，以及 CPU 旋转后的实例矩阵
+     * @param rotated 模拟线程旋转好的 amount 个实例矩阵，为空时在 shader 中旋转
+     */
+    void stream_begin(const glm::mat4 *rotated) {
+        glm::mat4 matrices[2] = {Render::camera->view_matrix_get(), Render::camera->projection_matrix()};
+
+        stopwatch_stream[stream_mode].start();
+        if (stream_mode == StreamRingBuffer) {
+            ring_uniform->frame_begin();
+            ring_instance->frame_begin();
+
+            RingAlloc ubo = ring_uniform->write(matrices, sizeof(matrices), RingBuffer::uniform_alignment());
+            glBindBufferRange(GL_UNIFORM_BUFFER, UniformBlockBinding::matrices, ubo.buffer, ubo.offset, ubo.size);
+
+            if (rotated && !command_list) {
+                RingAlloc instance = ring_instance->alloc(amount * sizeof(glm::mat4));
+                std::memcpy(instance.ptr, rotated, amount * sizeof(glm::mat4));
+                ring_instance->commit(instance);
+                instance_attrib_set(instance.buffer, instance.offset);
+            }
+        } else {
+            with(UBOMatrices, *ubo_matrices) {
+                glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(matrices), matrices);
+            }
+            glBindBufferBase(GL_UNIFORM_BUFFER, UniformBlockBinding::matrices, ubo_matrices->id);
+
+            if (rotated && !command_list) {
+                glBindBuffer(GL_ARRAY_BUFFER, stream_array);
+                glBufferSubData(GL_ARRAY_BUFFER, 0, amount * sizeof(glm::mat4), rotated);
+                glBindBuffer(GL_ARRAY_BUFFER, 0);
+                instance_attrib_set(stream_array, 0);
+            }
+        }
+        if (!rotated)
+            instance_attrib_set(model_array, 0);
+        stopwatch_stream[stream_mode].stop();
+    }
+
+    /* 这一帧的绘制已经提交，为 ring buffer 的当前区段插入 fence */
+    void stream_end() {
+        if (stream_mode != StreamRingBuffer)
+            return;
+        ring_uniform->frame_end();
+        ring_instance->frame_end();
+    }
 };
 
 
-int main() {
-    Render::init();
+int main(int argc, char **argv) {
+    Render::init(RenderOptions::parse(argc, argv));
     Render::render<SceneSpace>();
     Render::terminate();
     return 0;
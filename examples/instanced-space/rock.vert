@@ -3,7 +3,13 @@
 layout (location = 0) in vec3 aPos;
 layout (location = 1) in vec3 aNormal;
 layout (location = 2) in vec2 aTexCoord;
+/* PER_DRAW_MODEL：每个 rock 单独绘制（命令列表），model 矩阵是 uniform */
+#ifdef PER_DRAW_MODEL
+uniform mat4 model;
+#define instanceModel model
+#else
 layout (location = 3) in mat4 instanceModel;
+#endif
 
 out Block {
     vec3 FragPos;
@@ -0,0 +1,206 @@
+/**
+ * 延迟渲染的光照 pass：从 G-buffer 中读取表面的属性，位置由深度和 view-projection 的逆矩阵重建
+ *  定义了 LIGHT_VOLUME：只计算这个包围球对应的点光源，结果叠加到屏幕上
+ *  否则：计算方向光和聚光，并且把 G-buffer 的深度写入屏幕的深度缓冲，之后包围球按照它做深度测试
+ * 光照的公式和 phong.frag 一致，高光的颜色只保存了亮度
+ */
+
+#version 330 core
+
+// 类型定义 =======================================================================
+struct LightColor {
+    vec3 ambient;
+    vec3 diffuse;
+    vec3 specular;
+};
+
+/* 点光源，从纹理缓冲中读取，见 point_light_fetch() */
+struct PointLight {
+    vec3 position;
+    float radius;// 影响范围，超出之后不计算
+
+// 点光源随距离衰减的系数
+    float constant;
+    float linear;
+    float quadratic;
+
+    LightColor color;
+};
+
+
+/* 定向光 */
+struct DirLight {
+    vec3 direction;
+
+    LightColor color;
+};
+
+
+/* 聚光 */
+struct SpotLight {
+    vec3 position;
+    vec3 direction;
+
+    LightColor color;
+
+    // 角度衰减，cos
+    float inner_cutoff;
+    float outer_cutoff;
+
+    // 距离衰减
+    float constant;
+    float linear;
+    float quadratic;
+};
+
+
+// 全局变量 =======================================================================
+
+#ifdef LIGHT_VOLUME
+flat in int light_index;
+#endif
+
+out vec4 FragColor;
+
+uniform sampler2D gbuffer_albedo;// rgb 是漫反射的颜色，a 是高光的强度
+uniform sampler2D gbuffer_normal;// 八面体编码的法线
+uniform sampler2D gbuffer_depth;
+
+uniform mat4 inv_view_projection;
+uniform vec2 screen_size;// G-buffer 的尺寸，也是视口的尺寸
+uniform vec3 eye_pos;// 观察者的位置
+uniform float shininess;// 反光度
+
+#ifdef LIGHT_VOLUME
+// 点光源：每个光源 4 个 RGBA32F 的纹素，和 main.cpp 中的 GpuPointLight 一致
+uniform samplerBuffer point_lights;
+#else
+uniform DirLight dir_light;
+uniform SpotLight spot_light;
+#endif
+
+
+// 函数定义 =======================================================================
+/* 八面体编码的逆变换，见 gbuffer.frag */
+vec3 oct_decode(vec2 f);
+
+/* 从纹理缓冲中读取第 i 个点光源 */
+PointLight point_light_fetch(int i);
+
+vec3 phong_calc(LightColor light_color, vec3 light_dir, vec3 normal, vec3 view_dir, vec3 albedo, vec3 specular);
+
+vec3 dir_light_calc(DirLight light, vec3 normal, vec3 view_dir, vec3 albedo, vec3 specular);
+
+vec3 point_light_calc(PointLight light, vec3 position, vec3 normal, vec3 view_dir, vec3 albedo, vec3 specular);
+
+vec3 spot_light_calc(SpotLight light, vec3 position, vec3 normal, vec3 view_dir, vec3 albedo, vec3 specular);
+
+
+// ============================================================================
+void main()
+{
+    ivec2 texel = ivec2(gl_FragCoord.xy);
+    float depth = texelFetch(gbuffer_depth, texel, 0).r;
+#ifndef LIGHT_VOLUME
+    // 背景没有几何体
+    if (depth >= 1.0)
+        discard;
+    gl_FragDepth = depth;
+#endif
+
+    vec4 ndc = vec4(gl_FragCoord.xy / screen_size * 2.0 - 1.0, depth * 2.0 - 1.0, 1.0);
+    vec4 world = inv_view_projection * ndc;
+    vec3 position = world.xyz / world.w;
+
+    vec4 albedo_specular = texelFetch(gbuffer_albedo, texel, 0);
+    vec3 albedo = albedo_specular.rgb;
+    vec3 specular = vec3(albedo_specular.a);
+    vec3 normal = oct_decode(texelFetch(gbuffer_normal, texel, 0).rg);
+    vec3 view_dir = normalize(position - eye_pos);
+
+#ifdef LIGHT_VOLUME
+    // 包围球覆盖的像素不一定在影响范围内；不使用 discard，保留提前的深度测试
+    PointLight light = point_light_fetch(light_index);
+    vec3 result = distance(position, light.position) < light.radius
+                  ? point_light_calc(light, position, normal, view_dir, albedo, specular)
+                  : vec3(0.0);
+#else
+    vec3 result = dir_light_calc(dir_light, normal, view_dir, albedo, specular)
+                  + spot_light_calc(spot_light, position, normal, view_dir, albedo, specular);
+#endif
+
+    FragColor = vec4(result, 1.0);
+}
+
+
+// 函数实现 =======================================================================
+vec3 oct_decode(vec2 f) {
+    vec3 n = vec3(f, 1.0 - abs(f.x) - abs(f.y));
+    float t = clamp(-n.z, 0.0, 1.0);
+    n.xy += vec2(n.x >= 0.0 ? -t : t, n.y >= 0.0 ? -t : t);
+    return normalize(n);
+}
+
+
+#ifdef LIGHT_VOLUME
+PointLight point_light_fetch(int i) {
+    vec4 position_radius = texelFetch(point_lights, i * 4);
+    vec4 ambient_constant = texelFetch(point_lights, i * 4 + 1);
+    vec4 diffuse_linear = texelFetch(point_lights, i * 4 + 2);
+    vec4 specular_quadratic = texelFetch(point_lights, i * 4 + 3);
+
+    PointLight light;
+    light.position = position_radius.xyz;
+    light.radius = position_radius.w;
+    light.constant = ambient_constant.w;
+    light.linear = diffuse_linear.w;
+    light.quadratic = specular_quadratic.w;
+    light.color = LightColor(ambient_constant.rgb, diffuse_linear.rgb, specular_quadratic.rgb);
+    return light;
+}
+#endif
+
+
+vec3 phong_calc(LightColor light_color, vec3 light_dir, vec3 normal, vec3 view_dir, vec3 albedo, vec3 specular) {
+    vec3 reflect_dir = reflect(light_dir, normal);
+
+    // 漫反射，高光系数：和空间有关的
+    float diff_coef = max(0.0, -dot(normal, light_dir));
+    float spec_coef = pow(max(0.0, -dot(view_dir, reflect_dir)), shininess);
+
+    return light_color.ambient * albedo + light_color.diffuse * diff_coef * albedo
+           + light_color.specular * spec_coef * specular;
+}
+
+
+vec3 dir_light_calc(DirLight light, vec3 normal, vec3 view_dir, vec3 albedo, vec3 specular) {
+    return phong_calc(light.color, normalize(light.direction), normal, view_dir, albedo, specular);
+}
+
+
+vec3 point_light_calc(PointLight light, vec3 position, vec3 normal, vec3 view_dir, vec3 albedo, vec3 specular) {
+    vec3 light_dir = normalize(position - light.position);
+    float distance = length(light.position - position);
+
+    vec3 phong = phong_calc(light.color, light_dir, normal, view_dir, albedo, specular);
+
+    // 随距离衰减的系数；在影响范围的边界平滑地衰减到 0
+    float attenuation_coef = 1.0 / (light.constant + light.linear * distance + light.quadratic * distance * distance);
+    float window = clamp(1.0 - pow(distance / light.radius, 4.0), 0.0, 1.0);
+
+    return phong * attenuation_coef * window * window;
+}
+
+
+vec3 spot_light_calc(SpotLight light, vec3 position, vec3 normal, vec3 view_dir, vec3 albedo, vec3 specular) {
+    vec3 light_dir = normalize(light.direction);
+    float distance = length(light.position - position);
+    float theta = dot(light_dir, normalize(position - light.position));
+
+    vec3 phong = phong_calc(light.color, light_dir, normal, view_dir, albedo, specular);
+
+    float attenuation_dis = 1.0 / (light.constant + light.linear * distance + light.quadratic * distance * distance);
+    float attenuation_angle = clamp((theta - light.outer_cutoff) / (light.inner_cutoff - light.outer_cutoff), 0.0, 1.0);
+
+    return phong * attenuation_dis * attenuation_angle;
+}
@@ -0,0 +1,32 @@
+/**
+ * 延迟渲染的光照 pass
+ *  定义了 LIGHT_VOLUME：点光源的包围球，每个实例对应一个点光源
+ *  否则：覆盖屏幕的三角形，顶点由 gl_VertexID 生成，不需要顶点数据
+ */
+
+#version 330 core
+
+#ifdef LIGHT_VOLUME
+layout (location = 0) in vec3 aPos;
+
+// 点光源：每个光源 4 个 RGBA32F 的纹素，和 main.cpp 中的 GpuPointLight 一致
+uniform samplerBuffer point_lights;
+uniform mat4 view;
+uniform mat4 projection;
+
+flat out int light_index;
+
+// 低精度球体的三角形在单位球的内部，放大之后才能包住整个影响范围
+const float VOLUME_SCALE = 1.11;
+
+void main() {
+    vec4 position_radius = texelFetch(point_lights, gl_InstanceID * 4);
+    light_index = gl_InstanceID;
+    gl_Position = projection * view * vec4(position_radius.xyz + aPos * position_radius.w * VOLUME_SCALE, 1.0);
+}
+#else
+void main() {
+    vec2 p = vec2((gl_VertexID << 1) & 2, gl_VertexID & 2);
+    gl_Position = vec4(p * 2.0 - 1.0, 0.0, 1.0);
+}
+#endif
@@ -0,0 +1,35 @@
+/* 延迟渲染的几何 pass：把表面的属性写入 G-buffer，不计算光照 */
+
+#version 330 core
+
+struct Material {
+    sampler2D texture_diffuse_0;// 物体在漫反射、环境光下的颜色
+    sampler2D texture_specular_0;// 物体高光的颜色
+};
+
+in vec3 FragPos;
+in vec3 Normal;
+in vec2 TexCoord;
+
+layout (location = 0) out vec4 gbuffer_albedo;// rgb 是漫反射的颜色，a 是高光的强度（高光贴图的亮度）
+layout (location = 1) out vec2 gbuffer_normal;// 八面体编码的法线
+
+uniform Material material;
+
+
+/* 八面体编码：单位向量投影到 |x| + |y| + |z| = 1 的八面体上，下半部分翻折到上半部分，得到 [-1, 1] 中的两个分量 */
+vec2 oct_encode(vec3 n) {
+    n /= abs(n.x) + abs(n.y) + abs(n.z);
+    if (n.z < 0.0)
+        n.xy = (1.0 - abs(n.yx)) * vec2(n.x >= 0.0 ? 1.0 : -1.0, n.y >= 0.0 ? 1.0 : -1.0);
+    return n.xy;
+}
+
+
+void main() {
+    vec3 albedo = vec3(texture(material.texture_diffuse_0, TexCoord));
+    vec3 specular = vec3(texture(material.texture_specular_0, TexCoord));
+
+    gbuffer_albedo = vec4(albedo, dot(specular, vec3(0.2126, 0.7152, 0.0722)));
+    gbuffer_normal = oct_encode(normalize(Normal));
+}
@@ -1,9 +1,9 @@
 /* 渲染光源的参考物 */
 
 #version 330 core
-out vec4 FragColor;
+flat in vec3 light_color;
 
-uniform vec3 light_color;
+out vec4 FragColor;
 
 void main()
 {
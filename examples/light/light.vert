@@ -1,14 +1,20 @@
-/* 点光源可视化 */
+/* 点光源可视化：实例化绘制，每个实例对应一个点光源 */
 
 #version 330 core
 layout (location = 0) in vec3 aPos;
 layout (location = 1) in vec3 aNormal;
 layout (location = 2) in vec2 aTexCoord;
 
-uniform mat4 model;
+// 点光源：每个光源 4 个 RGBA32F 的纹素，和 main.cpp 中的 GpuPointLight 一致
+uniform samplerBuffer point_lights;
+uniform float scale;
 uniform mat4 view;
 uniform mat4 projection;
 
+flat out vec3 light_color;
+
 void main() {
-    gl_Position = projection * view * model * vec4(aPos, 1.0);
+    vec3 position = texelFetch(point_lights, gl_InstanceID * 4).xyz;
+    light_color = texelFetch(point_lights, gl_InstanceID * 4 + 2).rgb;
+    gl_Position = projection * view * vec4(position + aPos * scale, 1.0);
 }
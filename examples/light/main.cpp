@@ -1,12 +1,23 @@
 
+#include <array>
+#include <random>
+#include <vector>
 #include <memory>
+#include <mutex>
+#include <cmath>
+#include <cstring>
+#include <algorithm>
 
 #include "engine/render.h"
 #include "engine/scene.h"
 #include "engine/light.h"
 #include "engine/color.h"
+#include "engine/profiler.h"
+#include "engine/render_graph.h"
+#include "engine/dynamic_resolution.h"
 
 #include "assets/obj/cube.h"
+#include "assets/obj/sphere.h"
 #include "config.hpp"
 
 std::string CUR_DIR(const std::string &file_name) {
@@ -14,8 +25,47 @@ std::string CUR_DIR(const std::string &file_name) {
 }
 
 
-/* 多个光源的场景：点光源，聚光 */
+/**
+ * 多个光源的场景：点光源，方向光，聚光；可以切换前向渲染和延迟渲染，点光源可以是场景原有的 5 个，或者 4，64，1024 个
+ *  - 前向渲染：每个片段遍历所有的点光源，包括之后会被覆盖的片段
+ *  - 延迟渲染：几何 pass 只写入 G-buffer（RGBA8 的漫反射颜色和高光强度，RG16F 八面体编码的法线，深度），
+ *    光照 pass 先用全屏的三角形计算方向光和聚光，再实例化绘制点光源的包围球：只有包围球的远端在可见表面之后的像素才计算这个光源，
+ *    光照的开销和可见的像素数 × 影响它的光源数成正比
+ *  - 比较：依次切换到每种配置，统计分析器中着色区段的 GPU 和 CPU 耗时
+ *  - 点光源由模拟线程复制到 FrameSnapshot::lights，渲染线程每一帧从 snapshot 上传到纹理缓冲
+ */
 class SceneLight : public Scene {
+    /* 点光源在纹理缓冲中的布局：每个光源 4 个 RGBA32F 的纹素，和 shader 中的 point_light_fetch() 一致 */
+    struct GpuPointLight {
+        glm::vec4 position_radius;
+        glm::vec4 ambient_constant;
+        glm::vec4 diffuse_linear;
+        glm::vec4 specular_quadratic;
+    };
+    static_assert(sizeof(GpuPointLight) == 64);
+
+    /* 比较的一种配置 */
+    struct Sample {
+        bool deferred;
+        int lights;
+        uint64_t first, last;           // 测量的帧在分析器中的编号
+        bool measured;                  // 已经绘制完测量的帧
+        double gpu_ms, cpu_ms;          // 着色区段平均每帧的耗时，负数表示结果还不可用
+    };
+
+    static constexpr std::array<int, 3> LIGHT_COUNTS{4, 64, 1024};
+
+    /* 比较时每种配置先丢弃 SWEEP_WARMUP 帧，再测量 SWEEP_FRAMES 帧 */
+    static constexpr int SWEEP_WARMUP = 30;
+    static constexpr int SWEEP_FRAMES = 120;
+
+public:
+    ~SceneLight() {
+        glDeleteTextures(1, &light_texture);
+        glDeleteBuffers(1, &light_buffer);
+        glDeleteVertexArrays(1, &vao_empty);
+    }
+
 private:
     void _init() override {
         /* 为模型设置 texture */
@@ -24,27 +74,46 @@ private:
             mesh->add_texture(TextureType::specular, tex_box_specular);
         }
 
+        /* 点光源保存在纹理缓冲中，前向渲染，延迟渲染和光源的模型都从这里读取 */
+        glGenBuffers(1, &light_buffer);
+        glGenTextures(1, &light_texture);
+        glBindBuffer(GL_TEXTURE_BUFFER, light_buffer);
+        glBufferData(GL_TEXTURE_BUFFER, sizeof(GpuPointLight), nullptr, GL_STATIC_DRAW);
+        glBindTexture(GL_TEXTURE_BUFFER, light_texture);
+        glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, light_buffer);
+        glBindTexture(GL_TEXTURE_BUFFER, 0);
+        glBindBuffer(GL_TEXTURE_BUFFER, 0);
+        _lights_generate(light_count);
+
+        /* 全屏的三角形不需要顶点数据，但是 core profile 需要绑定一个 VAO */
+        glGenVertexArrays(1, &vao_empty);
+
         /* 数据绑定 box-shader，每帧，场景 */
         box_shader->set_update_per_frame([this](Shader &shader){
             shader.uniform_vec3_set("eye_pos", Render::camera->position());
             ShaderExtLight::set_spot_light_uniform(shader, this->spot_light, "spot_light");
             shader.uniform_mat4_set("view", Render::camera->view_matrix_get());
             shader.uniform_mat4_set("projection", Render::camera->projection_matrix());
+            shader.uniform_int_set("point_light_count", this->light_drawn);
+        });
+
+        /* 数据绑定 gbuffer-shader：每帧，场景 */
+        gbuffer_shader->set_update_per_frame([](Shader &shader) {
+            shader.uniform_mat4_set("view", Render::camera->view_matrix_get());
+            shader.uniform_mat4_set("projection", Render::camera->projection_matrix());
         });
 
         /* 数据绑定 light-shader：每帧，场景 */
-        light_shader->set_update_per_frame([](Shader &shader){
+        light_shader->set_update_per_frame([this](Shader &shader){
             shader.uniform_mat4_set("view", Render::camera->view_matrix_get());
             shader.uniform_mat4_set("projection", Render::camera->projection_matrix());
+            shader.uniform_float_set("scale", this->light_drawn > (int) point_lights.size() ? 0.1f : 1.f);
         });
 
         /* 数据绑定：常量，box-shader */
         with(Shader, *box_shader) {
-            /* 设置点光源的 uniform 属性 */
-            ShaderExtLight::set_point_light_uniform(*box_shader, point_lights[0], "point_lights[0]");
-            ShaderExtLight::set_point_light_uniform(*box_shader, point_lights[1], "point_lights[1]");
-            ShaderExtLight::set_point_light_uniform(*box_shader, point_lights[2], "point_lights[2]");
-            ShaderExtLight::set_point_light_uniform(*box_shader, point_lights[3], "point_lights[3]");
+            /* 点光源的纹理缓冲在 2 号纹理单元，0，1 号是箱子的纹理 */
+            box_shader->uniform_tex2d_set("point_lights", 2);
 
             /* 设置方向光的 uniform 属性 */
             ShaderExtLight::set_dir_light_uniform(*box_shader, dir_light, "dir_light");
@@ -53,43 +122,113 @@ private:
             ShaderExtLight::set_spot_light_uniform(*box_shader, spot_light, "spot_light");
 
             /* 设置 box 的光滑程度 */
-            this->box_shader->uniform_float_set("material.shininess", 128.f);
+            this->box_shader->uniform_float_set("material.shininess", SHININESS);
+        }
+
+        /* 数据绑定：常量，延迟渲染的光照；G-buffer 在 0，1，2 号纹理单元，点光源在 3 号 */
+        for (auto &shader: {deferred_shader, volume_shader}) {
+            with(Shader, *shader) {
+                shader->uniform_tex2d_set("gbuffer_albedo", 0);
+                shader->uniform_tex2d_set("gbuffer_normal", 1);
+                shader->uniform_tex2d_set("gbuffer_depth", 2);
+                shader->uniform_float_set("shininess", SHININESS);
+            }
+        }
+        with(Shader, *deferred_shader) {
+            ShaderExtLight::set_dir_light_uniform(*deferred_shader, dir_light, "dir_light");
         }
+        volume_shader->uniform_tex2d_set("point_lights", 3);
+        light_shader->uniform_tex2d_set("point_lights", 0);
 
-        /* 数据绑定 box-shader：mesh */
-        box_shader->set_draw([](Shader &shader, const Mesh &mesh) {
+        /* 数据绑定 box-shader 和 gbuffer-shader：mesh */
+        auto box_draw = [](Shader &shader, const Mesh &mesh) {
             shader.uniform_mat4_set("model", mesh.model());
             shader.set_textures(mesh, {
                     {"material.texture_diffuse_0",  TextureType::diffuse,  0},
                     {"material.texture_specular_0", TextureType::specular, 0},
             });
-        });
+        };
+        box_shader->set_draw(box_draw);
+        gbuffer_shader->set_draw(box_draw);
+    }
 
-        /* 数据绑定 light-shader：mesh */
-        light_shader->set_drawT([](Shader &shader, const Mesh &mesh, const glm::vec3 &diffuse) {
-            shader.uniform_mat4_set("model", mesh.model());
-            shader.uniform_vec3_set("light_color", diffuse);
-        });
+    /* 模拟线程：复制这一帧的点光源，渲染线程从 snapshot 中上传 */
+    void _simulate(FrameSnapshot &snapshot) override {
+        std::lock_guard<std::mutex> lock(light_mutex);
+        snapshot.lights.clear();
+        for (const GpuPointLight &light: light_data)
+            snapshot.lights.insert(snapshot.lights.end(), {light.position_radius, light.ambient_constant,
+                                                           light.diffuse_linear, light.specular_quadratic});
     }
 
     void _update() override {
+        _lights_upload(Render::snapshot().lights);
+
         /* 更新场景信息 */
         spot_light.position = Render::camera->position();
         spot_light.direction = Render::camera->front();
 
-        /* shader 同步场景信息 */
-        box_shader->update_per_frame();
-        light_shader->update_per_frame();
+        if (deferred)
+            _deferred_render();
+        else
+            _forward_render();
 
         /* 绘制表示光源的盒子 */
-        withT (ShaderT<glm::vec3>, *light_shader) {
-            for (unsigned i = 0; i < point_light_meshes.size(); ++i) {
-                light_shader->draw_t(*point_light_meshes[i], point_lights[i].color.diffuse);
+        light_shader->update_per_frame();
+        with(Shader, *light_shader) {
+            glActiveTexture(GL_TEXTURE0);
+            glBindTexture(GL_TEXTURE_BUFFER, light_texture);
+            mesh_light->draw(light_drawn);
+        }
+
+        _sweep_update();
+    }
+
+    void _gui() override {
+        ImGui::Begin("light");
+        /* 比较的过程中不能修改配置 */
+        if (sweep_index < 0) {
+            ImGui::Checkbox("deferred", &deferred);
+            ImGui::SameLine();
+            if (ImGui::RadioButton("scene", light_count == (int) point_lights.size()))
+                _lights_generate((int) point_lights.size());
+            for (int count: LIGHT_COUNTS) {
+                ImGui::SameLine();
+                if (ImGui::RadioButton(fmt::format("{}", count).c_str(), light_count == count))
+                    _lights_generate(count);
             }
+            if (ImGui::Button("compare forward / deferred"))
+                _sweep_start();
+        } else {
+            ImGui::Text("measuring %d / %zu ...", sweep_index + 1, samples.size());
+        }
+        for (const Sample &sample: samples) {
+            if (sample.gpu_ms < 0.0)
+                ImGui::Text("%-8s %4d lights: -", sample.deferred ? "deferred" : "forward", sample.lights);
+            else
+                ImGui::Text("%-8s %4d lights: gpu %7.3f ms, cpu %6.3f ms", sample.deferred ? "deferred" : "forward",
+                            sample.lights, sample.gpu_ms, sample.cpu_ms);
         }
+        if (!samples.empty() && (!Profiler::enabled() || Profiler::paused()))
+            ImGui::Text("the profiler must be running to compare.");
+        ImGui::End();
+
+        if (deferred)
+            graph.gui("render graph");
+    }
+
+
+    // =====================================================
+    // 前向渲染
+    // =====================================================
 
-        /* 绘制场景中的箱子 */
+    void _forward_render() {
+        PROFILE_ZONE("forward shading");
+        PROFILE_GPU_ZONE("forward shading");
+        box_shader->update_per_frame();
         with(Shader, *box_shader) {
+            glActiveTexture(GL_TEXTURE2);
+            glBindTexture(GL_TEXTURE_BUFFER, light_texture);
             for (auto &model : this->box_meshes) {
                 box_shader->draw(*model);
             }
@@ -97,14 +236,239 @@ private:
     }
 
 
+    // =====================================================
+    // 延迟渲染：G-buffer 是渲染图的临时纹理，和渲染的分辨率一样大
+    // =====================================================
+
+    void _deferred_render() {
+        graph.reset();
+        GraphTexture albedo, normal, depth;
+
+        /* 几何 pass：只写入表面的属性 */
+        graph.add_pass("gbuffer", [&](RenderGraph::Builder &builder) {
+            albedo = builder.write(builder.create("gbuffer albedo", {GL_RGBA8}), true);
+            normal = builder.write(builder.create("gbuffer normal", {GL_RG16F}), true);
+            depth = builder.write(builder.create("gbuffer depth", {GL_DEPTH24_STENCIL8}), true);
+        }, [this](const RenderGraph::Resources &) {
+            gbuffer_shader->update_per_frame();
+            with(Shader, *gbuffer_shader) {
+                for (auto &model : this->box_meshes) {
+                    gbuffer_shader->draw(*model);
+                }
+            }
+        });
+
+        /* 光照 pass：结果写入屏幕 */
+        graph.add_pass("deferred lighting", [&](RenderGraph::Builder &builder) {
+            builder.read(albedo);
+            builder.read(normal);
+            builder.read(depth);
+            builder.write(graph.backbuffer());
+        }, [&](const RenderGraph::Resources &resources) {
+            glActiveTexture(GL_TEXTURE0);
+            glBindTexture(GL_TEXTURE_2D, resources.texture(albedo));
+            glActiveTexture(GL_TEXTURE1);
+            glBindTexture(GL_TEXTURE_2D, resources.texture(normal));
+            glActiveTexture(GL_TEXTURE2);
+            glBindTexture(GL_TEXTURE_2D, resources.texture(depth));
+            glActiveTexture(GL_TEXTURE3);
+            glBindTexture(GL_TEXTURE_BUFFER, light_texture);
+            _deferred_lighting(resources.width(), resources.height());
+        });
+
+        graph.execute(DynamicResolution::width(), DynamicResolution::height());
+    }
+
+    void _deferred_lighting(int width, int height) {
+        const glm::mat4 view = Render::camera->view_matrix_get();
+        const glm::mat4 projection = Render::camera->projection_matrix();
+        const glm::mat4 inv_view_projection = glm::inverse(projection * view);
+        for (auto &shader: {deferred_shader, volume_shader}) {
+            shader->uniform_mat4_set("inv_view_projection", inv_view_projection);
+            shader->uniform_vec2_set("screen_size", {(float) width, (float) height});
+            shader->uniform_vec3_set("eye_pos", Render::camera->position());
+        }
+
+        /* 方向光和聚光，同时把 G-buffer 的深度写入屏幕：深度测试总是通过 */
+        glDepthFunc(GL_ALWAYS);
+        with(Shader, *deferred_shader) {
+            ShaderExtLight::set_spot_light_uniform(*deferred_shader, spot_light, "spot_light");
+            glBindVertexArray(vao_empty);
+            Mesh::draw_arrays(GL_TRIANGLES, 0, 3);
+            glBindVertexArray(0);
+        }
+
+        /**
+         * 点光源的包围球，结果叠加：只绘制球体的远端（顶点顺序从外面看是顺时针，远端的面朝向摄像机），
+         * 远端在可见表面之前时，表面不在这个光源的范围内，深度测试不通过；摄像机在包围球里面时也是正确的
+         */
+        glDepthFunc(GL_GEQUAL);
+        glDepthMask(GL_FALSE);
+        glEnable(GL_BLEND);
+        glBlendFunc(GL_ONE, GL_ONE);
+        glEnable(GL_CULL_FACE);
+        glCullFace(GL_BACK);
+        with(Shader, *volume_shader) {
+            volume_shader->uniform_mat4_set("view", view);
+            volume_shader->uniform_mat4_set("projection", projection);
+            light_volume->draw(light_drawn);
+        }
+        glDisable(GL_CULL_FACE);
+        glDisable(GL_BLEND);
+        glDepthMask(GL_TRUE);
+        glDepthFunc(GL_LESS);
+    }
+
+
+    // =====================================================
+    // 光源
+    // =====================================================
+
+    /* 先取场景原有的点光源，其余的随机分布在箱子周围：数量越多，影响范围越小，每个位置受到的光源数差不多 */
+    void _lights_generate(int count) {
+        std::vector<GpuPointLight> lights;
+        for (int i = 0; i < count && i < (int) point_lights.size(); ++i) {
+            const PointLight &light = point_lights[i];
+            const AttenuationCoeffDistance &a = light.attenuation;
+            lights.push_back({{light.position, light.range()}, {light.color.ambient, a.constant},
+                              {light.color.diffuse, a.linear}, {light.color.specular, a.quadratic}});
+        }
+
+        std::mt19937 random(2021);          // 固定的种子，每次运行的光源都一样
+        std::uniform_real_distribution<float> unit(0.f, 1.f);
+        const float radius = 4.f * std::cbrt(64.f / (float) count);
+        for (int i = (int) lights.size(); i < count; ++i) {
+            glm::vec3 position = LIGHT_MIN + (LIGHT_MAX - LIGHT_MIN) * glm::vec3(unit(random), unit(random), unit(random));
+
+            /* 饱和的颜色：色相随机 */
+            const float hue = unit(random) * 6.f;
+            glm::vec3 color;
+            for (int c = 0; c < 3; ++c)
+                color[c] = std::clamp(std::abs(std::fmod(hue + (float) ((6 - 2 * c) % 6), 6.f) - 3.f) - 1.f, 0.f, 1.f);
+            lights.push_back({{position, radius}, {glm::vec3(0.f), 1.f}, {color, 0.f},
+                              {color, 4.f / (radius * radius)}});
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(light_mutex);
+            light_data = std::move(lights);
+        }
+        light_count = count;
+    }
+
+    /* 渲染线程：把这一帧的点光源（每个光源 4 个 vec4，见 GpuPointLight）写入纹理缓冲，数量改变时重新分配 */
+    void _lights_upload(const std::vector<glm::vec4> &lights) {
+        if (lights.empty())
+            return;
+        const auto count = (int) (lights.size() / 4);
+        const auto size = (GLsizeiptr) (lights.size() * sizeof(glm::vec4));
+        glBindBuffer(GL_TEXTURE_BUFFER, light_buffer);
+        if (count != light_drawn)
+            glBufferData(GL_TEXTURE_BUFFER, size, lights.data(), GL_DYNAMIC_DRAW);
+        else
+            glBufferSubData(GL_TEXTURE_BUFFER, 0, size, lights.data());
+        glBindBuffer(GL_TEXTURE_BUFFER, 0);
+        light_drawn = count;
+    }
+
+
+    // =====================================================
+    // 比较前向渲染和延迟渲染
+    // =====================================================
+
+    void _sweep_start() {
+        samples.clear();
+        for (int count: LIGHT_COUNTS) {
+            samples.push_back({false, count, 0, 0, false, -1.0, -1.0});
+            samples.push_back({true, count, 0, 0, false, -1.0, -1.0});
+        }
+        sweep_restore = {deferred, light_count};
+        sweep_index = 0;
+        sweep_frame = 0;
+        _sweep_apply();
+    }
+
+    void _sweep_apply() {
+        deferred = samples[sweep_index].deferred;
+        if (light_count != samples[sweep_index].lights)
+            _lights_generate(samples[sweep_index].lights);
+    }
+
+    /* 在每一帧绘制之后调用：记录测量的帧，统计 GPU 结果已经可用的配置 */
+    void _sweep_update() {
+        _sweep_resolve();
+        if (sweep_index < 0)
+            return;
+
+        Sample &sample = samples[sweep_index];
+        if (sweep_frame == SWEEP_WARMUP)
+            sample.first = Profiler::frame_index();
+        if (++sweep_frame < SWEEP_WARMUP + SWEEP_FRAMES)
+            return;
+        sample.last = Profiler::frame_index();
+        sample.measured = true;
+
+        sweep_frame = 0;
+        if (++sweep_index < (int) samples.size()) {
+            _sweep_apply();
+            return;
+        }
+        sweep_index = -1;
+        deferred = sweep_restore.first;
+        _lights_generate(sweep_restore.second);
+    }
+
+    /* 着色区段：前向渲染是一个区段，延迟渲染是渲染图中的两个 pass */
+    static bool _shading_zone(const char *name) {
+        return std::strcmp(name, "forward shading") == 0 || std::strcmp(name, "gbuffer") == 0 ||
+               std::strcmp(name, "deferred lighting") == 0;
+    }
+
+    void _sweep_resolve() {
+        const auto &frames = Profiler::frames();
+        for (Sample &sample: samples) {
+            if (!sample.measured || sample.gpu_ms >= 0.0 || frames.empty() || frames.back().index < sample.last)
+                continue;
+            /* 帧的编号可能不连续，按编号查找；已经不在历史中的帧不再等待 */
+            if (const ProfileFrame *last = Profiler::frame_find(sample.last); last && !last->gpu_resolved)
+                continue;
+
+            /* GPU 的结果被丢弃的帧不计入 */
+            double gpu_ms = 0.0, cpu_ms = 0.0;
+            int count = 0;
+            for (const ProfileFrame &frame: frames) {
+                if (frame.index < sample.first || frame.index > sample.last || frame.gpu.empty())
+                    continue;
+                for (const ProfileEvent &event: frame.gpu)
+                    if (_shading_zone(event.name))
+                        gpu_ms += (double) (event.end_ns - event.begin_ns) / 1e6;
+                for (const ProfileEvent &event: frame.cpu)
+                    if (_shading_zone(event.name))
+                        cpu_ms += (double) (event.end_ns - event.begin_ns) / 1e6;
+                ++count;
+            }
+            sample.gpu_ms = gpu_ms / std::max(1, count);
+            sample.cpu_ms = cpu_ms / std::max(1, count);
+            SPDLOG_INFO("{} {} lights: gpu {:.3f} ms, cpu {:.3f} ms ({} frames)", sample.deferred ? "deferred" : "forward",
+                        sample.lights, sample.gpu_ms, sample.cpu_ms, count);
+        }
+    }
+
+
 private:
+    static constexpr float SHININESS = 128.f;
+
+    /* 随机光源的分布范围，包住所有的箱子 */
+    inline static const glm::vec3 LIGHT_MIN{-6.f, -5.f, -17.f};
+    inline static const glm::vec3 LIGHT_MAX{6.f, 7.f, 3.f};
+
     /* 光源随距离衰减的系数 */
     AttenuationCoeffDistance attenuation{1.f, 0.09f, 0.032f};
 
     /* 环境光的属性 */
     glm::vec3 ambient{0.05f, 0.05f, 0.05f};
 
-    /* 所有的点光源 */
+    /* 场景原有的点光源 */
     std::vector<PointLight> point_lights{
             {{ambient, Color::aquamarine2,    Color::white}, glm::vec3(0.7f, 0.2f, 2.0f),    attenuation},
             {{ambient, Color::rosy_brown,     Color::white}, glm::vec3(2.3f, -3.3f, -4.0f),  attenuation},
@@ -113,14 +477,18 @@ private:
             {{ambient, Color::deep_sky_blue2, Color::white}, glm::vec3(0.0f, 0.0f, -7.0f),   attenuation},
     };
 
-    /* 点光源对应的模型 */
-    std::vector<std::shared_ptr<Mesh>> point_light_meshes{
-            std::make_shared<Mesh>(cube_pnt_0_5, point_lights[0].position),
-            std::make_shared<Mesh>(cube_pnt_0_5, point_lights[1].position),
-            std::make_shared<Mesh>(cube_pnt_0_5, point_lights[2].position),
-            std::make_shared<Mesh>(cube_pnt_0_5, point_lights[3].position),
-            std::make_shared<Mesh>(cube_pnt_0_5, point_lights[4].position),
-    };
+    /* 纹理缓冲中的点光源 */
+    GLuint light_buffer{0};
+    GLuint light_texture{0};
+    int light_count{(int) point_lights.size()};        // 选择的点光源数量
+    int light_drawn{0};                                 // 纹理缓冲中的点光源数量，来自这一帧的 snapshot
+
+    /* 选择的点光源，_lights_generate() 写入，模拟线程复制到 snapshot.lights */
+    std::mutex light_mutex;
+    std::vector<GpuPointLight> light_data;
+
+    /* 点光源的模型，实例化绘制 */
+    std::shared_ptr<Mesh> mesh_light = std::make_shared<Mesh>(cube_pnt_0_5);
 
     /* 方向光 */
     DirLight dir_light{{ambient, Color::gray41, Color::white}, glm::vec3(-0.2f, -1.0f, -0.3f)};
@@ -132,7 +500,9 @@ private:
                          glm::cos(glm::radians(17.5f))};
 
     std::shared_ptr<Texture2D> tex_box_diffuse = std::make_shared<Texture2D>(TEXTURE("container2.jpg"));
-    std::shared_ptr<Texture2D> tex_box_specular = std::make_shared<Texture2D>(TEXTURE("container2_specular.jpg"));
+    std::shared_ptr<Texture2D> tex_box_specular = std::make_shared<Texture2D>(
+            TEXTURE("container2_specular.jpg"), TextureWrap::REPEAT, TextureColorFormat::Auto, true, false,
+            texture_type_srgb(TextureType::specular));
 
     /* 场景中的模型 */
     std::vector<std::shared_ptr<Mesh>> box_meshes{
@@ -148,17 +518,33 @@ private:
             std::make_shared<Mesh>(cube_pnt_0_5, glm::vec3(-1.3f, 1.0f, -1.5f))
     };
 
-    /* 用于渲染 box 的着色器 */
+    /* 前向渲染箱子的着色器 */
     std::shared_ptr<Shader> box_shader = std::make_shared<Shader>(CUR_DIR("phong.vert"), CUR_DIR("phong.frag"));
 
+    /* 延迟渲染：几何 pass，全屏的光照 pass，点光源包围球的光照 pass */
+    bool deferred{false};
+    RenderGraph graph;
+    GLuint vao_empty{0};
+    std::shared_ptr<Shader> gbuffer_shader = std::make_shared<Shader>(CUR_DIR("phong.vert"), CUR_DIR("gbuffer.frag"));
+    std::shared_ptr<Shader> deferred_shader = std::make_shared<Shader>(CUR_DIR("deferred.vert"),
+                                                                       CUR_DIR("deferred.frag"));
+    std::shared_ptr<Shader> volume_shader = std::make_shared<Shader>(CUR_DIR("deferred.vert"), CUR_DIR("deferred.frag"),
+                                                                     std::vector<std::string>{"LIGHT_VOLUME"});
+    std::shared_ptr<Sphere> light_volume = std::make_shared<Sphere>(16, 8);
+
     /* 用于渲染点光源的 shader */
-    std::shared_ptr<ShaderT<glm::vec3>> light_shader = std::make_shared<ShaderT<glm::vec3>>(CUR_DIR("light.vert"),
-                                                                                            CUR_DIR("light.frag"));
+    std::shared_ptr<Shader> light_shader = std::make_shared<Shader>(CUR_DIR("light.vert"), CUR_DIR("light.frag"));
+
+    /* 比较的结果；sweep_index 是正在测量的配置，-1 表示没有在比较 */
+    std::vector<Sample> samples;
+    int sweep_index{-1};
+    int sweep_frame{0};
+    std::pair<bool, int> sweep_restore{false, 4};
 };
 
 
-int main() {
-    Render::init();
+int main(int argc, char **argv) {
+    Render::init(RenderOptions::parse(argc, argv));
     Render::render<SceneLight>();
     Render::terminate();
     return 0;
@@ -7,9 +7,10 @@ struct LightColor {
     vec3 specular;
 };
 
-/* 点光源 */
+/* 点光源，从纹理缓冲中读取，见 point_light_fetch() */
 struct PointLight {
     vec3 position;
+    float radius;// 影响范围，超出之后不计算
 
 // 点光源随距离衰减的系数
     float constant;
@@ -64,41 +65,46 @@ out vec4 FragColor;
 uniform vec3 eye_pos;// 观察者的位置
 uniform Material material;
 
-#define CNT_LIGHT_POINT 4
-uniform PointLight point_lights[CNT_LIGHT_POINT];
+// 点光源：每个光源 4 个 RGBA32F 的纹素，和 main.cpp 中的 GpuPointLight 一致
+uniform samplerBuffer point_lights;
+uniform int point_light_count;
 uniform DirLight dir_light;
 uniform SpotLight spot_light;
 
 
 // 函数定义 =======================================================================
+/* 从纹理缓冲中读取第 i 个点光源 */
+PointLight point_light_fetch(int i);
+
 /**
  * 计算 phong 光照
  * @param light_dir 光线方向，单位向量
  * @param normal 片段的法线方向，单位向量
  * @param view_dir 视线方向，单位向量
+ * @param albedo, specular 漫反射和高光的颜色，每个片段只采样一次
  */
-vec3 phong_calc(LightColor light_color, vec3 light_dir, vec3 normal, vec3 view_dir);
+vec3 phong_calc(LightColor light_color, vec3 light_dir, vec3 normal, vec3 view_dir, vec3 albedo, vec3 specular);
 
 /**
  * 计算定向光的光照
  * @param normal 片段的法线，单位向量
  * @param view_dir 视线，单位向量
  */
-vec3 dir_light_calc(DirLight light, vec3 normal, vec3 view_dir);
+vec3 dir_light_calc(DirLight light, vec3 normal, vec3 view_dir, vec3 albedo, vec3 specular);
 
 /**
  * 计算点光源的光照
  * @param normal 片段的法线，单位向量
  * @param view_dir 视线，单位向量
  */
-vec3 point_light_calc(PointLight light, vec3 normal, vec3 view_dir);
+vec3 point_light_calc(PointLight light, vec3 normal, vec3 view_dir, vec3 albedo, vec3 specular);
 
 /**
  * 计算聚光的光照
  * @param normal 片段的法线，单位向量
  * @param view_dir 视线，单位向量
  */
-vec3 spot_light_calc(SpotLight light, vec3 normal, vec3 view_dir);
+vec3 spot_light_calc(SpotLight light, vec3 normal, vec3 view_dir, vec3 albedo, vec3 specular);
 
 
 // ============================================================================
@@ -107,17 +113,24 @@ void main()
     vec3 norm = normalize(Normal);
     vec3 view_dir = normalize(FragPos - eye_pos);
 
+    vec3 albedo = vec3(texture(material.texture_diffuse_0, TexCoord));
+    vec3 specular = vec3(texture(material.texture_specular_0, TexCoord));
+
     vec3 result = vec3(0, 0, 0);
 
     // 计算定向光照
-    result += dir_light_calc(dir_light, norm, view_dir);
+    result += dir_light_calc(dir_light, norm, view_dir, albedo, specular);
 
-    // 计算所有的点光
-    for (int i = 0; i < CNT_LIGHT_POINT; ++i)
-        result += point_light_calc(point_lights[i], norm, view_dir);
+    // 计算所有的点光：前向渲染中每个片段都要遍历所有的点光源，包括之后会被覆盖的片段
+    for (int i = 0; i < point_light_count; ++i) {
+        vec4 position_radius = texelFetch(point_lights, i * 4);
+        if (distance(position_radius.xyz, FragPos) >= position_radius.w)
+            continue;
+        result += point_light_calc(point_light_fetch(i), norm, view_dir, albedo, specular);
+    }
 
     // 计算聚光
-    result += spot_light_calc(spot_light, norm, view_dir);
+    result += spot_light_calc(spot_light, norm, view_dir, albedo, specular);
 
     // 最终颜色
     FragColor = vec4(result, 1.0);
@@ -125,7 +138,24 @@ void main()
 
 
 // 函数实现 =======================================================================
-vec3 phong_calc(LightColor light_color, vec3 light_dir, vec3 normal, vec3 view_dir) {
+PointLight point_light_fetch(int i) {
+    vec4 position_radius = texelFetch(point_lights, i * 4);
+    vec4 ambient_constant = texelFetch(point_lights, i * 4 + 1);
+    vec4 diffuse_linear = texelFetch(point_lights, i * 4 + 2);
+    vec4 specular_quadratic = texelFetch(point_lights, i * 4 + 3);
+
+    PointLight light;
+    light.position = position_radius.xyz;
+    light.radius = position_radius.w;
+    light.constant = ambient_constant.w;
+    light.linear = diffuse_linear.w;
+    light.quadratic = specular_quadratic.w;
+    light.color = LightColor(ambient_constant.rgb, diffuse_linear.rgb, specular_quadratic.rgb);
+    return light;
+}
+
+
+vec3 phong_calc(LightColor light_color, vec3 light_dir, vec3 normal, vec3 view_dir, vec3 albedo, vec3 specular) {
     vec3 reflect_dir = reflect(light_dir, normal);
 
     // 漫反射，高光系数：和空间有关的
@@ -133,42 +163,40 @@ vec3 phong_calc(LightColor light_color, vec3 light_dir, vec3 normal, vec3 view_d
     float spec_coef = pow(max(0.0, -dot(view_dir, reflect_dir)), material.shininess);
 
     // 环境、漫反射、高光颜色
-    vec3 ambient = light_color.ambient * vec3(texture(material.texture_diffuse_0, TexCoord));
-    vec3 diffuse = light_color.diffuse * diff_coef * vec3(texture(material.texture_diffuse_0, TexCoord));
-    vec3 specular = light_color.specular * spec_coef * vec3(texture(material.texture_specular_0, TexCoord));
-
-    return (ambient + diffuse + specular);
+    return light_color.ambient * albedo + light_color.diffuse * diff_coef * albedo
+           + light_color.specular * spec_coef * specular;
 }
 
 
-vec3 dir_light_calc(DirLight light, vec3 normal, vec3 view_dir) {
+vec3 dir_light_calc(DirLight light, vec3 normal, vec3 view_dir, vec3 albedo, vec3 specular) {
     vec3 light_dir = normalize(light.direction);
 
-    vec3 phong = phong_calc(light.color, light_dir, normal, view_dir);
+    vec3 phong = phong_calc(light.color, light_dir, normal, view_dir, albedo, specular);
 
     return phong;
 }
 
 
-vec3 point_light_calc(PointLight light, vec3 normal, vec3 view_dir) {
+vec3 point_light_calc(PointLight light, vec3 normal, vec3 view_dir, vec3 albedo, vec3 specular) {
     vec3 light_dir = normalize(FragPos - light.position);
     float distance = length(light.position - FragPos);
 
-    vec3 phong = phong_calc(light.color, light_dir, normal, view_dir);
+    vec3 phong = phong_calc(light.color, light_dir, normal, view_dir, albedo, specular);
 
-    // 随距离衰减的系数
+    // 随距离衰减的系数；在影响范围的边界平滑地衰减到 0
     float attenuation_coef = 1.0 / (light.constant + light.linear * distance + light.quadratic * distance * distance);
+    float window = clamp(1.0 - pow(distance / light.radius, 4.0), 0.0, 1.0);
 
-    return phong * attenuation_coef;
+    return phong * attenuation_coef * window * window;
 }
 
 
-vec3 spot_light_calc(SpotLight light, vec3 normal, vec3 view_dir) {
+vec3 spot_light_calc(SpotLight light, vec3 normal, vec3 view_dir, vec3 albedo, vec3 specular) {
     vec3 light_dir = normalize(light.direction);
     float distance = length(light.position - FragPos);
     float theta = dot(light_dir, normalize(FragPos - light.position));
 
-    vec3 phong = phong_calc(light.color, light_dir, normal, view_dir);
+    vec3 phong = phong_calc(light.color, light_dir, normal, view_dir, albedo, specular);
 
     float attenuation_dis = 1.0 / (light.constant + light.linear * distance + light.quadratic * distance * distance);
     float attenuation_angle = clamp((theta - light.outer_cutoff) / (light.inner_cutoff - light.outer_cutoff), 0.0, 1.0);
@@ -5,7 +5,10 @@
 #include "engine/model.h"
 #include "engine/shader.h"
 #include "engine/texture.h"
+#include "engine/texture_stream.h"
+#include "engine/texture_upload.h"
 #include "engine/render.h"
+#include "engine/utils/stopwatch.h"
 
 #include "config.hpp"
 
@@ -15,12 +18,90 @@ std::string CUR_DIR(const std::string &file_name) {
 }
 
 
+/**
+ * 静态分发数据绑定的 shader：uniform location 在构造时缓存，绑定函数可以被内联到绘制循环中
+ * texture_array 模式下，模型以纹理数组导入，所有 mesh 共用一组纹理，每个 mesh 只需要切换材质的参数块
+ */
+class TexShader : public ShaderPass<TexShader> {
+public:
+    TexShader(const std::string &vertex, const std::string &fragment, bool texture_array = false)
+            : ShaderPass(vertex, fragment, texture_array ? std::vector<std::string>{"TEXTURE_ARRAY"}
+                                                         : std::vector<std::string>{}),
+              _texture_array(texture_array),
+              _loc_model(_uniform_location_get("model")) {
+
+        /* 采样器和纹理单元的对应关系由材质决定，只需要设置一次 */
+        uniform_tex2d_set("material.texture_diffuse_0", (GLint) Material::texture_unit(TextureType::diffuse));
+        uniform_tex2d_set("material.texture_specular_0", (GLint) Material::texture_unit(TextureType::specular));
+        if (_texture_array) {
+            uniform_block("MaterialBlock", UniformBlockBinding::material);
+            _no_layers->params_set(TextureLayers{});
+        }
+    }
+
+    inline void bind(const Model &model, const Mesh &mesh) {
+        glUniformMatrix4fv(_loc_model, 1, GL_FALSE, glm::value_ptr(model.model()));
+
+        /* 没有材质的 mesh 使用所有层都是 -1 的参数块，不能沿用上一个 mesh 的层 */
+        const auto &material = mesh.material();
+        if (material == nullptr) {
+            if (_texture_array)
+                _no_layers->bind_params();
+            return;
+        }
+
+        /* 纹理数组中的层由参数块指定 */
+        if (_texture_array)
+            material->bind_params();
+
+        /* mesh 已经按材质排序，和上一个 mesh 的材质相同时不需要重新绑定纹理 */
+        if (material->id() == _last_material)
+            return;
+        material->bind_textures();
+        _last_material = material->id();
+    }
+
+    /* 每一帧开始时调用，因为其他的绘制可能改变了纹理单元 */
+    inline void reset_material() { _last_material = 0; }
+
+private:
+    bool _texture_array;
+    GLint _loc_model;
+    uint64_t _last_material{0};
+
+    /* 纹理数组模式下，没有材质的 mesh 使用的参数块：没有任何纹理 */
+    std::shared_ptr<Material> _no_layers = MaterialManager::material_create(std::vector<MaterialTexture>{},
+                                                                                 sizeof(TextureLayers));
+};
+
+
+/* 绘制的方式，用于对比每个 mesh 的提交耗时 */
+enum DrawMode {
+    DrawFunction = 0,           // std::function 的数据绑定
+    DrawStatic = 1,             // 静态分发的数据绑定
+    DrawTextureArray = 2,       // 静态分发 + 纹理数组
+};
+
+
 /* 纳米装甲模型的场景 */
 class SceneNano : public Scene {
 private:
     std::shared_ptr<Model> model_nano = Model::load_model(MODEL("nanosuit/nanosuit.obj"));
     std::shared_ptr<Shader> tex_shader = std::make_shared<Shader>(CUR_DIR("tex.vert"),
                                                                   CUR_DIR("tex.frag"));
+    std::shared_ptr<TexShader> tex_shader_static = std::make_shared<TexShader>(CUR_DIR("tex.vert"),
+                                                                               CUR_DIR("tex.frag"));
+
+    /* 以纹理数组的方式导入的模型 */
+    std::shared_ptr<Model> model_nano_array = Model::load_model(MODEL("nanosuit/nanosuit.obj"), true);
+    std::shared_ptr<TexShader> tex_shader_array = std::make_shared<TexShader>(CUR_DIR("tex.vert"),
+                                                                              CUR_DIR("tex.frag"), true);
+
+    /* 对比几种数据绑定方式下，每个 mesh 的提交耗时（CPU） */
+    int draw_mode = DrawStatic;
+    Stopwatch stopwatch_function;
+    Stopwatch stopwatch_static;
+    Stopwatch stopwatch_array;
 
     void _init() override {
         /* shader 和 mesh 的数据绑定 */
@@ -33,24 +114,94 @@ private:
         });
 
         /* 场景数据绑定：tex_shader */
-        tex_shader->set_update_per_frame([](Shader &shader) {
+        auto update_camera = [](Shader &shader) {
             shader.uniform_mat4_set("view", Render::camera->view_matrix_get());
             shader.uniform_mat4_set("projection", Render::camera->projection_matrix());
-        });
+        };
+        tex_shader->set_update_per_frame(update_camera);
+        tex_shader_static->set_update_per_frame(update_camera);
+        tex_shader_array->set_update_per_frame(update_camera);
     }
 
     void _update() override {
-        tex_shader->update_per_frame();
+        auto mesh_cnt = (unsigned) model_nano->meshes().size();
 
-        with(Shader, *tex_shader) {
-            tex_shader->draw(*model_nano);
+        switch (draw_mode) {
+            case DrawStatic:
+                tex_shader_static->update_per_frame();
+                tex_shader_static->reset_material();
+                stopwatch_static.start();
+                tex_shader_static->draw_pass(*model_nano);
+                stopwatch_static.stop(mesh_cnt);
+                break;
+            case DrawTextureArray:
+                tex_shader_array->update_per_frame();
+                tex_shader_array->reset_material();
+                stopwatch_array.start();
+                tex_shader_array->draw_pass(*model_nano_array);
+                stopwatch_array.stop(mesh_cnt);
+                break;
+            default:
+                tex_shader->update_per_frame();
+                stopwatch_function.start();
+                with(Shader, *tex_shader) {
+                    tex_shader->draw(*model_nano);
+                }
+                stopwatch_function.stop(mesh_cnt);
+                break;
         }
     }
+
+    void _gui() override {
+        ImGui::Begin("draw submission");
+        ImGui::RadioButton("std::function", &draw_mode, DrawFunction);
+        ImGui::RadioButton("static (CRTP)", &draw_mode, DrawStatic);
+        ImGui::RadioButton("texture array", &draw_mode, DrawTextureArray);
+        ImGui::Text("std::function: %.3f us/mesh", stopwatch_function.average_us());
+        ImGui::Text("static (CRTP): %.3f us/mesh", stopwatch_static.average_us());
+        ImGui::Text("texture array: %.3f us/mesh", stopwatch_array.average_us());
+        if (ImGui::Button("reset")) {
+            stopwatch_function.reset();
+            stopwatch_static.reset();
+            stopwatch_array.reset();
+        }
+        ImGui::End();
+
+        /* 纹理缓存的统计 */
+        auto stats = TextureManager::stats();
+        ImGui::Begin("texture cache");
+        ImGui::Text("textures: %zu, resident: %.1f / %.1f MB", stats.textures,
+                    (double) stats.resident_bytes / 1048576.0, (double) stats.budget_bytes / 1048576.0);
+        ImGui::Text("hits: %zu, misses: %zu, evictions: %zu", stats.hits, stats.misses, stats.evictions);
+        if (ImGui::SliderInt("budget (MB)", &texture_budget_mb, 16, 1024))
+            TextureManager::budget_set((size_t) texture_budget_mb << 20);
+
+        /* 纹理流送：驻留的 mip 和全部驻留时的显存 */
+        auto stream_stats = TextureStreamer::stats();
+        ImGui::Text("streamed: %zu, resident: %.1f / %.1f MB", stream_stats.textures,
+                    (double) stream_stats.resident_bytes / 1048576.0, (double) stream_stats.full_bytes / 1048576.0);
+        ImGui::Text("loads: %zu, drops: %zu, pending: %zu", stream_stats.loads, stream_stats.drops,
+                    stream_stats.pending);
+        ImGui::Text("decoded cache: %.1f MB, hits: %zu, misses: %zu", (double) stream_stats.decoded_bytes / 1048576.0,
+                    stream_stats.decode_hits, stream_stats.decode_misses);
+
+        /* PBO 上传：排队的数据，上一帧上传的数据和预算 */
+        auto upload_stats = TextureUploader::stats();
+        ImGui::Text("upload queued: %zu jobs, %.1f MB", upload_stats.queued_jobs,
+                    (double) upload_stats.queued_bytes / 1048576.0);
+        ImGui::Text("upload last frame: %.1f / %.1f MB, pbo: %zu, %.1f MB",
+                    (double) upload_stats.frame_bytes / 1048576.0,
+                    (double) TextureUploader::frame_budget() / 1048576.0, upload_stats.buffers,
+                    (double) upload_stats.pool_bytes / 1048576.0);
+        ImGui::End();
+    }
+
+    int texture_budget_mb = (int) (TextureManager::stats().budget_bytes >> 20);
 };
 
 
-int main() {
-    Render::init();
+int main(int argc, char **argv) {
+    Render::init(RenderOptions::parse(argc, argv));
     Render::render<SceneNano>();
     Render::terminate();
     return 0;
@@ -2,12 +2,30 @@
 
 #version 330 core
 
+#ifdef TEXTURE_ARRAY
+/* 整个模型的纹理都在纹理数组中，当前 mesh 使用哪一层由材质的参数块决定 */
+struct Material {
+    sampler2DArray texture_diffuse_0;
+    sampler2DArray texture_specular_0;
+};
+
+/* x: diffuse，y: specular，z: normal；-1 表示没有这种纹理 */
+layout (std140) uniform MaterialBlock {
+    ivec4 layers;
+};
+
+/* diffuse 的纹理数组是 GL_SRGB8_ALPHA8，采样得到线性的颜色；重新编码为 sRGB，和其他绘制方式的输出一致 */
+vec3 srgb_encode(vec3 linear) {
+    return mix(linear * 12.92, 1.055 * pow(linear, vec3(1.0 / 2.4)) - 0.055, step(vec3(0.0031308), linear));
+}
+#else
 struct Material {
     sampler2D texture_diffuse_0;// 物体在漫反射、环境光下的颜色
     sampler2D texture_specular_0;// 物体高光的颜色
 
     float shininess;// 反光度，影响高光光斑的大小
 };
+#endif
 
 in vec3 FragPos;
 in vec3 Normal;
@@ -19,8 +37,14 @@ uniform Material material;
 
 void main()
 {
+#ifdef TEXTURE_ARRAY
+    vec4 diffuse = layers.x < 0 ? vec4(0.0) : texture(material.texture_diffuse_0, vec3(TexCoord, layers.x));
+    diffuse.rgb = srgb_encode(diffuse.rgb);
+    vec4 specular = layers.y < 0 ? vec4(0.0) : texture(material.texture_specular_0, vec3(TexCoord, layers.y));
+#else
     vec4 diffuse = texture(material.texture_diffuse_0, TexCoord);
     vec4 specular = texture(material.texture_specular_0, TexCoord);
+#endif
 
     FragColor = diffuse + specular * 1.f;
 }
@@ -139,8 +139,8 @@ private:
 };
 
 
-int main() {
-    Render::init();
+int main(int argc, char **argv) {
+    Render::init(RenderOptions::parse(argc, argv));
     Render::render<SceneNormalVisualize>();
     Render::terminate();
     return 0;
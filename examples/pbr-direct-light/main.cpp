@@ -132,10 +132,13 @@ private:
                                                                           std::vector<std::string>{"MATERIAL_TEXTURE"});
 
     std::shared_ptr<Texture2D> tex_albedo = std::make_shared<Texture2D>(TEXTURE("pbr_ball/rustediron2_basecolor.png"));
+    /* 金属度和粗糙度是线性的数据 */
     std::shared_ptr<Texture2D> tex_metalness = std::make_shared<Texture2D>(
-            TEXTURE("pbr_ball/rustediron2_metallic.png"));
+            TEXTURE("pbr_ball/rustediron2_metallic.png"), TextureWrap::REPEAT, TextureColorFormat::Auto, true, false,
+            false);
     std::shared_ptr<Texture2D> tex_roughness = std::make_shared<Texture2D>(
-            TEXTURE("pbr_ball/rustediron2_roughness.png"));
+            TEXTURE("pbr_ball/rustediron2_roughness.png"), TextureWrap::REPEAT, TextureColorFormat::Auto, true, false,
+            false);
 
     glm::vec3 ambient{0.2f};
 
@@ -146,8 +149,8 @@ private:
 };
 
 
-int main() {
-    Render::init();
+int main(int argc, char **argv) {
+    Render::init(RenderOptions::parse(argc, argv));
     Render::render<ScenePbrDL>();
     Render::terminate();
     return 0;
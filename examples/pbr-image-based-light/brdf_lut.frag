@@ -0,0 +1,65 @@
+/* 预计算 PBR 的镜面反射部分（split sum 的第二项）：x 是 dot(N, V)，y 是 GGX 的 alpha，结果是 F0 的缩放和偏移 */
+
+#version 330 core
+
+in vec2 TexCoord;
+out vec4 FragColor;
+
+const float PI = 3.14159265359;
+const uint SAMPLE_COUNT = 1024u;
+
+
+float radical_inverse_VdC(uint bits) {
+    bits = (bits << 16u) | (bits >> 16u);
+    bits = ((bits & 0x55555555u) << 1u) | ((bits & 0xAAAAAAAAu) >> 1u);
+    bits = ((bits & 0x33333333u) << 2u) | ((bits & 0xCCCCCCCCu) >> 2u);
+    bits = ((bits & 0x0F0F0F0Fu) << 4u) | ((bits & 0xF0F0F0F0u) >> 4u);
+    bits = ((bits & 0x00FF00FFu) << 8u) | ((bits & 0xFF00FF00u) >> 8u);
+    return float(bits) * 2.3283064365386963e-10;
+}
+
+vec2 hammersley(uint i, uint n) {
+    return vec2(float(i) / float(n), radical_inverse_VdC(i));
+}
+
+/* 切线空间中，按照 GGX 的法线分布采样半程向量 */
+vec3 importance_sample_GGX(vec2 xi, float a) {
+    float phi = 2.0 * PI * xi.x;
+    float cos_theta = sqrt((1.0 - xi.y) / (1.0 + (a * a - 1.0) * xi.y));
+    float sin_theta = sqrt(1.0 - cos_theta * cos_theta);
+    return vec3(cos(phi) * sin_theta, sin(phi) * sin_theta, cos_theta);
+}
+
+/* 和 ibl_ambient.frag 一致的几何函数；IBL 使用 k = alpha^2 / 2 */
+float geometry_Schlick_GGX(float ndotv, float k) {
+    return ndotv / (ndotv * (1.0 - k) + k);
+}
+
+
+void main() {
+    float ndotv = max(TexCoord.x, 0.001);
+    float alpha = TexCoord.y;
+    float k = alpha * alpha / 2.0;
+
+    vec3 V = vec3(sqrt(1.0 - ndotv * ndotv), 0.0, ndotv);
+    float scale = 0.0;
+    float bias = 0.0;
+    for (uint i = 0u; i < SAMPLE_COUNT; ++i) {
+        vec3 H = importance_sample_GGX(hammersley(i, SAMPLE_COUNT), alpha);
+        vec3 L = normalize(2.0 * dot(V, H) * H - V);
+
+        float ndotl = max(L.z, 0.0);
+        float ndoth = max(H.z, 0.0);
+        float vdoth = max(dot(V, H), 0.0);
+        if (ndotl <= 0.0)
+            continue;
+
+        float G = geometry_Schlick_GGX(ndotv, k) * geometry_Schlick_GGX(ndotl, k);
+        float G_vis = G * vdoth / (ndoth * ndotv);
+        float Fc = pow(1.0 - vdoth, 5.0);
+        scale += (1.0 - Fc) * G_vis;
+        bias += Fc * G_vis;
+    }
+
+    FragColor = vec4(scale / float(SAMPLE_COUNT), bias / float(SAMPLE_COUNT), 0.0, 1.0);
+}
@@ -20,11 +20,23 @@ in vec3 Normal;
 in vec2 TexCoord;
 
 uniform PointLight light;
-uniform Material material;
+layout (std140) uniform MaterialBlock {
+    Material material;
+};
 uniform vec3 eye_pos;
 uniform vec3 ambient;
 uniform samplerCube cubemap_env;
 
+/* 镜面反射的环境光（split sum）：预滤波的环境贴图，每一级对应一个 alpha；BRDF 的查找表 */
+uniform samplerCube cubemap_prefilter;
+uniform sampler2D brdf_lut;
+uniform float prefilter_max_level;
+uniform bool specular_ibl;
+#ifdef SH_AMBIENT
+/* 辐照度的球谐系数，已经和余弦核卷积并除以 π，见 engine/sh9.h */
+uniform vec3 sh_irradiance[9];
+#endif
+
 out vec4 FragColor;
 /* ------------------------------------------------------ */
 
@@ -61,14 +73,41 @@ float geometry_Smith(vec3 N, vec3 V, vec3 L, float k) {
 }
 
 
+#ifdef SH_AMBIENT
+/* 对球谐求值，基函数和 engine/src/sh9.cpp 一致 */
+vec3 sh_eval(vec3 n) {
+    return sh_irradiance[0] * 0.282095
+         + sh_irradiance[1] * 0.488603 * n.y
+         + sh_irradiance[2] * 0.488603 * n.z
+         + sh_irradiance[3] * 0.488603 * n.x
+         + sh_irradiance[4] * 1.092548 * n.x * n.y
+         + sh_irradiance[5] * 1.092548 * n.y * n.z
+         + sh_irradiance[6] * 0.315392 * (3.0 * n.z * n.z - 1.0)
+         + sh_irradiance[7] * 1.092548 * n.x * n.z
+         + sh_irradiance[8] * 0.546274 * (n.x * n.x - n.y * n.y);
+}
+#endif
+
+
 vec3 ambient_ibl(vec3 N, vec3 V, vec3 F0, Material m) {
     vec3 F = fresnel_Schlick(N, V, F0);
     vec3 k_diffuse = 1.0 - F;
     k_diffuse *= 1.0 - m.metalness;
 
+#ifdef SH_AMBIENT
+    vec3 irradiance = max(sh_eval(N), vec3(0.0));
+#else
     vec3 irradiance = texture(cubemap_env, N).xyz;
-    vec3 ambient = k_diffuse * irradiance * m.albedo * m.ao;
-    return ambient;
+#endif
+    vec3 ambient = k_diffuse * irradiance * m.albedo;
+
+    if (specular_ibl) {
+        vec3 R = reflect(V, N);
+        vec3 prefiltered = textureLod(cubemap_prefilter, R, m.alpha * prefilter_max_level).rgb;
+        vec2 brdf = texture(brdf_lut, vec2(max(dot(N, -V), 0.0), m.alpha)).rg;
+        ambient += prefiltered * (F0 * brdf.x + brdf.y);
+    }
+    return ambient * m.ao;
 }
 
 
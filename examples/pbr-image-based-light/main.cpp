@@ -8,10 +8,15 @@
 #include "engine/render.h"
 #include "engine/mesh.h"
 #include "engine/camera.h"
-#include "engine/frame_buffer.h"
+#include "engine/render_target.h"
+#include "engine/material.h"
+#include "engine/env_cache.h"
+#include "engine/sh9.h"
+#include "engine/utils/stopwatch.h"
 
 #include "assets/obj/box.h"
 #include "assets/obj/sphere.h"
+#include "assets/obj/plane.h"
 
 #include "config.hpp"
 
@@ -22,12 +27,15 @@ std::string CUR_DIR(const std::string &file_name) {
 
 /* PBR：ambient 的图像光照 + diffuse、specular 的直接光照 */
 class ScenePbrIBL : public Scene {
-    struct Material {
+    /* 材质的参数块，和 ibl_ambient.frag 中 std140 的 MaterialBlock 布局一致 */
+    struct MaterialParams {
         float alpha;
         float metalness;
+        float _padding[2];      // std140：vec3 需要 16 字节对齐
         glm::vec3 albedo;
         float ao;
     };
+    static_assert(sizeof(MaterialParams) == 32);
 
     struct PLight {
         glm::vec3 position;
@@ -40,13 +48,58 @@ public:
 
         glDepthFunc(GL_LEQUAL);
 
+        /* 预滤波时跨越立方体贴图的面采样，避免接缝 */
+        glEnable(GL_TEXTURE_CUBE_MAP_SEAMLESS);
+
+        /* 预计算的结果只在源文件或 shader 修改后才重新计算，否则从磁盘缓存载入，见 env_cache.h */
+        const std::string hdr_path = TEXTURE("Desert_Highway/Road_to_MonumentValley_Ref.hdr");
+        const std::vector<std::string> hdr2cube_inputs{CUR_DIR("hdr2cube.vert"), CUR_DIR("hdr2cube.frag")};
+
         SPDLOG_INFO("transform hdr texture -> cube map");
-        hdr2cubemap();
+        precompute_ms[0] = timed([&] {
+            cubemap_hdr = EnvCache::cube_map_cached(hdr_path, "cubemap-512", hdr2cube_inputs, "hdr2cube", 512, 1,
+                                                    [&](GLuint cube_map) { hdr2cubemap(hdr_path, cube_map); });
+        });
 
         SPDLOG_INFO("calucate irradiance cube map");
-        env_cubemap();
+        std::vector<std::string> env_inputs = hdr2cube_inputs;
+        env_inputs.insert(env_inputs.end(), {CUR_DIR("convolution_env.vert"), CUR_DIR("convolution_env.frag")});
+        precompute_ms[1] = timed([&] {
+            cubemap_env = EnvCache::cube_map_cached(hdr_path, "irradiance-512", env_inputs, "convolution_env", 512, 1,
+                                                    [&](GLuint cube_map) { env_cubemap(cube_map); });
+        });
+
+        /**
+         * 带滤波的重要性采样需要 hdr 立方体贴图的 mip
+         * EnvCache 创建的立方体贴图只有 1 级，MAX_LEVEL 是 0；先提高 MAX_LEVEL，glGenerateMipmap 才会生成其余的级别
+         */
+        glBindTexture(GL_TEXTURE_CUBE_MAP, cubemap_hdr);
+        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAX_LEVEL, 9);        // 512 x 512 一共 10 级
+        glGenerateMipmap(GL_TEXTURE_CUBE_MAP);
+        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+        glBindTexture(GL_TEXTURE_CUBE_MAP, 0);
+
+        SPDLOG_INFO("prefilter specular cube map");
+        std::vector<std::string> prefilter_inputs = hdr2cube_inputs;
+        prefilter_inputs.insert(prefilter_inputs.end(), {CUR_DIR("convolution_env.vert"), CUR_DIR("prefilter.frag")});
+        std::string prefilter_params = "prefilter;samples=";
+        for (GLsizei level = 0; level < PREFILTER_LEVELS; ++level)
+            prefilter_params += fmt::format("{},", prefilter_samples(level));
+        precompute_ms[2] = timed([&] {
+            cubemap_prefilter = EnvCache::cube_map_cached(
+                    hdr_path, fmt::format("prefilter-{}", PREFILTER_SIZE), prefilter_inputs, prefilter_params,
+                    PREFILTER_SIZE, PREFILTER_LEVELS, [&](GLuint cube_map) { prefilter_cubemap(cube_map); });
+        });
+
+        SPDLOG_INFO("integrate brdf lut");
+        precompute_ms[3] = timed([&] {
+            brdf_lut = EnvCache::texture_2d_cached(CUR_DIR("brdf_lut.frag"), "lut-512", {CUR_DIR("brdf_lut.vert")},
+                                                   "brdf_lut", 512, [&](GLuint texture) { brdf_lut_integrate(texture); });
+        });
         glViewport(0, 0, Window::width(), Window::height());
 
+        sh_init(hdr_path);
+
         /* 数据绑定：shader-sky，用于绘制天空盒 */
         shader_sky->set_update_per_frame([](Shader &shader) {
             shader.uniform_mat4_set("view", Render::camera->view_matrix_get());
@@ -68,25 +121,31 @@ public:
             shader.uniform_vec3_set("light_color", light_.color);
         });
 
-        /* 数据绑定：shader-ibl-ambient：用于绘制球体 */
-        shader_ibl_ambient->set_update_per_frame([this](Shader &shader){
-            shader.uniform_mat4_set("view", Render::camera->view_matrix_get());
-            shader.uniform_mat4_set("projection", Render::camera->projection_matrix());
-            shader.uniform_vec3_set("eye_pos", Render::camera->position());
-
-            /* 光源 */
-            shader.uniform_vec3_set("light.position", this->light.position);
-            shader.uniform_vec3_set("light.color", this->light.color);
-            glActiveTexture(GL_TEXTURE0);
-            glBindTexture(GL_TEXTURE_CUBE_MAP, this->cubemap_env);
-            shader.uniform_tex2d_set("cubemap_env", 0);
-
-            /* 物体的参数 */
-            shader.uniform_float_set("material.alpha", this->material.alpha);
-            shader.uniform_float_set("material.metalness", this->material.metalness);
-            shader.uniform_vec3_set("material.albedo", this->material.albedo);
-            shader.uniform_float_set("material.ao", this->material.ao);
-        });
+        /* 球体的材质：辐照度图只需要绑定一次，参数块只有在 GUI 修改后才会重新上传 */
+        material_sphere = MaterialManager::material_create({{0, GL_TEXTURE_CUBE_MAP, cubemap_env},
+                                                            {1, GL_TEXTURE_CUBE_MAP, cubemap_prefilter},
+                                                            {2, GL_TEXTURE_2D, brdf_lut}},
+                                                           sizeof(MaterialParams));
+        material_sphere->params_set(material);
+        /* 数据绑定：shader-ibl-ambient：用于绘制球体；SH 版本使用相同的数据，只是环境光来自球谐系数 */
+        for (auto &shader_ambient : {shader_ibl_ambient, shader_ibl_ambient_sh}) {
+            shader_ambient->uniform_block("MaterialBlock", UniformBlockBinding::material);
+            shader_ambient->uniform_tex2d_set("cubemap_env", 0);
+            shader_ambient->uniform_tex2d_set("cubemap_prefilter", 1);
+            shader_ambient->uniform_tex2d_set("brdf_lut", 2);
+            shader_ambient->uniform_float_set("prefilter_max_level", (float) (PREFILTER_LEVELS - 1));
+            shader_ambient->set_update_per_frame([this](Shader &shader) {
+                shader.uniform_mat4_set("view", Render::camera->view_matrix_get());
+                shader.uniform_mat4_set("projection", Render::camera->projection_matrix());
+                shader.uniform_vec3_set("eye_pos", Render::camera->position());
+                shader.uniform_int_set("specular_ibl", this->specular_ibl);
+
+                /* 光源 */
+                shader.uniform_vec3_set("light.position", this->light.position);
+                shader.uniform_vec3_set("light.color", this->light.color);
+            });
+        }
+        shader_ibl_ambient_sh->uniform_vec3_array_set("sh_irradiance", sh_irradiance.coeffs.data(), 9);
     }
 
     void _update() override {
@@ -100,10 +159,11 @@ public:
         shader_sky->draw_t(*mesh_cube, cubemap_hdr);
 
         // 绘制球体
-        with(Shader, *shader_ibl_ambient) {
-            shader_ibl_ambient->uniform_mat4_set("model",
-                                                 glm::translate(glm::one<glm::mat4>(), glm::vec3(0.f, 0.f, -4.f)));
-            shader_ibl_ambient->update_per_frame();
+        Shader &shader_ambient = sh_ambient ? *shader_ibl_ambient_sh : *shader_ibl_ambient;
+        with(Shader, shader_ambient) {
+            shader_ambient.uniform_mat4_set("model", glm::translate(glm::one<glm::mat4>(), glm::vec3(0.f, 0.f, -4.f)));
+            shader_ambient.update_per_frame();
+            material_sphere->bind();
             mesh_sphere->draw();
         }
     }
@@ -114,11 +174,24 @@ public:
         ImGui::SliderFloat("metalness", &material.metalness, 0, 1);
         ImGui::ColorEdit3("albedo", (float *) &material.albedo);
         ImGui::End();
+        material_sphere->params_set(material);
 
         ImGui::Begin("light");
         ImGui::DragFloat3("position", (float *) &light.position);
         ImGui::ColorEdit3("color", (float *) &light.color);
         ImGui::End();
+
+        /* 环境光：辐照度图或者球谐 */
+        ImGui::Begin("ambient");
+        ImGui::Checkbox("sh9 irradiance", &sh_ambient);
+        ImGui::Checkbox("specular ibl", &specular_ibl);
+        ImGui::Text("precompute (ms): cube %.1f, irradiance %.1f, prefilter %.1f, brdf lut %.1f", precompute_ms[0],
+                    precompute_ms[1], precompute_ms[2], precompute_ms[3]);
+        ImGui::Text("project hdr: %.2f ms, rms %.2f%%, max %.2f%%", sh_equirect_ms, sh_equirect_error.rms * 100.0,
+                    sh_equirect_error.max * 100.0);
+        ImGui::Text("project cube: %.2f ms, rms %.2f%%, max %.2f%%", sh_cube_ms, sh_cube_error.rms * 100.0,
+                    sh_cube_error.max * 100.0);
+        ImGui::End();
     }
 
 private:
@@ -130,14 +203,33 @@ private:
                                               std::vector<std::string>{"HDR_INPUT"});
     std::shared_ptr<Shader> shader_ibl_ambient = std::make_shared<Shader>(CUR_DIR("ibl_ambient.vert"),
                                                                           CUR_DIR("ibl_ambient.frag"));
+    std::shared_ptr<Shader> shader_ibl_ambient_sh =
+            std::make_shared<Shader>(CUR_DIR("ibl_ambient.vert"), CUR_DIR("ibl_ambient.frag"),
+                                     std::vector<std::string>{"SH_AMBIENT"});
     std::shared_ptr<ShaderT<PLight>> shader_light = std::make_shared<ShaderT<PLight>>(CUR_DIR("light.vert"),
                                                                                       CUR_DIR("light.frag"));
 
-    Material material{0.1, 0.9, glm::vec3(0.5, 0.0, 0.0), 1.0};
+    MaterialParams material{0.1, 0.9, {}, glm::vec3(0.5, 0.0, 0.0), 1.0};
+    std::shared_ptr<Material> material_sphere;
     PLight light{glm::vec3(-4.0f, 1.0f, 4.0f), glm::vec3(300.0f, 300.0f, 300.0f)};
 
-    GLuint cubemap_env = TextureCube::cube_map_create(512);        // 辐照度图
-    GLuint cubemap_hdr = TextureCube::cube_map_create(512);         // hdr 贴图转换为立方体贴图
+    GLuint cubemap_env{0};          // 辐照度图
+    GLuint cubemap_hdr{0};          // hdr 贴图转换为立方体贴图
+    GLuint cubemap_prefilter{0};    // 镜面反射预滤波的环境贴图，第 i 级对应 alpha = i / (PREFILTER_LEVELS - 1)
+    GLuint brdf_lut{0};             // BRDF 积分的查找表
+
+    static constexpr GLsizei PREFILTER_SIZE = 128;
+    static constexpr GLsizei PREFILTER_LEVELS = 5;
+
+    /* 预计算每一步的耗时（包括从缓存载入），依次是：立方体贴图，辐照度图，预滤波，BRDF 查找表 */
+    double precompute_ms[4]{};
+    bool specular_ibl{true};
+
+    /* 球谐的辐照度，以及和辐照度图相比的耗时，误差 */
+    SH9 sh_irradiance;
+    bool sh_ambient{false};
+    double sh_equirect_ms{0.0}, sh_cube_ms{0.0};
+    SH9Error sh_equirect_error, sh_cube_error;
 
     glm::mat4 views[6] = {
             glm::lookAt(glm::vec3(0.0f), glm::vec3(1.0f, 0.0f, 0.0f), glm::vec3(0.0f, -1.0f, 0.0f)),
@@ -148,14 +240,14 @@ private:
             glm::lookAt(glm::vec3(0.0f), glm::vec3(0.0f, 0.0f, -1.0f), glm::vec3(0.0f, -1.0f, 0.0f))
     };
 
-    /* 将等距柱状投影的 hdr 贴图转换为立方体贴图 */
-    void hdr2cubemap() {
+    /* 将等距柱状投影的 hdr 贴图转换为立方体贴图，渲染到 cube_map 中 */
+    void hdr2cubemap(const std::string &hdr_path, GLuint cube_map) {
         auto shader_hdr2cube = std::make_shared<Shader>(CUR_DIR("hdr2cube.vert"), CUR_DIR("hdr2cube.frag"));
-        auto texture_hdr = TextureHDR(TEXTURE("Desert_Highway/Road_to_MonumentValley_Ref.hdr"));
-        auto frame_buffer = std::make_shared<DepthFrameBuffer>(512, 512);
+        auto texture_hdr = TextureHDR(hdr_path);
+        RenderTargetLease frame_buffer({512, 512, 1.f, 0, GL_DEPTH_COMPONENT24});
 
 
-        with(DepthFrameBuffer, *frame_buffer) {
+        with(RenderTarget, *frame_buffer) {
             with (Shader, *shader_hdr2cube) {
                 glViewport(0, 0, 512, 512);
 
@@ -171,7 +263,7 @@ private:
                     shader_hdr2cube->uniform_mat4_set("view", views[i]);
 
                     glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_CUBE_MAP_POSITIVE_X + i,
-                                           cubemap_hdr, 0);
+                                           cube_map, 0);
                     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
                     mesh_cube->draw();
@@ -180,13 +272,110 @@ private:
         }
     }
 
-    /* 根据 hdr 的立方体贴图，通过卷积生成辐照度图 */
-    void env_cubemap() {
-        auto frame_buffer = std::make_shared<DepthFrameBuffer>(512, 512);
+    /**
+     * 计算辐照度的球谐系数：分别从等距柱状投影的 HDR 和转换得到的立方体贴图投影
+     * 以卷积得到的辐照度图为参考，统计误差；shader 使用从 HDR 投影的结果
+     */
+    void sh_init(const std::string &hdr_path) {
+        EnvCubeData reference = EnvCache::cube_map_read(cubemap_env, 512);
+
+        Stopwatch stopwatch;
+        stopwatch.start();
+        sh_irradiance = sh9_irradiance(sh9_project_equirect_file(hdr_path));
+        stopwatch.stop();
+        sh_equirect_ms = stopwatch.average_us() / 1000.0;
+        sh_equirect_error = sh9_compare(sh_irradiance, reference);
+
+        EnvCubeData cube = EnvCache::cube_map_read(cubemap_hdr, 512);
+        stopwatch.reset();
+        stopwatch.start();
+        SH9 sh_cube = sh9_irradiance(sh9_project_cube(cube));
+        stopwatch.stop();
+        sh_cube_ms = stopwatch.average_us() / 1000.0;
+        sh_cube_error = sh9_compare(sh_cube, reference);
+
+        SPDLOG_INFO("sh9 from hdr: {:.2f} ms (including decode), error: rms {:.2f}%, max {:.2f}%", sh_equirect_ms,
+                    sh_equirect_error.rms * 100.0, sh_equirect_error.max * 100.0);
+        SPDLOG_INFO("sh9 from cube map: {:.2f} ms, error: rms {:.2f}%, max {:.2f}%", sh_cube_ms,
+                    sh_cube_error.rms * 100.0, sh_cube_error.max * 100.0);
+    }
+
+    /* 执行 func 的耗时，单位是毫秒；等待 GPU 完成 */
+    template<class Func>
+    static double timed(Func &&func) {
+        Stopwatch stopwatch;
+        stopwatch.start();
+        func();
+        glFinish();
+        stopwatch.stop();
+        return stopwatch.average_us() / 1000.0;
+    }
+
+    /**
+     * 预滤波每一级的采样数：alpha 越大，GGX 的波瓣越宽，需要的采样越多
+     * 带滤波的重要性采样从 hdr 立方体贴图的 mip 中采样，每个采样代表了一片立体角，所以采样数可以比较少
+     * 第 0 级的 alpha 为 0，是镜面反射，只需要一个采样
+     */
+    static int prefilter_samples(GLsizei level) {
+        return level == 0 ? 1 : std::min(1024, 64 << level);
+    }
+
+    /* 预滤波镜面反射的环境贴图，每一级对应一个 alpha，渲染到 cube_map 的每一级中 */
+    void prefilter_cubemap(GLuint cube_map) {
+        RenderTargetLease frame_buffer({PREFILTER_SIZE, PREFILTER_SIZE, 1.f, 0, GL_DEPTH_COMPONENT24});
+        auto shader_prefilter = std::make_shared<Shader>(CUR_DIR("convolution_env.vert"), CUR_DIR("prefilter.frag"));
+
+        with(RenderTarget, *frame_buffer) {
+            with (Shader, *shader_prefilter) {
+                glActiveTexture(GL_TEXTURE0);
+                glBindTexture(GL_TEXTURE_CUBE_MAP, cubemap_hdr);
+                glm::mat4 projection = glm::perspective(glm::radians(90.0f), 1.0f, 0.1f, 10.0f);
+                shader_prefilter->uniform_mat4_set("projection", projection);
+                shader_prefilter->uniform_tex2d_set("cubemap_hdr", 0);
+                shader_prefilter->uniform_float_set("resolution", 512.f);
+
+                for (GLsizei level = 0; level < PREFILTER_LEVELS; ++level) {
+                    GLsizei size = std::max(1, PREFILTER_SIZE >> level);
+                    glViewport(0, 0, size, size);
+                    shader_prefilter->uniform_float_set("alpha", (float) level / (float) (PREFILTER_LEVELS - 1));
+                    shader_prefilter->uniform_int_set("sample_count", prefilter_samples(level));
+
+                    for (unsigned int i = 0; i < 6; ++i) {
+                        shader_prefilter->uniform_mat4_set("view", views[i]);
+                        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_CUBE_MAP_POSITIVE_X + i,
+                                               cube_map, level);
+                        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+                        mesh_cube->draw();
+                    }
+                }
+            }
+        }
+    }
+
+    /* 积分 BRDF，渲染到查找表 texture 中 */
+    void brdf_lut_integrate(GLuint texture) {
+        RenderTargetLease frame_buffer({512, 512, 1.f, 0, GL_DEPTH_COMPONENT24});
+        auto shader_brdf = std::make_shared<Shader>(CUR_DIR("brdf_lut.vert"), CUR_DIR("brdf_lut.frag"));
+        auto mesh_square = std::make_shared<Mesh>(plane_pt_2, glm::vec3(), 2, 0, 2);
+
+        with(RenderTarget, *frame_buffer) {
+            with (Shader, *shader_brdf) {
+                glViewport(0, 0, 512, 512);
+                glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, texture, 0);
+                glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+                mesh_square->draw();
+            }
+        }
+    }
+
+    /* 根据 hdr 的立方体贴图，通过卷积生成辐照度图，渲染到 cube_map 中 */
+    void env_cubemap(GLuint cube_map) {
+        RenderTargetLease frame_buffer({512, 512, 1.f, 0, GL_DEPTH_COMPONENT24});
         auto shader_convo_env = std::make_shared<Shader>(CUR_DIR("convolution_env.vert"),
                                                          CUR_DIR("convolution_env.frag"));
 
-        with(DepthFrameBuffer, *frame_buffer) {
+        with(RenderTarget, *frame_buffer) {
             with (Shader, *shader_convo_env) {
                 glViewport(0, 0, 512, 512);
 
@@ -198,7 +387,7 @@ private:
                 for (unsigned int i = 0; i < 6; ++i) {
                     shader_convo_env->uniform_mat4_set("view", views[i]);
                     glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_CUBE_MAP_POSITIVE_X + i,
-                                           cubemap_env, 0);
+                                           cube_map, 0);
                     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
                     mesh_cube->draw();
@@ -210,8 +399,8 @@ private:
 };
 
 
-int main() {
-    Render::init();
+int main(int argc, char **argv) {
+    Render::init(RenderOptions::parse(argc, argv));
     Render::render<ScenePbrIBL>();
     Render::terminate();
     return 0;
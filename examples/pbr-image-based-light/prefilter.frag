@@ -0,0 +1,81 @@
+/* 预计算 PBR 的镜面反射部分（split sum 的第一项）：GGX 重要性采样，对环境贴图预滤波 */
+
+#version 330 core
+
+in vec3 FragPos;
+out vec4 FragColor;
+
+uniform samplerCube cubemap_hdr;
+uniform float alpha;                // GGX 的 alpha，和 ibl_ambient.frag 中的 material.alpha 一致
+uniform int sample_count;
+uniform float resolution;           // cubemap_hdr 第 0 级的边长
+
+const float PI = 3.14159265359;
+
+
+/* Hammersley 低差异序列 */
+float radical_inverse_VdC(uint bits) {
+    bits = (bits << 16u) | (bits >> 16u);
+    bits = ((bits & 0x55555555u) << 1u) | ((bits & 0xAAAAAAAAu) >> 1u);
+    bits = ((bits & 0x33333333u) << 2u) | ((bits & 0xCCCCCCCCu) >> 2u);
+    bits = ((bits & 0x0F0F0F0Fu) << 4u) | ((bits & 0xF0F0F0F0u) >> 4u);
+    bits = ((bits & 0x00FF00FFu) << 8u) | ((bits & 0xFF00FF00u) >> 8u);
+    return float(bits) * 2.3283064365386963e-10;
+}
+
+vec2 hammersley(uint i, uint n) {
+    return vec2(float(i) / float(n), radical_inverse_VdC(i));
+}
+
+/* 按照 GGX 的法线分布采样半程向量 */
+vec3 importance_sample_GGX(vec2 xi, vec3 N, float a) {
+    float phi = 2.0 * PI * xi.x;
+    float cos_theta = sqrt((1.0 - xi.y) / (1.0 + (a * a - 1.0) * xi.y));
+    float sin_theta = sqrt(1.0 - cos_theta * cos_theta);
+    vec3 H = vec3(cos(phi) * sin_theta, sin(phi) * sin_theta, cos_theta);
+
+    vec3 up = abs(N.z) < 0.999 ? vec3(0.0, 0.0, 1.0) : vec3(1.0, 0.0, 0.0);
+    vec3 tangent = normalize(cross(up, N));
+    vec3 bitangent = cross(N, tangent);
+    return normalize(tangent * H.x + bitangent * H.y + N * H.z);
+}
+
+float NDF_GGX(float ndoth, float a) {
+    float a2 = a * a;
+    float denom = ndoth * ndoth * (a2 - 1.0) + 1.0;
+    return a2 / max(PI * denom * denom, 0.0000001);
+}
+
+
+void main() {
+    /* 假设 N = V = R */
+    vec3 N = normalize(FragPos);
+    vec3 V = N;
+
+    /* 每个纹素对应的立体角 */
+    float sa_texel = 4.0 * PI / (6.0 * resolution * resolution);
+
+    vec3 color = vec3(0.0);
+    float weight = 0.0;
+    for (uint i = 0u; i < uint(sample_count); ++i) {
+        vec3 H = importance_sample_GGX(hammersley(i, uint(sample_count)), N, alpha);
+        vec3 L = normalize(2.0 * dot(V, H) * H - V);
+        float ndotl = dot(N, L);
+        if (ndotl <= 0.0)
+            continue;
+
+        /**
+         * 带滤波的重要性采样：概率密度小的采样覆盖的立体角大，从 cubemap_hdr 更粗糙的 mip 中采样
+         * N = V 时 pdf = D * ndoth / (4 * vdoth) = D / 4
+         */
+        float ndoth = max(dot(N, H), 0.0);
+        float pdf = NDF_GGX(ndoth, alpha) / 4.0;
+        float sa_sample = 1.0 / (float(sample_count) * pdf + 0.0001);
+        float lod = alpha == 0.0 ? 0.0 : max(0.5 * log2(sa_sample / sa_texel) + 1.0, 0.0);
+
+        color += textureLod(cubemap_hdr, L, lod).rgb * ndotl;
+        weight += ndotl;
+    }
+
+    FragColor = vec4(color / max(weight, 0.0001), 1.0);
+}
@@ -1,14 +1,13 @@
 
 #include <memory>
 
-#include "engine/utils/with.h"
 #include "engine/scene.h"
 #include "engine/shader.h"
 #include "engine/mesh.h"
 #include "engine/camera.h"
-#include "engine/frame_buffer.h"
-#include "engine/frame_buffer.h"
 #include "engine/render.h"
+#include "engine/render_graph.h"
+#include "engine/dynamic_resolution.h"
 
 #include "assets/obj/cube.h"
 #include "assets/obj/plane.h"
@@ -45,7 +44,7 @@ public:
         /* 数据绑定 */
         shader_framebuffer->set_draw([this](Shader &shader, const Mesh &mesh){
             glActiveTexture(GL_TEXTURE0);
-            glBindTexture(GL_TEXTURE_2D, this->framebuffer->color_tex_get());
+            glBindTexture(GL_TEXTURE_2D, this->scene_color);
             shader.uniform_tex2d_set("texture1", 0);
             shader.uniform_int_set("post_process_id", post_process);
         });
@@ -64,24 +63,29 @@ public:
         ImGui::SliderInt("post process", &post_process, 0, 7);
         ImGui::Text("%s", comment.c_str());
         ImGui::End();
+
+        graph.gui("render graph");
     }
 
 
     // =====================================================
     // 后处理的原理：
-    //  1. 首先绑定一个自定义的 framebuffer，渲染场景
-    //  2. 将 framebuffer 作为 texture，使用后处理着色器，渲染到 screen 上面
+    //  1. 首先将场景绘制到一个临时的颜色纹理
+    //  2. 将这个纹理作为输入，使用后处理着色器，渲染到 screen 上面
+    // 两个 pass 通过渲染图声明，临时纹理和渲染的分辨率一样大，由渲染图分配和复用
     // =====================================================
 
     void _update() override {
-
-        /* 在 framebuffer 中绘制场景 */
-        with(FrameBuffer, *framebuffer) {
+        graph.reset();
+        GraphTexture color;
+
+        /* 在临时纹理中绘制场景 */
+        graph.add_pass("scene pass", [&](RenderGraph::Builder &builder) {
+            color = builder.write(builder.create("scene color", {GL_RGBA8}), true);
+            builder.write(builder.create("scene depth", {GL_DEPTH24_STENCIL8}), true);
+        }, [this](const RenderGraph::Resources &) {
             shader_diffuse->update_per_frame();
-
             glEnable(GL_DEPTH_TEST);
-            glClearColor(0.f, 0.f, 0.f, 0.f);
-            glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
             /* 绘制地面 */
             shader_diffuse->draw(*mesh_plane);
@@ -91,11 +95,19 @@ public:
             shader_diffuse->draw(*mesh_cube);
             mesh_cube->set_model(model_box_2);
             shader_diffuse->draw(*mesh_cube);
-        }
+        });
+
+        /* 使用正方形渲染场景的纹理，做后处理 */
+        graph.add_pass("post process pass", [&](RenderGraph::Builder &builder) {
+            builder.read(color);
+            builder.write(graph.backbuffer());
+        }, [this, &color](const RenderGraph::Resources &resources) {
+            scene_color = resources.texture(color);
+            glDisable(GL_DEPTH_TEST);
+            shader_framebuffer->draw(*mesh_square);
+        });
 
-        /* 使用正方形渲染 framebuffer，做后处理 */
-        glDisable(GL_DEPTH_TEST);
-        shader_framebuffer->draw(*mesh_square);
+        graph.execute(DynamicResolution::width(), DynamicResolution::height());
     }
 
 
@@ -103,8 +115,9 @@ private:
 
     int post_process = 0;
 
-    // todo 动态调节尺寸
-    std::shared_ptr<FrameBuffer> framebuffer = std::make_shared<FrameBuffer>(2560, 1440);
+    /* 场景绘制到的临时纹理，只在这一帧的后处理 pass 中有效 */
+    RenderGraph graph;
+    GLuint scene_color = 0;
 
     glm::mat4 model_box_1 = glm::translate(glm::one<glm::mat4>(), glm::vec3(-2.f, 0.01f, -2.f));
     glm::mat4 model_box_2 = glm::translate(glm::one<glm::mat4>(), glm::vec3(2.0f, 0.01f, 1.0f));
@@ -122,8 +135,8 @@ private:
 };
 
 
-int main() {
-    Render::init();
+int main(int argc, char **argv) {
+    Render::init(RenderOptions::parse(argc, argv));
     Render::render<ScenePostProcess>();
     Render::terminate();
     return 0;
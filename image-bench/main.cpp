@@ -0,0 +1,193 @@
+/**
+ * image-bench：测试每个图像解码器（engine/image_decoder.h）的吞吐量
+ * 每个文件由所有能够解码它的解码器分别解码，目标内存只分配一次并重复使用，和解码到映射的 PBO 的情况一致
+ *
+ * 用法：image-bench [--repeat n] [--channels n] [path ...]
+ *  path        文件或目录（递归），默认是 assets/texture
+ *  --repeat    每个文件每个解码器解码的次数（另有一次预热），默认 5
+ *  --channels  输出的通道数，默认 0，也就是文件本身的通道数
+ */
+#include <map>
+#include <cctype>
+#include <string>
+#include <vector>
+#include <cstdio>
+#include <filesystem>
+#include <algorithm>
+
+#include <fmt/format.h>
+#include <fmt/ranges.h>
+#include <spdlog/spdlog.h>
+
+#include "engine/image_decoder.h"
+#include "engine/utils/stopwatch.h"
+
+#include "config.hpp"
+
+
+namespace fs = std::filesystem;
+
+
+struct Options {
+    int repeat{5};
+    int channels{0};
+    std::vector<std::string> paths;
+};
+
+/* 一个解码器在一类文件上的累计结果 */
+struct Total {
+    size_t files{0};
+    double ms{0.0};
+    double pixels{0.0};
+    double decoded_bytes{0.0};
+    double file_bytes{0.0};
+};
+
+
+static std::string extension(const fs::path &path) {
+    std::string ext = path.extension().string();
+    std::transform(ext.begin(), ext.end(), ext.begin(), [](unsigned char c) { return (char) std::tolower(c); });
+    return ext == ".jpeg" ? ".jpg" : ext;
+}
+
+static bool is_source(const fs::path &path) {
+    std::string ext = extension(path);
+    return ext == ".png" || ext == ".jpg" || ext == ".tga" || ext == ".bmp" || ext == ".hdr";
+}
+
+static Options options_parse(int argc, char **argv) {
+    Options options;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--repeat" && i + 1 < argc) {
+            options.repeat = std::max(1, std::stoi(argv[++i]));
+        } else if (arg == "--channels" && i + 1 < argc) {
+            options.channels = std::stoi(argv[++i]);
+            if (options.channels < 0 || options.channels > 4)
+                throw std::runtime_error(fmt::format("bad channels: {}", options.channels));
+        } else if (arg.rfind("--", 0) == 0) {
+            throw std::runtime_error(fmt::format("unknown option: {}", arg));
+        } else {
+            options.paths.push_back(arg);
+        }
+    }
+    if (options.paths.empty())
+        options.paths = {TEXTURE_DIR};
+    return options;
+}
+
+static std::vector<std::string> sources_collect(const std::vector<std::string> &paths) {
+    std::vector<std::string> sources;
+    for (const auto &path : paths) {
+        if (fs::is_directory(path)) {
+            for (const auto &entry : fs::recursive_directory_iterator(path))
+                if (entry.is_regular_file() && is_source(entry.path()))
+                    sources.push_back(entry.path().string());
+        } else if (fs::is_regular_file(path)) {
+            sources.push_back(path);
+        } else {
+            SPDLOG_WARN("path not found: {}", path);
+        }
+    }
+    std::sort(sources.begin(), sources.end());
+    return sources;
+}
+
+/* 输出时使用相对于 assets/texture 的路径 */
+static std::string display_name(const std::string &path) {
+    std::string relative = fs::path(path).lexically_relative(TEXTURE_DIR).string();
+    return relative.empty() || relative.rfind("..", 0) == 0 ? path : relative;
+}
+
+/* 文件开头的若干字节，用于判断解码器能否解码 */
+static std::vector<unsigned char> head_read(const std::string &path) {
+    std::vector<unsigned char> head(ImageDecoders::HEAD_SIZE);
+    FILE *file = std::fopen(path.c_str(), "rb");
+    head.resize(file ? std::fread(head.data(), 1, head.size(), file) : 0);
+    if (file)
+        std::fclose(file);
+    return head;
+}
+
+
+int main(int argc, char **argv) {
+    Options options;
+    try {
+        options = options_parse(argc, argv);
+    } catch (const std::exception &e) {
+        SPDLOG_ERROR("{}", e.what());
+        return 2;
+    }
+
+    std::vector<std::string> decoder_names;
+    for (const auto *decoder : ImageDecoders::all())
+        decoder_names.emplace_back(decoder->name());
+    fmt::print("decoders (by priority): {}\n", fmt::join(decoder_names, ", "));
+    fmt::print("{:<48} {:>12} {:>10} {:>10} {:>10} {:>10}\n", "file", "decoder", "size", "ms", "MP/s", "MB/s");
+
+    /* (解码器, 扩展名) -> 累计结果 */
+    std::map<std::pair<std::string, std::string>, Total> totals;
+    std::vector<unsigned char> buffer;
+    size_t failed = 0;
+
+    for (const auto &source : sources_collect(options.paths)) {
+        const auto head = head_read(source);
+        const double file_bytes = (double) fs::file_size(source);
+        const std::string ext = extension(source);
+
+        for (const auto *decoder : ImageDecoders::all()) {
+            try {
+                if (!decoder->accepts(head.data(), head.size()))
+                    continue;
+                ImageInfo info = decoder->info(source);
+                ImageRequest request{options.channels, false, info.hdr};
+                if (request.hdr && !decoder->hdr_output())
+                    continue;
+
+                /* 目标内存只分配一次，之后所有的解码都写入同一块内存 */
+                buffer.resize(std::max(buffer.size(), ImageDecoders::bytes(info, request)));
+                decoder->decode(source, request, buffer.data(), buffer.size());
+
+                Stopwatch stopwatch;
+                stopwatch.start();
+                for (int i = 0; i < options.repeat; ++i)
+                    decoder->decode(source, request, buffer.data(), buffer.size());
+                stopwatch.stop(options.repeat);
+
+                const double ms = stopwatch.average_us() / 1000.0;
+                const double pixels = (double) info.width * info.height;
+                const double decoded_bytes = (double) ImageDecoders::bytes(info, request);
+                const std::string size = fmt::format("{}x{}x{}", info.width, info.height,
+                                                     request.channels ? request.channels : info.channels);
+                fmt::print("{:<48} {:>12} {:>10} {:>10.2f} {:>10.1f} {:>10.1f}\n", display_name(source),
+                           decoder->name(), size, ms, pixels / ms / 1000.0, decoded_bytes / ms / 1000.0);
+
+                Total &total = totals[{decoder->name(), ext}];
+                total.files += 1;
+                total.ms += ms;
+                total.pixels += pixels;
+                total.decoded_bytes += decoded_bytes;
+                total.file_bytes += file_bytes;
+            } catch (const std::exception &e) {
+                ++failed;
+                SPDLOG_ERROR("{} fails on {}: {}", decoder->name(), source, e.what());
+            }
+        }
+    }
+
+    /* 汇总：每个解码器在每一类文件上的吞吐量；MB/s 是解码后的数据量，file MB/s 是文件的数据量 */
+    fmt::print("\n{:<12} {:>6} {:>6} {:>10} {:>10} {:>10} {:>12}\n", "decoder", "ext", "files", "ms", "MP/s",
+               "MB/s", "file MB/s");
+    for (const auto &[key, total] : totals)
+        fmt::print("{:<12} {:>6} {:>6} {:>10.2f} {:>10.1f} {:>10.1f} {:>12.1f}\n", key.first, key.second,
+                   total.files, total.ms, total.pixels / total.ms / 1000.0, total.decoded_bytes / total.ms / 1000.0,
+                   total.file_bytes / total.ms / 1000.0);
+
+    /* 和 stb_image 相比的加速比，只比较两者都解码了的那一类文件 */
+    for (const auto &[key, total] : totals) {
+        auto stb = totals.find({"stb_image", key.second});
+        if (key.first != "stb_image" && stb != totals.end() && stb->second.files == total.files)
+            fmt::print("{} on {}: {:.2f}x stb_image\n", key.first, key.second, stb->second.ms / total.ms);
+    }
+    return failed == 0 ? 0 : 1;
+}
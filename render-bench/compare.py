@@ -0,0 +1,88 @@
+#!/usr/bin/env python3
+"""
+比较两次 benchmark 的报告（RenderBench 输出的 .json），超出阈值的变慢标记为回退
+
+用法：
+    compare.py base.json new.json [--threshold 5] [--metrics cpu_ms,gpu_ms] [--stats p50,p95,p99]
+    compare.py base-dir new-dir ...        比较两个目录中同名的报告
+
+有回退时返回 1，可以用于 CI
+"""
+import argparse
+import json
+import os
+import sys
+
+
+def load_reports(path):
+    """文件或者目录，返回 {名字: 报告}"""
+    if os.path.isdir(path):
+        return {name: load_json(os.path.join(path, name))
+                for name in sorted(os.listdir(path)) if name.endswith('.json')}
+    return {os.path.basename(path): load_json(path)}
+
+
+def load_json(path):
+    with open(path, encoding='utf-8') as file:
+        return json.load(file)
+
+
+def compare(name, base, new, metrics, stats, threshold):
+    """输出一个场景的对比，返回回退的项数"""
+    print(f'{name}: {base.get("scene", "?")}, {new.get("frames", 0)} frames')
+    if base.get('path') != new.get('path') or base.get('size') != new.get('size'):
+        print(f'  warning: different path or size: {base.get("path")} {base.get("size")} '
+              f'vs {new.get("path")} {new.get("size")}')
+
+    regressions = 0
+    for metric in metrics:
+        if metric not in base['metrics'] or metric not in new['metrics']:
+            continue
+        for stat in stats:
+            old_value = base['metrics'][metric][stat]
+            new_value = new['metrics'][metric][stat]
+            change = (new_value - old_value) / old_value * 100.0 if old_value > 0 else 0.0
+            flag = ''
+            if change > threshold:
+                flag = '  <-- REGRESSION'
+                regressions += 1
+            elif change < -threshold:
+                flag = '  improved'
+            print(f'  {metric:>10} {stat:>4}: {old_value:10.3f} -> {new_value:10.3f}  {change:+7.1f}%{flag}')
+    return regressions
+
+
+def main():
+    parser = argparse.ArgumentParser(description='compare two render benchmark reports')
+    parser.add_argument('base', help='report or directory of reports of the baseline')
+    parser.add_argument('new', help='report or directory of reports to check')
+    parser.add_argument('--threshold', type=float, default=5.0, help='allowed slowdown in percent')
+    parser.add_argument('--metrics', default='cpu_ms,gpu_ms', help='metrics to check')
+    parser.add_argument('--stats', default='p50,p95,p99', help='statistics to check')
+    args = parser.parse_args()
+
+    if os.path.isdir(args.base) != os.path.isdir(args.new):
+        parser.error('base and new should be both files or both directories')
+    base_reports = load_reports(args.base)
+    new_reports = load_reports(args.new)
+    if not os.path.isdir(args.base):
+        new_reports = {name: report for name, report in zip(base_reports, new_reports.values())}
+    metrics = args.metrics.split(',')
+    stats = args.stats.split(',')
+
+    regressions = 0
+    for name, base in base_reports.items():
+        if name not in new_reports:
+            print(f'{name}: missing in {args.new}')
+            continue
+        regressions += compare(name, base, new_reports[name], metrics, stats, args.threshold)
+
+    if regressions:
+        print(f'{regressions} regression(s) above {args.threshold}%')
+        return 1
+    print(f'no regression above {args.threshold}%')
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
@@ -0,0 +1,350 @@
+#include <cmath>
+#include <limits>
+#include <cstring>
+#include <utility>
+#include <algorithm>
+
+#include "bc_encoder.h"
+
+
+/* BC6H 和 BC7 中 4 位索引的插值权重，总和是 64 */
+static const int WEIGHTS_4[16] = {0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64};
+
+
+/* 按位写入 128 位的块，低位在前 */
+class BitWriter {
+public:
+    explicit BitWriter(uint8_t *out) : _out(out) { std::memset(_out, 0, 16); }
+
+    void put(uint32_t value, int bits) {
+        for (int i = 0; i < bits; ++i, ++_pos)
+            if ((value >> i) & 1u)
+                _out[_pos >> 3] |= (uint8_t) (1u << (_pos & 7));
+    }
+
+private:
+    uint8_t *_out;
+    int _pos{0};
+};
+
+
+/**
+ * 在主成分方向上，找到所有像素投影的最小值和最大值，作为两个端点
+ * @param channels 参与计算的通道数，1 ~ 4
+ */
+static void endpoints_pca(const float (*pixels)[4], int channels, float lo[4], float hi[4]) {
+    float mean[4] = {0, 0, 0, 0};
+    for (int i = 0; i < 16; ++i)
+        for (int c = 0; c < channels; ++c)
+            mean[c] += pixels[i][c] / 16.f;
+
+    /* 协方差矩阵 */
+    float cov[4][4] = {};
+    for (int i = 0; i < 16; ++i)
+        for (int a = 0; a < channels; ++a)
+            for (int b = 0; b < channels; ++b)
+                cov[a][b] += (pixels[i][a] - mean[a]) * (pixels[i][b] - mean[b]);
+
+    /* 幂迭代求最大特征值对应的方向 */
+    float axis[4] = {1, 1, 1, 1};
+    for (int iter = 0; iter < 8; ++iter) {
+        float next[4] = {0, 0, 0, 0};
+        float norm = 0;
+        for (int a = 0; a < channels; ++a) {
+            for (int b = 0; b < channels; ++b)
+                next[a] += cov[a][b] * axis[b];
+            norm = std::max(norm, std::abs(next[a]));
+        }
+        if (norm < 1e-8f)
+            break;
+        for (int a = 0; a < channels; ++a)
+            axis[a] = next[a] / norm;
+    }
+    float len2 = 0;
+    for (int c = 0; c < channels; ++c)
+        len2 += axis[c] * axis[c];
+
+    /* 所有像素相同，或者方向退化 */
+    float t_min = 0, t_max = 0;
+    if (len2 > 1e-8f) {
+        t_min = std::numeric_limits<float>::max();
+        t_max = std::numeric_limits<float>::lowest();
+        for (int i = 0; i < 16; ++i) {
+            float t = 0;
+            for (int c = 0; c < channels; ++c)
+                t += (pixels[i][c] - mean[c]) * axis[c];
+            t /= len2;
+            t_min = std::min(t_min, t);
+            t_max = std::max(t_max, t);
+        }
+    }
+    for (int c = 0; c < channels; ++c) {
+        lo[c] = mean[c] + t_min * axis[c];
+        hi[c] = mean[c] + t_max * axis[c];
+    }
+}
+
+/* 在调色板中找到每个像素最近的颜色，返回总误差 */
+template<int PaletteSize>
+static float indices_nearest(const float (*pixels)[4], int channels, const float (*palette)[4], int indices[16]) {
+    float total = 0;
+    for (int i = 0; i < 16; ++i) {
+        float best = std::numeric_limits<float>::max();
+        for (int j = 0; j < PaletteSize; ++j) {
+            float err = 0;
+            for (int c = 0; c < channels; ++c) {
+                float d = pixels[i][c] - palette[j][c];
+                err += d * d;
+            }
+            if (err < best) {
+                best = err;
+                indices[i] = j;
+            }
+        }
+        total += best;
+    }
+    return total;
+}
+
+static void pixels_load(const uint8_t rgba[64], float pixels[16][4]) {
+    for (int i = 0; i < 16; ++i)
+        for (int c = 0; c < 4; ++c)
+            pixels[i][c] = rgba[i * 4 + c];
+}
+
+
+// =====================================================
+// BC1，BC3，BC4，BC5
+// =====================================================
+
+static uint16_t rgb565(const float rgb[3]) {
+    auto q = [](float v, int max) { return (uint16_t) std::clamp((int) std::lround(v / 255.f * max), 0, max); };
+    return (uint16_t) (q(rgb[0], 31) << 11 | q(rgb[1], 63) << 5 | q(rgb[2], 31));
+}
+
+static void rgb565_decode(uint16_t c, float rgb[4]) {
+    int r = c >> 11 & 31, g = c >> 5 & 63, b = c & 31;
+    rgb[0] = (float) (r << 3 | r >> 2);
+    rgb[1] = (float) (g << 2 | g >> 4);
+    rgb[2] = (float) (b << 3 | b >> 2);
+    rgb[3] = 255.f;
+}
+
+void bc1_encode(const uint8_t rgba[64], uint8_t out[8]) {
+    float pixels[16][4];
+    pixels_load(rgba, pixels);
+
+    /* 端点向内收缩一点，减少端点附近的量化误差 */
+    float lo[4], hi[4];
+    endpoints_pca(pixels, 3, lo, hi);
+    for (int c = 0; c < 3; ++c) {
+        float inset = (hi[c] - lo[c]) / 16.f;
+        lo[c] += inset;
+        hi[c] -= inset;
+    }
+
+    /* c0 > c1 时是 4 色模式 */
+    uint16_t c0 = rgb565(hi), c1 = rgb565(lo);
+    if (c0 < c1)
+        std::swap(c0, c1);
+    std::memset(out, 0, 8);
+    out[0] = (uint8_t) (c0 & 0xFF);
+    out[1] = (uint8_t) (c0 >> 8);
+    out[2] = (uint8_t) (c1 & 0xFF);
+    out[3] = (uint8_t) (c1 >> 8);
+    if (c0 == c1)
+        return;
+
+    float palette[4][4];
+    rgb565_decode(c0, palette[0]);
+    rgb565_decode(c1, palette[1]);
+    for (int c = 0; c < 3; ++c) {
+        palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3.f;
+        palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3.f;
+    }
+
+    int indices[16];
+    indices_nearest<4>(pixels, 3, palette, indices);
+    uint32_t bits = 0;
+    for (int i = 0; i < 16; ++i)
+        bits |= (uint32_t) indices[i] << (2 * i);
+    std::memcpy(out + 4, &bits, 4);
+}
+
+void bc4_encode(const uint8_t rgba[64], int channel, uint8_t out[8]) {
+    int lo = 255, hi = 0;
+    for (int i = 0; i < 16; ++i) {
+        lo = std::min(lo, (int) rgba[i * 4 + channel]);
+        hi = std::max(hi, (int) rgba[i * 4 + channel]);
+    }
+
+    /* a0 > a1 时是 8 值模式：a0，a1，以及中间的 6 个插值 */
+    std::memset(out, 0, 8);
+    out[0] = (uint8_t) hi;
+    out[1] = (uint8_t) lo;
+    if (hi == lo)
+        return;
+
+    float pixels[16][4], palette[8][4];
+    for (int i = 0; i < 16; ++i)
+        pixels[i][0] = rgba[i * 4 + channel];
+    palette[0][0] = (float) hi;
+    palette[1][0] = (float) lo;
+    for (int j = 2; j < 8; ++j)
+        palette[j][0] = (float) ((8 - j) * hi + (j - 1) * lo) / 7.f;
+
+    int indices[16];
+    indices_nearest<8>(pixels, 1, palette, indices);
+    uint64_t bits = 0;
+    for (int i = 0; i < 16; ++i)
+        bits |= (uint64_t) indices[i] << (3 * i);
+    for (int b = 0; b < 6; ++b)
+        out[2 + b] = (uint8_t) (bits >> (8 * b));
+}
+
+void bc3_encode(const uint8_t rgba[64], uint8_t out[16]) {
+    bc4_encode(rgba, 3, out);
+    bc1_encode(rgba, out + 8);
+}
+
+void bc5_encode(const uint8_t rgba[64], uint8_t out[16]) {
+    bc4_encode(rgba, 0, out);
+    bc4_encode(rgba, 1, out + 8);
+}
+
+
+// =====================================================
+// BC7 mode 6
+// =====================================================
+
+void bc7_encode(const uint8_t rgba[64], uint8_t out[16]) {
+    float pixels[16][4];
+    pixels_load(rgba, pixels);
+    float lo[4], hi[4];
+    endpoints_pca(pixels, 4, lo, hi);
+
+    /* 尝试 4 种 p-bit 的组合，保留误差最小的：端点是 (7 位 << 1) | p-bit */
+    float best_err = std::numeric_limits<float>::max();
+    int best_q[2][4] = {}, best_p[2] = {}, best_indices[16] = {};
+    for (int p0 = 0; p0 < 2; ++p0) {
+        for (int p1 = 0; p1 < 2; ++p1) {
+            int q[2][4], e[2][4];
+            for (int c = 0; c < 4; ++c) {
+                q[0][c] = std::clamp((int) std::lround((lo[c] - (float) p0) / 2.f), 0, 127);
+                q[1][c] = std::clamp((int) std::lround((hi[c] - (float) p1) / 2.f), 0, 127);
+                e[0][c] = q[0][c] << 1 | p0;
+                e[1][c] = q[1][c] << 1 | p1;
+            }
+
+            float palette[16][4];
+            for (int j = 0; j < 16; ++j)
+                for (int c = 0; c < 4; ++c)
+                    palette[j][c] = (float) ((e[0][c] * (64 - WEIGHTS_4[j]) + e[1][c] * WEIGHTS_4[j] + 32) >> 6);
+
+            int indices[16];
+            float err = indices_nearest<16>(pixels, 4, palette, indices);
+            if (err < best_err) {
+                best_err = err;
+                std::memcpy(best_q, q, sizeof(q));
+                best_p[0] = p0;
+                best_p[1] = p1;
+                std::memcpy(best_indices, indices, sizeof(indices));
+            }
+        }
+    }
+
+    /* 第 0 个像素的索引最高位隐含为 0，否则交换两个端点 */
+    if (best_indices[0] >= 8) {
+        std::swap(best_q[0], best_q[1]);
+        std::swap(best_p[0], best_p[1]);
+        for (int &index : best_indices)
+            index = 15 - index;
+    }
+
+    BitWriter writer(out);
+    writer.put(1u << 6, 7);                 // mode 6
+    for (int c = 0; c < 4; ++c) {
+        writer.put((uint32_t) best_q[0][c], 7);
+        writer.put((uint32_t) best_q[1][c], 7);
+    }
+    writer.put((uint32_t) best_p[0], 1);
+    writer.put((uint32_t) best_p[1], 1);
+    for (int i = 0; i < 16; ++i)
+        writer.put((uint32_t) best_indices[i], i == 0 ? 3 : 4);
+}
+
+
+// =====================================================
+// BC6H mode 11
+// =====================================================
+
+/* 非负的 float 转换为 half 的位，截断到最大的有限值 0x7BFF */
+static int half_bits(float f) {
+    if (!(f > 0.f))
+        return 0;
+    if (f >= 65504.f)
+        return 0x7BFF;
+    if (f < 6.103515625e-05f)                   // 次正规数，单位是 2^-24
+        return (int) std::lround(f * 16777216.f);
+    int e;
+    float m = std::frexp(f, &e);                // f = m * 2^e，m 在 [0.5, 1) 中
+    int exponent = e + 14;
+    int fraction = (int) std::lround((2.f * m - 1.f) * 1024.f);
+    if (fraction == 1024) {
+        fraction = 0;
+        ++exponent;
+    }
+    return std::min(0x7BFF, exponent << 10 | fraction);
+}
+
+/* 10 位无符号端点的反量化，结果是 16 位 */
+static int bc6h_unquantize(int q) {
+    if (q == 0)
+        return 0;
+    if (q == 1023)
+        return 0xFFFF;
+    return (q << 6) + 32;
+}
+
+void bc6h_encode(const float rgb[48], uint8_t out[16]) {
+    /* 在 half 的位表示上插值，和硬件的解码方式一致 */
+    float pixels[16][4];
+    for (int i = 0; i < 16; ++i)
+        for (int c = 0; c < 3; ++c)
+            pixels[i][c] = (float) half_bits(rgb[i * 3 + c]);
+    float lo[4], hi[4];
+    endpoints_pca(pixels, 3, lo, hi);
+
+    /* 解码的最终结果是 unquantize * 31 / 64，反过来求量化值 */
+    int q[2][3];
+    for (int c = 0; c < 3; ++c) {
+        q[0][c] = std::clamp((int) std::lround(lo[c] / 31.f - 0.5f), 0, 1023);
+        q[1][c] = std::clamp((int) std::lround(hi[c] / 31.f - 0.5f), 0, 1023);
+    }
+
+    float palette[16][4];
+    for (int j = 0; j < 16; ++j)
+        for (int c = 0; c < 3; ++c) {
+            int value = (bc6h_unquantize(q[0][c]) * (64 - WEIGHTS_4[j]) +
+                         bc6h_unquantize(q[1][c]) * WEIGHTS_4[j] + 32) >> 6;
+            palette[j][c] = (float) ((value * 31) >> 6);
+        }
+
+    int indices[16];
+    indices_nearest<16>(pixels, 3, palette, indices);
+
+    /* 第 0 个像素的索引最高位隐含为 0，否则交换两个端点 */
+    if (indices[0] >= 8) {
+        std::swap(q[0], q[1]);
+        for (int &index : indices)
+            index = 15 - index;
+    }
+
+    BitWriter writer(out);
+    writer.put(0x03, 5);                    // mode 11
+    for (int e = 0; e < 2; ++e)
+        for (int c = 0; c < 3; ++c)
+            writer.put((uint32_t) q[e][c], 10);
+    for (int i = 0; i < 16; ++i)
+        writer.put((uint32_t) indices[i], i == 0 ? 3 : 4);
+}
@@ -0,0 +1,34 @@
+/**
+ * 块压缩的 CPU 编码器，每次编码一个 4x4 的块
+ * 输入的像素按行存放：第 i 个像素是 (x = i % 4, y = i / 4)
+ * 追求的是足够的质量和简单的实现，不做穷举搜索：
+ *  - BC1/BC3/BC4/BC5：主成分方向上的端点 + 最近的调色板索引
+ *  - BC7：只使用 mode 6（单个子集，RGBA 端点 7 位 + p-bit，4 位索引）
+ *  - BC6H：只使用 mode 11（单个子集，无符号，10 位端点，4 位索引）
+ */
+#ifndef RENDER_TEXTURE_COOK_BC_ENCODER_H
+#define RENDER_TEXTURE_COOK_BC_ENCODER_H
+
+#include <cstdint>
+
+
+/* RGB，8 字节；alpha 被忽略 */
+void bc1_encode(const uint8_t rgba[64], uint8_t out[8]);
+
+/* RGBA，16 字节：BC4 编码的 alpha + BC1 编码的颜色 */
+void bc3_encode(const uint8_t rgba[64], uint8_t out[16]);
+
+/* 单通道，8 字节 */
+void bc4_encode(const uint8_t rgba[64], int channel, uint8_t out[8]);
+
+/* R 和 G 两个通道，16 字节，适合法线贴图 */
+void bc5_encode(const uint8_t rgba[64], uint8_t out[16]);
+
+/* RGBA，16 字节 */
+void bc7_encode(const uint8_t rgba[64], uint8_t out[16]);
+
+/* RGB 浮点数，16 字节；负数会被截断为 0 */
+void bc6h_encode(const float rgb[48], uint8_t out[16]);
+
+
+#endif //RENDER_TEXTURE_COOK_BC_ENCODER_H
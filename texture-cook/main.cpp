@@ -0,0 +1,274 @@
+/**
+ * texture-cook：离线将纹理编码为块压缩的 DDS 文件，包含所有级别的 mip，和源文件放在同一目录
+ * 运行时 Texture2D，TextureCube，TextureHDR 会优先使用这些文件，不再解码 PNG/JPG/HDR
+ *
+ * 用法：texture-cook [--format bc1|bc3|bc4|bc5|bc7] [--filter box|kaiser] [--threads n] [--force] [path ...]
+ *  path        文件或目录（递归），默认是 assets/texture 和 assets/model
+ *  --format    LDR 纹理使用的格式，默认单通道使用 BC4，其余使用 BC7；HDR 纹理总是使用 BC6H
+ *  --filter    生成 mip 的滤波器，见 texture_mip.h
+ *  --threads   编码使用的线程数，默认是硬件线程数
+ *  --force     即使 DDS 文件比源文件新，也重新编码
+ */
+#include <cmath>
+#include <cctype>
+#include <chrono>
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <filesystem>
+#include <algorithm>
+
+#include <fmt/format.h>
+#include <spdlog/spdlog.h>
+
+#include "engine/gl_ext.h"
+#include "engine/image_decoder.h"
+#include "engine/texture_mip.h"
+#include "engine/texture_file.h"
+#include "engine/utils/parallel.h"
+
+#include "config.hpp"
+
+#include "bc_encoder.h"
+
+
+namespace fs = std::filesystem;
+
+
+struct Options {
+    GLenum ldr_format{0};           // 0 表示根据通道数选择
+    MipFilter filter{MipFilter::Box};
+    unsigned threads{0};
+    bool force{false};
+    std::vector<std::string> paths;
+};
+
+
+/* 可以编码的源文件 */
+static bool is_source(const fs::path &path) {
+    std::string ext = path.extension().string();
+    std::transform(ext.begin(), ext.end(), ext.begin(), [](unsigned char c) { return (char) std::tolower(c); });
+    return ext == ".png" || ext == ".jpg" || ext == ".jpeg" || ext == ".tga" || ext == ".bmp" || ext == ".hdr";
+}
+
+static bool is_hdr(const std::string &path) {
+    std::string ext = fs::path(path).extension().string();
+    std::transform(ext.begin(), ext.end(), ext.begin(), [](unsigned char c) { return (char) std::tolower(c); });
+    return ext == ".hdr";
+}
+
+
+// =====================================================
+// 编码
+// =====================================================
+
+/**
+ * 编码一级 mip，每一行块是一个任务，分给多个线程
+ * @tparam T 像素分量的类型：LDR 是 RGBA 的 uint8_t，HDR 是 RGB 的 float
+ * @param encode void(const T *block_pixels, uint8_t *out)
+ */
+template<class T, class Encode>
+static std::vector<unsigned char> level_encode(const std::vector<T> &pixels, int width, int height, int channels,
+                                               GLenum format, unsigned threads, Encode &&encode) {
+    const int blocks_x = (width + 3) / 4, blocks_y = (height + 3) / 4;
+    const size_t block_bytes = TextureFile::block_bytes(format);
+    std::vector<unsigned char> out((size_t) blocks_x * blocks_y * block_bytes);
+
+    parallel_for(0, (size_t) blocks_y, [&](size_t by) {
+        T block[16 * 4];
+        for (int bx = 0; bx < blocks_x; ++bx) {
+            /* 不足 4x4 的块，重复使用边缘的像素 */
+            for (int i = 0; i < 16; ++i) {
+                int x = std::min(bx * 4 + i % 4, width - 1);
+                int y = std::min((int) by * 4 + i / 4, height - 1);
+                for (int c = 0; c < channels; ++c)
+                    block[i * channels + c] = pixels[((size_t) y * width + x) * channels + c];
+            }
+            encode(block, out.data() + (by * blocks_x + bx) * block_bytes);
+        }
+    }, threads);
+    return out;
+}
+
+/* 编码 LDR 纹理：所有的 mip */
+static CompressedImage ldr_cook(const std::string &path, const Options &options) {
+    const int nr_channels = ImageDecoders::info(path).channels;
+    Image source = ImageDecoders::load(path, {4});
+    const int width = source.width, height = source.height;
+    const std::vector<uint8_t> &pixels = source.data;
+
+    CompressedImage image;
+    image.internal_format = options.ldr_format ? options.ldr_format
+                                               : nr_channels == 1 ? GL_COMPRESSED_RED_RGTC1
+                                                                  : GL_COMPRESSED_RGBA_BPTC_UNORM;
+    image.width = width;
+    image.height = height;
+
+    auto encode = [format = image.internal_format](const uint8_t *block, uint8_t *out) {
+        switch (format) {
+            case GL_COMPRESSED_RGB_S3TC_DXT1_EXT:
+                bc1_encode(block, out);
+                break;
+            case GL_COMPRESSED_RGBA_S3TC_DXT5_EXT:
+                bc3_encode(block, out);
+                break;
+            case GL_COMPRESSED_RED_RGTC1:
+                bc4_encode(block, 0, out);
+                break;
+            case GL_COMPRESSED_RG_RGTC2:
+                bc5_encode(block, out);
+                break;
+            default:
+                bc7_encode(block, out);
+                break;
+        }
+    };
+
+    /* 单通道的纹理，以及 BC4/BC5 存放的数据（比如法线）不是颜色，在线性空间中滤波 */
+    MipOptions mip_options;
+    mip_options.filter = options.filter;
+    mip_options.srgb = nr_channels >= 3 && image.internal_format != GL_COMPRESSED_RED_RGTC1 &&
+                       image.internal_format != GL_COMPRESSED_RG_RGTC2;
+    mip_options.threads = options.threads;
+    auto chain = mip_chain_generate(pixels.data(), width, height, 4, mip_options);
+
+    for (size_t level = 0; level < chain.levels.size(); ++level)
+        image.data.push_back(level_encode(chain.levels[level], chain.level_width(level), chain.level_height(level), 4,
+                                          image.internal_format, options.threads, encode));
+    image.levels = (GLsizei) image.data.size();
+    return image;
+}
+
+/* 编码 HDR 纹理：和 TextureHDR 一致，进行了垂直翻转 */
+static CompressedImage hdr_cook(const std::string &path, const Options &options) {
+    Image source = ImageDecoders::load(path, {3, true, true});
+    const int width = source.width, height = source.height;
+    std::vector<float> pixels(source.pixels_f(), source.pixels_f() + (size_t) width * height * 3);
+
+    CompressedImage image;
+    image.internal_format = GL_COMPRESSED_RGB_BPTC_UNSIGNED_FLOAT;
+    image.width = width;
+    image.height = height;
+
+    MipOptions mip_options;
+    mip_options.filter = options.filter;
+    mip_options.threads = options.threads;
+    auto chain = mip_chain_generate(pixels.data(), width, height, 3, mip_options);
+
+    for (size_t level = 0; level < chain.levels.size(); ++level)
+        image.data.push_back(level_encode(chain.levels[level], chain.level_width(level), chain.level_height(level), 3,
+                                          image.internal_format, options.threads, bc6h_encode));
+    image.levels = (GLsizei) image.data.size();
+    return image;
+}
+
+
+// =====================================================
+// 命令行
+// =====================================================
+
+static Options options_parse(int argc, char **argv) {
+    Options options;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--force") {
+            options.force = true;
+        } else if (arg == "--filter" && i + 1 < argc) {
+            std::string filter = argv[++i];
+            if (filter == "box")
+                options.filter = MipFilter::Box;
+            else if (filter == "kaiser")
+                options.filter = MipFilter::Kaiser;
+            else
+                throw std::runtime_error(fmt::format("unknown filter: {}", filter));
+        } else if (arg == "--threads" && i + 1 < argc) {
+            options.threads = (unsigned) std::stoul(argv[++i]);
+        } else if (arg == "--format" && i + 1 < argc) {
+            std::string format = argv[++i];
+            if (format == "bc1")
+                options.ldr_format = GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+            else if (format == "bc3")
+                options.ldr_format = GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+            else if (format == "bc4")
+                options.ldr_format = GL_COMPRESSED_RED_RGTC1;
+            else if (format == "bc5")
+                options.ldr_format = GL_COMPRESSED_RG_RGTC2;
+            else if (format == "bc7")
+                options.ldr_format = GL_COMPRESSED_RGBA_BPTC_UNORM;
+            else
+                throw std::runtime_error(fmt::format("unknown format: {}", format));
+        } else if (arg.rfind("--", 0) == 0) {
+            throw std::runtime_error(fmt::format("unknown option: {}", arg));
+        } else {
+            options.paths.push_back(arg);
+        }
+    }
+    if (options.paths.empty())
+        options.paths = {TEXTURE_DIR, MODEL_DIR};
+    if (options.threads == 0)
+        options.threads = parallel_threads();
+    return options;
+}
+
+/* 需要编码的源文件：目录会递归查找 */
+static std::vector<std::string> sources_collect(const std::vector<std::string> &paths) {
+    std::vector<std::string> sources;
+    for (const auto &path : paths) {
+        if (fs::is_directory(path)) {
+            for (const auto &entry : fs::recursive_directory_iterator(path))
+                if (entry.is_regular_file() && is_source(entry.path()))
+                    sources.push_back(entry.path().string());
+        } else if (fs::is_regular_file(path)) {
+            sources.push_back(path);
+        } else {
+            SPDLOG_WARN("path not found: {}", path);
+        }
+    }
+    std::sort(sources.begin(), sources.end());
+    return sources;
+}
+
+
+int main(int argc, char **argv) {
+    Options options;
+    try {
+        options = options_parse(argc, argv);
+    } catch (const std::exception &e) {
+        SPDLOG_ERROR("{}", e.what());
+        return 2;
+    }
+
+    size_t cooked = 0, skipped = 0, failed = 0;
+    size_t source_bytes = 0, cooked_bytes = 0;
+    auto total_start = std::chrono::steady_clock::now();
+
+    for (const auto &source : sources_collect(options.paths)) {
+        std::string target = TextureFile::cooked_path(source);
+        if (!options.force && fs::exists(target) && fs::last_write_time(target) >= fs::last_write_time(source)) {
+            ++skipped;
+            continue;
+        }
+
+        try {
+            auto start = std::chrono::steady_clock::now();
+            CompressedImage image = is_hdr(source) ? hdr_cook(source, options) : ldr_cook(source, options);
+            TextureFile::dds_save(target, image);
+            double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+            source_bytes += fs::file_size(source);
+            cooked_bytes += fs::file_size(target);
+            ++cooked;
+            SPDLOG_INFO("{} -> {}: {}x{}, {} mips, {:#x}, {:.1f} ms", source, fs::path(target).filename().string(),
+                        image.width, image.height, image.levels, image.internal_format, ms);
+        } catch (const std::exception &e) {
+            ++failed;
+            SPDLOG_ERROR("fail to cook {}: {}", source, e.what());
+        }
+    }
+
+    double total_s = std::chrono::duration<double>(std::chrono::steady_clock::now() - total_start).count();
+    SPDLOG_INFO("cooked: {}, up to date: {}, failed: {}, threads: {}, {:.2f} s; source {:.1f} MB -> dds {:.1f} MB",
+                cooked, skipped, failed, options.threads, total_s, (double) source_bytes / 1048576.0,
+                (double) cooked_bytes / 1048576.0);
+    return failed == 0 ? 0 : 1;
+}